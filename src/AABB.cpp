@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <iostream>
 #include "AABB.h"
+#include "Kernels.h"
 #include "Utils.h"
 
 /******************************************************************************/
@@ -19,6 +20,7 @@
 AABB::AABB() :
 	v1(glm::vec3()),
     v2(glm::vec3()),
+    bounds{glm::vec3(), glm::vec3()},
 	C(glm::vec3()),
     _width(this->computeWidth()),
     _height(this->computeHeight()),
@@ -31,6 +33,7 @@ AABB::AABB() :
 AABB::AABB(const glm::vec3& _v1, const glm::vec3& _v2) :
     v1(_v1),
     v2(_v2),
+    bounds{glm::min(_v1, _v2), glm::max(_v1, _v2)},
     _width(this->computeWidth()),
     _height(this->computeHeight()),
     _depth(this->computeDepth()),
@@ -40,50 +43,12 @@ AABB::AABB(const glm::vec3& _v1, const glm::vec3& _v2) :
 }
 
 /**
- * Tests if the given ray intersects the AABB
+ * Tests if the given ray intersects the AABB within [ray.tMin, ray.tMax]. 
+ * Runs the kernel for the instruction set selected in Kernels
  */
 bool AABB::intersected(const Ray& ray) const
 {
-	float xd  = ray.dir.x;
-    float yd  = ray.dir.y;
-    float zd  = ray.dir.z;
-	float eps = Utils::EPSILON;
-
-    if (xd == 0.0f) {
-        xd = eps;
-    }
-    if (yd == 0.0f) {
-        yd = eps;
-    }
-    if (zd == 0.0f) {
-        zd = eps;
-    }
-
-    float x1 = (this->v1.x - ray.orig.x) / xd;
-    float x2 = (this->v2.x - ray.orig.x) / xd;
-    float y1 = (this->v1.y - ray.orig.y) / yd;
-    float y2 = (this->v2.y - ray.orig.y) / yd;
-    float z1 = (this->v1.z - ray.orig.z) / zd;
-    float z2 = (this->v2.z - ray.orig.z) / zd;
-
-    if (x1 > x2) {
-		std::swap(x1, x2);
-    }
-    if (y1 > y2) {
-		std::swap(y1, y2);
-    }
-    if (z1 > z2) {
-		std::swap(z1, z2);   
-    }
-
-    float tNear = std::max(x1, std::max(y1, z1));
-    float tFar  = std::min(x2, std::min(y2, z2));
-
-    if (tNear > tFar || tFar < 0.0f) {
-        return false;
-    }
-
-	return true;
+    return Kernels::active().intersectBox(this->bounds, ray);
 }
 
 /**
@@ -120,9 +85,11 @@ float AABB::computeArea() const
 
 AABB& AABB::operator+=(const AABB &other)
 {
-    AABB t   = *this + other;
-    this->v1 = t.v1;
-    this->v2 = t.v2;
+    AABB t          = *this + other;
+    this->v1        = t.v1;
+    this->v2        = t.v2;
+    this->bounds[0] = t.bounds[0];
+    this->bounds[1] = t.bounds[1];
     return *this;
 }
 
@@ -33,8 +33,9 @@ class AABB
 		float computeArea() const;
 
 	protected:
-		glm::vec3 v1, v2; // Vertices defining the AABB
-		glm::vec3 C;      // The centroid of the AABB
+		glm::vec3 v1, v2;     // Vertices defining the AABB
+		glm::vec3 bounds[2];  // { min, max } corners, indexed by Ray::sign
+		glm::vec3 C;          // The centroid of the AABB
 		float _width, _height, _depth, _area;
 
 	public:
@@ -56,9 +57,47 @@ class AABB
 		// Computes the area of the AABB
 		float area() const { return this->_area; }
 
-		// Tests if the given ray intersects the AABB
+		// Returns the minimum corner of the AABB
+		const glm::vec3& minimum() const { return this->bounds[0]; }
+
+		// Returns the maximum corner of the AABB
+		const glm::vec3& maximum() const { return this->bounds[1]; }
+
+		// Tests if the given ray intersects the AABB within [ray.tMin, ray.tMax]
 		bool intersected(const Ray& ray) const;
 
+		// Branch-free slab test: per axis, tNear and tFar receive the ray 
+		// distances to the near and far planes of the slab. An axis the ray 
+		// is parallel to gives +/-infinity, or NaN if the origin lies exactly
+		// on one of its planes
+		void slabs(const Ray& ray, glm::vec3& tNear, glm::vec3& tFar) const
+		{
+			tNear.x = (this->bounds[ray.sign[0]].x - ray.orig.x) * ray.invDir.x;
+			tNear.y = (this->bounds[ray.sign[1]].y - ray.orig.y) * ray.invDir.y;
+			tNear.z = (this->bounds[ray.sign[2]].z - ray.orig.z) * ray.invDir.z;
+			tFar.x  = (this->bounds[1 - ray.sign[0]].x - ray.orig.x) * ray.invDir.x;
+			tFar.y  = (this->bounds[1 - ray.sign[1]].y - ray.orig.y) * ray.invDir.y;
+			tFar.z  = (this->bounds[1 - ray.sign[2]].z - ray.orig.z) * ray.invDir.z;
+		}
+
+		// Returns the largest of t and the components of v, ignoring NaN
+		// components; reduces the tNear values from slabs()
+		static float maxNear(float t, const glm::vec3& v)
+		{
+			t = v.x > t ? v.x : t;
+			t = v.y > t ? v.y : t;
+			return v.z > t ? v.z : t;
+		}
+
+		// Returns the smallest of t and the components of v, ignoring NaN
+		// components; reduces the tFar values from slabs()
+		static float minFar(float t, const glm::vec3& v)
+		{
+			t = v.x < t ? v.x : t;
+			t = v.y < t ? v.y : t;
+			return v.z < t ? v.z : t;
+		}
+
         friend std::ostream& operator<<(std::ostream& s, const AABB& aabb);		
 
         AABB& operator+=(const AABB &other);
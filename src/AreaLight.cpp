@@ -8,6 +8,7 @@
  ******************************************************************************/
 
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <memory>
 #include "AreaLight.h"
@@ -28,6 +29,8 @@ AreaLight::AreaLight(shared_ptr<GraphNode> _node, mat4 _T) :
 
 	assert(!!geometry);
 
+	geometry->prepareSampling();
+
 	this->centroidWorld = vec3(Utils::transform(this->T, vec4(geometry->getCentroid(), 1.0f)));
 }
 
@@ -64,17 +67,37 @@ vec3 AreaLight::fromSampledPoint(const vec3& from) const
 	return geometry->sample(this->T) - from;
 }
 
-vec3 AreaLight::fromSampledPoint(const vec3& from, float& cosineAngle) const
+/**
+ * A sample of density pdf per unit area stands for 1 / pdf of the light's
+ * area, which subtends a solid angle of cos / d^2 per unit area, seen from
+ * a distance d at an angle whose cosine is cos.
+ *
+ * A closed shape is only seen on the side turned toward the point, so
+ * samples on its far side are drawn again, a few times at most: that only
+ * scales the density by the same amount for every sample taken from the
+ * point, which the weighted average in shadow() divides out again. The
+ * triangles of a mesh have no inside, so they light both ways
+ */
+vec3 AreaLight::fromSampledPoint(const vec3& from, float& weight) const
 {
 	shared_ptr<Geometry> geometry  = this->node->getGeometry();
 
 	assert(!!geometry);
 
-	vec3 samplePoint = geometry->sample(this->T);
-	vec3 centroid    = geometry->getCentroid();
-	vec3 L           = samplePoint - from;
-	vec3 D           = samplePoint - centroid;
-	cosineAngle      = dot(normalize(L), normalize(D));
+	bool twoSided = geometry->getGeometryType() == Geometry::MESH;
+	vec3 N, L;
+	float pdf     = 0.0f;
+	float cosine  = 0.0f;
+
+	for (int i=0; i<MAX_SAMPLE_TRIES && cosine <= 0.0f; i++) {
+
+		L      = geometry->sample(this->T, N, pdf) - from;
+		cosine = twoSided ? fabs(dot(N, L)) : -dot(N, L);
+	}
+
+	float d2 = dot(L, L);
+
+	weight = (cosine > 0.0f && pdf > 0.0f && d2 > 0.0f) ? cosine / (std::sqrt(d2) * d2 * pdf) : 0.0f;
 
 	return L;
 }
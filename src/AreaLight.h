@@ -21,6 +21,11 @@
 
 class AreaLight : public Light
 {
+	public:
+		// Most points drawn on the light by fromSampledPoint() in search of
+		// one facing the point it is seen from
+		static const int MAX_SAMPLE_TRIES = 8;
+
 	protected:
 		// The centroid of the light in world space
 		glm::vec3 centroidWorld;
@@ -44,7 +49,7 @@ class AreaLight : public Light
 		virtual glm::vec3 fromCenter(const glm::vec3& from) const;
 
 		virtual glm::vec3 fromSampledPoint(const glm::vec3& from) const;
-		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& cosineAngle) const;
+		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& weight) const;
 
 		virtual Color getColor(const glm::vec3& from) const;
 
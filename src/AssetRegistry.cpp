@@ -0,0 +1,322 @@
+/*******************************************************************************
+ *
+ * A registry of the texture, bump and normal maps and meshes loaded while a
+ * scene is read, keyed by content
+ *
+ * @file AssetRegistry.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <easylogging++.h>
+#include "AssetRegistry.h"
+#include "ModelImport.h"
+#include "Mesh.h"
+#include "TaskPool.h"
+#include "Utils.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+static const char* KIND_NAMES[] = { "texture", "bump", "normal", "mesh" };
+
+/******************************************************************************/
+
+AssetRegistry::AssetRegistry() :
+    loads(0),
+    reuses(0)
+{
+
+}
+
+AssetRegistry::~AssetRegistry()
+{
+    this->wait();
+}
+
+const char* AssetRegistry::kindName(Kind kind)
+{
+    return KIND_NAMES[kind];
+}
+
+uint64_t AssetRegistry::digest(const string& filename)
+{
+    ifstream is(filename.c_str(), ifstream::in | ifstream::binary);
+
+    if (!is.good()) {
+        throw runtime_error("AssetRegistry: Could not read " + filename);
+    }
+
+    // 64-bit FNV-1a:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    vector<char> buffer(1 << 16);
+
+    while (is) {
+
+        is.read(buffer.data(), buffer.size());
+        streamsize n = is.gcount();
+
+        for (streamsize i=0; i<n; i++) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * Returns the asset of the given kind loaded from filename, or from another
+ * file with the same contents, calling load() only if there is none yet. If
+ * async is set, the file is read and loaded on the TaskPool; otherwise it
+ * is done before returning
+ */
+AssetRegistry::PendingAsset AssetRegistry::find(Kind kind
+                                               ,const string& filename
+                                               ,function<Asset(const string&)> load
+                                               ,bool async
+                                               ,const string& options)
+{
+    // Let the loader report files that can't be read, as it always has:
+    if (!ifstream(filename.c_str()).good()) {
+        promise<Asset> loaded;
+        loaded.set_value(load(filename));
+        return loaded.get_future().share();
+    }
+
+    string kindKey = string(KIND_NAMES[kind]) + options;
+    string pathKey = kindKey + ":" + Utils::realPath(filename);
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        auto p = this->byPath.find(pathKey);
+
+        if (p != this->byPath.end()) {
+            this->reuses++;
+            return p->second;
+        }
+    }
+
+    PendingAsset pending;
+
+    if (async) {
+        pending = TaskPool::shared().submit([this, kind, kindKey, filename, load]() {
+            return this->loadContent(kind, kindKey, filename, load);
+        }).share();
+    } else {
+        promise<Asset> loaded;
+        loaded.set_value(this->loadContent(kind, kindKey, filename, load));
+        pending = loaded.get_future().share();
+    }
+
+    lock_guard<mutex> guard(this->lock);
+    this->byPath[pathKey] = pending;
+
+    return pending;
+}
+
+/**
+ * Loads a file not seen under its path yet, unless the same contents were
+ * already loaded from another
+ */
+AssetRegistry::Asset AssetRegistry::loadContent(Kind kind
+                                               ,const string& kindKey
+                                               ,const string& filename
+                                               ,function<Asset(const string&)> load)
+{
+    auto start = chrono::steady_clock::now();
+
+    ostringstream contentKey;
+    contentKey << kindKey << ":" << hex << digest(filename);
+
+    promise<Asset> loaded;
+    PendingAsset existing;
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        auto c = this->byContent.find(contentKey.str());
+
+        if (c != this->byContent.end()) {
+            this->reuses++;
+            existing = c->second;
+        } else {
+            this->byContent[contentKey.str()] = loaded.get_future().share();
+        }
+    }
+
+    // The same contents under a different name. Whoever claimed them is 
+    // already loading them, so this never waits on a task still queued:
+    if (existing.valid()) {
+        return existing.get();
+    }
+
+    try {
+
+        Asset asset    = load(filename);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        loaded.set_value(asset);
+
+        lock_guard<mutex> guard(this->lock);
+        this->loads++;
+        this->times.push_back(LoadTime { kind, filename, seconds });
+
+        return asset;
+
+    } catch (...) {
+
+        loaded.set_exception(current_exception());
+        throw;
+    }
+}
+
+void AssetRegistry::wait() const
+{
+    vector<PendingAsset> pending;
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        for (auto p=this->byPath.begin(); p != this->byPath.end(); p++) {
+            pending.push_back(p->second);
+        }
+    }
+
+    for (auto p=pending.begin(); p != pending.end(); p++) {
+        p->wait();
+    }
+}
+
+size_t AssetRegistry::getLoadCount() const
+{
+    lock_guard<mutex> guard(this->lock);
+    return this->loads;
+}
+
+size_t AssetRegistry::getReuseCount() const
+{
+    lock_guard<mutex> guard(this->lock);
+    return this->reuses;
+}
+
+vector<AssetRegistry::LoadTime> AssetRegistry::getLoadTimes() const
+{
+    lock_guard<mutex> guard(this->lock);
+    return this->times;
+}
+
+vector<pair<string, shared_ptr<Geometry>>> AssetRegistry::getMeshes() const
+{
+    vector<pair<string, PendingAsset>> pending;
+    string prefix = string(KIND_NAMES[MESH]) + ":";
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        for (auto p=this->byPath.begin(); p != this->byPath.end(); p++) {
+            if (p->first.compare(0, prefix.size(), prefix) == 0) {
+                pending.push_back(make_pair(p->first.substr(prefix.size()), p->second));
+            }
+        }
+    }
+
+    vector<pair<string, shared_ptr<Geometry>>> meshes;
+
+    for (auto p=pending.begin(); p != pending.end(); p++) {
+
+        if (p->second.wait_for(chrono::seconds(0)) != future_status::ready) {
+            continue;
+        }
+
+        shared_ptr<Geometry> mesh;
+
+        try {
+            mesh = static_pointer_cast<Geometry>(p->second.get());
+        } catch (std::exception&) {
+            continue;
+        }
+
+        // Paths with the same content share one mesh:
+        bool seen = mesh == nullptr;
+
+        for (auto m=meshes.begin(); m != meshes.end() && !seen; m++) {
+            seen = m->second == mesh;
+        }
+
+        if (!seen) {
+            meshes.push_back(make_pair(p->first, mesh));
+        }
+    }
+
+    return meshes;
+}
+
+shared_ptr<TextureMap> AssetRegistry::getTextureMap(const string& filename)
+{
+    // Maps only decode their bitmaps when first used, so creating one is
+    // cheap enough to do as the scene is read:
+    return static_pointer_cast<TextureMap>(this->find(TEXTURE_MAP, filename, [](const string& file) {
+        return Asset(make_shared<TextureMap>(file));
+    }, false).get());
+}
+
+shared_ptr<BumpMap> AssetRegistry::getBumpMap(const string& filename)
+{
+    return static_pointer_cast<BumpMap>(this->find(BUMP_MAP, filename, [](const string& file) {
+        return Asset(make_shared<BumpMap>(file));
+    }, false).get());
+}
+
+shared_ptr<NormalMap> AssetRegistry::getNormalMap(const string& filename, NormalMap::Source source, float heightScale)
+{
+    // Height maps converted with different scales are different normals:
+    ostringstream options;
+
+    if (source == NormalMap::HEIGHT) {
+        options << "/height=" << heightScale;
+    }
+
+    return static_pointer_cast<NormalMap>(this->find(NORMAL_MAP, filename, [source, heightScale](const string& file) {
+        return Asset(make_shared<NormalMap>(file, source, heightScale));
+    }, false, options.str()).get());
+}
+
+AssetRegistry::Pending<Geometry> AssetRegistry::loadMesh(const string& filename)
+{
+    return Pending<Geometry>(this->find(MESH, filename, [](const string& file) {
+
+        LOG(INFO) << "load model from file: " << file << endl;
+
+        auto meshData = Model::loadMeshes(file);
+
+        std::vector<std::shared_ptr<Mesh>> meshes;
+
+        for (auto i = meshData.begin(); i != meshData.end(); i++) {
+            meshes.push_back(make_shared<Mesh>(move(*i)));
+        }
+
+        if (meshes.size() == 0) {
+            return Asset(shared_ptr<Geometry>(nullptr));
+        }
+
+        return Asset(shared_ptr<Geometry>(make_shared<MultiMesh>(meshes)));
+    }, true));
+}
+
+shared_ptr<Geometry> AssetRegistry::getMesh(const string& filename)
+{
+    return this->loadMesh(filename).get();
+}
+
+/******************************************************************************/
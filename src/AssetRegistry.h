@@ -0,0 +1,150 @@
+/*******************************************************************************
+ *
+ * A registry of the texture, bump and normal maps and meshes loaded while a
+ * scene is read. Assets are keyed by their content, so every file is
+ * decoded, imported and indexed once, however many materials or nodes
+ * reference it and under whichever path. Meshes are imported and indexed on
+ * the TaskPool while the rest of the scene is read
+ *
+ * @file AssetRegistry.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Geometry.h"
+#include "NormalMap.h"
+#include "SurfaceMap.h"
+
+/******************************************************************************/
+
+class AssetRegistry
+{
+	public:
+		// Kinds of asset; the same file loaded as two different kinds is
+		// two different assets
+		enum Kind
+		{
+			 TEXTURE_MAP
+			,BUMP_MAP
+			,NORMAL_MAP
+			,MESH
+		};
+
+		// Time spent loading one asset, on whichever thread loaded it
+		struct LoadTime
+		{
+			Kind kind;
+			std::string filename;
+			double seconds;
+		};
+
+	protected:
+		typedef std::shared_ptr<void> Asset;
+		typedef std::shared_future<Asset> PendingAsset;
+
+	public:
+		// An asset that may still be loading
+		template <typename T>
+		class Pending
+		{
+			protected:
+				PendingAsset future;
+
+			public:
+				Pending(const PendingAsset& _future) :
+					future(_future)
+				{ 
+
+				}
+
+				// Waits for the asset, rethrowing anything its load threw
+				std::shared_ptr<T> get() const
+				{
+					return std::static_pointer_cast<T>(this->future.get());
+				}
+		};
+
+	protected:
+		// Guards everything below, as loads finish on the pool's threads
+		mutable std::mutex lock;
+
+		// Assets by "<kind>:<canonical path>", and by "<kind>:<content digest>".
+		// Assets of one kind loaded with different options add the options
+		// to the kind
+		std::map<std::string, PendingAsset> byPath;
+		std::map<std::string, PendingAsset> byContent;
+
+		// Number of assets loaded, and of requests answered with one
+		// already loaded
+		size_t loads;
+		size_t reuses;
+
+		std::vector<LoadTime> times;
+
+		PendingAsset find(Kind kind
+		                 ,const std::string& filename
+		                 ,std::function<Asset(const std::string&)> load
+		                 ,bool async
+		                 ,const std::string& options = "");
+
+		Asset loadContent(Kind kind
+		                 ,const std::string& kindKey
+		                 ,const std::string& filename
+		                 ,std::function<Asset(const std::string&)> load);
+
+	public:
+		AssetRegistry();
+
+		// Waits for the loads still running, which refer to the registry
+		virtual ~AssetRegistry();
+
+		// 64-bit FNV-1a digest of a file's contents
+		static uint64_t digest(const std::string& filename);
+
+		std::shared_ptr<TextureMap> getTextureMap(const std::string& filename);
+		std::shared_ptr<BumpMap> getBumpMap(const std::string& filename);
+		std::shared_ptr<NormalMap> getNormalMap(const std::string& filename
+		                                       ,NormalMap::Source source = NormalMap::RGB
+		                                       ,float heightScale = NormalMap::DEFAULT_HEIGHT_SCALE);
+
+		// Imports every mesh in a model file as a single geometry with its
+		// KD-trees built. Geometry holds no per-node state, so any number
+		// of nodes can share it. loadMesh() returns at once, leaving the 
+		// work to the TaskPool; getMesh() waits for it
+		Pending<Geometry> loadMesh(const std::string& filename);
+		std::shared_ptr<Geometry> getMesh(const std::string& filename);
+
+		// Waits for every load started so far. Errors are left for the
+		// callers of Pending::get()
+		void wait() const;
+
+		size_t getLoadCount() const;
+		size_t getReuseCount() const;
+
+		// Load times of every asset loaded, in the order they finished
+		std::vector<LoadTime> getLoadTimes() const;
+
+		// Every mesh loaded successfully so far, once each, under one of
+		// the paths it was requested by
+		std::vector<std::pair<std::string, std::shared_ptr<Geometry>>> getMeshes() const;
+
+		// Returns the name of a kind of asset: "texture", "bump", "normal"
+		// or "mesh"
+		static const char* kindName(Kind kind);
+};
+
+/******************************************************************************/
+
+#endif
@@ -52,7 +52,18 @@ bool BoundingSphere::intersects(const Ray& ray) const
 	float b = 2.0f * dot(ray.dir, ray.orig - this->center);
 	float c = dot(oc, oc) - (this->radius * this->radius);
 
-	return ((b * b) - (4.0f * a * c)) >= 0.0f;
+	float D = (b * b) - (4.0f * a * c);
+
+	if (D < 0.0f) {
+		return false;
+	}
+
+	// The ray crosses the sphere over [t0, t1]:
+	float sqrtD = std::sqrt(D);
+	float t0    = (-b - sqrtD) / (2.0f * a);
+	float t1    = (-b + sqrtD) / (2.0f * a);
+
+	return t1 >= ray.tMin && t0 <= ray.tMax;
 }
 
 /******************************************************************************/
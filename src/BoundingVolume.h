@@ -10,6 +10,7 @@
 #ifndef BOUNDING_VOLUME_H
 #define BOUNDING_VOLUME_H
 
+#include "AABB.h"
 #include "Ray.h"
 
 /*******************************************************************************
@@ -22,7 +23,8 @@ class BoundingVolume
 
 		BoundingVolume() { }
 
-		// Intersects the bounding volume
+		// Intersects the bounding volume. A volume that the ray only crosses
+		// outside of [ray.tMin, ray.tMax] is not intersected
 		virtual bool intersects(const Ray& ray) const = 0;
 };
 
@@ -59,6 +61,22 @@ class BoundingSphere : public BoundingVolume
 		virtual bool intersects(const Ray& ray) const;
 };
 
+/*******************************************************************************
+ * Axis-aligned bounding box volume
+ ******************************************************************************/
+
+class BoundingBox : public BoundingVolume
+{
+	protected:
+		AABB aabb;
+
+	public:
+		BoundingBox() : BoundingVolume() { }
+		BoundingBox(const AABB& _aabb) : BoundingVolume(), aabb(_aabb) { }
+
+		virtual bool intersects(const Ray& ray) const { return this->aabb.intersected(ray); }
+};
+
 /******************************************************************************/
 
 #endif
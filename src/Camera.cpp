@@ -160,6 +160,22 @@ Ray Camera::spawnRay(float x, float y, float resoX, float resoY) const
     return Ray(this->position, screen2World(x, y, resoX, resoY) - this->position);
 }
 
+/**
+ * Spawns a ray through the NDC point (x,y), along with the ray differentials
+ * for the neighbouring points (x + dx, y) and (x, y + dy). dx and dy are 
+ * normally the spacing between samples, so the differentials describe the
+ * footprint of a single sample
+ */
+Ray Camera::spawnRayDifferential(float x, float y, float dx, float dy) const
+{
+    Ray ray = this->spawnRay(x, y);
+
+    ray.setDifferentials(this->position, ndc2World(x + dx, y) - this->position
+                        ,this->position, ndc2World(x, y + dy) - this->position);
+
+    return ray;
+}
+
 /**
  * Computes the width and height dimensions of the given pixel, setting 
  * width and height with the computed values
@@ -63,6 +63,10 @@ class Camera
         Ray spawnRay(float x, float y) const;
         Ray spawnRay(float x, float y, float resoX, float resoY) const;
 
+        // Spawns a ray as spawnRay(x,y) does, with differentials for the rays
+        // through (x + dx, y) and (x, y + dy)
+        Ray spawnRayDifferential(float x, float y, float dx, float dy) const;
+
         friend std::ostream& operator<<(std::ostream& s, const Camera& c);
 };
 
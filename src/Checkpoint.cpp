@@ -0,0 +1,237 @@
+/*******************************************************************************
+ *
+ * This file defines the render state that is periodically written to disk
+ * so that long running renders can be resumed after being interrupted
+ *
+ * @file Checkpoint.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include "Checkpoint.h"
+#include "Utils.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+// File identification + layout version. The layout is written in the host's
+// native byte order, so checkpoints are not portable across architectures:
+static const char     MAGIC[4] = { 'R', 'C', 'P', 'K' };
+static const uint32_t VERSION  = 1;
+
+static volatile sig_atomic_t stopFlag = 0;
+
+/*******************************************************************************
+ * RenderState
+ ******************************************************************************/
+
+RenderState::RenderState() :
+    sceneHash(0),
+    seed(0),
+    width(0),
+    height(0),
+    pass(1),
+    avgIntensity(0.0f)
+{
+
+}
+
+void RenderState::reset(uint64_t _sceneHash, uint64_t _seed, int _width, int _height)
+{
+    this->sceneHash    = _sceneHash;
+    this->seed         = _seed;
+    this->width        = _width;
+    this->height       = _height;
+    this->avgIntensity = 0.0f;
+
+    this->color.assign(3 * _width * _height, 0.0f);
+    this->samples.assign(_width * _height, 0);
+    this->edgeMap.clear();
+
+    this->beginPass(1);
+}
+
+void RenderState::beginPass(int _pass)
+{
+    this->pass = _pass;
+    this->tileDone.assign(this->tileCount(), 0);
+}
+
+int RenderState::tilesCompleted() const
+{
+    int n = 0;
+    for (auto t=this->tileDone.begin(); t != this->tileDone.end(); t++) {
+        n += (*t ? 1 : 0);
+    }
+    return n;
+}
+
+/*******************************************************************************
+ * Binary I/O helpers
+ ******************************************************************************/
+
+template<typename T> static void writeValue(ofstream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T> static void writeArray(ofstream& out, const vector<T>& values)
+{
+    writeValue(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template<typename T> static void readValue(ifstream& in, T& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template<typename T> static void readArray(ifstream& in, vector<T>& values, uint64_t expected)
+{
+    uint64_t n = 0;
+    readValue(in, n);
+
+    if (!in || n != expected) {
+        throw runtime_error("Checkpoint: array size mismatch");
+    }
+
+    values.resize(n);
+    in.read(reinterpret_cast<char*>(values.data()), n * sizeof(T));
+}
+
+/*******************************************************************************
+ * Checkpoint
+ ******************************************************************************/
+
+uint64_t Checkpoint::hashScene(const string& sceneFile, const vector<int64_t>& params)
+{
+    // 64-bit FNV-1a:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    auto mix = [&hash](const char* bytes, size_t n) {
+        for (size_t i=0; i<n; i++) {
+            hash ^= static_cast<unsigned char>(bytes[i]);
+            hash *= 0x100000001b3ULL;
+        }
+    };
+
+    string contents = Utils::textFileRead(sceneFile);
+    mix(contents.data(), contents.size());
+
+    for (auto p=params.begin(); p != params.end(); p++) {
+        mix(reinterpret_cast<const char*>(&(*p)), sizeof(int64_t));
+    }
+
+    return hash;
+}
+
+void Checkpoint::save(const string& file, const RenderState& state)
+{
+    string tmpFile = file + ".tmp";
+
+    {
+        ofstream out(tmpFile, ios::out | ios::binary | ios::trunc);
+
+        if (!out) {
+            throw runtime_error("Checkpoint: cannot open " + tmpFile + " for writing");
+        }
+
+        out.write(MAGIC, sizeof(MAGIC));
+        writeValue(out, VERSION);
+        writeValue(out, state.sceneHash);
+        writeValue(out, state.seed);
+        writeValue(out, static_cast<int32_t>(state.width));
+        writeValue(out, static_cast<int32_t>(state.height));
+        writeValue(out, static_cast<int32_t>(RenderState::TILE_SIZE));
+        writeValue(out, static_cast<int32_t>(state.pass));
+        writeValue(out, state.avgIntensity);
+        writeArray(out, state.tileDone);
+        writeArray(out, state.color);
+        writeArray(out, state.samples);
+        writeArray(out, state.edgeMap);
+
+        out.flush();
+
+        if (!out) {
+            throw runtime_error("Checkpoint: failed writing " + tmpFile);
+        }
+    }
+
+    if (rename(tmpFile.c_str(), file.c_str()) != 0) {
+        throw runtime_error("Checkpoint: cannot rename " + tmpFile + " to " + file);
+    }
+}
+
+bool Checkpoint::load(const string& file, RenderState& state)
+{
+    ifstream in(file, ios::in | ios::binary);
+
+    if (!in) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    int32_t width = 0, height = 0, tileSize = 0, pass = 0;
+
+    in.read(magic, sizeof(magic));
+    readValue(in, version);
+
+    if (!in || !equal(magic, magic + 4, MAGIC) || version != VERSION) {
+        throw runtime_error("Checkpoint: " + file + " is not a valid checkpoint file");
+    }
+
+    readValue(in, state.sceneHash);
+    readValue(in, state.seed);
+    readValue(in, width);
+    readValue(in, height);
+    readValue(in, tileSize);
+    readValue(in, pass);
+    readValue(in, state.avgIntensity);
+
+    if (!in || width <= 0 || height <= 0 || tileSize != RenderState::TILE_SIZE || (pass != 1 && pass != 2)) {
+        throw runtime_error("Checkpoint: " + file + " has an invalid header");
+    }
+
+    state.width  = width;
+    state.height = height;
+    state.pass   = pass;
+
+    uint64_t pixels = static_cast<uint64_t>(width) * static_cast<uint64_t>(height);
+
+    readArray(in, state.tileDone, state.tileCount());
+    readArray(in, state.color, 3 * pixels);
+    readArray(in, state.samples, pixels);
+    readArray(in, state.edgeMap, pass == 2 ? pixels : 0);
+
+    if (!in) {
+        throw runtime_error("Checkpoint: " + file + " is truncated");
+    }
+
+    return true;
+}
+
+void Checkpoint::remove(const string& file)
+{
+    std::remove(file.c_str());
+}
+
+void Checkpoint::requestStop()
+{
+    stopFlag = 1;
+}
+
+bool Checkpoint::stopRequested()
+{
+    return stopFlag != 0;
+}
+
+/******************************************************************************/
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ *
+ * This file defines the render state that is periodically written to disk
+ * so that long running renders can be resumed after being interrupted
+ *
+ * @file Checkpoint.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/******************************************************************************/
+
+/**
+ * The complete state of a render in progress. The image is divided into
+ * square tiles which are rendered independently; once a tile is completed,
+ * its pixels are copied into the accumulation buffer and the tile is marked
+ * as done for the current pass.
+ *
+ * Random numbers are drawn from a generator reseeded per pixel from the base
+ * seed, so the base seed is the only RNG state that needs to be stored.
+ */
+class RenderState
+{
+	public:
+		static const int TILE_SIZE = 32;
+
+		// Hash of the scene file and the options affecting the output
+		uint64_t sceneHash;
+
+		// Base random seed
+		uint64_t seed;
+
+		// Image dimensions
+		int width;
+		int height;
+
+		// Current pass: 1 = primary, 2 = adaptive supersampling
+		int pass;
+
+		// Average edge intensity; only meaningful in pass 2
+		float avgIntensity;
+
+		// Per-tile completion flags for the current pass
+		std::vector<unsigned char> tileDone;
+
+		// RGB color per pixel, stored in column-major order (i * height + j)
+		std::vector<float> color;
+
+		// Number of samples taken per pixel
+		std::vector<unsigned int> samples;
+
+		// Edge intensity map computed at the start of pass 2
+		std::vector<float> edgeMap;
+
+		RenderState();
+
+		// Sets up an empty state for a render of the given size
+		void reset(uint64_t sceneHash, uint64_t seed, int width, int height);
+
+		// Moves on to the given pass, clearing the tile completion flags
+		void beginPass(int pass);
+
+		int tilesX() const { return (this->width + TILE_SIZE - 1) / TILE_SIZE; }
+		int tilesY() const { return (this->height + TILE_SIZE - 1) / TILE_SIZE; }
+		int tileCount() const { return this->tilesX() * this->tilesY(); }
+
+		// Number of tiles completed in the current pass
+		int tilesCompleted() const;
+};
+
+/******************************************************************************/
+
+namespace Checkpoint
+{
+	// Computes a hash of the scene file's contents combined with the given
+	// option values, used to reject checkpoints from a different render
+	uint64_t hashScene(const std::string& sceneFile
+		              ,const std::vector<int64_t>& params);
+
+	// Atomically writes the render state to the given file. The state is
+	// written to a temporary file first, which is then renamed over the
+	// target. Throws std::runtime_error on failure
+	void save(const std::string& file, const RenderState& state);
+
+	// Reads the render state from the given file, returning false if no
+	// checkpoint exists. Throws std::runtime_error if the file is corrupt
+	bool load(const std::string& file, RenderState& state);
+
+	// Deletes the given checkpoint file if it exists
+	void remove(const std::string& file);
+
+	// Requests that the render in progress stops at the next tile boundary
+	// and writes a final checkpoint. Safe to call from a signal handler
+	void requestStop();
+
+	// Tests if a stop has been requested
+	bool stopRequested();
+}
+
+/******************************************************************************/
+
+#endif
@@ -8,24 +8,24 @@
  *
  *****************************************************************************/
 
+#include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <stdexcept>
-#include <fstream>
-#include <sstream>
 #include <utility>
 #include <ctime>
 #include <easylogging++.h>
 
-#include "ModelImport.h"
 #include "Utils.h"
 #include "Config.h"
 #include "Sphere.h"
 #include "Cube.h"
 #include "Cylinder.h"
 #include "Mesh.h"
-#include "GLGeometry.h"
 #include "PointLight.h"
 #include "AreaLight.h"
+#include "EnvironmentLight.h"
+#include "Stats.h"
 #include "SurfaceMap.h"
 
 /******************************************************************************/
@@ -33,6 +33,7 @@
 using namespace std;
 using namespace glm;
 using namespace Utils;
+using namespace TextScan;
 
 /******************************************************************************/
 
@@ -46,8 +47,24 @@ using namespace Utils;
 
 static bool isNullValue(const string& testValue)
 {
-	auto s = lowercase(string(testValue));
-	return s == "null" || s == "~";
+	if (testValue == "~") {
+		return true;
+	}
+
+	// Compared without copying, as nearly every node has a few:
+	static const char null[] = "null";
+
+	if (testValue.size() != 4) {
+		return false;
+	}
+
+	for (size_t i=0; i<4; i++) {
+		if (tolower(static_cast<unsigned char>(testValue[i])) != null[i]) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
 /******************************************************************************/
@@ -129,19 +146,19 @@ void Configuration::registerLight(shared_ptr<Light> light)
  * UVEC <x:float> <y:float> <z:float>
  * FOVY <angle:float>
  */
-void Configuration::parseCameraSection(istream& is, const string& beginToken)
+void Configuration::parseCameraSection(Scanner& is, const string& beginToken)
 {
-	string line, attribute;
+	string attribute;
+	Line ss;
 	bool readNonEmptyLine = false;
 
 	#ifdef ENABLE_DEBUG
 	LOG(DEBUG) << "<<parseCameraSection>>";
 	#endif
 
-	while (getline(is, line)) {
+	while (is.nextLine(ss)) {
 
-		line = trim(line);
-		if (line.length() == 0) {
+		if (ss.empty()) {
 			if (readNonEmptyLine) {
 				break;
 			} else {
@@ -149,9 +166,8 @@ void Configuration::parseCameraSection(istream& is, const string& beginToken)
 			}
 		}
 
-		istringstream ss(line);
 		ss >> attribute;
-		attribute = lowercase(attribute);
+		toLower(attribute);
 
 		#ifdef ENABLE_DEBUG
 		LOG(DEBUG) << "ATTRIBUTE<parseCameraSection>: "<< attribute;
@@ -184,24 +200,26 @@ void Configuration::parseCameraSection(istream& is, const string& beginToken)
  *
  * FILE "filename.bmp"               -- Environment mapping file
  * SHAPE <SPHERE|CUBE|WILD1|WILD2>   -- Mapping shape: sphere or cube
+ * LIGHT <intensity:float>           -- Optional: light the scene with the map
  */
-void Configuration::parseEnvironmentSection(istream& is, const string& beginToken)
+void Configuration::parseEnvironmentSection(Scanner& is, const string& beginToken)
 {
-	string line, attribute;
+	string attribute;
+	Line ss;
 	bool readNonEmptyLine = false;
 
 	string SHAPE           = "";
 	string envMapFile      = "";
+	float LIGHT            = 0.0f;
 	string basePath        = baseName(realPath(this->filename));
 
 	#ifdef ENABLE_DEBUG
 	LOG(DEBUG) << "<<parseEnvironmentSection>>" << endl;
 	#endif
 
-	while (getline(is, line)) {
+	while (is.nextLine(ss)) {
 
-		line = trim(line);
-		if (line.length() == 0) {
+		if (ss.empty()) {
 			if (readNonEmptyLine) {
 				break;
 			} else {
@@ -209,9 +227,8 @@ void Configuration::parseEnvironmentSection(istream& is, const string& beginToke
 			}
 		}
 
-		istringstream ss(line);
 		ss >> attribute;
-		attribute = lowercase(attribute);
+		toLower(attribute);
 
 		#ifdef ENABLE_DEBUG
 		LOG(DEBUG) << "ATTRIBUTE<parseEnvironmentSection>: " << attribute;
@@ -225,6 +242,9 @@ void Configuration::parseEnvironmentSection(istream& is, const string& beginToke
 		} else if (attribute == "shape") {
 			ss >> SHAPE;
 			readNonEmptyLine = true;
+		} else if (attribute == "light") {
+			ss >> LIGHT;
+			readNonEmptyLine = true;
 		} else {
 			LOG(WARNING) << "<parseEnvironmentSection> Ignoring extra attribute: " 
 			             << attribute ;
@@ -232,6 +252,10 @@ void Configuration::parseEnvironmentSection(istream& is, const string& beginToke
 	}
 
 	this->envMap = shared_ptr<EnvironmentMap>(make_shared<TextureEnvironmentMap>(envMapFile, uppercase(SHAPE)));
+
+	if (LIGHT > 0.0f) {
+		this->registerLight(make_shared<EnvironmentLight>(this->envMap, LIGHT));
+	}
 }
 
 /**
@@ -247,10 +271,16 @@ void Configuration::parseEnvironmentSection(istream& is, const string& beginToke
  * EMIT <0|1>                         -- Emissive surface (area light)
  * TEXTURE "filename.bmp"             -- Texture mapping file
  * BUMP "filename.bmp"                -- Bump mapping file
+ * NORMAL "filename.bmp"              -- Tangent-space normal map file
+ * NORMAL "filename.bmp" HEIGHT [<scale:float>]
+ *                                    -- Height map, converted to a normal
+ *                                       map with white <scale> times the
+ *                                       map's width above black
  */
-void Configuration::parseMaterialSection(istream& is, const string& beginToken)
+void Configuration::parseMaterialSection(Scanner& is, const string& beginToken)
 {
-	string line, attribute;
+	string attribute;
+	Line ss;
 	bool readNonEmptyLine = false;
 
 	string name   = "";
@@ -262,17 +292,18 @@ void Configuration::parseMaterialSection(istream& is, const string& beginToken)
 	int   TRAN    = 0;
 	int   EMIT    = 0;
 	float AMBIENT = Material::DEFAULT_AMBIENT_COEFF;
-	string textureMapFile = "", bumpMapFile = "";
+	string textureMapFile = "", bumpMapFile = "", normalMapFile = "";
+	NormalMap::Source normalSource = NormalMap::RGB;
+	float normalHeightScale        = NormalMap::DEFAULT_HEIGHT_SCALE;
 	string basePath = baseName(realPath(this->filename));
 
 	#ifdef ENABLE_DEBUG
 	LOG(DEBUG) << "<<parseMaterialSection>>";
 	#endif
 
-	while (getline(is, line)) {
+	while (is.nextLine(ss)) {
 
-		line = trim(line);
-		if (line.length() == 0) {
+		if (ss.empty()) {
 			if (readNonEmptyLine) {
 				break;
 			} else {
@@ -280,9 +311,8 @@ void Configuration::parseMaterialSection(istream& is, const string& beginToken)
 			}
 		}
 
-		istringstream ss(line);
 		ss >> attribute;
-		attribute = lowercase(attribute);
+		toLower(attribute);
 
 		#ifdef ENABLE_DEBUG
 		LOG(DEBUG) << "ATTRIBUTE<parseMaterialSection>: "<< attribute;
@@ -322,6 +352,23 @@ void Configuration::parseMaterialSection(istream& is, const string& beginToken)
 			// Get the basepath from the filename for normal map file lookup:
 			bumpMapFile = basePath + DirSep + "textures" + DirSep + bumpMapFile;
 			readNonEmptyLine = true;
+		} else if (attribute == "normal" || attribute == "normal-map") {
+			string source;
+			ss >> normalMapFile >> source;
+			normalMapFile = basePath + DirSep + "textures" + DirSep + normalMapFile;
+			if (lowercase(source) == "height") {
+				// The scale is optional; a failed read would zero it:
+				float scale  = 0.0f;
+				normalSource = NormalMap::HEIGHT;
+				if (ss >> scale) {
+					normalHeightScale = scale;
+				}
+			} else if (source != "") {
+				LOG(WARNING) << "<parseMaterialSection> Ignoring normal map source: " 
+				             << source 
+				             << endl;
+			}
+			readNonEmptyLine = true;
 		} else {
 			if (beginToken == "mat" || beginToken == "material" || beginToken == "[material]") {
 				name = attribute;
@@ -338,21 +385,27 @@ void Configuration::parseMaterialSection(istream& is, const string& beginToken)
 		throw runtime_error("Material name cannot be empty");
 	}
 
+	// Materials that use the same files share the maps:
 	shared_ptr<TextureMap> textureMap(nullptr);
 	if (textureMapFile != "") {
-		textureMap = shared_ptr<TextureMap>(make_shared<TextureMap>(textureMapFile));
+		textureMap = this->assets.getTextureMap(textureMapFile);
 	}
 
 	shared_ptr<BumpMap> bumpMap(nullptr);
 	if (bumpMapFile != "") {
-		bumpMap = shared_ptr<BumpMap>(make_shared<BumpMap>(bumpMapFile));
+		bumpMap = this->assets.getBumpMap(bumpMapFile);
+	}
+
+	shared_ptr<NormalMap> normalMap(nullptr);
+	if (normalMapFile != "") {
+		normalMap = this->assets.getNormalMap(normalMapFile, normalSource, normalHeightScale);
 	}
 
 	shared_ptr<Material> 
 		material(make_shared<Material>(
 			 name
 			,Color(DIFF), Color(REFL), EXPO, IOR 
-			,MIRR != 0, TRAN != 0, EMIT != 0, AMBIENT, textureMap, bumpMap));
+			,MIRR != 0, TRAN != 0, EMIT != 0, AMBIENT, textureMap, bumpMap, normalMap));
 
 	this->registerMaterial(material);
 }
@@ -364,9 +417,10 @@ void Configuration::parseMaterialSection(istream& is, const string& beginToken)
  * LPOS <x:float> <y:float> <z:float>
  * LCOL <r:float> <g:float> <b:float>
  */
-void Configuration::parsePointLightSection(istream& is, const string& beginToken)
+void Configuration::parsePointLightSection(Scanner& is, const string& beginToken)
 {
-	string line, attribute;
+	string attribute;
+	Line ss;
 	bool readNonEmptyLine = false;
 
 	float LPOS[3] = { 0.0f, 0.0f, 0.0f };
@@ -376,10 +430,9 @@ void Configuration::parsePointLightSection(istream& is, const string& beginToken
 	LOG(DEBUG) << "<<parsePointLightSection>>" << endl;
 	#endif
 
-	while (getline(is, line)) {
+	while (is.nextLine(ss)) {
 
-		line = trim(line);
-		if (line.length() == 0) {
+		if (ss.empty()) {
 			if (readNonEmptyLine) {
 				break;
 			} else {
@@ -387,9 +440,8 @@ void Configuration::parsePointLightSection(istream& is, const string& beginToken
 			}
 		}
 
-		istringstream ss(line);
 		ss >> attribute;
-		attribute = lowercase(attribute);
+		toLower(attribute);
 
 		#ifdef ENABLE_DEBUG
 		LOG(DEBUG) << "ATTRIBUTE<parsePointLightSection>: " << attribute;
@@ -424,10 +476,30 @@ void Configuration::parsePointLightSection(istream& is, const string& beginToken
  * PARENT <parent-name:string>
  * SHAPE <type-name:string>
  * MAT <name:string>
+ *
+ * A node may instead place many copies of its shape, which share the one
+ * geometry (and a mesh's KD-tree) and cost a transformation and a material
+ * index each. Copies are placed relative to the node, and may be given by
+ * any number of the following:
+ *
+ * ARRAY <nx:int> <ny:int> <nz:int> <dx:float> <dy:float> <dz:float>
+ *                                    -- A grid of nx * ny * nz copies, the
+ *                                       first at the node's origin, spaced
+ *                                       apart by (dx, dy, dz)
+ * SCATTER <count:int> <seed:int> <min-x> <min-y> <min-z> <max-x> <max-y> <max-z> [<min-scale> <max-scale>]
+ *                                    -- count copies placed at random in the
+ *                                       box, turned about Y at random and
+ *                                       scaled by a random amount in the
+ *                                       range (default 1 1)
+ * INSTANCES "filename.txt"           -- A list of copies, relative to the
+ *                                       scene file; see readInstanceList()
+ *
+ * Copies of an emissive shape glow, but don't act as area lights
  */
-void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
+void Configuration::parseNodeDefinition(Scanner& is, const string& beginToken)
 {
-	string line, attribute;
+	string attribute;
+	Line ss;
 	string objFileName    = "";
 	bool isMesh           = false;
 	bool readNonEmptyLine = false;
@@ -440,27 +512,24 @@ void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
 	LOG(DEBUG) << "<<parseNodeDefinition>>" << endl;
 	#endif
 
-	while (getline(is, line)) {
+	while (is.nextLine(ss)) {
 
 		if (firstLine) {
-			line = trim(beginToken + " " + line);
+			// The keyword that began the section is the first attribute, and
+			// the rest of its line its value:
+			attribute = beginToken;
 			firstLine = false;
-		} else {
-			line = trim(line);
-		}
-
-		if (line.length() == 0) {
+		} else if (ss.empty()) {
 			if (readNonEmptyLine) {
 				break;
 			} else {
 				continue;
 			}
+		} else {
+			ss >> attribute;
+			toLower(attribute);
 		}
 
-		istringstream ss(line);
-		ss >> attribute;
-		attribute = lowercase(attribute);
-
 		#ifdef ENABLE_DEBUG
 		LOG(DEBUG) << "ATTRIBUTE<parseNodeDefinition>: " 
 		           << attribute 
@@ -512,8 +581,9 @@ void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
 					node->setParent(nullptr);
 					this->graphBuilder.setRoot(node);
 				} else {
-					// Otherwise, see if named parent exists, and if so link it to the child:
-					this->graphBuilder.linkNodes(parentName, node);
+					// Otherwise, link it to the named parent once every node is
+					// read, so parents may be defined after their children:
+					this->graphBuilder.linkLater(parentName, node);
 				}
 				readNonEmptyLine = true;
 			} else if (attribute == "shape") {
@@ -521,16 +591,10 @@ void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
 				ss >> shapeType;
 				if (isNullValue(shapeType)) {
 					// Do nothing
-				} else if (shapeType == "sphere") {
-					geometry = shared_ptr<Geometry>(make_shared<Sphere>());
-				} else if (shapeType == "cylinder") {
-					geometry = shared_ptr<Geometry>(make_shared<Cylinder>());
-				} else if (shapeType == "cube") {
-					geometry = shared_ptr<Geometry>(make_shared<Cube>());
 				} else if (shapeType == "mesh") {
 					isMesh = true;
 				} else {
-					throw runtime_error("parseNodeDefinition: Unsupported geometry type: " + shapeType);
+					geometry = this->getPrimitive(shapeType);
 				}
 				readNonEmptyLine = true;
 			} else if (attribute == "file") {
@@ -539,6 +603,44 @@ void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
 				string path = baseName(realPath(this->filename));
 				objFileName = path + DirSep + "models" + DirSep + objFileName;
 				readNonEmptyLine = true;
+			} else if (attribute == "array") {
+				int N[3]   = { 1, 1, 1 };
+				float D[3] = { 0.0f, 0.0f, 0.0f };
+				ss >> N[0] >> N[1] >> N[2] >> D[0] >> D[1] >> D[2];
+				if (N[0] < 1 || N[1] < 1 || N[2] < 1) {
+					throw runtime_error("parseNodeDefinition: ARRAY counts must be positive");
+				}
+				copiesOf(node)->addGrid(ivec3(N[0], N[1], N[2]), vec3(D[0], D[1], D[2]));
+				readNonEmptyLine = true;
+			} else if (attribute == "scatter") {
+				int count           = 0;
+				unsigned long seed  = 0;
+				float lo[3]         = { 0.0f, 0.0f, 0.0f };
+				float hi[3]         = { 0.0f, 0.0f, 0.0f };
+				float scaleRange[2] = { 1.0f, 1.0f };
+				ss >> count >> seed >> lo[0] >> lo[1] >> lo[2] >> hi[0] >> hi[1] >> hi[2];
+				if (ss.fail() || count < 0) {
+					throw runtime_error("parseNodeDefinition: SCATTER expects a count, a seed and two corners");
+				}
+				// The scale range is optional, but takes both of its values; a
+				// failed read would zero them:
+				float minScale = 0.0f, maxScale = 0.0f;
+				if (ss >> minScale) {
+					if (!(ss >> maxScale)) {
+						throw runtime_error("parseNodeDefinition: SCATTER expects both a minimum and a maximum scale");
+					}
+					scaleRange[0] = minScale;
+					scaleRange[1] = maxScale;
+				}
+				copiesOf(node)->addScatter(count, seed, vec3(lo[0], lo[1], lo[2]), vec3(hi[0], hi[1], hi[2]), scaleRange[0], scaleRange[1]);
+				readNonEmptyLine = true;
+			} else if (attribute == "instances") {
+				string listFile;
+				ss >> listFile;
+				// Get the basepath from the filename for list file lookup:
+				listFile = baseName(realPath(this->filename)) + DirSep + listFile;
+				this->readInstanceList(listFile, *copiesOf(node));
+				readNonEmptyLine = true;
 			} else if (attribute == "mat" || attribute == "material") {
 				string matName;
 				ss >> matName;
@@ -575,65 +677,201 @@ void Configuration::parseNodeDefinition(istream& is, const string& beginToken)
 			throw runtime_error("No object filename given for mesh object!");
 		}
 
-		LOG(INFO) << "load model from file: " << objFileName << endl;
- 
-		auto meshData = Model::importMeshes(objFileName);
+		// Imported and indexed once, however many nodes use it, while the
+		// rest of the scene is read:
+		this->pendingMeshes.push_back(make_pair(node, this->assets.loadMesh(objFileName)));
+
+	} else {
+
+		this->setGeometry(node, geometry);
+	}
 
-		assert(meshData.size() > 0);
+	if (node->getCopies() && node->isAreaLight()) {
+		LOG(WARNING) << "<parseNodeDefinition> Copies of emissive node " << node->getName() 
+		             << " don't light the scene";
+	}
 
-		std::vector<std::shared_ptr<Mesh>> meshes;
+	// Register the node, unless the map contains one of the same name
+	// already. If so signal an error, since a duplicate has been defined
+	if (!this->graphBuilder.addNode(node)) {
+		throw runtime_error("Duplicate node found: " + node->getName());
+	}
+}
 
-		for (auto i = meshData.begin(); i != meshData.end(); i++) {
-			meshes.push_back(shared_ptr<Mesh>(make_shared<Mesh>(*i)));
+/**
+ * Reads a list of copies for an INSTANCES node attribute, one per line:
+ *
+ * <tx> <ty> <tz> [<rx> <ry> <rz> [<sx> <sy> <sz>]] [<material:string>]
+ *
+ * giving the translation, the rotation in degrees and the scale of the 
+ * copy, and optionally a material to use instead of the node's. Blank lines
+ * and lines starting with '#' are skipped; a placement that cannot be
+ * inverted, e.g. one with a zero scale, is an error
+ */
+void Configuration::readInstanceList(const string& listFile, InstanceSet& copies) const
+{
+	MappedFile file(listFile);
+
+	if (!file.isGood()) {
+		throw runtime_error("readInstanceList: " + listFile + " cannot be read");
+	}
+
+	Scanner is(file);
+	Line ss;
+	int lineNumber = 0;
+
+	while (is.nextLine(ss)) {
+
+		lineNumber++;
+
+		if (ss.empty() || ss.peek() == '#') {
+			continue;
 		}
 
-		if (meshes.size() > 0) {
-			geometry = shared_ptr<Geometry>(make_shared<MultiMesh>(meshes));
-		} else {
-			geometry = shared_ptr<Geometry>(nullptr);
+		float values[9] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+		float value     = 0.0f;
+		int count       = 0;
+
+		// A failed read zeroes its target, so the defaults are only replaced
+		// by values that were actually read:
+		while (count < 9 && ss >> value) {
+			values[count++] = value;
 		}
+
+		string matName;
+		ss.clear();
+		ss >> matName;
+
+		if (count != 3 && count != 6 && count != 9) {
+			throw runtime_error("readInstanceList: " + listFile + ":" + S(lineNumber) + ": expected 3, 6 or 9 numbers");
+		}
+
+		shared_ptr<Material> material(nullptr);
+
+		if (matName != "" && !isNullValue(matName)) {
+			if (!this->materialExists(matName)) {
+				throw runtime_error("readInstanceList: " + listFile + ":" + S(lineNumber) + ": Material not defined: " + matName);
+			}
+			material = this->getMaterial(matName);
+		}
+
+		vec3 position(values[0], values[1], values[2]);
+		vec3 angles(radians(values[3]), radians(values[4]), radians(values[5]));
+		vec3 scaling(values[6], values[7], values[8]);
+		mat4 T = InstanceSet::placement(position, angles, scaling);
+
+		// Copies are hit through the inverse of their placement:
+		float det = determinant(T);
+
+		if (!(fabsf(det) > 0.0f) || !std::isfinite(det)) {
+			throw runtime_error("readInstanceList: " + listFile + ":" + S(lineNumber) + ": placement cannot be inverted (zero scale?)");
+		}
+
+		copies.add(T, material);
 	}
+}
 
+/**
+ * Returns the copies placed by the given node, creating them if need be
+ */
+shared_ptr<InstanceSet> Configuration::copiesOf(shared_ptr<GraphNode> node)
+{
+	if (!node->getCopies()) {
+		node->setCopies(make_shared<InstanceSet>());
+	}
+
+	return node->getCopies();
+}
+
+/**
+ * Returns the named unit primitive. Nodes place a primitive by their
+ * transformations alone, so every node of a shape shares one, rather than
+ * each building (and tessellating) its own
+ */
+shared_ptr<Geometry> Configuration::getPrimitive(const string& shapeType)
+{
+	auto i = this->primitives.find(shapeType);
+
+	if (i != this->primitives.end()) {
+		return i->second;
+	}
+
+	shared_ptr<Geometry> geometry(nullptr);
+
+	if (shapeType == "sphere") {
+		geometry = shared_ptr<Geometry>(make_shared<Sphere>());
+	} else if (shapeType == "cylinder") {
+		geometry = shared_ptr<Geometry>(make_shared<Cylinder>());
+	} else if (shapeType == "cube") {
+		geometry = shared_ptr<Geometry>(make_shared<Cube>());
+	} else {
+		throw runtime_error("parseNodeDefinition: Unsupported geometry type: " + shapeType);
+	}
+
+	this->primitives[shapeType] = geometry;
+
+	return geometry;
+}
+
+/**
+ * Associates the geometric object definition, if any, with the actual node
+ */
+void Configuration::setGeometry(shared_ptr<GraphNode> node, shared_ptr<Geometry> geometry)
+{
 	// We have a non-null object:
 	if (geometry) {
 
-		// Associate the geometric object definition with the actual node:
 		node->setGeometry(geometry);
 
-		std::shared_ptr<GLGeometry> instance(make_shared<GLGeometry>(geometry));
-		node->setInstance(instance);
+		if (node->getCopies()) {
+			node->getCopies()->build(geometry);
+		}
 
-		// Set the color of the geometry contained in the node based
-		// on the diffuse color of the node's material:
-		instance->setColor(node->getMaterial()->getDiffuseColor());
+		// The node's OpenGL instance is left to the preview, which creates
+		// it when its window opens
 	}
+}
 
-	// Test if the map contains the node already. If so
-	// signal an error, since a duplicate has been defined
-	if (this->graphBuilder.nodeExists(node->getName())) {
-		throw runtime_error("Duplicate node found: " + node->getName());
-	} else {
-		this->graphBuilder.registerNode(node);
+/**
+ * Logs how long each asset took to load, slowest first
+ */
+void Configuration::logLoadTimes() const
+{
+	auto times   = this->assets.getLoadTimes();
+	double total = 0.0;
+
+	sort(times.begin(), times.end(), [](const AssetRegistry::LoadTime& a, const AssetRegistry::LoadTime& b) {
+		return a.seconds > b.seconds;
+	});
+
+	for (auto t=times.begin(); t != times.end(); t++) {
+		LOG(INFO) << "load " << AssetRegistry::kindName(t->kind) << " " << t->filename 
+		          << ": " << t->seconds << "s";
+		total += t->seconds;
 	}
+
+	// Summed over every loading thread, so usually more than "load":
+	Stats::addTime("load.assets", total);
 }
 
 /**
- * Reads a configuration from the given stream, updating the corresponding 
- * member values of this instance
+ * Reads a configuration from the given file, updating the corresponding 
+ * member values of this instance. The file is mapped into memory and read
+ * in a single pass
  */
 unique_ptr<SceneContext> Configuration::read()
 {
-	ifstream is;
-	is.open(filename.c_str(), ifstream::in);
+	MappedFile file(this->filename);
 
-	if (!is.good()) {
+	if (!file.isGood()) {
 		throw runtime_error("read: " + filename + " cannot be read");
 	}
 
+	Scanner is(file);
 	string keyword;
 
-	while (is >> keyword) {
-		keyword = lowercase(keyword);
+	while (is.nextWord(keyword)) {
+		toLower(keyword);
 		if (keyword == "camera" || keyword == "[camera]") {
 			this->parseCameraSection(is, keyword);
 		} else if (keyword == "environment" || keyword == "[environment]") {
@@ -649,10 +887,30 @@ unique_ptr<SceneContext> Configuration::read()
 		}
 	}
 
+	// Wait for the meshes loading in the background. Nothing else about a
+	// node depends on its geometry until the graph is built:
+	for (auto p=this->pendingMeshes.begin(); p != this->pendingMeshes.end(); p++) {
+		this->setGeometry(p->first, p->second.get());
+	}
+
+	this->pendingMeshes.clear();
+	this->logLoadTimes();
+
 	// Finally, set the scene graph's root node:
 	this->graph = this->graphBuilder.build();
 
-	is.close();
+	// Collect all objects that constitute emissive objects and merge them
+	// with the existing light list. This is done once here rather than per 
+	// render, so the same scene can be rendered repeatedly:
+	auto areaLights = this->graph.areaLights();
+	for (auto l=areaLights->begin(); l != areaLights->end(); l++) {
+		this->lights->push_back(*l);
+	}
+
+	// If no environment map is given, just use a simple color:
+	if (!this->envMap) {
+		this->envMap = shared_ptr<EnvironmentMap>(make_shared<ColorEnvironmentMap>(Color::BLACK));
+	}
 
 	return unique_ptr<SceneContext>(
 		new SceneContext(vec2(this->RESO[0], this->RESO[1])
@@ -16,12 +16,16 @@
 #include <map>
 #include <list>
 #include <string>
+#include <utility>
+#include <vector>
 #include "Graph.h"
 #include "GraphBuilder.h"
+#include "AssetRegistry.h"
 #include "Light.h"
 #include "Material.h"
 #include "EnvironmentMap.h"
 #include "SceneContext.h"
+#include "TextScan.h"
 
 /******************************************************************************/
 
@@ -55,16 +59,30 @@ class Configuration
 
     protected:
         GraphBuilder graphBuilder;
+		AssetRegistry assets;
 		std::shared_ptr<EnvironmentMap> envMap;
 		Graph graph;
 		std::shared_ptr<MATERIALS> materials;
         std::shared_ptr<LIGHTS> lights;
 
-		void parseCameraSection(std::istream& is, const std::string& beginToken);
-		void parseEnvironmentSection(std::istream& is, const std::string& beginToken);
-		void parsePointLightSection(std::istream& is, const std::string& beginToken);
-		void parseMaterialSection(std::istream& is, const std::string& beginToken);
-		void parseNodeDefinition(std::istream& is, const std::string& beginToken);
+		// The unit sphere, cylinder and cube by name, each shared by every
+		// node of that shape
+		std::map<std::string, std::shared_ptr<Geometry>> primitives;
+
+		// Mesh nodes whose geometry is still loading; see read()
+		std::vector<std::pair<std::shared_ptr<GraphNode>, AssetRegistry::Pending<Geometry>>> pendingMeshes;
+
+		std::shared_ptr<Geometry> getPrimitive(const std::string& shapeType);
+		void setGeometry(std::shared_ptr<GraphNode> node, std::shared_ptr<Geometry> geometry);
+		std::shared_ptr<InstanceSet> copiesOf(std::shared_ptr<GraphNode> node);
+		void readInstanceList(const std::string& listFile, InstanceSet& copies) const;
+		void logLoadTimes() const;
+
+		void parseCameraSection(TextScan::Scanner& is, const std::string& beginToken);
+		void parseEnvironmentSection(TextScan::Scanner& is, const std::string& beginToken);
+		void parsePointLightSection(TextScan::Scanner& is, const std::string& beginToken);
+		void parseMaterialSection(TextScan::Scanner& is, const std::string& beginToken);
+		void parseNodeDefinition(TextScan::Scanner& is, const std::string& beginToken);
 
     public:
         Configuration(const std::string& filename);
@@ -72,6 +90,8 @@ class Configuration
 
 		const std::string& getFileName() { return this->filename; }
 
+		const AssetRegistry& getAssets() const { return this->assets; }
+
         std::unique_ptr<SceneContext> read();
 
         friend std::ostream& operator<<(std::ostream& os, const Configuration& c);
@@ -23,7 +23,6 @@ Cube::Cube() :
 	v2(glm::vec3(-0.5f, -0.5f, 0.5f)) // FRONT_BOTTOM_LEFT
 
 {
-    this->buildGeometry();
 	this->computeCentroid();
 	this->buildVolume();
     this->computeAABB();
@@ -34,7 +33,8 @@ Cube::Cube(const Cube& other) :
 	v1(other.v1),
 	v2(other.v2),
 	centroid(other.centroid),
-	volume(other.volume)
+	volume(other.volume),
+	aabb(other.aabb)
 { 
 
 }
@@ -140,112 +140,81 @@ void Cube::buildGeometry()
 	indices_.push_back(2); indices_.push_back(6); indices_.push_back(7);
 }
 
-Intersection Cube::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scene) const
+Hit Cube::hitImpl(const Ray &ray) const
 {
-	float xd  = ray.dir.x;
-    float yd  = ray.dir.y;
-    float zd  = ray.dir.z;
-	float eps = Utils::EPSILON;
+	glm::vec3 tIn, tOut;
 
-    if (xd == 0.0f) {
-        xd = eps;
-    }
-    if (yd == 0.0f) {
-        yd = eps;
-    }
-    if (zd == 0.0f) {
-        zd = eps;
-    }
+	this->aabb.slabs(ray, tIn, tOut);
 
-    float x1 = (this->v1.x - ray.orig.x) / xd;
-    float x2 = (this->v2.x - ray.orig.x) / xd;
-    float y1 = (this->v1.y - ray.orig.y) / yd;
-    float y2 = (this->v2.y - ray.orig.y) / yd;
-    float z1 = (this->v1.z - ray.orig.z) / zd;
-    float z2 = (this->v2.z - ray.orig.z) / zd;
-
-    if (x1 > x2) {
-		std::swap(x1, x2);
-    }
-    if (y1 > y2) {
-		std::swap(y1, y2);
-    }
-    if (z1 > z2) {
-		std::swap(z1, z2);   
-    }
+    float tNear = AABB::maxNear(-INFINITY, tIn);
+    float tFar  = AABB::minFar(INFINITY, tOut);
 
-    float tNear = std::max(x1, std::max(y1, z1));
-    float tFar  = std::min(x2, std::min(y2, z2));
+	// Starting inside the cube, the hit is where the ray leaves it:
+	bool inside = tNear < ray.tMin;
+	float t     = inside ? tFar : tNear;
 
-    if (tNear > tFar || tFar < 0) {
-        return Intersection::miss();
+    if (tNear > tFar || tFar < ray.tMin || t > ray.tMax) {
+        return Hit::miss();
     }
 
-	float t, nx, ny, nz;
-	if (tNear < 0.0f) {
-		t  = tFar;
-		nx = x2; 
-		ny = y2;
-		nz = z2;
-	} else {
-		t = tNear;
-		nx = x1;
-		ny = y1;
-		nz = z1;
-	}
-
-	// Now, compute the normal:
-	glm::vec3 normal;
-	if (fabs(nx - t) < eps) {
-		normal = glm::vec3(nx < 0.0f ? -1.0f : 1.0, 0.0f, 0.0f);
-	} else if (fabs(ny - t) < eps) {
-		normal = glm::vec3(0.0f, ny < 0.0f ? -1.0f : 1.0f, 1.0f);
+	// Per axis distance to the plane that was hit:
+	glm::vec3 n = inside ? tOut : tIn;
+	float eps   = Utils::EPSILON;
+
+	// Record the face that was hit, as (axis * 2) + (1 if negative); the 
+	// normal is derived from it later:
+	int face;
+	if (fabs(n.x - t) < eps) {
+		face = n.x < 0.0f ? 1 : 0;
+	} else if (fabs(n.y - t) < eps) {
+		face = n.y < 0.0f ? 3 : 2;
 	} else {
-		normal = glm::vec3(0.0f, 0.0f, nz < 0.0f ? -1.0f : 1.0f);
+		face = n.z < 0.0f ? 5 : 4;
 	}
 
-	return Intersection(t, normal);
+	return Hit(t, face);
 }
 
-glm::vec3 Cube::sampleImpl() const
+glm::vec3 Cube::normalImpl(const Ray &ray, const Hit& hit) const
 {
-	// TODO: get the dimensions of the transformed cube in world space
-	glm::vec3 dim (0, 0, 0);
+	float sign = (hit.primitive & 1) ? -1.0f : 1.0f;
+
+	switch (hit.primitive >> 1) {
+		case 0:
+			return glm::vec3(sign, 0.0f, 0.0f);
+		case 1:
+			return glm::vec3(0.0f, sign, 1.0f);
+		default:
+			return glm::vec3(0.0f, 0.0f, sign);
+	}
+}
 
-	// Get surface area of the cube
-	float side1 = dim[0] * dim[1];		// x-y
-	float side2 = dim[1] * dim[2];		// y-z
-	float side3 = dim[0] * dim[2];		// x-z
-	float totalArea = 2.0f * (side1 + side2 + side3);	
+glm::vec3 Cube::sampleImpl(glm::vec3& normal) const
+{
+	// Every face of the unit cube has the same area, so one is picked at
+	// random: its axis, and which side of the cube it is on
+	int face   = std::min(static_cast<int>(Utils::unitRand() * 6.0f), 5);
+	int axis   = face >> 1;
+	float sign = (face & 1) ? -1.0f : 1.0f;
 
-	// pick random face weighted by surface area
-	float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
 	// pick 2 random components for the point in the range (-0.5, 0.5)
-	float c1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX) - 0.5f;
-	float c2 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX) - 0.5f;
+	float c1 = Utils::unitRand() - 0.5f;
+	float c2 = Utils::unitRand() - 0.5f;
 
 	glm::vec3 point;
-	if (r < side1 / totalArea) {				
-		// x-y front
-		point = glm::vec3(c1, c2, 0.5f);
-	} else if (r < (side1 * 2) / totalArea) {
-		// x-y back
-		point = glm::vec3(c1, c2, -0.5f);
-	} else if (r < (side1 * 2 + side2) / totalArea) {
-		// y-z front
-		point = glm::vec3(0.5f, c1, c2);
-	} else if (r < (side1 * 2 + side2 * 2) / totalArea) {
-		// y-z back
-		point = glm::vec3(-0.5f, c1, c2);
-	} else if (r < (side1 * 2 + side2 * 2 + side3) / totalArea) {
-		// x-z front 
-		point = glm::vec3(c1, 0.5f, c2);
-	} else {
-		// x-z back
-		point = glm::vec3(c1, -0.5f, c2);
-	}
+	point[axis]           = 0.5f * sign;
+	point[(axis + 1) % 3] = c1;
+	point[(axis + 2) % 3] = c2;
+
+	normal       = glm::vec3();
+	normal[axis] = sign;
 
 	return point;
 }
 
+float Cube::areaImpl() const
+{
+	return 6.0f;
+}
+
 /******************************************************************************/
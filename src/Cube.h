@@ -27,8 +27,10 @@ class Cube : public Geometry
 		void computeAABB();
 
 	protected:
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const;
-		virtual glm::vec3 sampleImpl() const;
+		virtual Hit hitImpl(const Ray &ray) const;
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const;
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const;
+		virtual float areaImpl() const;
 
 	public:
 		Cube();
@@ -40,6 +42,10 @@ class Cube : public Geometry
 		virtual const AABB& getAABB() const;
 		virtual void buildGeometry();
 		virtual void repr(std::ostream& s) const;
+
+		// Opposite corners of the cube, in OBJECT-LOCAL-space
+		const glm::vec3& getV1() const { return this->v1; }
+		const glm::vec3& getV2() const { return this->v2; }
 };
 
 /******************************************************************************/
@@ -28,7 +28,6 @@ Cylinder::Cylinder() :
     radius_(0.5f),
     height_(1.0f)
 {
-    this->buildGeometry();
 	this->buildVolume();
     this->computeAABB();
 }
@@ -159,7 +158,7 @@ void Cylinder::buildGeometry()
     }
 }
 
-Intersection Cylinder::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scene) const
+Hit Cylinder::hitImpl(const Ray &ray) const
 {
 	float inf   = numeric_limits<float>::infinity();
     float r2    = this->radius_ * this->radius_;
@@ -178,11 +177,9 @@ Intersection Cylinder::intersectImpl(const Ray &ray, shared_ptr<SceneContext> sc
 
 	// No roots = no hit
     if (D < 0.0) {
-		return Intersection::miss();
+		return Hit::miss();
 	}
 
-	glm::vec3 normal = glm::vec3(1.0f, 0.0, 1.0f);
-
 	float halfH = this->height_ * 0.5f;
 	float t     = -1.0f;
 
@@ -248,24 +245,66 @@ Intersection Cylinder::intersectImpl(const Ray &ray, shared_ptr<SceneContext> sc
 	}
 
 	if (t < 0.0f) {
-		return Intersection::miss();
+		return Hit::miss();
 	}
 
+	// Record the part that was hit: 0 = side, 1 = top, 2 = bottom
 	if (t == tTop) {
-		normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		return Hit(t, 1);
 	} else if (t == tBottom) {
-		normal = glm::vec3(0.0f, -1.0f, 0.0f);
-	} else {
-		glm::vec3 p = ray.project(t);
-		normal = glm::vec3(p.x / this->radius_, 0.0f, p.z / this->radius_);
+		return Hit(t, 2);
 	}
 
-	return Intersection(t, normal);
+	return Hit(t, 0);
 }
 
-glm::vec3 Cylinder::sampleImpl() const
+glm::vec3 Cylinder::normalImpl(const Ray &ray, const Hit& hit) const
 {
-	throw runtime_error("Cylinder::sampleImpl() not implemented");
+	switch (hit.primitive) {
+		case 1:
+			return glm::vec3(0.0f, 1.0f, 0.0f);
+		case 2:
+			return glm::vec3(0.0f, -1.0f, 0.0f);
+		default:
+			{
+				glm::vec3 p = ray.project(hit.t);
+				return glm::vec3(p.x / this->radius_, 0.0f, p.z / this->radius_);
+			}
+	}
+}
+
+/**
+ * The side or one of the caps is picked in proportion to its area, then a
+ * point uniformly over it
+ */
+glm::vec3 Cylinder::sampleImpl(glm::vec3& normal) const
+{
+	float side  = 2.0f * static_cast<float>(M_PI) * this->radius_ * this->height_;
+	float cap   = static_cast<float>(M_PI) * this->radius_ * this->radius_;
+	float r     = Utils::unitRand() * (side + (2.0f * cap));
+	float theta = 2.0f * static_cast<float>(M_PI) * Utils::unitRand();
+	float c     = cos(theta);
+	float s     = sin(theta);
+
+	if (r < side) {
+		float y = (Utils::unitRand() - 0.5f) * this->height_;
+		normal  = glm::vec3(c, 0.0f, s);
+		return this->center_ + glm::vec3(this->radius_ * c, y, this->radius_ * s);
+	}
+
+	// Uniform over the disc of the cap:
+	float d    = this->radius_ * sqrt(Utils::unitRand());
+	float sign = r < (side + cap) ? 1.0f : -1.0f;
+	normal     = glm::vec3(0.0f, sign, 0.0f);
+
+	return this->center_ + glm::vec3(d * c, 0.5f * sign * this->height_, d * s);
+}
+
+float Cylinder::areaImpl() const
+{
+	float r = this->radius_;
+
+	return 2.0f * static_cast<float>(M_PI) * r * (this->height_ + r);
 }
 
 /*****************************************************************************/
@@ -27,8 +27,10 @@ class Cylinder : public Geometry
 		void computeAABB();
 
 	protected:
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const;
-		virtual glm::vec3 sampleImpl() const;
+		virtual Hit hitImpl(const Ray &ray) const;
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const;
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const;
+		virtual float areaImpl() const;
 
 	public:
 		Cylinder();
@@ -0,0 +1,535 @@
+/*******************************************************************************
+ *
+ * This file defines a persistent render server which keeps parsed scenes and
+ * their acceleration structures resident in memory between render jobs
+ *
+ * @file Daemon.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define GLM_FORCE_RADIANS
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef ENABLE_OPENMP
+#include <omp.h>
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "Config.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Raytrace.h"
+#include "Stats.h"
+#include "Utils.h"
+#include "Daemon.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/*******************************************************************************
+ * SceneCache
+ ******************************************************************************/
+
+SceneCache::SceneCache(size_t _capacity) :
+    capacity(std::max(static_cast<size_t>(1), _capacity)),
+    clock(0)
+{
+
+}
+
+size_t SceneCache::size()
+{
+    lock_guard<mutex> guard(this->lock);
+    return this->entries.size();
+}
+
+void SceneCache::evict()
+{
+    while (this->entries.size() > this->capacity) {
+
+        auto oldest = this->entries.begin();
+
+        for (auto i=this->entries.begin(); i != this->entries.end(); i++) {
+            if (i->second.lastUsed < oldest->second.lastUsed) {
+                oldest = i;
+            }
+        }
+
+        this->entries.erase(oldest);
+    }
+}
+
+shared_ptr<SceneContext> SceneCache::get(const string& file, bool& cached)
+{
+    struct stat st;
+
+    if (stat(file.c_str(), &st) != 0) {
+        throw runtime_error("SceneCache: " + file + " cannot be read");
+    }
+
+    string key = Utils::realPath(file);
+    promise<shared_ptr<SceneContext>> loaded;
+    shared_future<shared_ptr<SceneContext>> scene;
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        auto i = this->entries.find(key);
+
+        cached = (i != this->entries.end() && i->second.mtime == st.st_mtime);
+
+        if (cached) {
+            scene = i->second.scene;
+            i->second.lastUsed = ++this->clock;
+        } else {
+            scene = loaded.get_future().share();
+            this->entries[key] = Entry { st.st_mtime, scene, ++this->clock };
+            this->evict();
+        }
+    }
+
+    // Load outside of the lock, so other scenes can be served meanwhile. Any
+    // other request for the same scene waits on the shared future:
+    if (!cached) {
+
+        try {
+
+            Configuration config(file);
+            loaded.set_value(shared_ptr<SceneContext>(config.read()));
+
+        } catch (...) {
+
+            loaded.set_exception(current_exception());
+
+            // Don't cache failures; the scene may reference a missing asset
+            // which can be fixed without touching the scene file itself:
+            lock_guard<mutex> guard(this->lock);
+            this->entries.erase(key);
+        }
+    }
+
+    return scene.get();
+}
+
+/*******************************************************************************
+ * JobQueue
+ ******************************************************************************/
+
+JobQueue::JobQueue(size_t _capacity) :
+    capacity(std::max(static_cast<size_t>(1), _capacity)),
+    closed(false)
+{
+
+}
+
+bool JobQueue::push(shared_ptr<RenderJob> job)
+{
+    unique_lock<mutex> guard(this->lock);
+
+    this->notFull.wait(guard, [this] { return this->closed || this->jobs.size() < this->capacity; });
+
+    if (this->closed) {
+        return false;
+    }
+
+    this->jobs.push_back(job);
+    this->notEmpty.notify_one();
+
+    return true;
+}
+
+shared_ptr<RenderJob> JobQueue::pop()
+{
+    unique_lock<mutex> guard(this->lock);
+
+    this->notEmpty.wait(guard, [this] { return this->closed || !this->jobs.empty(); });
+
+    if (this->jobs.empty()) {
+        return nullptr;
+    }
+
+    auto job = this->jobs.front();
+    this->jobs.pop_front();
+    this->notFull.notify_one();
+
+    return job;
+}
+
+void JobQueue::close()
+{
+    lock_guard<mutex> guard(this->lock);
+
+    this->closed = true;
+    this->notEmpty.notify_all();
+    this->notFull.notify_all();
+}
+
+/*******************************************************************************
+ * RenderDaemon
+ ******************************************************************************/
+
+/**
+ * Reads a vec3 from a JSON array, returning def if the value is not an array
+ */
+static vec3 toVec3(const JsonValue& value, const vec3& def)
+{
+    if (!value.isArray() || value.size() != 3) {
+        return def;
+    }
+
+    return vec3(value[0].asNumber(def.x), value[1].asNumber(def.y), value[2].asNumber(def.z));
+}
+
+/**
+ * Returns the job id as a JSON fragment, echoing whatever the client sent
+ */
+static string jobId(const JsonValue& request)
+{
+    const JsonValue& id = request["id"];
+
+    if (id.getType() == JsonValue::STRING) {
+        return JsonValue::quote(id.asString());
+    }
+
+    if (id.getType() == JsonValue::NUMBER) {
+        ostringstream ss;
+        ss << id.asNumber();
+        return ss.str();
+    }
+
+    return "null";
+}
+
+/**
+ * Formats an error response
+ */
+static string errorResponse(const JsonValue& request, const string& message)
+{
+    return "{\"id\": " + jobId(request) + ", \"status\": \"error\", \"message\": " + JsonValue::quote(message) + "}";
+}
+
+RenderDaemon::RenderDaemon(int jobs, size_t queueCapacity, size_t cachedScenes) :
+    cache(cachedScenes),
+    queue(queueCapacity),
+    threadsPerJob(1)
+{
+    jobs = std::max(1, jobs);
+
+    // Every response reports the job's own ray and intersection counts:
+    Stats::enabled = true;
+
+    // Split the available cores between the concurrently running jobs:
+    #ifdef ENABLE_OPENMP
+    this->threadsPerJob = std::max(1, omp_get_max_threads() / jobs);
+    #endif
+
+    for (int i=0; i<jobs; i++) {
+        this->workers.push_back(thread(&RenderDaemon::work, this));
+    }
+
+    cout << "> Render server started with " << jobs << " worker(s), "
+         << this->threadsPerJob << " thread(s) per job"
+         << endl;
+}
+
+RenderDaemon::~RenderDaemon()
+{
+    this->shutdown();
+}
+
+void RenderDaemon::work()
+{
+    #ifdef ENABLE_OPENMP
+    omp_set_num_threads(this->threadsPerJob);
+    #endif
+
+    while (auto job = this->queue.pop()) {
+
+        string response;
+
+        try {
+
+            response = this->render(job->request);
+
+        } catch (std::exception& e) {
+
+            response = errorResponse(job->request, e.what());
+        }
+
+        job->reply(response);
+    }
+}
+
+string RenderDaemon::render(const JsonValue& request)
+{
+    string sceneFile  = request["scene"].asString();
+    string outputFile = request["output"].asString();
+
+    if (sceneFile.empty() || outputFile.empty()) {
+        throw runtime_error("\"scene\" and \"output\" are required");
+    }
+
+    auto start  = chrono::system_clock::now();
+    bool cached = false;
+    auto base   = this->cache.get(sceneFile, cached);
+
+    chrono::duration<double> loadTime = chrono::system_clock::now() - start;
+
+    // Apply the job's overrides to a view of the cached scene. The graph,
+    // materials and lights are shared, not copied:
+    const JsonValue& camera = request["camera"];
+    vec2 reso = base->getResolution();
+
+    reso.x = static_cast<float>(request["width"].asNumber(reso.x));
+    reso.y = static_cast<float>(request["height"].asNumber(reso.y));
+
+    if (reso.x < 1.0f || reso.y < 1.0f) {
+        throw runtime_error("invalid resolution");
+    }
+
+    auto scene = make_shared<SceneContext>(reso
+                                          ,toVec3(camera["eye"], base->getEyePosition())
+                                          ,toVec3(camera["viewDir"], base->getViewDir())
+                                          ,toVec3(camera["up"], base->getUpDir())
+                                          ,static_cast<float>(camera["fov"].asNumber(base->getFOVAngle()))
+                                          ,base->getSceneGraph()
+                                          ,base->getEnvironmentMap()
+                                          ,base->getMaterials()
+                                          ,base->getLights());
+
+    auto opts = make_shared<TraceOptions>();
+
+    opts->samplesPerPixel = static_cast<int>(request["samplesPerPixel"].asNumber(opts->samplesPerPixel));
+    opts->samplesPerLight = static_cast<int>(request["samplesPerLight"].asNumber(opts->samplesPerLight));
+    opts->seed            = static_cast<uint64_t>(request["seed"].asNumber(static_cast<double>(time(nullptr))));
+    opts->verbose         = false;
+
+    string filter = request["textureFilter"].asString();
+
+    if (!filter.empty() && !TextureMap::filterFromName(filter, opts->textureFilter)) {
+        throw runtime_error("unknown texture filter: " + filter);
+    }
+
+    Camera rayTraceCamera;
+    initRaytrace(rayTraceCamera, scene);
+
+    auto output = make_shared<Image>(static_cast<int>(reso.x), static_cast<int>(reso.y), 1, 3, 0);
+
+    // Counted apart from any job rendering alongside this one:
+    Stats::Scope jobStats;
+
+    start = chrono::system_clock::now();
+    {
+        Stats::Enter enterScope(&jobStats);
+        rayTrace(output, rayTraceCamera, scene, opts);
+    }
+    chrono::duration<double> renderTime = chrono::system_clock::now() - start;
+
+    Stats::Block counts = jobStats.merge();
+    uint64_t rays       = 0;
+    uint64_t tests      = counts.counts[Stats::KD_TRIS_TESTED];
+
+    for (int c=Stats::RAYS_PRIMARY; c<=Stats::RAYS_SHADOW; c++) {
+        rays += counts.counts[c];
+    }
+
+    for (int c=Stats::TESTS_CUBE; c<=Stats::TESTS_VOLUME; c++) {
+        tests += counts.counts[c];
+    }
+
+    output->save(outputFile.c_str());
+
+    ostringstream ss;
+    ss << "{\"id\": " << jobId(request)
+       << ", \"status\": \"ok\""
+       << ", \"output\": " << JsonValue::quote(outputFile)
+       << ", \"cached\": " << (cached ? "true" : "false")
+       << ", \"loadTime\": " << loadTime.count()
+       << ", \"renderTime\": " << renderTime.count()
+       << ", \"rays\": " << rays
+       << ", \"tests\": " << tests
+       << "}";
+
+    return ss.str();
+}
+
+void RenderDaemon::serveStream(istream& in, ostream& out)
+{
+    auto outLock = make_shared<mutex>();
+    auto reply   = [&out, outLock](const string& response) {
+        lock_guard<mutex> guard(*outLock);
+        out << response << endl;
+    };
+
+    string line;
+
+    while (getline(in, line)) {
+
+        line = Utils::trim(line);
+
+        if (line.empty()) {
+            continue;
+        }
+
+        try {
+
+            this->queue.push(make_shared<RenderJob>(JsonValue::parse(line), reply));
+
+        } catch (std::runtime_error& e) {
+
+            reply(errorResponse(JsonValue(), e.what()));
+        }
+    }
+
+    this->shutdown();
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+/**
+ * A client connection; the socket is closed once the client has disconnected
+ * and every job it submitted has been answered
+ */
+class Connection
+{
+    protected:
+        int fd;
+        mutex writeLock;
+
+    public:
+        Connection(int _fd) : fd(_fd) { }
+        ~Connection() { ::close(this->fd); }
+
+        int getFd() const { return this->fd; }
+
+        void send(const string& response)
+        {
+            lock_guard<mutex> guard(this->writeLock);
+
+            string data = response + "\n";
+            size_t sent = 0;
+
+            while (sent < data.size()) {
+                ssize_t n = ::write(this->fd, data.data() + sent, data.size() - sent);
+                if (n <= 0) {
+                    return; // Client went away
+                }
+                sent += static_cast<size_t>(n);
+            }
+        }
+};
+
+void RenderDaemon::serveSocket(const string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("RenderDaemon: socket path too long: " + path);
+    }
+
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (server < 0) {
+        throw runtime_error("RenderDaemon: cannot create socket");
+    }
+
+    unlink(path.c_str());
+
+    if (::bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(server, 16) != 0) {
+        ::close(server);
+        throw runtime_error("RenderDaemon: cannot listen on " + path + ": " + strerror(errno));
+    }
+
+    // Writing to a client that disconnected must not kill the server:
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << "> Listening on " << path << endl;
+
+    while (true) {
+
+        int client = accept(server, nullptr, nullptr);
+
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("RenderDaemon: accept failed: ") + strerror(errno));
+        }
+
+        thread([this, client] {
+
+            auto conn  = make_shared<Connection>(client);
+            auto reply = [conn](const string& response) { conn->send(response); };
+
+            string pending;
+            char buffer[4096];
+            ssize_t n;
+
+            while ((n = ::read(conn->getFd(), buffer, sizeof(buffer))) > 0) {
+
+                pending.append(buffer, static_cast<size_t>(n));
+
+                size_t eol;
+
+                while ((eol = pending.find('\n')) != string::npos) {
+
+                    string line = Utils::trim(pending.substr(0, eol));
+                    pending.erase(0, eol + 1);
+
+                    if (line.empty()) {
+                        continue;
+                    }
+
+                    try {
+
+                        this->queue.push(make_shared<RenderJob>(JsonValue::parse(line), reply));
+
+                    } catch (std::runtime_error& e) {
+
+                        reply(errorResponse(JsonValue(), e.what()));
+                    }
+                }
+            }
+
+        }).detach();
+    }
+}
+
+#else
+
+void RenderDaemon::serveSocket(const string& path)
+{
+    (void)path;
+    throw runtime_error("RenderDaemon: Unix domain sockets are not supported on this platform");
+}
+
+#endif
+
+void RenderDaemon::shutdown()
+{
+    this->queue.close();
+
+    for (auto w=this->workers.begin(); w != this->workers.end(); w++) {
+        if (w->joinable()) {
+            w->join();
+        }
+    }
+}
+
+/******************************************************************************/
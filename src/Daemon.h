@@ -0,0 +1,165 @@
+/*******************************************************************************
+ *
+ * This file defines a persistent render server which keeps parsed scenes and
+ * their acceleration structures resident in memory between render jobs
+ *
+ * @file Daemon.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Json.h"
+#include "SceneContext.h"
+
+/******************************************************************************/
+
+/**
+ * Cache of loaded scenes, keyed by the scene file's real path. An entry is
+ * reloaded when the file's modification time changes. Note that only the
+ * scene file itself is checked, not the models and textures it references.
+ *
+ * At most "capacity" scenes are kept; beyond that the least recently used
+ * one is dropped. Jobs still rendering a dropped scene keep it alive until
+ * they finish
+ */
+class SceneCache
+{
+	protected:
+		struct Entry
+		{
+			time_t mtime;
+			std::shared_future<std::shared_ptr<SceneContext>> scene;
+
+			// Value of "clock" when the entry was last requested
+			uint64_t lastUsed;
+		};
+
+		std::mutex lock;
+		std::map<std::string, Entry> entries;
+		size_t capacity;
+		uint64_t clock;
+
+		// Drops least recently used entries until at most "capacity" remain.
+		// The lock must be held
+		void evict();
+
+	public:
+		SceneCache(size_t capacity);
+
+		// Returns the number of scenes currently cached
+		size_t size();
+
+		// Returns the scene for the given file, loading it if needed. If the
+		// scene is already being loaded by another thread, this waits for it
+		// to finish. "cached" is set to true if no load was necessary.
+		// Throws std::runtime_error if the scene cannot be loaded
+		std::shared_ptr<SceneContext> get(const std::string& file, bool& cached);
+};
+
+/**
+ * A single render request
+ */
+class RenderJob
+{
+	public:
+		// The request as received
+		JsonValue request;
+
+		// Called with a one line JSON response once the job is done
+		std::function<void(const std::string&)> reply;
+
+		RenderJob(const JsonValue& _request, std::function<void(const std::string&)> _reply) :
+			request(_request),
+			reply(_reply)
+		{
+
+		}
+};
+
+/**
+ * Bounded FIFO of pending jobs. Producers block while the queue is full
+ */
+class JobQueue
+{
+	protected:
+		std::mutex lock;
+		std::condition_variable notEmpty;
+		std::condition_variable notFull;
+		std::deque<std::shared_ptr<RenderJob>> jobs;
+		size_t capacity;
+		bool closed;
+
+	public:
+		JobQueue(size_t capacity);
+
+		// Adds a job, blocking while the queue is full. Returns false if the
+		// queue has been closed
+		bool push(std::shared_ptr<RenderJob> job);
+
+		// Removes the next job, blocking while the queue is empty. Returns
+		// nullptr once the queue is closed and drained
+		std::shared_ptr<RenderJob> pop();
+
+		// Stops accepting jobs and wakes all waiting consumers
+		void close();
+};
+
+/**
+ * The render server. Jobs are read one per line as JSON objects, e.g.
+ *
+ *   {"id": "thumb-1", "scene": "assets/cornell.txt", "output": "out.png",
+ *    "width": 128, "height": 128, "samplesPerPixel": 1, "samplesPerLight": 4,
+ *    "seed": 1, "camera": {"eye": [0,0,5], "viewDir": [0,0,-1],
+ *    "up": [0,1,0], "fov": 45}}
+ *
+ * Everything except "scene" and "output" is optional and defaults to the
+ * values given in the scene file. One line of JSON is written back per job;
+ * besides the timings it holds the rays traced and intersection tests done
+ * by that job alone, even while other jobs are rendering.
+ */
+class RenderDaemon
+{
+	protected:
+		SceneCache cache;
+		JobQueue queue;
+		std::vector<std::thread> workers;
+		int threadsPerJob;
+
+		void work();
+		std::string render(const JsonValue& request);
+
+	public:
+		// Creates a server running up to "jobs" renders concurrently and
+		// keeping up to "cachedScenes" scenes loaded
+		RenderDaemon(int jobs, size_t queueCapacity, size_t cachedScenes = 8);
+		~RenderDaemon();
+
+		// Reads jobs from stdin, writing responses to stdout, until EOF
+		void serveStream(std::istream& in, std::ostream& out);
+
+		// Accepts connections on the given Unix domain socket; each
+		// connection may submit any number of jobs. Does not return
+		void serveSocket(const std::string& path);
+
+		// Waits for all queued jobs to finish and stops the workers
+		void shutdown();
+};
+
+/******************************************************************************/
+
+#endif
@@ -0,0 +1,235 @@
+/*******************************************************************************
+ *
+ * This file defines a light that illuminates the scene with its environment
+ * map (image based lighting)
+ *
+ * @file EnvironmentLight.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include "EnvironmentLight.h"
+#include "SurfaceMap.h"
+#include "Utils.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+const float EnvironmentLight::DISTANCE = 1.0e6f;
+
+/******************************************************************************/
+
+/**
+ * Inverse of SurfaceMap::mapToSphere: the unit direction at (u,v)
+ */
+static inline vec3 directionAt(float u, float v)
+{
+	float phi   = 2.0f * static_cast<float>(M_PI) * (u - 0.5f);
+	float theta = static_cast<float>(M_PI) * v;
+	float s     = sinf(theta);
+
+	return vec3(s * cosf(phi), cosf(theta), s * sinf(phi));
+}
+
+/**
+ * Finds the interval of cdf (an increasing array of n + 1 values from 0 to 1)
+ * that u falls in, returning its index; u is then remapped to [0,1) within
+ * the interval. Empty intervals are never returned
+ */
+static inline int sampleCDF(const float* cdf, int n, float& u)
+{
+	int i = static_cast<int>(std::upper_bound(cdf, cdf + n + 1, u) - cdf) - 1;
+	i     = std::min(std::max(i, 0), n - 1);
+
+	float width = cdf[i + 1] - cdf[i];
+	u           = width > 0.0f ? std::min((u - cdf[i]) / width, 0.99999994f) : 0.5f;
+
+	return i;
+}
+
+/******************************************************************************/
+
+EnvironmentLight::EnvironmentLight(shared_ptr<EnvironmentMap> _envMap, float _intensity) :
+	Light(ENVIRONMENT_LIGHT),
+	envMap(_envMap),
+	intensity(_intensity)
+{
+	this->buildCDFs();
+}
+
+EnvironmentLight::EnvironmentLight(const EnvironmentLight& other) :
+	Light(ENVIRONMENT_LIGHT),
+	envMap(other.envMap),
+	intensity(other.intensity),
+	rowCDF(other.rowCDF),
+	colCDF(other.colCDF),
+	average(other.average),
+	dominant(other.dominant)
+{
+
+}
+
+/**
+ * Each cell is weighted by the luminance at its center times the solid angle
+ * it covers, which shrinks towards the poles with sin(theta). A small floor
+ * keeps every direction possible, as the cells' centers may miss details
+ */
+void EnvironmentLight::buildCDFs()
+{
+	const int W = GRID_WIDTH;
+	const int H = GRID_HEIGHT;
+
+	vector<float> weights(W * H);
+	vector<float> sines(H);
+	vec3 total;
+	vec3 towards;
+	float area = 0.0f;
+	float sum  = 0.0f;
+
+	for (int j=0; j<H; j++) {
+
+		float v  = (static_cast<float>(j) + 0.5f) / static_cast<float>(H);
+		sines[j] = sinf(static_cast<float>(M_PI) * v);
+
+		for (int i=0; i<W; i++) {
+
+			float u = (static_cast<float>(i) + 0.5f) / static_cast<float>(W);
+			vec3 d  = directionAt(u, v);
+			Color c = this->envMap->getColor(d);
+			float Y = c.luminosity();
+
+			weights[(j * W) + i] = Y;
+			total   += vec3(c.fR(), c.fG(), c.fB()) * sines[j];
+			towards += d * (Y * sines[j]);
+			area    += sines[j];
+			sum     += Y * sines[j];
+		}
+	}
+
+	this->average  = total / area;
+	this->dominant = length(towards) > 0.0f ? normalize(towards) : vec3(0.0f, 1.0f, 0.0f);
+
+	// A black environment is sampled uniformly over the sphere:
+	float minimum = sum > 0.0f ? 0.01f * (sum / area) : 1.0f;
+
+	this->rowCDF.assign(H + 1, 0.0f);
+	this->colCDF.assign(H * (W + 1), 0.0f);
+
+	for (int j=0; j<H; j++) {
+
+		float* cdf = &this->colCDF[j * (W + 1)];
+
+		for (int i=0; i<W; i++) {
+			cdf[i + 1] = cdf[i] + ((weights[(j * W) + i] + minimum) * sines[j]);
+		}
+
+		float row = cdf[W];
+
+		for (int i=1; i<=W; i++) {
+			cdf[i] /= row;
+		}
+
+		this->rowCDF[j + 1] = this->rowCDF[j] + row;
+	}
+
+	float rows = this->rowCDF[H];
+
+	for (int j=1; j<=H; j++) {
+		this->rowCDF[j] /= rows;
+	}
+}
+
+void EnvironmentLight::repr(ostream& s) const
+{
+	s << "EnvironmentLight { intensity: " << this->intensity << " }";
+}
+
+vec3 EnvironmentLight::getRadiance(const vec3& d) const
+{
+	Color c = this->envMap->getColor(d);
+	return vec3(c.fR(), c.fG(), c.fB()) * this->intensity;
+}
+
+vec3 EnvironmentLight::sample(float u1, float u2, vec3& d, float& pdf) const
+{
+	const int W = GRID_WIDTH;
+	const int H = GRID_HEIGHT;
+
+	int j = sampleCDF(this->rowCDF.data(), H, u2);
+	int i = sampleCDF(&this->colCDF[j * (W + 1)], W, u1);
+
+	float u = (static_cast<float>(i) + u1) / static_cast<float>(W);
+	float v = (static_cast<float>(j) + u2) / static_cast<float>(H);
+
+	d = directionAt(u, v);
+
+	// Cells are sampled uniformly in (u,v); a cell at polar angle theta
+	// covers 2 * pi^2 * sin(theta) / (W * H) steradians:
+	float s = sinf(static_cast<float>(M_PI) * v);
+	pdf     = s > 0.0f
+	        ? (this->cellProbability(i, j) * W * H) / (2.0f * static_cast<float>(M_PI * M_PI) * s)
+	        : 0.0f;
+
+	return this->getRadiance(d);
+}
+
+float EnvironmentLight::pdf(const vec3& d) const
+{
+	const int W = GRID_WIDTH;
+	const int H = GRID_HEIGHT;
+
+	vec2 uv = SurfaceMap::mapToSphere(d);
+	int i   = std::min(static_cast<int>(uv[0] * W), W - 1);
+	int j   = std::min(static_cast<int>(uv[1] * H), H - 1);
+	float s = sqrtf(std::max(0.0f, 1.0f - (d.y * d.y)));
+
+	return s > 0.0f
+	     ? (this->cellProbability(i, j) * W * H) / (2.0f * static_cast<float>(M_PI * M_PI) * s)
+	     : 0.0f;
+}
+
+vec3 EnvironmentLight::fromCenter(const vec3& from) const
+{
+	return this->dominant * DISTANCE;
+}
+
+vec3 EnvironmentLight::fromSampledPoint(const vec3& from) const
+{
+	vec3 d;
+	float pdf = 0.0f;
+
+	this->sample(Utils::unitRand(), Utils::unitRand(), d, pdf);
+
+	return d * DISTANCE;
+}
+
+vec3 EnvironmentLight::fromSampledPoint(const vec3& from, float& weight) const
+{
+	// Directions are already picked in proportion to how much light comes
+	// from them, so every sample weighs the same:
+	weight = 1.0f;
+	return this->fromSampledPoint(from);
+}
+
+Color EnvironmentLight::getColor(const vec3& from) const
+{
+	vec3 c = this->average * this->intensity;
+	return Color(c.r, c.g, c.b);
+}
+
+bool EnvironmentLight::isLightSourceNode(shared_ptr<GraphNode> testNode) const
+{
+	// No node is involved with the environment:
+	return false;
+}
+
+/******************************************************************************/
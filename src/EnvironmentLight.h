@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *
+ * This file defines a light that illuminates the scene with its environment
+ * map (image based lighting). The map is importance sampled: directions are
+ * drawn in proportion to the brightness of the environment in them, using
+ * marginal and conditional CDFs built over a latitude-longitude grid when
+ * the light is created
+ *
+ * @file EnvironmentLight.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef ENVIRONMENT_LIGHT_H
+#define ENVIRONMENT_LIGHT_H
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "Light.h"
+#include "Color.h"
+#include "EnvironmentMap.h"
+
+/******************************************************************************/
+
+class EnvironmentLight : public Light
+{
+	public:
+		// Size of the grid the environment is sampled over. Rows run from
+		// +Y to -Y, columns around the Y axis, as in SurfaceMap::mapToSphere
+		static const int GRID_WIDTH  = 512;
+		static const int GRID_HEIGHT = 256;
+
+		// Distance at which directions to the environment are given by
+		// fromCenter() and fromSampledPoint(); past every object in the scene
+		static const float DISTANCE;
+
+	protected:
+		std::shared_ptr<EnvironmentMap> envMap;
+
+		// Scale applied to the colors of the map
+		float intensity;
+
+		// rowCDF[j] is the probability of picking a row before row j. Each
+		// row of colCDF (GRID_WIDTH + 1 entries) is the same for the columns
+		// of that row, given the row was picked
+		std::vector<float> rowCDF;
+		std::vector<float> colCDF;
+
+		// Mean of the environment's colors over the sphere, and the
+		// direction its light comes from on average
+		glm::vec3 average;
+		glm::vec3 dominant;
+
+		void buildCDFs();
+
+		// Probability of picking grid cell (i,j)
+		inline float cellProbability(int i, int j) const
+		{
+			const float* cdf = &this->colCDF[j * (GRID_WIDTH + 1)];
+			return (this->rowCDF[j + 1] - this->rowCDF[j]) * (cdf[i + 1] - cdf[i]);
+		}
+
+	public:
+		EnvironmentLight(std::shared_ptr<EnvironmentMap> envMap, float intensity = 1.0f);
+		EnvironmentLight(const EnvironmentLight& other);
+
+		virtual void repr(std::ostream& s) const;
+
+		float getIntensity() const { return this->intensity; }
+
+		// RGB of the light arriving from the unit direction d. Unlike a 
+		// Color, it is not clamped to [0,1]
+		glm::vec3 getRadiance(const glm::vec3& d) const;
+
+		/**
+		 * Given two uniform random numbers in [0,1], picks a unit direction
+		 * d, returning the light arriving from it; pdf is set to the
+		 * probability density of d, per steradian
+		 */
+		glm::vec3 sample(float u1, float u2, glm::vec3& d, float& pdf) const;
+
+		// Probability density, per steradian, of sample() picking d
+		float pdf(const glm::vec3& d) const;
+
+		virtual glm::vec3 fromCenter(const glm::vec3& from) const;
+
+		virtual glm::vec3 fromSampledPoint(const glm::vec3& from) const;
+		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& weight) const;
+
+		virtual Color getColor(const glm::vec3& from) const;
+
+		virtual bool isLightSourceNode(std::shared_ptr<GraphNode> testNode) const;
+};
+
+/******************************************************************************/
+
+#endif
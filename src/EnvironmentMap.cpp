@@ -20,17 +20,18 @@ using namespace std;
  * Abstract environment map type
  ******************************************************************************/
 
-EnvironmentMap::EnvironmentMap(const std::string& mapType, float radius)
+EnvironmentMap::EnvironmentMap(const std::string& mapType)
 {
 	this->mapType = this->stringToType(mapType);
-	this->T       = glm::scale(glm::mat4(), glm::vec3(radius));
 }
 
 EnvironmentMap::EnvironmentMap(const EnvironmentMap& other) :
-	mapType(other.mapType),
-	T(other.T),
-	sphere(other.sphere),
-	cube(other.cube)
+	mapType(other.mapType)
+{
+
+}
+
+EnvironmentMap::~EnvironmentMap()
 {
 
 }
@@ -62,59 +63,29 @@ EnvironmentMap::MappingType EnvironmentMap::stringToType(const std::string& name
 	return mapType;
 }
 
-Color EnvironmentMap::getColor(const Ray& ray, shared_ptr<SceneContext> scene) const
+/**
+ * Maps the direction straight to UV: an infinitely distant sphere or cube
+ * is hit at the same point from anywhere in the scene
+ */
+Color EnvironmentMap::getColor(const glm::vec3& d) const
 {
-	Intersection isect;
-
 	switch (this->mapType) {
+		case WILD1:
+			return Color(fabs(d.x), fabs(d.y), fabs(d.z));
+		case WILD2:
+			return Color(max(0.0f, d.x), max(0.0f, d.y), max(0.0f, d.z));
 		case SPHERE:
 			{
-				isect = this->sphere.intersect(this->T, ray, scene);
+				glm::vec2 uv = SurfaceMap::mapToSphere(d);
+				return this->getColor(uv[0], uv[1]);
 			}
-			break;
 		case CUBE:
 		default:
 			{
-				isect = this->cube.intersect(this->T, ray, scene);
+				glm::vec2 uv = SurfaceMap::mapToCube(d);
+				return this->getColor(uv[0], uv[1]);
 			}
-			break;
-	}
-
-	if (isect.isHit()) {
-
-		glm::vec3 hit = glm::normalize(ray.project(isect.t));
-		Color out;
-
-		switch (this->mapType) {
-			case WILD1:
-				{
-					out = Color(fabs(hit.x), fabs(hit.y), fabs(hit.z));
-				}
-				break;
-			case WILD2:
-				{
-					out = Color(max(0.0f, hit.x), max(0.0f, hit.y), max(0.0f, hit.z));
-				}
-				break;
-			case SPHERE:
-				{
-					glm::vec2 uv = SurfaceMap::mapToSphere(hit);
-					out          = this->getColor(uv[0], uv[1]);
-				}
-				break;
-			case CUBE:
-			default:
-				{
-					glm::vec2 uv = SurfaceMap::mapToCube(hit);
-					out          = this->getColor(uv[0], uv[1]);
-				}
-				break;
-		}
-
-		return out;
 	}
-
-	return Color::BLACK;
 }
 
 /*******************************************************************************
@@ -133,6 +104,11 @@ Color ColorEnvironmentMap::getColor(float u, float v) const
 	return this->color;
 }
 
+Color ColorEnvironmentMap::getColor(const glm::vec3& d) const
+{
+	return this->color;
+}
+
 /*******************************************************************************
  * Texture environment map type
  ******************************************************************************/
@@ -140,23 +116,46 @@ Color ColorEnvironmentMap::getColor(float u, float v) const
 TextureEnvironmentMap::TextureEnvironmentMap(const std::string& filename
 	                                        ,const std::string& mapType) :
 	EnvironmentMap(mapType),
-	TextureMap(filename)
+	SurfaceMap(filename, TEXTURE_MAP)
+{
+	// Unlike other maps, decoded as soon as the scene is read:
+	this->ensureLoaded();
+}
+
+TextureEnvironmentMap::~TextureEnvironmentMap()
 {
 
 }
 
-TextureEnvironmentMap::TextureEnvironmentMap(const std::string& filename
-	                                        ,const std::string& mapType
-							                ,float radius) :
-	EnvironmentMap(mapType, radius),
-	TextureMap(filename)
+void TextureEnvironmentMap::build(const Image& image) const
 {
+	this->texels.resize(static_cast<size_t>(this->iWidth) * this->iHeight);
 
+	for (int y=0; y<this->iHeight; y++) {
+		for (int x=0; x<this->iWidth; x++) {
+			ImagePixel p = pixel(image, x, y);
+			this->texels[(y * this->iWidth) + x] = glm::vec3(RED(p), GREEN(p), BLUE(p)) / 255.0f;
+		}
+	}
 }
 
+/**
+ * Bilinearly filtered, as TextureMap::getColor(u, v)
+ */
 Color TextureEnvironmentMap::getColor(float u, float v) const
 {
-	return TextureMap::getColor(u, v);
+	glm::vec2 P1, P2, P3, P4;
+	glm::vec4 W = this->getBilinearWeights(u, v, P1, P2, P3, P4);
+
+	const glm::vec3* t = this->texels.data();
+	int w              = this->iWidth;
+
+	glm::vec3 c = (W[0] * t[(static_cast<int>(P1.y) * w) + static_cast<int>(P1.x)])
+	            + (W[1] * t[(static_cast<int>(P2.y) * w) + static_cast<int>(P2.x)])
+	            + (W[2] * t[(static_cast<int>(P3.y) * w) + static_cast<int>(P3.x)])
+	            + (W[3] * t[(static_cast<int>(P4.y) * w) + static_cast<int>(P4.x)]);
+
+	return Color(c.r, c.g, c.b);
 }
 
 /******************************************************************************/
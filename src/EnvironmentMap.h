@@ -1,6 +1,7 @@
 /*******************************************************************************
  *
- * A simple spherical environment map model
+ * A simple spherical environment map model. The environment is infinitely
+ * distant, so it is looked up by the direction of a ray alone
  *
  * @file EnvironmentMap.h
  * @author Michael Woods
@@ -10,18 +11,13 @@
 #ifndef ENVIRONMENT_MAP_H
 #define ENVIRONMENT_MAP_H
 
-#include <memory>
+#include <vector>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
-#include "Sphere.h"
-#include "Cube.h"
 #include "Color.h"
+#include "Ray.h"
 #include "SurfaceMap.h"
 
-/******************************************************************************/
-
-class SceneContext;
-
 /*******************************************************************************
  * Abstract environment map type
  ******************************************************************************/
@@ -39,20 +35,23 @@ class EnvironmentMap
 
 	protected:
 		MappingType mapType;
-		glm::mat4 T;
-		Sphere sphere;
-		Cube cube;
 
 		MappingType stringToType(const std::string& name) const;
 
 	public:
-		EnvironmentMap(const std::string& mapType, float radius = 1.0e3f);
+		EnvironmentMap(const std::string& mapType);
 		EnvironmentMap(const EnvironmentMap& other);
+		virtual ~EnvironmentMap();
 
 		MappingType getMappingType() const { return this->mapType; }
 
 		virtual Color getColor(float u, float v) const = 0;
-		Color getColor(const Ray& ray, std::shared_ptr<SceneContext> scene) const;
+
+		// Get the color seen in the unit direction d
+		virtual Color getColor(const glm::vec3& d) const;
+
+		// Get the color seen by a ray that escapes the scene
+		Color getColor(const Ray& ray) const { return this->getColor(glm::normalize(ray.dir)); }
 };
 
 /*******************************************************************************
@@ -68,6 +67,7 @@ class ColorEnvironmentMap : public EnvironmentMap
 		ColorEnvironmentMap(const Color& color);
 
 		virtual Color getColor(float u, float v) const;
+		virtual Color getColor(const glm::vec3& d) const;
 
 		const Color& getColor() const { return this->color; }
 };
@@ -76,11 +76,19 @@ class ColorEnvironmentMap : public EnvironmentMap
  * Texture environment map type
  ******************************************************************************/
 
-class TextureEnvironmentMap : public EnvironmentMap, public TextureMap
+class TextureEnvironmentMap : public EnvironmentMap, public SurfaceMap
 {
+	protected:
+		// Texels as RGB in [0,1], row by row. Every ray that leaves the 
+		// scene reads them, so they are built when the map is created and
+		// kept for its lifetime rather than held in the TextureCache
+		mutable std::vector<glm::vec3> texels;
+
+		virtual void build(const Image& image) const;
+
 	public:
 		TextureEnvironmentMap(const std::string& filename, const std::string& mapType);
-		TextureEnvironmentMap(const std::string& filename, const std::string& mapType, float radius);
+		virtual ~TextureEnvironmentMap();
 
 		virtual Color getColor(float u, float v) const;
 };
@@ -23,7 +23,8 @@ GLGeometry::GLGeometry(shared_ptr<Geometry> _geometry) :
 	geometry(_geometry),
 	color(Color::WHITE),
     vao(0),
-    vbo(0), vboIndex(0), 
+    vbo(0), vboNormal(0), vboIndex(0), 
+	locationCol(-1),
 	drawMode(GL_TRIANGLES),
 	polyMode(GL_FILL)
 { 
@@ -34,7 +35,8 @@ GLGeometry::GLGeometry(shared_ptr<Geometry> _geometry, const Color& _color) :
 	geometry(_geometry),
 	color(_color),
 	vao(0),
-    vbo(0), vboIndex(0), 
+    vbo(0), vboNormal(0), vboIndex(0), 
+	locationCol(-1),
 	drawMode(GL_TRIANGLES),
 	polyMode(GL_FILL)
 { 
@@ -45,7 +47,8 @@ GLGeometry::GLGeometry(const GLGeometry& other) :
 	geometry(other.geometry),
 	color(other.color),
 	vao(other.vao),
-    vbo(other.vbo), vboIndex(other.vboIndex),  
+    vbo(other.vbo), vboNormal(other.vboNormal), vboIndex(other.vboIndex),  
+	locationCol(other.locationCol),
 	drawMode(other.drawMode),
 	polyMode(other.polyMode)
 { 
@@ -55,6 +58,7 @@ GLGeometry::GLGeometry(const GLGeometry& other) :
 GLGeometry::~GLGeometry() 
 {
 	glDeleteBuffers(1, &this->vbo);
+	glDeleteBuffers(1, &this->vboNormal);
 	glDeleteBuffers(1, &this->vboIndex);
 
 	glDeleteVertexArrays(1, &this->vao);
@@ -65,21 +69,17 @@ void GLGeometry::upload(GLuint shaderProgram
 					   ,GLint locationNor
 					   ,GLint locationCol)
 {
-	vector<glm::vec3> positions  = this->geometry->getVertices();
-	vector<glm::vec3> normals    = this->geometry->getNormals();
-	vector<glm::vec3> colors     = this->geometry->getColors(this->color);
-	vector<unsigned int> indices = this->geometry->getIndices();
-	size_t is                    = sizeof(unsigned int);
-	unsigned int ic              = this->geometry->getIndexCount();
+	this->geometry->ensureGeometry();
 
-	////////////////////////////////////////////////////////////////////////////
+	const vector<glm::vec3>& positions     = this->geometry->getVertices();
+	const vector<glm::vec3>& normals       = this->geometry->getNormals();
+	const vector<glm::uint16>& halfNormals = this->geometry->getHalfNormals();
+	const vector<unsigned int>& indices    = this->geometry->getIndices();
 
-	vector<VBOUnit> units;
-	size_t n = positions.size();
+	this->locationCol = locationCol;
 
-	for (unsigned int i=0; i<n; i++) {
-		VBOUnit unit = { positions[i], normals[i], colors[i] };
-		units.push_back(unit);
+	if (positions.empty() || indices.empty()) {
+		return;
 	}
 
 	////////////////////////////////////////////////////////////////////////////
@@ -90,26 +90,33 @@ void GLGeometry::upload(GLuint shaderProgram
 	glGenVertexArrays(1, &this->vao);
     glBindVertexArray(this->vao);
 
-    // VBO unit: position + normal + color
+	// - Position:
 	glGenBuffers(1, &this->vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VBOUnit) * units.size(), &units[0], GL_STATIC_DRAW);
-
-	// Set up the attributes packed into VBOUnit
-	// - Position:
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), positions.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(locationPos);
-    glVertexAttribPointer(locationPos, 3, GL_FLOAT, false, sizeof(VBOUnit), 0);
-	// - Normals:
+    glVertexAttribPointer(locationPos, 3, GL_FLOAT, false, 0, 0);
+
+	// - Normals, in whichever precision the geometry keeps them:
+	glGenBuffers(1, &this->vboNormal);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vboNormal);
     glEnableVertexAttribArray(locationNor);
-    glVertexAttribPointer(locationNor, 3, GL_FLOAT, false, sizeof(VBOUnit), (void*)(1 * sizeof(glm::vec3)));
-	// - Colors:
-    glEnableVertexAttribArray(locationCol);
-    glVertexAttribPointer(locationCol, 3, GL_FLOAT, false, sizeof(VBOUnit), (void*)(2 * sizeof(glm::vec3)));
+
+	if (halfNormals.empty()) {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(locationNor, 3, GL_FLOAT, false, 0, 0);
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::uint16) * halfNormals.size(), halfNormals.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(locationNor, 3, GL_HALF_FLOAT, false, 0, 0);
+	}
+
+	// - Colors: constant, see draw()
+    glDisableVertexAttribArray(locationCol);
 
 	// Indices:
 	glGenBuffers(1, &this->vboIndex);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->vboIndex);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ic * is, &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
 }
@@ -127,6 +134,13 @@ void GLGeometry::draw(const GLWorldState& state
     const glm::mat4 modelInvTranspose = glm::inverse(glm::transpose(affine));
     glUniformMatrix4fv(unifModelInvT, 1, GL_FALSE, &modelInvTranspose[0][0]);
 
+	if (this->vao == 0) {
+		return;
+	}
+
+	// A constant attribute isn't part of the VAO's state:
+	glVertexAttrib3f(this->locationCol, this->color.fR(), this->color.fG(), this->color.fB());
+
 	glBindVertexArray(this->vao);
 	glPolygonMode(GL_FRONT_AND_BACK, this->getPolyMode());
     glDrawElements(this->getDrawMode(), this->geometry->getIndexCount(), GL_UNSIGNED_INT, 0);
@@ -21,16 +21,6 @@ class GLWorldState;
 
 /******************************************************************************/
 
-// Used to pack data into a VBO:
-
-typedef struct VBOUnit {
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec3 color;
-} VBOUnit; 
-
-/******************************************************************************/
-
 class GLGeometry
 {
 	protected:
@@ -40,7 +30,12 @@ class GLGeometry
 		// GL object instance color
 		Color color;
 
-		GLuint vao, vbo, vboIndex;
+		// Positions and normals are uploaded straight from the geometry's
+		// arrays, in buffers of their own, so nothing is copied to build
+		// them. The color is the same for every vertex, so it is set as a
+		// constant attribute when drawing
+		GLuint vao, vbo, vboNormal, vboIndex;
+		GLint locationCol;
 
 		// Determines which drawing mode will be passed to glDrawElements()
 		// when the geometry contained in this instance is rendered
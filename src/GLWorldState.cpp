@@ -13,6 +13,7 @@
 #include <memory>
 #include <cmath>
 #include "GLWorldState.h"
+#include "GLGeometry.h"
 
 /******************************************************************************/
 
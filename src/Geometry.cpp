@@ -12,6 +12,8 @@
 #include <sstream>
 #include "Geometry.h"
 #include "Graph.h"
+#include "Stats.h"
+#include "SurfaceMap.h"
 #include "Utils.h"
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -45,6 +47,13 @@ Geometry::~Geometry()
     indices_.clear();
 }
 
+void Geometry::ensureGeometry()
+{
+	if (this->vertices_.empty()) {
+		this->buildGeometry();
+	}
+}
+
 /**
  * Generates vec3 color instances for every vertex  based on the supplied 
  * Color instance
@@ -55,72 +64,200 @@ vector<vec3> Geometry::getColors(const Color& color) const
 							,vec3(color.fR(), color.fG(), color.fB()));
 }
 
-Intersection Geometry::intersect(const mat4 &T
-                                ,const Ray& rayWorld
-                                ,shared_ptr<SceneContext> scene) const
+/**
+ * Uses the same projection as Material picks for the object's type
+ */
+void Geometry::frameImpl(const Hit& hit, Intersection& isect, vec3& dpdu, vec3& dpdv) const
 {
-	Ray rayNormal = Ray(rayWorld.orig, normalize(rayWorld.dir));
-	mat4 invT     = inverse(T);
+	vec3 d = normalize(isect.hitLocal);
 
-    // Transform the ray into OBJECT-LOCAL-space, for intersection calculation.
+	if (this->type == CUBE || this->type == VOLUME) {
+		SurfaceMap::cubeFrame(d, isect.tangent, isect.bitangent);
+	} else {
+		SurfaceMap::sphereFrame(d, isect.tangent, isect.bitangent);
+	}
+}
+
+/**
+ * Transforms a WORLD-space ray into OBJECT-LOCAL-space
+ */
+static Ray toLocal(const mat4& invT, const Ray& rayWorld)
+{
 	// (Remember that position = vec4(vec3, 1) while direction = vec4(vec3, 0).)
-	Ray rayLocal(transform(invT, vec4(rayNormal.orig, 1.0f))
-		        ,transform(invT, vec4(rayNormal.dir, 0.0f)));
+	Ray rayLocal(transform(invT, vec4(rayWorld.orig, 1.0f))
+		        ,transform(invT, vec4(normalize(rayWorld.dir), 0.0f)));
+
+	// The direction isn't re-normalized, so distances carry over unchanged:
+	rayLocal.tMin = rayWorld.tMin;
+	rayLocal.tMax = rayWorld.tMax;
+
+	return rayLocal;
+}
+
+Hit Geometry::hit(const mat4& invT, const Ray& rayWorld) const
+{
+    // Transform the ray into OBJECT-LOCAL-space, for intersection calculation.
+	return this->hitLocal(toLocal(invT, rayWorld));
+}
+
+Hit Geometry::hitLocal(const Ray& rayLocal) const
+{
+	Stats::add(static_cast<Stats::Counter>(Stats::TESTS_CUBE + this->type));
 
 	// Test the bounding volume first:
 	if (!this->getVolume().intersects(rayLocal)) {
-		return Intersection::miss();
+		return Hit::miss();
 	}
 
-    // Compute the intersection in LOCAL-space.
-    Intersection isect = this->intersectImpl(rayLocal, scene);
-
-    if (isect.isHit()) {
-
-        // Transform the local-space intersection BACK into world-space.
-        // (Note that, as long as you didn't re-normalize the ray direction
-        // earlier, `t` doesn't need to change.)
-        const vec3 normalLocal = isect.normal;
-
-        // Inverse-transpose-transform the normal to get it back from 
-		// local-space to world-space. (If you were transforming a position, 
-		// you would just use the unmodified transform T.)
-		//
-        // http://www.arcsynthesis.org/gltut/Illumination/Tut09%20Normal%20Transformation.html
-        isect.normal = normalize(transform(transpose(invT), vec4(normalLocal, 0.0f)));
-
-		// Compute the hit position in world space:
-		isect.hitWorld = rayNormal.project(isect.t);
-
-		// Compute the hit position in local space:
-		isect.hitLocal = transform(invT, vec4(isect.hitWorld, 1.0f));
-
-		// Make sure the intersection surface normal always points toward (
-        // not away from) the incident ray's origin. Note: this should only
-        // be done for instances in which the correctNormal flag on the
-        // on the Intersection object is true
-		if (dot(isect.normal, rayWorld.dir) > 0.0f) {
-            
-            if (isect.correctNormal || !rayWorld.isPrimaryRay()) {
-                isect.normal = -isect.normal;
+    // As long as the ray direction isn't re-normalized after transforming it,
+    // `t` is the same in both spaces
+    Hit hit = this->hitImpl(rayLocal);
+
+    // Implementations may not check tMax themselves:
+    return hit.t <= rayLocal.tMax ? hit : Hit::miss();
+}
+
+Intersection Geometry::surface(const mat4& T, const mat4& invT, const Ray& rayWorld, const Hit& hit) const
+{
+    if (hit.isMiss()) {
+        return Intersection::miss();
+    }
+
+	Ray rayNormal = Ray(rayWorld.orig, normalize(rayWorld.dir));
+	Ray rayLocal  = toLocal(invT, rayWorld);
+
+    Intersection isect(hit.t, this->normalImpl(rayLocal, hit));
+
+    isect.correctNormal = this->correctsNormal();
+
+    // Inverse-transpose-transform the normal to get it back from 
+	// local-space to world-space. (If you were transforming a position, 
+	// you would just use the unmodified transform T.)
+	//
+    // http://www.arcsynthesis.org/gltut/Illumination/Tut09%20Normal%20Transformation.html
+    isect.normal = normalize(transform(transpose(invT), vec4(isect.normal, 0.0f)));
+
+	// Compute the hit position in world space:
+	isect.hitWorld = rayNormal.project(isect.t);
+
+	// Compute the hit position in local space:
+	isect.hitLocal = transform(invT, vec4(isect.hitWorld, 1.0f));
+
+	// Make sure the intersection surface normal always points toward (
+    // not away from) the incident ray's origin. Note: this should only
+    // be done for instances in which the correctNormal flag on the
+    // on the Intersection object is true
+	if (dot(isect.normal, rayWorld.dir) > 0.0f) {
+        
+        if (isect.correctNormal || !rayWorld.isPrimaryRay()) {
+            isect.normal = -isect.normal;
+        }
+		
+        isect.inside = true;
+	}
+
+    #ifdef DEBUG
+	assert(abs(length(isect.normal) - 1.0f) <= 1.0e-6f);
+    #endif
+
+    // Find where the ray differentials cross the plane tangent to the hit,
+    // which approximates the area of the surface seen by a single sample:
+    if (rayWorld.hasDifferentials) {
+
+        float d   = dot(isect.normal, isect.hitWorld);
+        float dnx = dot(isect.normal, rayWorld.rxDir);
+        float dny = dot(isect.normal, rayWorld.ryDir);
+
+        // A differential parallel to the plane never crosses it; it is
+        // taken as zero, so the footprint along the other one still counts:
+        if (dnx != 0.0f || dny != 0.0f) {
+
+            if (dnx != 0.0f) {
+                float tx   = (d - dot(isect.normal, rayWorld.rxOrig)) / dnx;
+                isect.dpdx = (rayWorld.rxOrig + (tx * rayWorld.rxDir)) - isect.hitWorld;
+            } else {
+                isect.dpdx = vec3();
             }
-			
-            isect.inside = true;
-		}
 
-        #ifdef DEBUG
-		assert(abs(length(isect.normal) - 1.0f) <= 1.0e-6f);
-        #endif
+            if (dny != 0.0f) {
+                float ty   = (d - dot(isect.normal, rayWorld.ryOrig)) / dny;
+                isect.dpdy = (rayWorld.ryOrig + (ty * rayWorld.ryDir)) - isect.hitWorld;
+            } else {
+                isect.dpdy = vec3();
+            }
+
+            isect.dLocaldx         = transform(invT, vec4(isect.dpdx, 0.0f));
+            isect.dLocaldy         = transform(invT, vec4(isect.dpdy, 0.0f));
+            isect.hasDifferentials = true;
+        }
+    }
+
+    vec3 dpdu, dpdv;
+    this->frameImpl(hit, isect, dpdu, dpdv);
+
+    isect.tangent   = transform(T, vec4(isect.tangent, 0.0f));
+    isect.bitangent = transform(T, vec4(isect.bitangent, 0.0f));
+
+    // Find the changes in (u,v) that best account for the differential 
+    // offsets, by least squares on dLocal = (du * dpdu) + (dv * dpdv):
+    if (isect.hasUV && isect.hasDifferentials) {
+
+        float a   = dot(dpdu, dpdu);
+        float b   = dot(dpdu, dpdv);
+        float c   = dot(dpdv, dpdv);
+        float det = (a * c) - (b * b);
+
+        if (det != 0.0f) {
+
+            vec3 dX = vec3(dot(dpdu, isect.dLocaldx), dot(dpdv, isect.dLocaldx), 0.0f);
+            vec3 dY = vec3(dot(dpdu, isect.dLocaldy), dot(dpdv, isect.dLocaldy), 0.0f);
+
+            isect.dUVdx = vec2((c * dX.x) - (b * dX.y), (a * dX.y) - (b * dX.x)) / det;
+            isect.dUVdy = vec2((c * dY.x) - (b * dY.y), (a * dY.y) - (b * dY.x)) / det;
+        }
     }
 
     // The final output intersection data is in WORLD-space.
     return isect;
 }
 
+Intersection Geometry::intersect(const mat4 &T
+                                ,const Ray& rayWorld
+                                ,shared_ptr<SceneContext> scene) const
+{
+	mat4 invT = inverse(T);
+
+    return this->surface(T, invT, rayWorld, this->hit(invT, rayWorld));
+}
+
 // Returns a sample point from the surface of the object in WORLD-space
 vec3 Geometry::sample(const mat4& T) const
 {
-	return transform(T, vec4(this->sampleImpl(), 1.0f));
+	vec3 N;
+
+	return transform(T, vec4(this->sampleImpl(N), 1.0f));
+}
+
+/**
+ * Points are picked uniformly over the OBJECT-LOCAL-space surface. T may not
+ * scale every part of it alike, so the density in WORLD-space is found from
+ * how much T scales the area at the point: the length of the normal carried
+ * by the cofactor matrix of T (Nanson's formula)
+ */
+vec3 Geometry::sample(const mat4& T, vec3& normal, float& pdf) const
+{
+	vec3 N;
+	vec3 P = this->sampleImpl(N);
+
+	mat3 M(T);
+	vec3 scaledN = abs(determinant(M)) * (transpose(inverse(M)) * N);
+	float scale  = length(scaledN);
+	float area   = this->areaImpl() * scale;
+
+	normal = scale > 0.0f ? scaledN / scale : vec3();
+	pdf    = area > 0.0f ? 1.0f / area : 0.0f;
+
+	return transform(T, vec4(P, 1.0f));
 }
 
 /******************************************************************************/
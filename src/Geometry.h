@@ -55,11 +55,19 @@ class Geometry
 		// OpenGL normal buffer data
 		std::vector<glm::vec3> normals_;
 
+		// The normals packed as three half floats each, kept instead of
+		// normals_ by geometry built to save memory
+		std::vector<glm::uint16> halfNormals_;
+
 		// OpenGl index buffer data
 		std::vector<unsigned int> indices_;
 
-		// Sample a point on the object's surface in OBJECT-LOCAL-space ray.
-		virtual glm::vec3 sampleImpl() const = 0;
+		// Samples a point on the object's surface in OBJECT-LOCAL-space,
+		// uniformly by area, also returning the surface normal there
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const = 0;
+
+		// Surface area of the object in OBJECT-LOCAL-space
+		virtual float areaImpl() const = 0;
 
 	public:
 		// Enums for the types of geometry that your scene graph is required to contain.
@@ -75,8 +83,30 @@ class Geometry
 		// Implemented in Sphere and Cylinder.
 		virtual void buildGeometry() = 0;
 
-		// Compute an intersection with an OBJECT-LOCAL-space ray.
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const = 0;
+		// Builds the vertex data the first time it is needed. Only the
+		// OpenGL preview draws it, so the analytic shapes leave it unbuilt
+		// until the preview asks for it
+		void ensureGeometry();
+
+		// Compute a compact hit with an OBJECT-LOCAL-space ray. Only what is
+		// needed to evaluate the surface later is recorded. Implementations 
+		// should use ray.tMax to skip work that can only find farther hits
+		virtual Hit hitImpl(const Ray &ray) const = 0;
+
+		// Compute the OBJECT-LOCAL-space surface normal at a hit returned by
+		// hitImpl() for the same ray
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const = 0;
+
+		// Fill in the OBJECT-LOCAL-space tangent and bitangent of the 
+		// intersection for a hit returned by hitImpl(), given its hitLocal.
+		// Surfaces with texture coordinates also set uv and hasUV, along 
+		// with dpdu and dpdv: the derivatives of position along u and v. 
+		// By default the frame of the projection that maps textures onto
+		// the object is used
+		virtual void frameImpl(const Hit& hit, Intersection& isect, glm::vec3& dpdu, glm::vec3& dpdv) const;
+
+		// If false, normals are not flipped to face the origin of primary rays
+		virtual bool correctsNormal() const { return true; }
 
 		// Return the bounding volume used to contain this geometric object
 		virtual const BoundingVolume& getVolume() const { return this->volume; }
@@ -94,6 +124,7 @@ class Geometry
 		// Getters
 		const std::vector<glm::vec3>& getVertices() const   { return this->vertices_; };
 		const std::vector<glm::vec3>& getNormals() const    { return this->normals_; };
+		const std::vector<glm::uint16>& getHalfNormals() const { return this->halfNormals_; };
 		const std::vector<unsigned int>& getIndices() const { return this->indices_; };
 		
 		unsigned int getVertexCount() const { return this->vertices_.size(); };
@@ -101,12 +132,37 @@ class Geometry
 		
 		Type getGeometryType() const { return this->type; };
 
+		// Compute a compact hit with a WORLD-space ray, given the inverse of 
+		// the object's transformation matrix. Hits beyond rayWorld.tMax, in 
+		// units of the normalized ray direction, are misses
+		Hit hit(const glm::mat4& invT, const Ray& rayWorld) const;
+
+		// Same as hit(), for a ray already in OBJECT-LOCAL-space. Its 
+		// direction must be the normalized WORLD-space direction carried 
+		// into local space, so distances are in WORLD-space units
+		Hit hitLocal(const Ray& rayLocal) const;
+
+		// Evaluates the full WORLD-space intersection for a hit returned by
+		// hit() for the same ray, given the object's transformation matrix
+		// and its inverse
+		Intersection surface(const glm::mat4& T, const glm::mat4& invT, const Ray& rayWorld, const Hit& hit) const;
+
 		// Compute an intersection with a WORLD-space ray.
 		Intersection intersect(const glm::mat4& T, const Ray& rayWorld, std::shared_ptr<SceneContext> scene) const;
 
+		// Gets the object ready to be sampled, before sample() is first
+		// called. Meshes build the table they pick triangles from here, so
+		// only those that act as lights pay for one
+		virtual void prepareSampling() { }
+
 		// Returns a sample point from the surface of the object in WORLD-space
 		glm::vec3 sample(const glm::mat4& T) const;
 
+		// Like sample(T), also returning the WORLD-space surface normal at
+		// the point, and the probability density of picking it per unit of
+		// WORLD-space area, or 0 if the surface has no area
+		glm::vec3 sample(const glm::mat4& T, glm::vec3& normal, float& pdf) const;
+
 		friend std::ostream& operator<<(std::ostream& s, const Geometry& geometry);
 };
 
@@ -15,9 +15,10 @@ using namespace glm;
 
 GraphNode::GraphNode(const string& _name) :
 	name(_name),
-	parent(nullptr),
+	parent(),
 	geometry(shared_ptr<Geometry>(nullptr)),
 	instance(nullptr),
+	copies(nullptr),
 	material(nullptr),
 	T(vec3(0.0f, 0.0f, 0.0f)),
 	R(vec3(0.0f, 0.0f, 0.0f)),
@@ -31,13 +32,14 @@ GraphNode::GraphNode(const GraphNode& other) :
 	parent(other.parent),
 	geometry(other.geometry),
 	instance(other.instance),
+	copies(other.copies),
 	material(other.material),
+	children(other.children),
 	T(other.T),
 	R(other.R),
 	S(other.S)
 {
-	// Copy the children list:
-	copy(other.children.begin(), other.children.end(), back_inserter(this->children));
+
 }
 
 GraphNode::~GraphNode() 
@@ -47,13 +49,22 @@ GraphNode::~GraphNode()
 
 void GraphNode::detachChild(shared_ptr<GraphNode> child)
 {
-	this->children.remove(child);
+	this->children.erase(remove(this->children.begin(), this->children.end(), child), this->children.end());
 }
 
 void GraphNode::detachFromParent()
 {
-	if (this->parent) {
-		this->parent->detachChild(shared_ptr<GraphNode>(this));
+	shared_ptr<GraphNode> parent = this->parent.lock();
+
+	if (parent) {
+
+		// The parent may hold the only reference to this node, so it is
+		// forgotten before the node is let go:
+		this->parent.reset();
+
+		parent->children.erase(remove_if(parent->children.begin(), parent->children.end(), [this](const shared_ptr<GraphNode>& child) {
+			return child.get() == this;
+		}), parent->children.end());
 	}
 }
 
@@ -141,8 +152,9 @@ static pair<LIGHTS*, mat4> collectAreaLight(std::shared_ptr<GraphNode> node, pai
 {
 	mat4 nextT = applyTransform(node, current.second);
 
-	// Found a node with an emissive material assigned to it:
-	if (node->getMaterial() && node->getMaterial()->isEmissive()) {
+	// Found a node with an emissive material assigned to it. Copies of 
+	// emissive geometry glow, but don't light the scene:
+	if (node->getMaterial() && node->getMaterial()->isEmissive() && !node->getCopies()) {
 
 		auto areaLights = current.first;
 		areaLights->push_back(make_shared<AreaLight>(node, nextT));
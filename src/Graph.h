@@ -19,34 +19,49 @@
 #include <stack>
 #include <queue>
 #include <memory>
+#include <vector>
 #include "Color.h"
 #include "Material.h"
 #include "Geometry.h"
-#include "GLGeometry.h"
+#include "InstanceSet.h"
 #include "Light.h"
 
 /******************************************************************************/
 
+// Only the OpenGL preview creates and draws these, so the renderer itself
+// never needs OpenGL:
+class GLGeometry;
+
+/******************************************************************************/
+
 class GraphNode
 {
 	protected:
 		// Node name
 		std::string name;
 
-		// Pointer to parent, if any. If null, node is the root of the graph
-		std::shared_ptr<GraphNode> parent;
+		// Pointer to parent, if any. If null, node is the root of the graph.
+		// Parents own their children, not the other way around, so a graph
+		// is freed with its root
+		std::weak_ptr<GraphNode> parent;
 
 		// The geometric object definition itself
 		std::shared_ptr<Geometry> geometry;
 
-		// GL wrapped instance of a geometric primitive
+		// GL wrapped instance of a geometric primitive, created when the
+		// preview opens; null when rendering without one
 		std::shared_ptr<GLGeometry> instance;
 
+		// If set, the geometry is placed at each of these copies' 
+		// transformations, relative to the node, rather than once
+		std::shared_ptr<InstanceSet> copies;
+
 		// Surface material
 		std::shared_ptr<Material> material;
 
-		// All child nodes of this node in the scene graph
-		std::list<std::shared_ptr<GraphNode>> children;
+		// All child nodes of this node in the scene graph, kept contiguous
+		// as graphs with millions of nodes are walked often
+		std::vector<std::shared_ptr<GraphNode>> children;
 
 		// <x,y,z> translation values
 		glm::vec3 T;
@@ -70,10 +85,10 @@ class GraphNode
 		const std::string& getName() const    { return this->name; }
 		void setName(const std::string& name) { this->name = name; }
 
-		std::shared_ptr<GraphNode> getParent() const      { return this->parent; }
+		std::shared_ptr<GraphNode> getParent() const      { return this->parent.lock(); }
 		void setParent(std::shared_ptr<GraphNode> parent) { this->parent = parent; }
 
-		const std::list<std::shared_ptr<GraphNode>>& getChildren() const { return this->children; }
+		const std::vector<std::shared_ptr<GraphNode>>& getChildren() const { return this->children; }
 		void addChild(std::shared_ptr<GraphNode> child)  { this->children.push_back(child); }
 
 		void detachChild(std::shared_ptr<GraphNode> child);
@@ -87,6 +102,9 @@ class GraphNode
 		std::shared_ptr<GLGeometry> getInstance() const        { return this->instance; }
 		void setInstance(std::shared_ptr<GLGeometry> instance) { this->instance = instance; }
 
+		std::shared_ptr<InstanceSet> getCopies() const      { return this->copies; }
+		void setCopies(std::shared_ptr<InstanceSet> copies) { this->copies = copies; }
+
 		const glm::vec3& getTranslate() const       { return this->T; }
 		void setTranslate(const glm::vec3& T)       { this->T = T; }
 		void translateBy(float x, float y, float z) { this->T = glm::vec3(x, y, z); }
@@ -267,10 +285,12 @@ class Graph
 						return nullptr;
 					}
 
-					std::list<std::shared_ptr<GraphNode>> children = this->st.top()->getChildren();
+					std::shared_ptr<GraphNode> top = this->st.top();
 					this->st.pop();
 
-					for (std::list<std::shared_ptr<GraphNode>>::reverse_iterator i=children.rbegin()
+					const std::vector<std::shared_ptr<GraphNode>>& children = top->getChildren();
+
+					for (auto i=children.rbegin()
 						; i != children.rend()
 						; i++)
 					{
@@ -320,7 +340,7 @@ void walk(std::shared_ptr<GraphNode> root // The graph root
 {
 	T next = visit(root, initial, depth);
 
-	auto children = root->getChildren();
+	const auto& children = root->getChildren();
 
 	for (auto i=children.begin(); i != children.end(); i++) {
 		walk(*i, visit, next, depth+1);
@@ -353,7 +373,7 @@ T fold(std::shared_ptr<GraphNode> root                         // The graph root
 	T next  = visit(root, initial);
 	T total = accum(next, initial);
 
-	auto children = root->getChildren();
+	const auto& children = root->getChildren();
 
 	for (auto i=children.begin(); i != children.end(); i++) {
 		total = accum(fold(*i, visit, accum, next), total);
@@ -377,7 +397,7 @@ void postWalk(std::shared_ptr<GraphNode> root
 	         ,void (*visit)(std::shared_ptr<GraphNode> node, T context)
 	         ,T context)
 {
-	auto children = root->getChildren();
+	const auto& children = root->getChildren();
 
 	for (auto i=children.begin(); i != children.end(); i++) {
 		postWalk(*i, visit, context);
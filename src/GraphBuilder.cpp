@@ -8,6 +8,7 @@
  *
  ******************************************************************************/
 
+#include <algorithm>
 #include <stdexcept>
 #include <iterator>
 #include "GraphBuilder.h"
@@ -25,9 +26,11 @@ GraphBuilder::GraphBuilder() :
 }
 
 GraphBuilder::GraphBuilder(const GraphBuilder& other) :
-    root(other.root)
+    root(other.root),
+    nodeMap(other.nodeMap),
+    pendingLinks(other.pendingLinks)
 {
-    this->nodeMap.insert(other.nodeMap.begin(), other.nodeMap.end());
+
 }
 
 GraphBuilder::~GraphBuilder()
@@ -41,6 +44,11 @@ GraphBuilder const * GraphBuilder::registerNode(shared_ptr<GraphNode> node)
     return this;
 }
 
+bool GraphBuilder::addNode(shared_ptr<GraphNode> node)
+{
+    return this->nodeMap.insert(make_pair(node->getName(), node)).second;
+}
+
 shared_ptr<GraphNode> GraphBuilder::getNode(const string& name) const
 {
     return this->nodeMap.at(name);
@@ -53,11 +61,13 @@ bool GraphBuilder::nodeExists(const string& name) const
 
 GraphBuilder const * GraphBuilder::linkNodes(const string& parentName, shared_ptr<GraphNode> child)
 {
-    if (!this->nodeExists(parentName)) {
+    auto parent = this->nodeMap.find(parentName);
+
+    if (parent == this->nodeMap.end()) {
         throw runtime_error("linkNodes: Parent node does not exist: " + parentName);
     }
 
-    this->linkNodes(this->nodeMap.at(parentName), child);
+    this->linkNodes(parent->second, child);
     return this;
 }
 
@@ -83,8 +93,83 @@ GraphBuilder const * GraphBuilder::setRoot(shared_ptr<GraphNode> root)
     return this;
 }
 
-Graph GraphBuilder::build() const
+GraphBuilder const * GraphBuilder::linkLater(const string& parentName, shared_ptr<GraphNode> child)
 {
+    this->pendingLinks.push_back(make_pair(parentName, child));
+    return this;
+}
+
+void GraphBuilder::checkLinks() const
+{
+    unordered_map<string, string> parentOf;
+
+    for (auto i=this->pendingLinks.begin(); i != this->pendingLinks.end(); i++) {
+
+        if (i->first == i->second->getName()) {
+            throw runtime_error("build: Node names itself as its parent: " + i->first);
+        }
+
+        parentOf[i->second->getName()] = i->first;
+    }
+
+    // Follow each node's parents up to the root. Nodes on the current path
+    // are marked false, and nodes already known to lead to the root true:
+    unordered_map<string, bool> leadsToRoot;
+
+    for (auto i=this->pendingLinks.begin(); i != this->pendingLinks.end(); i++) {
+
+        vector<string> path;
+        string name = i->second->getName();
+
+        while (true) {
+
+            auto visited = leadsToRoot.find(name);
+
+            if (visited != leadsToRoot.end()) {
+
+                if (!visited->second) {
+
+                    string cycle = name;
+
+                    for (auto p=find(path.begin(), path.end(), name) + 1; p != path.end(); p++) {
+                        cycle += " -> " + *p;
+                    }
+
+                    throw runtime_error("build: Node parents form a cycle: " + cycle + " -> " + name);
+                }
+
+                break;
+            }
+
+            leadsToRoot[name] = false;
+            path.push_back(name);
+
+            auto parent = parentOf.find(name);
+
+            if (parent == parentOf.end()) {
+                break;
+            }
+
+            name = parent->second;
+        }
+
+        for (auto p=path.begin(); p != path.end(); p++) {
+            leadsToRoot[*p] = true;
+        }
+    }
+}
+
+Graph GraphBuilder::build()
+{
+    this->checkLinks();
+
+    for (auto i=this->pendingLinks.begin(); i != this->pendingLinks.end(); i++) {
+        this->linkNodes(i->first, i->second);
+    }
+
+    this->pendingLinks.clear();
+    this->pendingLinks.shrink_to_fit();
+
     return Graph(this->root);
 }
 
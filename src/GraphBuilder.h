@@ -11,8 +11,11 @@
 #ifndef GRAPH_BUILDER_H
 #define GRAPH_BUILDER_H
 
-#include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "Graph.h"
 
 /******************************************************************************/
@@ -22,7 +25,14 @@
     protected:
         std::shared_ptr<GraphNode> root;
         Graph graph;
-        std::map<std::string, std::shared_ptr<GraphNode>> nodeMap;
+        std::unordered_map<std::string, std::shared_ptr<GraphNode>> nodeMap;
+
+        // Children to link to their named parents in build()
+        std::vector<std::pair<std::string, std::shared_ptr<GraphNode>>> pendingLinks;
+
+        // Throws if a node given to linkLater() would end up as its own
+        // ancestor, either directly or through a cycle of parents
+        void checkLinks() const;
 
     public:
         GraphBuilder();
@@ -31,11 +41,23 @@
 
         bool nodeExists(const std::string& name) const;
         GraphBuilder const * registerNode(std::shared_ptr<GraphNode> node);
+
+        // Registers the node unless one of the same name already is, in
+        // which case it returns false
+        bool addNode(std::shared_ptr<GraphNode> node);
         std::shared_ptr<GraphNode> getNode(const std::string& name) const;
         GraphBuilder const * linkNodes(const std::string& parentName, std::shared_ptr<GraphNode> child);
         GraphBuilder const * linkNodes(std::shared_ptr<GraphNode> parent, std::shared_ptr<GraphNode> child);
         GraphBuilder const * setRoot(std::shared_ptr<GraphNode> root);
-        Graph build() const;
+
+        // Links the child to the named parent when the graph is built, so
+        // the parent may be registered after the child
+        GraphBuilder const * linkLater(const std::string& parentName, std::shared_ptr<GraphNode> child);
+
+        // Links every child given to linkLater(), in the order they were
+        // given, and returns the graph. Throws if a parent doesn't exist,
+        // or if the parents form a cycle; nothing is linked in that case
+        Graph build();
 };
 
 /******************************************************************************/
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ *
+ * This file defines a per-pixel render cost map, used to find the parts of
+ * a scene that account for most of the rendering time
+ *
+ * @file Heatmap.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define GLM_FORCE_RADIANS
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <glm/glm.hpp>
+#include "Image.h"
+#include "Heatmap.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+Heatmap::Heatmap(int _width, int _height) :
+    width(_width),
+    height(_height),
+    data(static_cast<size_t>(_width) * static_cast<size_t>(_height) * CHANNEL_COUNT, 0.0f)
+{
+
+}
+
+void Heatmap::add(int i, int j, float micros, float rays, float tests)
+{
+    float* p = &this->data[((j * this->width) + i) * CHANNEL_COUNT];
+
+    p[TIME]  += micros;
+    p[RAYS]  += rays;
+    p[TESTS] += tests;
+}
+
+float Heatmap::get(int i, int j, Channel channel) const
+{
+    return this->data[(((j * this->width) + i) * CHANNEL_COUNT) + channel];
+}
+
+void Heatmap::writePFM(const string& file) const
+{
+    ofstream os(file, ios::binary);
+
+    if (!os) {
+        throw runtime_error("Cannot write heatmap to " + file);
+    }
+
+    // A negative scale marks the data as little-endian:
+    uint16_t probe    = 1;
+    bool littleEndian = *reinterpret_cast<unsigned char*>(&probe) == 1;
+
+    os << "PF\n" << this->width << " " << this->height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+
+    // Rows are stored bottom to top:
+    for (int j=this->height-1; j>=0; j--) {
+        os.write(reinterpret_cast<const char*>(&this->data[j * this->width * CHANNEL_COUNT])
+                ,sizeof(float) * this->width * CHANNEL_COUNT);
+    }
+
+    if (!os) {
+        throw runtime_error("Cannot write heatmap to " + file);
+    }
+}
+
+/**
+ * Maps t in [0,1] onto a black -> blue -> red -> yellow -> white ramp
+ */
+static vec3 heatColor(float t)
+{
+    static const vec3 stops[] = {
+         vec3(0.0f, 0.0f, 0.0f)
+        ,vec3(0.0f, 0.0f, 1.0f)
+        ,vec3(1.0f, 0.0f, 0.0f)
+        ,vec3(1.0f, 1.0f, 0.0f)
+        ,vec3(1.0f, 1.0f, 1.0f)
+    };
+    static const int N = sizeof(stops) / sizeof(stops[0]);
+
+    float x = clamp(t, 0.0f, 1.0f) * static_cast<float>(N - 1);
+    int k   = std::min(static_cast<int>(x), N - 2);
+
+    return mix(stops[k], stops[k + 1], x - static_cast<float>(k));
+}
+
+void Heatmap::writePNG(const string& file, Channel channel) const
+{
+    size_t n = static_cast<size_t>(this->width) * static_cast<size_t>(this->height);
+
+    // Scale by the 99th percentile rather than the maximum, so a handful of
+    // outlying pixels don't wash out the rest of the image:
+    vector<float> values;
+    values.reserve(n);
+    for (size_t k=0; k<n; k++) {
+        values.push_back(this->data[(k * CHANNEL_COUNT) + channel]);
+    }
+
+    float scale = 0.0f;
+    if (n > 0) {
+        auto p = values.begin() + static_cast<ptrdiff_t>((n - 1) * 99 / 100);
+        nth_element(values.begin(), p, values.end());
+        scale = *p > 0.0f ? *p : *max_element(values.begin(), values.end());
+    }
+
+    Image image(this->width, this->height, 1, 3, 0);
+
+    for (int i=0; i<this->width; i++) {
+        for (int j=0; j<this->height; j++) {
+
+            vec3 c = heatColor(scale > 0.0f ? this->get(i, j, channel) / scale : 0.0f);
+
+            image(i, j, 0, 0) = static_cast<unsigned char>(c.r * 255.0f);
+            image(i, j, 0, 1) = static_cast<unsigned char>(c.g * 255.0f);
+            image(i, j, 0, 2) = static_cast<unsigned char>(c.b * 255.0f);
+        }
+    }
+
+    image.save(file.c_str());
+}
+
+Heatmap::Channel Heatmap::channelFromName(const string& name)
+{
+    if (name == "time") {
+        return TIME;
+    } else if (name == "rays") {
+        return RAYS;
+    } else if (name == "tests") {
+        return TESTS;
+    }
+
+    throw runtime_error("Unknown heatmap channel: " + name);
+}
+
+/******************************************************************************/
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ *
+ * This file defines a per-pixel render cost map, used to find the parts of
+ * a scene that account for most of the rendering time
+ *
+ * @file Heatmap.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <string>
+#include <vector>
+
+/******************************************************************************/
+
+/**
+ * Records the cost of every pixel of a render: the wall-clock time spent on
+ * it, the number of rays it spawned and the number of intersection tests
+ * performed. Costs from all passes over a pixel accumulate.
+ *
+ * Each pixel is only ever written by the thread rendering it, so no
+ * synchronization is needed while rendering.
+ */
+class Heatmap
+{
+	public:
+		enum Channel {
+			 TIME  // Microseconds
+			,RAYS
+			,TESTS
+			,CHANNEL_COUNT
+		};
+
+		Heatmap(int width, int height);
+
+		int getWidth() const  { return this->width; }
+		int getHeight() const { return this->height; }
+
+		// Adds the given costs to the pixel at (i,j)
+		void add(int i, int j, float micros, float rays, float tests);
+
+		// Returns the value of one channel at (i,j)
+		float get(int i, int j, Channel channel) const;
+
+		// Writes all channels as an RGB Portable Float Map: R = time in
+		// microseconds, G = rays, B = intersection tests
+		void writePFM(const std::string& file) const;
+
+		// Writes a single channel as a false-colour PNG, scaled so that the
+		// 99th percentile maps to the hottest colour
+		void writePNG(const std::string& file, Channel channel) const;
+
+		// Returns the channel with the given name ("time", "rays" or
+		// "tests"), or throws if there is none
+		static Channel channelFromName(const std::string& name);
+
+	protected:
+		int width;
+		int height;
+
+		// CHANNEL_COUNT values per pixel, stored in row-major order
+		std::vector<float> data;
+};
+
+/******************************************************************************/
+
+#endif
@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <utility>
 #include "Image.h"
+#include "Kernels.h"
 
 /******************************************************************************/
 
@@ -46,52 +47,26 @@ ImagePixel pixel(const Image& image, int i, int j)
  */
 unique_ptr<float[]> edges(const Image& input, int w, int h, float& avgIntensity)
 {   
-    // Sobel filter in X:
-    float Gx[3][3] = {{-1.0f, 0.0f, 1.0f}
-                     ,{-2.0f, 0.0f, 2.0f}
-                     ,{-1.0f, 0.0f, 1.0f}};
-    // Sobel filter in Y:
-    float Gy[3][3] = {{-1.0f, -2.0f, -1.0f}
-                     ,{ 0.0f,  0.0f,  0.0f}
-                     ,{ 1.0f,  2.0f,  1.0f}};
-
-    unique_ptr<float[]> edgeMap(new float[w * h]);
-    avgIntensity = 0.0f;
+    // Intensity of every pixel, stored column-major like the edge map:
+    unique_ptr<float[]> intensity(new float[w * h]);
 
     #ifdef ENABLE_OPENMP
     #pragma omp parallel for
     #endif
-    for (int i=1; i<(w-1); i++) {
-        for (int j=1; j<(h-1); j++) {
-
-            // Gradient values in the X and Y directions at (i,j)
-            float X = 0.0f;
-            float Y = 0.0f;
-
-            for (int u=0; u<3; u++) {
-                for (int v=0; v<3; v++) {
-
-                    int ii = i + (u - 1);
-                    int jj = j + (v - 1);
-                    assert(ii >= 0 && ii < w);
-                    assert(jj >= 0 && jj < h);
+    for (int i=0; i<w; i++) {
+        for (int j=0; j<h; j++) {
+            intensity[(i * h) + j] = luminosity(input(i, j, 0, 0), input(i, j, 0, 1), input(i, j, 0, 2));
+        }
+    }
 
-                    auto red   = input(ii, jj, 0, 0);
-                    auto green = input(ii, jj, 0, 1);
-                    auto blue  = input(ii, jj, 0, 2);
-                    
-                    float intensity = luminosity(red, green, blue);
-                    X += (intensity * Gx[u][v]);
-                    Y += (intensity * Gy[u][v]);
-                }
-            }
+    unique_ptr<float[]> edgeMap(new float[w * h]());
+    avgIntensity = 0.0f;
 
-            // Compute the gradient magnitude and clamp to the range [0,1]:
-            float magnitude = std::min(std::max(0.0f, std::sqrt(powf(X, 2.0f) + powf(Y, 2.0f))), 1.0f); 
-            edgeMap[(i * h) + j]  = magnitude;
+    Kernels::active().sobel(intensity.get(), w, h, edgeMap.get());
 
-            avgIntensity += magnitude;
-        }
+    // Sum serially so the average doesn't depend on thread scheduling:
+    for (int k=0; k<(w * h); k++) {
+        avgIntensity += edgeMap[k];
     }
 
     avgIntensity /= static_cast<float>(w * h);
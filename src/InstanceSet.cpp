@@ -0,0 +1,323 @@
+/*******************************************************************************
+ *
+ * Many copies of one geometric object, each placed by a transformation of
+ * its own and indexed by a bounding volume hierarchy
+ *
+ * @file InstanceSet.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include "InstanceSet.h"
+#include "Stats.h"
+#include "Utils.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+// Deep enough for any hierarchy of up to 2^32 copies:
+#define MAX_STACK_DEPTH 64
+
+/******************************************************************************/
+
+/**
+ * Returns the bounds of the box [lo, hi] once transformed by T
+ */
+static void transformBounds(const mat4& T, const vec3& lo, const vec3& hi, vec3& outLo, vec3& outHi)
+{
+	outLo = vec3(INFINITY);
+	outHi = vec3(-INFINITY);
+
+	for (int k=0; k<8; k++) {
+
+		vec3 corner((k & 1) ? hi.x : lo.x
+		           ,(k & 2) ? hi.y : lo.y
+		           ,(k & 4) ? hi.z : lo.z);
+
+		vec3 p = Utils::transform(T, vec4(corner, 1.0f));
+
+		outLo = glm::min(outLo, p);
+		outHi = glm::max(outHi, p);
+	}
+}
+
+/**
+ * A random number in [0,1) for the given copy and draw, which depends only
+ * on the seed, so scattered copies land in the same places on every run
+ */
+static float scatterRand(uint64_t seed, uint64_t copy, uint64_t draw)
+{
+	return static_cast<float>(Utils::mixSeed(seed, copy, draw) >> 40) / 16777216.0f;
+}
+
+/******************************************************************************/
+
+InstanceSet::InstanceSet() :
+	geometry(nullptr)
+{
+	this->materials.push_back(nullptr);
+}
+
+mat4 InstanceSet::placement(const vec3& T, const vec3& R, const vec3& S)
+{
+	mat4 M = translate(mat4(), T);
+
+	M = rotate(M, R[0], vec3(1.0f, 0.0f, 0.0f));
+	M = rotate(M, R[1], vec3(0.0f, 1.0f, 0.0f));
+	M = rotate(M, R[2], vec3(0.0f, 0.0f, 1.0f));
+
+	return scale(M, S);
+}
+
+void InstanceSet::add(const mat4& T, shared_ptr<Material> material)
+{
+	// Copies share the few materials they use:
+	auto i = find(this->materials.begin(), this->materials.end(), material);
+
+	if (i == this->materials.end()) {
+		i = this->materials.insert(this->materials.end(), material);
+	}
+
+	this->pending.push_back(make_pair(T, static_cast<unsigned int>(i - this->materials.begin())));
+}
+
+void InstanceSet::addGrid(const ivec3& counts, const vec3& spacing)
+{
+	for (int z=0; z<counts.z; z++) {
+		for (int y=0; y<counts.y; y++) {
+			for (int x=0; x<counts.x; x++) {
+				this->add(translate(mat4(), vec3(x, y, z) * spacing));
+			}
+		}
+	}
+}
+
+void InstanceSet::addScatter(int count, uint64_t seed, const vec3& lo, const vec3& hi, float minScale, float maxScale)
+{
+	for (int i=0; i<count; i++) {
+
+		vec3 P(scatterRand(seed, i, 0), scatterRand(seed, i, 1), scatterRand(seed, i, 2));
+		float angle = scatterRand(seed, i, 3) * 2.0f * static_cast<float>(M_PI);
+		float s     = glm::mix(minScale, maxScale, scatterRand(seed, i, 4));
+
+		this->add(placement(lo + ((hi - lo) * P), vec3(0.0f, angle, 0.0f), vec3(s)));
+	}
+}
+
+mat4 InstanceSet::getTransform(int i) const
+{
+	return inverse(mat4(this->instances[i].invT));
+}
+
+size_t InstanceSet::getByteSize() const
+{
+	return (this->instances.capacity() * sizeof(Instance))
+	     + (this->nodes.capacity() * sizeof(Node))
+	     + (this->materials.capacity() * sizeof(shared_ptr<Material>));
+}
+
+/******************************************************************************/
+
+void InstanceSet::build(shared_ptr<Geometry> geometry)
+{
+	this->geometry = geometry;
+
+	size_t count = this->pending.size();
+
+	// The bounds of every copy, and the order they end up in:
+	vector<vec3> lo(count), hi(count);
+	vector<unsigned int> order(count);
+
+	const AABB& aabb = geometry->getAABB();
+
+	for (size_t i=0; i<count; i++) {
+		transformBounds(this->pending[i].first, aabb.minimum(), aabb.maximum(), lo[i], hi[i]);
+		order[i] = static_cast<unsigned int>(i);
+	}
+
+	this->nodes.clear();
+	this->nodes.reserve(count);
+
+	if (count > 0) {
+		this->buildNode(order, 0, static_cast<unsigned int>(count), lo, hi);
+	}
+
+	this->nodes.shrink_to_fit();
+
+	// Lay the copies out in leaf order:
+	this->instances.resize(count);
+
+	for (size_t i=0; i<count; i++) {
+
+		const pair<mat4, unsigned int>& copy = this->pending[order[i]];
+
+		this->instances[i].invT     = mat4x3(inverse(copy.first));
+		this->instances[i].material = copy.second;
+	}
+
+	this->pending.clear();
+	this->pending.shrink_to_fit();
+}
+
+unsigned int InstanceSet::buildNode(vector<unsigned int>& order
+	                               ,unsigned int first
+	                               ,unsigned int count
+	                               ,const vector<vec3>& lo
+	                               ,const vector<vec3>& hi)
+{
+	unsigned int index = static_cast<unsigned int>(this->nodes.size());
+
+	Node node;
+	node.bounds[0] = vec3(INFINITY);
+	node.bounds[1] = vec3(-INFINITY);
+	node.first     = first;
+	node.count     = 0;
+	node.axis      = 0;
+
+	// Bounds of the copies, and of their centers:
+	vec3 cLo(INFINITY), cHi(-INFINITY);
+
+	for (unsigned int i=first; i<first+count; i++) {
+
+		node.bounds[0] = glm::min(node.bounds[0], lo[order[i]]);
+		node.bounds[1] = glm::max(node.bounds[1], hi[order[i]]);
+
+		vec3 C = 0.5f * (lo[order[i]] + hi[order[i]]);
+		cLo    = glm::min(cLo, C);
+		cHi    = glm::max(cHi, C);
+	}
+
+	if (count <= static_cast<unsigned int>(MAX_PER_LEAF)) {
+		node.count = static_cast<uint16_t>(count);
+		this->nodes.push_back(node);
+		return index;
+	}
+
+	this->nodes.push_back(node);
+
+	// Split at the median center along the axis the centers spread most:
+	vec3 extent = cHi - cLo;
+	int axis    = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	unsigned int half = count / 2;
+
+	nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count
+	           ,[&lo, &hi, axis](unsigned int a, unsigned int b) {
+					return (lo[a][axis] + hi[a][axis]) < (lo[b][axis] + hi[b][axis]);
+	            });
+
+	this->buildNode(order, first, half, lo, hi);
+	unsigned int right = this->buildNode(order, first + half, count - half, lo, hi);
+
+	this->nodes[index].first = right;
+	this->nodes[index].axis  = static_cast<uint16_t>(axis);
+
+	return index;
+}
+
+/******************************************************************************/
+
+Hit InstanceSet::hit(const mat4& invT, const Ray& rayWorld, int ignore) const
+{
+	Hit closest;
+
+	if (this->nodes.empty()) {
+		return closest;
+	}
+
+	// The ray in the node's space. As for Geometry::hit(), the direction is
+	// not re-normalized, so distances are the same in every space:
+	Ray rayNode(Utils::transform(invT, vec4(rayWorld.orig, 1.0f))
+	           ,Utils::transform(invT, vec4(normalize(rayWorld.dir), 0.0f)));
+
+	rayNode.tMin = rayWorld.tMin;
+	rayNode.tMax = rayWorld.tMax;
+
+	unsigned int stack[MAX_STACK_DEPTH];
+	int top = 0;
+
+	stack[top++] = 0;
+
+	while (top > 0) {
+
+		unsigned int index = stack[--top];
+		const Node& node   = this->nodes[index];
+
+		Stats::add(Stats::INSTANCE_NODES_VISITED);
+
+		// Skip nodes the ray misses, or reaches beyond the closest hit:
+		vec3 tNear, tFar;
+
+		tNear.x = (node.bounds[rayNode.sign[0]].x - rayNode.orig.x) * rayNode.invDir.x;
+		tNear.y = (node.bounds[rayNode.sign[1]].y - rayNode.orig.y) * rayNode.invDir.y;
+		tNear.z = (node.bounds[rayNode.sign[2]].z - rayNode.orig.z) * rayNode.invDir.z;
+		tFar.x  = (node.bounds[1 - rayNode.sign[0]].x - rayNode.orig.x) * rayNode.invDir.x;
+		tFar.y  = (node.bounds[1 - rayNode.sign[1]].y - rayNode.orig.y) * rayNode.invDir.y;
+		tFar.z  = (node.bounds[1 - rayNode.sign[2]].z - rayNode.orig.z) * rayNode.invDir.z;
+
+		if (AABB::maxNear(rayNode.tMin, tNear) > AABB::minFar(rayNode.tMax, tFar)) {
+			continue;
+		}
+
+		if (node.count == 0) {
+
+			// Visit the nearer child first:
+			unsigned int nearChild = index + 1;
+			unsigned int farChild  = node.first;
+
+			if (rayNode.sign[node.axis]) {
+				swap(nearChild, farChild);
+			}
+
+			stack[top++] = farChild;
+			stack[top++] = nearChild;
+			continue;
+		}
+
+		for (unsigned int i=node.first; i<node.first+node.count; i++) {
+
+			if (static_cast<int>(i) == ignore) {
+				continue;
+			}
+
+			const Instance& copy = this->instances[i];
+
+			Ray rayLocal(copy.invT * vec4(rayNode.orig, 1.0f), copy.invT * vec4(rayNode.dir, 0.0f));
+
+			rayLocal.tMin = rayNode.tMin;
+			rayLocal.tMax = rayNode.tMax;
+
+			Stats::add(Stats::INSTANCES_TESTED);
+
+			Hit next = this->geometry->hitLocal(rayLocal);
+
+			if (next.isCloser(closest)) {
+				closest          = next;
+				closest.instance = static_cast<int>(i);
+				rayNode.tMax     = next.t;
+			}
+		}
+	}
+
+	return closest;
+}
+
+Intersection InstanceSet::surface(const mat4& T, const mat4& invT, const Ray& rayWorld, const Hit& hit) const
+{
+	if (hit.isMiss()) {
+		return Intersection::miss();
+	}
+
+	mat4 copyInvT = mat4(this->instances[hit.instance].invT);
+
+	return this->geometry->surface(T * inverse(copyInvT), copyInvT * invT, rayWorld, hit);
+}
+
+/******************************************************************************/
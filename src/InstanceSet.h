@@ -0,0 +1,141 @@
+/*******************************************************************************
+ *
+ * Many copies of one geometric object, each placed by a transformation of
+ * its own and indexed by a bounding volume hierarchy. A scene graph node
+ * holding an instance set is the top level of a two-level structure: rays
+ * are carried into the node's space, where the hierarchy finds the copies
+ * they may hit, and from there into the space of each copy, where the
+ * shared geometry (e.g. a mesh and its KD-tree) is tested
+ *
+ * @file InstanceSet.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef INSTANCE_SET_H
+#define INSTANCE_SET_H
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "Geometry.h"
+#include "Intersection.h"
+#include "Material.h"
+#include "Ray.h"
+
+/******************************************************************************/
+
+class InstanceSet
+{
+	public:
+		// Most copies in a leaf of the hierarchy
+		static const int MAX_PER_LEAF = 4;
+
+	protected:
+		// A copy of the geometry: the inverse of its transformation relative
+		// to the node, which is affine so only its top three rows are kept,
+		// and the index of its material in materials
+		struct Instance
+		{
+			glm::mat4x3 invT;
+			unsigned int material;
+		};
+
+		// A node of the hierarchy, with its bounds in the node's space. A
+		// leaf (count > 0) holds the copies [first, first + count). An
+		// inner node's children follow it and start at first; axis is the
+		// one they were split along
+		struct Node
+		{
+			glm::vec3 bounds[2]; // { min, max }, indexed by Ray::sign
+			unsigned int first;
+			std::uint16_t count;
+			std::uint16_t axis;
+		};
+
+		std::shared_ptr<Geometry> geometry;
+
+		// Materials of the copies. The first is always null, which stands
+		// for the material of the node
+		std::vector<std::shared_ptr<Material>> materials;
+
+		// Every copy, ordered so the copies of each leaf are consecutive
+		std::vector<Instance> instances;
+
+		// The hierarchy, depth first; the root comes first
+		std::vector<Node> nodes;
+
+		// Copies added since the last build(): their transformations, and
+		// their material indices
+		std::vector<std::pair<glm::mat4, unsigned int>> pending;
+
+		// Builds the subtree over the copies [first, first + count), given
+		// their bounds and centers, returning the index of its root
+		unsigned int buildNode(std::vector<unsigned int>& order
+			                  ,unsigned int first
+			                  ,unsigned int count
+			                  ,const std::vector<glm::vec3>& lo
+			                  ,const std::vector<glm::vec3>& hi);
+
+	public:
+		InstanceSet();
+
+		/**
+		 * The transformation placing a copy: scaled by S, rotated about X,
+		 * then Y, then Z by the angles (in radians) in R, then translated by T
+		 */
+		static glm::mat4 placement(const glm::vec3& T, const glm::vec3& R = glm::vec3(), const glm::vec3& S = glm::vec3(1.0f));
+
+		// Adds a copy placed by T, relative to the node, using the given
+		// material, or the node's own if null
+		void add(const glm::mat4& T, std::shared_ptr<Material> material = nullptr);
+
+		// Adds a grid of counts.x * counts.y * counts.z copies, the first at
+		// the node's origin and the others spaced apart by spacing
+		void addGrid(const glm::ivec3& counts, const glm::vec3& spacing);
+
+		/**
+		 * Adds count copies placed at random within the box [lo, hi], each
+		 * turned about Y at random and scaled uniformly by a random amount
+		 * in [minScale, maxScale]. The same seed places them the same way
+		 */
+		void addScatter(int count, std::uint64_t seed, const glm::vec3& lo, const glm::vec3& hi, float minScale = 1.0f, float maxScale = 1.0f);
+
+		// Indexes every copy added as a copy of the given geometry. Must be
+		// called once, after the last copy is added
+		void build(std::shared_ptr<Geometry> geometry);
+
+		std::shared_ptr<Geometry> getGeometry() const { return this->geometry; }
+
+		// Number of copies
+		size_t size() const { return this->instances.size() + this->pending.size(); }
+
+		// Transformation of the given copy, relative to the node
+		glm::mat4 getTransform(int i) const;
+
+		// Material of the given copy, or null if it uses the node's
+		std::shared_ptr<Material> getMaterial(int i) const { return this->materials[this->instances[i].material]; }
+
+		// Bytes used by the copies and the hierarchy; the geometry is shared
+		// and not counted
+		size_t getByteSize() const;
+
+		/**
+		 * Computes the closest hit of a WORLD-space ray with any copy, given
+		 * the inverse of the node's transformation. The copy hit is set in
+		 * Hit::instance. The copy numbered ignore, if any, is skipped
+		 */
+		Hit hit(const glm::mat4& invT, const Ray& rayWorld, int ignore = -1) const;
+
+		// Evaluates the full WORLD-space intersection for a hit returned by
+		// hit() for the same ray, given the node's transformation and its
+		// inverse
+		Intersection surface(const glm::mat4& T, const glm::mat4& invT, const Ray& rayWorld, const Hit& hit) const;
+};
+
+/******************************************************************************/
+
+#endif
@@ -22,8 +22,12 @@ Intersection::Intersection() :
     t(-1.0f),
     density(-1.0f),
     node(nullptr),
+    instance(-1),
+    material(nullptr),
     inside(false),
-    correctNormal(true)
+    correctNormal(true),
+    hasDifferentials(false),
+    hasUV(false)
 { 
     
 }
@@ -32,9 +36,13 @@ Intersection::Intersection(float _t, glm::vec3 _normal) :
     t(_t), 
     density(1.0f),
     node(nullptr),
+    instance(-1),
+    material(nullptr),
     normal(_normal),
     inside(false),
-    correctNormal(true)
+    correctNormal(true),
+    hasDifferentials(false),
+    hasUV(false)
 { 
     
 }
@@ -43,9 +51,13 @@ Intersection::Intersection(float _t, float _density, glm::vec3 _normal) :
     t(_t), 
     density(_density),
     node(nullptr),
+    instance(-1),
+    material(nullptr),
     normal(_normal),
     inside(false),
-    correctNormal(true)
+    correctNormal(true),
+    hasDifferentials(false),
+    hasUV(false)
 { 
 
 }
@@ -18,8 +18,9 @@
 
 /******************************************************************************/
 
-// Have to forward declare this guy:
+// Have to forward declare these guys:
 class GraphNode;
+class Material;
 
 class Intersection 
 {
@@ -35,6 +36,13 @@ class Intersection
 		// The node of the scene graph that was intersected
 		std::shared_ptr<GraphNode> node;
 
+		// If the node places copies of its geometry, the copy that was 
+		// intersected; otherwise -1. See InstanceSet
+		int instance;
+
+		// Material of the surface: the node's, or that of the copy hit
+		std::shared_ptr<Material> material;
+
 	    // The surface normal at the point of intersection. (Ignored if t < 0.)
 	    glm::vec3 normal;
 
@@ -51,6 +59,28 @@ class Intersection
 		// (i.e flipped) if it is pointing away from the ray's origin
 		bool correctNormal;
 
+		// Set if the ray had differentials, in which case dpdx and dpdy hold
+		// the offsets from hitWorld to where the differential rays cross the
+		// plane tangent to the hit; dLocaldx and dLocaldy are the same 
+		// offsets in local space
+		bool hasDifferentials;
+		glm::vec3 dpdx, dpdy;
+		glm::vec3 dLocaldx, dLocaldy;
+
+		// Set if the surface has a (u,v) parameterization of its own, such
+		// as a mesh's texture coordinates, in which case uv is the hit's 
+		// position in it, and dUVdx and dUVdy its changes from one sample 
+		// to the next if hasDifferentials is set. Otherwise surfaces are 
+		// mapped by projecting hitLocal
+		bool hasUV;
+		glm::vec2 uv;
+		glm::vec2 dUVdx, dUVdy;
+
+		// World-space directions of increasing u and of up in the image 
+		// along the surface, which orient normal maps. Neither is 
+		// normalized nor necessarily perpendicular to the normal
+		glm::vec3 tangent, bitangent;
+
 		// Compare two intersections, returning the closet of the two
 		static Intersection getClosest(const Intersection& current, const Intersection& last)
 		{
@@ -79,6 +109,66 @@ class Intersection
 		bool isCloser(const Intersection& other) const;
 };
 
+/**
+ * A compact ray-object hit record. While searching for the closest 
+ * intersection only these records are produced; the full Intersection, with
+ * its normal and hit positions, is evaluated for the closest hit alone
+ */
+class Hit
+{
+	public:
+		// The parameter `t` along the ray. (A negative value indicates a miss.)
+		float t;
+
+		// Index of the render item that was hit; see SceneContext
+		int item;
+
+		// Primitive hit within the object, e.g. the triangle of a mesh or
+		// the face of a cube
+		int primitive;
+
+		// Copy of the object hit, if it is one of an InstanceSet, or -1
+		int instance;
+
+		// Barycentric coordinates (u,v) of the hit on the primitive, if any
+		glm::vec2 uv;
+
+		// Miss constructor function
+		static Hit miss()
+		{
+			return Hit();
+		}
+
+		// Miss constructor by default:
+		Hit() :
+			t(-1.0f),
+			item(-1),
+			primitive(0),
+			instance(-1)
+		{ 
+
+		}
+
+		Hit(float _t, int _primitive = 0, const glm::vec2& _uv = glm::vec2()) :
+			t(_t),
+			item(-1),
+			primitive(_primitive),
+			instance(-1),
+			uv(_uv)
+		{ 
+
+		}
+
+		bool isMiss() const { return this->t < 0.0f; }
+		bool isHit() const  { return this->t >= 0.0f; }
+
+		// Is this hit closer than the given hit?
+		bool isCloser(const Hit& other) const
+		{
+			return this->isHit() && (other.isMiss() || this->t < other.t);
+		}
+};
+
 /******************************************************************************/
 
 #endif
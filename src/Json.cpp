@@ -0,0 +1,317 @@
+/*******************************************************************************
+ *
+ * A minimal JSON value type and parser, used for machine-readable input and
+ * output (render jobs, statistics, benchmark results)
+ *
+ * @file Json.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include "Json.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+static const JsonValue NULL_VALUE;
+
+/**
+ * Recursive descent parser over a string
+ */
+class JsonParser
+{
+	private:
+		const string& text;
+		size_t pos;
+
+		void fail(const string& message)
+		{
+			ostringstream ss;
+			ss << "JSON: " << message << " at offset " << this->pos;
+			throw runtime_error(ss.str());
+		}
+
+		void skipWhitespace()
+		{
+			while (this->pos < this->text.size() && isspace(static_cast<unsigned char>(this->text[this->pos]))) {
+				this->pos++;
+			}
+		}
+
+		char peek()
+		{
+			this->skipWhitespace();
+			return this->pos < this->text.size() ? this->text[this->pos] : '\0';
+		}
+
+		void expect(char c)
+		{
+			if (this->peek() != c) {
+				this->fail(string("expected '") + c + "'");
+			}
+			this->pos++;
+		}
+
+		void expectLiteral(const string& literal)
+		{
+			if (this->text.compare(this->pos, literal.size(), literal) != 0) {
+				this->fail("expected " + literal);
+			}
+			this->pos += literal.size();
+		}
+
+		// Appends the code point cp to out as UTF-8
+		static void appendUTF8(string& out, unsigned int cp)
+		{
+			if (cp < 0x80) {
+				out += static_cast<char>(cp);
+			} else if (cp < 0x800) {
+				out += static_cast<char>(0xC0 | (cp >> 6));
+				out += static_cast<char>(0x80 | (cp & 0x3F));
+			} else {
+				out += static_cast<char>(0xE0 | (cp >> 12));
+				out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (cp & 0x3F));
+			}
+		}
+
+		string parseString()
+		{
+			this->expect('"');
+
+			string out;
+
+			while (this->pos < this->text.size()) {
+
+				char c = this->text[this->pos++];
+
+				if (c == '"') {
+					return out;
+				}
+
+				if (c != '\\') {
+					out += c;
+					continue;
+				}
+
+				if (this->pos >= this->text.size()) {
+					break;
+				}
+
+				char e = this->text[this->pos++];
+
+				switch (e) {
+					case '"':  out += '"';  break;
+					case '\\': out += '\\'; break;
+					case '/':  out += '/';  break;
+					case 'b':  out += '\b'; break;
+					case 'f':  out += '\f'; break;
+					case 'n':  out += '\n'; break;
+					case 'r':  out += '\r'; break;
+					case 't':  out += '\t'; break;
+					case 'u':
+						if (this->pos + 4 > this->text.size()) {
+							this->fail("truncated \\u escape");
+						}
+						appendUTF8(out, static_cast<unsigned int>(strtoul(this->text.substr(this->pos, 4).c_str(), nullptr, 16)));
+						this->pos += 4;
+						break;
+					default:
+						this->fail("invalid escape sequence");
+				}
+			}
+
+			this->fail("unterminated string");
+			return out;
+		}
+
+		JsonValue parseValue()
+		{
+			JsonValue value;
+			char c = this->peek();
+
+			if (c == '{') {
+
+				this->pos++;
+				value.type = JsonValue::OBJECT;
+
+				if (this->peek() == '}') {
+					this->pos++;
+					return value;
+				}
+
+				do {
+					string key = this->parseString();
+					this->expect(':');
+					value.members[key] = make_shared<const JsonValue>(this->parseValue());
+				} while (this->peek() == ',' && ++this->pos);
+
+				this->expect('}');
+
+			} else if (c == '[') {
+
+				this->pos++;
+				value.type = JsonValue::ARRAY;
+
+				if (this->peek() == ']') {
+					this->pos++;
+					return value;
+				}
+
+				do {
+					value.elements.push_back(make_shared<const JsonValue>(this->parseValue()));
+				} while (this->peek() == ',' && ++this->pos);
+
+				this->expect(']');
+
+			} else if (c == '"') {
+
+				value.type = JsonValue::STRING;
+				value.str  = this->parseString();
+
+			} else if (c == 't') {
+
+				this->expectLiteral("true");
+				value.type    = JsonValue::BOOLEAN;
+				value.boolean = true;
+
+			} else if (c == 'f') {
+
+				this->expectLiteral("false");
+				value.type    = JsonValue::BOOLEAN;
+				value.boolean = false;
+
+			} else if (c == 'n') {
+
+				this->expectLiteral("null");
+
+			} else if (c == '-' || isdigit(static_cast<unsigned char>(c))) {
+
+				const char* begin = this->text.c_str() + this->pos;
+				char* end         = nullptr;
+
+				value.type   = JsonValue::NUMBER;
+				value.number = strtod(begin, &end);
+				this->pos   += (end - begin);
+
+			} else {
+
+				this->fail("unexpected character");
+			}
+
+			return value;
+		}
+
+	public:
+		JsonParser(const string& _text) : text(_text), pos(0) { }
+
+		JsonValue parse()
+		{
+			JsonValue value = this->parseValue();
+
+			if (this->peek() != '\0') {
+				this->fail("trailing characters");
+			}
+
+			return value;
+		}
+};
+
+/******************************************************************************/
+
+JsonValue::JsonValue() :
+	type(NUL),
+	boolean(false),
+	number(0.0)
+{
+
+}
+
+JsonValue JsonValue::parse(const string& text)
+{
+	return JsonParser(text).parse();
+}
+
+string JsonValue::quote(const string& s)
+{
+	string out = "\"";
+
+	for (auto i=s.begin(); i != s.end(); i++) {
+
+		unsigned char c = static_cast<unsigned char>(*i);
+
+		switch (c) {
+			case '"':  out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n";  break;
+			case '\r': out += "\\r";  break;
+			case '\t': out += "\\t";  break;
+			default:
+				if (c < 0x20) {
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\u%04x", c);
+					out += buf;
+				} else {
+					out += static_cast<char>(c);
+				}
+		}
+	}
+
+	return out + "\"";
+}
+
+bool JsonValue::has(const string& key) const
+{
+	return this->type == OBJECT && this->members.count(key) > 0;
+}
+
+const JsonValue& JsonValue::operator[](const string& key) const
+{
+	if (this->type != OBJECT) {
+		return NULL_VALUE;
+	}
+
+	auto i = this->members.find(key);
+	return i != this->members.end() ? *i->second : NULL_VALUE;
+}
+
+const JsonValue& JsonValue::operator[](size_t i) const
+{
+	return (this->type == ARRAY && i < this->elements.size()) ? *this->elements[i] : NULL_VALUE;
+}
+
+size_t JsonValue::size() const
+{
+	if (this->type == ARRAY) {
+		return this->elements.size();
+	}
+	if (this->type == OBJECT) {
+		return this->members.size();
+	}
+	return 0;
+}
+
+double JsonValue::asNumber(double def) const
+{
+	return this->type == NUMBER ? this->number : def;
+}
+
+bool JsonValue::asBool(bool def) const
+{
+	return this->type == BOOLEAN ? this->boolean : def;
+}
+
+string JsonValue::asString(const string& def) const
+{
+	return this->type == STRING ? this->str : def;
+}
+
+/******************************************************************************/
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *
+ * A minimal JSON value type and parser, used for machine-readable input and
+ * output (render jobs, statistics, benchmark results)
+ *
+ * @file Json.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/******************************************************************************/
+
+class JsonValue
+{
+	public:
+		enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	protected:
+		Type type;
+		bool boolean;
+		double number;
+		std::string str;
+
+		// Children are held by pointer, since JsonValue is still incomplete
+		// here. Parsed values are never modified, so copies share them
+		std::vector<std::shared_ptr<const JsonValue>> elements;
+		std::map<std::string, std::shared_ptr<const JsonValue>> members;
+
+		friend class JsonParser;
+
+	public:
+		JsonValue();
+
+		// Parses the given text, throwing std::runtime_error on malformed input
+		static JsonValue parse(const std::string& text);
+
+		// Returns the given string as a quoted and escaped JSON string literal
+		static std::string quote(const std::string& s);
+
+		Type getType() const  { return this->type; }
+		bool isNull() const   { return this->type == NUL; }
+		bool isObject() const { return this->type == OBJECT; }
+		bool isArray() const  { return this->type == ARRAY; }
+
+		// Tests if this value is an object with the given key
+		bool has(const std::string& key) const;
+
+		// Object member access; returns a null value if the key is absent
+		const JsonValue& operator[](const std::string& key) const;
+
+		// Array element access; returns a null value if out of range
+		const JsonValue& operator[](size_t i) const;
+
+		// Number of array elements or object members
+		size_t size() const;
+
+		// Typed accessors, returning the given default on a type mismatch
+		double asNumber(double def = 0.0) const;
+		bool asBool(bool def = false) const;
+		std::string asString(const std::string& def = "") const;
+};
+
+/******************************************************************************/
+
+#endif
@@ -20,6 +20,7 @@
 #include <queue>
 #include "KDTree.h"
 #include "Utils.h"
+#include "Stats.h"
 
 /******************************************************************************/
 
@@ -27,9 +28,11 @@ using namespace std;
 
 /******************************************************************************/
 
-static AABB findExtent(const std::vector<Tri>& triangles);
+static AABB findExtent(Tri const * triangles, size_t count);
 
-static NodeChild const * build(const std::vector<Tri>& triangles
+static NodeChild const * build(std::vector<Tri>& triangles
+	                          ,unsigned int first
+	                          ,size_t count
 	                          ,int currentDepth
 			 	              ,unique_ptr<SplitStrategy> splitHalf
 					          ,StorageStrategy* storageStrategy);
@@ -38,7 +41,7 @@ static NodeChild const * build(const std::vector<Tri>& triangles
  * CycleAxisStrategy -- Basic axis-cycling strategy: 0->1,1->2,2->0
  ******************************************************************************/
 
-int CycleAxisStrategy::nextAxis(const std::vector<Tri>& _data)
+int CycleAxisStrategy::nextAxis(Tri const * data, size_t count)
 {
 	// Ignore data and cycle the axis
 	int currentAxis = this->axis;
@@ -56,7 +59,7 @@ Split CycleAxisStrategy::divide() const
  * RandomAxisStrategy -- choose an axis at random
  ******************************************************************************/
 
-int RandomAxisStrategy::nextAxis(const std::vector<Tri>& data)
+int RandomAxisStrategy::nextAxis(Tri const * data, size_t count)
 {
 	return static_cast<int>(Utils::randInRange(0, 2));
 }
@@ -72,9 +75,9 @@ Split RandomAxisStrategy::divide() const
  * Adapted from http://www.flipcode.com/archives/Raytracing_Topics_Techniques-Part_7_Kd-Trees_and_More_Speed.shtml
  ******************************************************************************/
 
-int SurfaceAreaStrategy::nextAxis(const std::vector<Tri>& data)
+int SurfaceAreaStrategy::nextAxis(Tri const * data, size_t count)
 {
-	AABB totalExtent = findExtent(data);
+	AABB totalExtent = findExtent(data, count);
 	glm::vec3 center = totalExtent.centroid();
 	float cost[3]    = { 0.0f, 0.0f, 0.0f };
 	float inf        = numeric_limits<float>::infinity();
@@ -93,9 +96,9 @@ int SurfaceAreaStrategy::nextAxis(const std::vector<Tri>& data)
 		float zMaxL = -inf, zMaxR = -inf;
 		int countL = 0, countR = 0;
 
-		for (auto i=data.begin(); i != data.end(); i++) {
+		for (size_t i=0; i<count; i++) {
 			
-			Tri T               = *i;
+			const Tri& T        = data[i];
 			glm::vec3 triCenter = T.getAABB().centroid();
 
 			// Partition the points based on the current axis and update the extrema
@@ -160,14 +163,16 @@ Split SurfaceAreaStrategy::divide() const
  * KDTree :: Leaf
  *****************************************************************************/
 
-Leaf::Leaf(const vector<Tri>& _data, const AABB& _aabb, int _depth) : 
-	data(_data),
+Leaf::Leaf(unsigned int _first, int _count, const AABB& _aabb, int _depth) : 
+	first(_first),
+	count(_count),
 	aabb(_aabb),
 	depth(_depth)
 { }
 
 Leaf::Leaf(const Leaf& other) :
-	data(other.data),
+	first(other.first),
+	count(other.count),
 	aabb(other.aabb),
 	depth(other.depth)
 { }
@@ -187,7 +192,7 @@ ostream& Leaf::repr(ostream& s
 		s << ">: ";
 	}
 	s << "{"
-	  << " size="   << this->data.size()
+	  << " size="   << this->count
 	  << ", aabb="  << this->aabb
 	  << ", depth=" << this->depth 
 	  << " }";
@@ -309,15 +314,18 @@ ostream& operator<<(ostream& s, const Node& node)
  * KDTree 
  *****************************************************************************/
 
-KDTree::KDTree(const vector<Tri>& data
+KDTree::KDTree(vector<Tri> data
 	          ,SplitStrategy* splitStrategy
-	          ,StorageStrategy* storageStrategy)
+	          ,StorageStrategy* storageStrategy) :
+	triangles(move(data))
 { 
 	// Start timing
 	clock_t start = clock(); 
 
-	// Build the tree
-	this->root = build(data
+	// Build the tree, sorting the triangles into leaf order as it goes:
+	this->root = build(this->triangles
+		              ,0
+		              ,this->triangles.size()
 		              ,0
 		              ,unique_ptr<SplitStrategy>(splitStrategy)
 		              ,storageStrategy);
@@ -371,6 +379,26 @@ int KDTree::countInNode(NodeChild const * root) const
 	}
 }
 
+size_t KDTree::sizeOfNode(NodeChild const * root) const
+{
+	if (root == nullptr) {
+		return 0;
+	}
+
+	if (root->isLeaf()) {
+		return sizeof(NodeChild) + sizeof(Leaf);
+	}
+
+	Node const * node = root->asNode();
+
+	return sizeof(NodeChild) + sizeof(Node) + sizeOfNode(node->getLeftChild()) + sizeOfNode(node->getRightChild());
+}
+
+size_t KDTree::getByteSize() const
+{
+	return (this->triangles.capacity() * sizeof(Tri)) + this->sizeOfNode(this->root);
+}
+
 /**
  * Recursive helper function for KDTree::intersects
  */
@@ -378,6 +406,7 @@ bool KDTree::intersectWalk(const Ray& ray, NodeChild const * root, vector<Tri>&
 {
 	queue<NodeChild const *> Q;
 	bool hit = false;
+	uint64_t visited = 0;
 
 	Q.push(root);
 
@@ -385,6 +414,7 @@ bool KDTree::intersectWalk(const Ray& ray, NodeChild const * root, vector<Tri>&
 
 		NodeChild const * head = Q.front();
 		Q.pop();
+		visited++;
 
 		if (head == nullptr) {
 			continue;
@@ -394,7 +424,8 @@ bool KDTree::intersectWalk(const Ray& ray, NodeChild const * root, vector<Tri>&
 
 			Leaf const * leaf = head->asLeaf();
 			hit = true;
-			copy(leaf->getData().begin(), leaf->getData().end(), back_inserter(tris));
+			auto first = this->triangles.begin() + leaf->getFirst();
+			copy(first, first + leaf->getCount(), back_inserter(tris));
 
 		} else {
 
@@ -417,6 +448,9 @@ bool KDTree::intersectWalk(const Ray& ray, NodeChild const * root, vector<Tri>&
 		}
 	}
 
+	Stats::add(Stats::KD_TRAVERSALS);
+	Stats::add(Stats::KD_NODES_VISITED, visited);
+
 	return hit;
 }
 
@@ -425,16 +459,97 @@ bool KDTree::intersectWalk(const Ray& ray, NodeChild const * root, vector<Tri>&
  * that are potentially intersected, collecting the resulting triangle
  * instances into the supplied vector
  */
-bool KDTree::intersects(const Ray& ray, vector<Tri>& tris)
+bool KDTree::intersects(const Ray& ray, vector<Tri>& tris) const
 {
 	return intersectWalk(ray, this->root, tris);
 }
 
+/**
+ * Finds the closest triangle hit by the given ray, narrowing the ray's tMax
+ * to each hit found so that farther subtrees are skipped
+ */
+Tri const * KDTree::closest(const Ray& ray, float& t, glm::vec3& W) const
+{
+	// Depth-first: every level leaves at most one farther child behind
+	NodeChild const * stack[DEEPEST_DEPTH_ALLOWED + 2];
+	int top = 0;
+
+	Ray probe(ray);
+	Tri const * found = nullptr;
+	uint64_t visited  = 0;
+	uint64_t tested   = 0;
+
+	stack[top++] = this->root;
+
+	while (top > 0) {
+
+		NodeChild const * head = stack[--top];
+
+		if (head == nullptr) {
+			continue;
+		}
+
+		visited++;
+
+		if (head->isLeaf()) {
+
+			Leaf const * leaf = head->asLeaf();
+
+			if (!leaf->getAABB().intersected(probe)) {
+				continue;
+			}
+
+			Tri const * first = &this->triangles[leaf->getFirst()];
+			Tri const * last  = first + leaf->getCount();
+			tested += leaf->getCount();
+
+			for (Tri const * i=first; i != last; i++) {
+
+				glm::vec3 W_i;
+				float t_i = i->intersected(probe, W_i);
+
+				if (t_i >= probe.tMin && t_i <= probe.tMax && (found == nullptr || t_i < t)) {
+					found      = i;
+					t          = t_i;
+					W          = W_i;
+					probe.tMax = t_i;
+				}
+			}
+
+		} else {
+
+			Node const * node = head->asNode();
+
+			if (!node->getAABB().intersected(probe)) {
+				continue;
+			}
+
+			// The left child holds the triangles with the smaller centroids
+			// along the split axis, so it's nearer unless the ray points back:
+			NodeChild const * nearer  = node->getLeftChild();
+			NodeChild const * farther = node->getRightChild();
+
+			if (probe.sign[node->getAxis()]) {
+				swap(nearer, farther);
+			}
+
+			stack[top++] = farther;
+			stack[top++] = nearer;
+		}
+	}
+
+	Stats::add(Stats::KD_TRAVERSALS);
+	Stats::add(Stats::KD_NODES_VISITED, visited);
+	Stats::add(Stats::KD_TRIS_TESTED, tested);
+
+	return found;
+}
+
 /**
  * Given a list of triangles, this function computes the largest AABB 
  * needed to contain all of the triangles 
  */
-static AABB findExtent(const std::vector<Tri>& triangles)
+static AABB findExtent(Tri const * triangles, size_t count)
 {
 	float xMin = numeric_limits<float>::infinity();
 	float yMin = numeric_limits<float>::infinity();
@@ -444,8 +559,8 @@ static AABB findExtent(const std::vector<Tri>& triangles)
 	float zMax = -numeric_limits<float>::infinity();
 	float eps = Utils::EPSILON;
 
-	for (auto i=triangles.begin(); i != triangles.end(); i++) {
-		Tri T = *i;
+	for (size_t i=0; i<count; i++) {
+		const Tri& T = triangles[i];
 		xMin  = min(xMin, T.getXMinima());
 		yMin  = min(yMin, T.getYMinima());
 		zMin  = min(zMin, T.getZMinima());
@@ -495,11 +610,16 @@ static float getY(const glm::vec3& p) {return p.y; }
 static float getZ(const glm::vec3& p) {return p.z; }
 
 /**
- * Given a list of triangles and a splitting strategy, this function returns
- * KD-tree node
+ * Given a run of triangles and a splitting strategy, this function returns
+ * KD-tree node. The run is partitioned in place, so each leaf ends up 
+ * referring to a run of its own
  *
- * @param const std::vector<Tri>& triangles 
- *   The current set of triangles to index
+ * @param std::vector<Tri>& triangles 
+ *   All of the triangles being indexed
+ * @param unsigned int first
+ *   Index of the first triangle of the current set to index
+ * @param size_t count
+ *   The number of triangles in the current set
  * @param int depth 
  *   The current depth in the tree the function is being called at
  * @param SplitStrategy splitStrategy 
@@ -508,21 +628,25 @@ static float getZ(const glm::vec3& p) {return p.z; }
  *   The strategy used to determine where to split on
  * @returns Node
  */
-NodeChild const * build(const std::vector<Tri>& triangles
+NodeChild const * build(std::vector<Tri>& triangles
+	                   ,unsigned int first
+	                   ,size_t count
 	                   ,int currentDepth
 				       ,unique_ptr<SplitStrategy> splitStrategy
 					   ,StorageStrategy* storageStrategy)
 {
+	Tri* data = triangles.data() + first;
+
 	// Compute the AABB needed to contain all triangle corners
-	AABB extent = findExtent(triangles);
+	AABB extent = findExtent(data, count);
 
 	// Have we reached a situation in which we create a leaf?
 	//if (currentDepth > maxDepth) {
-	if (storageStrategy->done(currentDepth, triangles.size())) {
+	if (storageStrategy->done(currentDepth, static_cast<int>(count))) {
 
 		// Only bother to create a Leaf instance if there's any actual data to store:
-		if (triangles.size() > 0) {
-			return new NodeChild(new Leaf(triangles, extent, currentDepth));
+		if (count > 0) {
+			return new NodeChild(new Leaf(first, static_cast<int>(count), extent, currentDepth));
 		}
 
 		return nullptr;
@@ -531,7 +655,7 @@ NodeChild const * build(const std::vector<Tri>& triangles
 	glm::vec3 splitPoint = extent.centroid();
 
 	// Now find the split axis: 0 = X, 1 = Y, 2 = Z
-	int axis = splitStrategy->nextAxis(triangles);
+	int axis = splitStrategy->nextAxis(data, count);
 	assert (axis >= 0 && axis <= 2);
 
 	// Component getter:
@@ -549,37 +673,28 @@ NodeChild const * build(const std::vector<Tri>& triangles
 			break;
 	}
 
-	// Partition the triangles according to the scheme:
-	std::vector<Tri> left, right;
-
-	for (auto i=triangles.begin(); i != triangles.end(); i++) {
-
-		Tri T              = *i;
-		glm::vec3 centroid = T.getAABB().centroid();
-
-		// Based on the split-axis. Compare the chosen axis-component of each triangle's
-		// centroid against the split axis value. Those less than splitOnValue go in one
-		// list, everything else goes in the other list. Afterward, we recurse on the
-		// partitions
+	// Partition the triangles according to the scheme. Based on the split-axis,
+	// compare the chosen axis-component of each triangle's centroid against the
+	// split axis value. Those less than it are moved to the front of the run, 
+	// keeping their order, everything else goes after them. Afterward, we 
+	// recurse on the partitions
+	float splitValue = axisValue(splitPoint);
 
-		if (axisValue(centroid) < axisValue(splitPoint)) {
+	Tri* middle = stable_partition(data, data + count, [axisValue, splitValue](const Tri& T) {
+		return axisValue(T.getAABB().centroid()) < splitValue;
+	});
 
-			left.push_back(*i);
-
-		} else if (axisValue(centroid) >= axisValue(splitPoint)) {
-
-			right.push_back(*i);
-		} 
-	}
+	size_t leftCount  = middle - data;
+	size_t rightCount = count - leftCount;
 
 	Split S = splitStrategy->divide();
 
 	NodeChild const * N =
-		new NodeChild(new Node(left.size() > 0 
-								? build(left, currentDepth + 1, move(get<0>(S)), storageStrategy) 
+		new NodeChild(new Node(leftCount > 0 
+								? build(triangles, first, leftCount, currentDepth + 1, move(get<0>(S)), storageStrategy) 
 								: nullptr
-			                  ,right.size() > 0 
-			                  	? build(right, currentDepth + 1, move(get<1>(S)), storageStrategy) 
+			                  ,rightCount > 0 
+			                  	? build(triangles, first + static_cast<unsigned int>(leftCount), rightCount, currentDepth + 1, move(get<1>(S)), storageStrategy) 
 			                  	: nullptr
 							  ,extent
 							  ,currentDepth
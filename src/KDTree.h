@@ -48,8 +48,8 @@ class SplitStrategy
 		// Returns the name of this splitting strategy
 		virtual std::string getName() const = 0;
 
-		// Returns the axis to split on
-		virtual int nextAxis(const std::vector<Tri>& _data) = 0;
+		// Returns the axis to split on, given the triangles being split
+		virtual int nextAxis(Tri const * data, size_t count) = 0;
 
 		// Divide the splitter state into two new instances for
 		// the left and right subtrees to recurse on
@@ -74,7 +74,7 @@ class CycleAxisStrategy : public SplitStrategy
 
 		virtual std::string getName() const { return "CycleAxisStrategy"; }
 
-		virtual int nextAxis(const std::vector<Tri>& _data);
+		virtual int nextAxis(Tri const * data, size_t count);
 		
 		virtual Split divide() const;
 };
@@ -92,7 +92,7 @@ class RandomAxisStrategy : public SplitStrategy
 
 		virtual std::string getName() const { return "RandomAxisStrategy"; }
 
-		virtual int nextAxis(const std::vector<Tri>& _data);
+		virtual int nextAxis(Tri const * data, size_t count);
 		
 		virtual Split divide() const;
 };
@@ -110,7 +110,7 @@ class SurfaceAreaStrategy : public SplitStrategy
 
 		virtual std::string getName() const { return "SurfaceAreaStrategy"; }
 
-		virtual int nextAxis(const std::vector<Tri>& _data);
+		virtual int nextAxis(Tri const * data, size_t count);
 		
 		virtual Split divide() const;
 };
@@ -169,22 +169,24 @@ class MaxValuesPerLeaf : public StorageStrategy
 };
 
 /**
- * Tree leaves contain the actual data to be looked up
+ * Tree leaves refer to the data to be looked up: a run of consecutive 
+ * triangles in the tree's triangle array
  */
 class Leaf
 {
 	protected:
-		std::vector<Tri> data;
+		unsigned int first;
+		int count;
 		AABB aabb;
 		int depth;
 
 	public:
-		Leaf(const std::vector<Tri>& _data, const AABB& extent, int depth);
+		Leaf(unsigned int first, int count, const AABB& extent, int depth);
 		Leaf(const Leaf& other);
 
-		const std::vector<Tri>& getData() const { return this->data; }
+		unsigned int getFirst() const           { return this->first; }
 		const AABB& getAABB() const             { return this->aabb; }
-		int getCount() const                    { return this->data.size(); }
+		int getCount() const                    { return this->count; }
 		int getDepth() const                    { return this->depth; }
 
 		std::ostream& repr(std::ostream& s
@@ -232,6 +234,8 @@ std::ostream& operator<<(std::ostream& s, const Node& node);
  * data type KDTree, if it were defined in Haskell:
  *
  *   data KDTree = Node KDTree KDTree | Leaf [Tri]
+ *
+ * where the triangles of a leaf are a slice of the tree's triangle array
  */
 class NodeChild
 {
@@ -301,25 +305,44 @@ class KDTree
 		// Recursive helper to count the number of primitives per leaf node:
 		int countInNode(NodeChild const * root) const ;
 
+		// Recursive helper to sum the memory used by nodes and leaves:
+		size_t sizeOfNode(NodeChild const * root) const;
+
 		// Recursive helper function for KDTree::intersects
 		bool intersectWalk(const Ray& ray, NodeChild const * root, std::vector<Tri>& tris) const;
 
 	protected:
+		// Every triangle in the tree, ordered so that the triangles of each
+		// leaf are consecutive. The tree is their only copy
+		std::vector<Tri> triangles;
+
 		// Root of the KD-tree
 		NodeChild const * root;
 
 	public:
-		KDTree(const std::vector<Tri>& data
+		KDTree(std::vector<Tri> data
 			  ,SplitStrategy* splitStrategy
 			  ,StorageStrategy* storageStrategy);
 
 		// Count the number of primitives/triangles indexed in the tree
 		int count() const { return this->countInNode(this->root); }
 
+		// The triangles indexed, in leaf order
+		const std::vector<Tri>& getTriangles() const { return this->triangles; }
+
+		// Bytes used by the triangles, nodes and leaves of the tree
+		size_t getByteSize() const;
+
 		// Tests if the given ray intersects the KD-tree, returning any triangles
 		// that are potentially intersected, collecting the resulting triangle
 		// instances into the supplied vector
-		bool intersects(const Ray& ray, std::vector<Tri>& tris);
+		bool intersects(const Ray& ray, std::vector<Tri>& tris) const;
+
+		// Finds the closest triangle hit by the ray within [ray.tMin, ray.tMax],
+		// setting t and the barycentric weights W. Subtrees are visited nearest 
+		// first and skipped once they start beyond the closest hit found so 
+		// far. Returns nullptr on a miss
+		Tri const * closest(const Ray& ray, float& t, glm::vec3& W) const;
 
 		// Get the build time in milliseconds
 		int getBuildTime() const { return this->msBuildTime; }
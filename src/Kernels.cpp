@@ -0,0 +1,155 @@
+/*******************************************************************************
+ *
+ * This file defines the table of hot SIMD kernels. Each kernel is compiled
+ * once per supported instruction set; the best one the CPU supports is
+ * selected once at startup
+ *
+ * @file Kernels.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <stdexcept>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#include "Kernels.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+static const char* ISA_NAMES[Kernels::ISA_COUNT] = { "sse2", "avx2", "avx512" };
+
+const Kernels::Table* Kernels::current = Kernels::sse2Table();
+
+// Picks the best kernels before main() runs, so they are in place for
+// anything that renders without going through main():
+static struct AutoSelect
+{
+    AutoSelect() { Kernels::select(Kernels::best()); }
+} autoSelect;
+
+/******************************************************************************/
+
+const char* Kernels::name(Isa isa)
+{
+    return ISA_NAMES[isa];
+}
+
+bool Kernels::fromName(const string& name, Isa& isa)
+{
+    for (int i=0; i<ISA_COUNT; i++) {
+        if (name == ISA_NAMES[i]) {
+            isa = static_cast<Isa>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Kernels::cpuSupports(Isa isa)
+{
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+    // These also check that the OS saves the wider registers:
+    switch (isa) {
+        case SSE2:
+            return __builtin_cpu_supports("sse2");
+        case AVX2:
+            return __builtin_cpu_supports("avx2");
+        case AVX512:
+            return __builtin_cpu_supports("avx512f");
+        default:
+            return false;
+    }
+
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+
+    int info[4];
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool sse2    = (info[3] & (1 << 26)) != 0;
+
+    __cpuidex(info, 7, 0);
+    bool avx2   = (info[1] & (1 << 5)) != 0;
+    bool avx512 = (info[1] & (1 << 16)) != 0;
+
+    // The OS must save the YMM (and for AVX-512, the ZMM + mask) state:
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+    switch (isa) {
+        case SSE2:
+            return sse2;
+        case AVX2:
+            return avx2 && (xcr0 & 0x6) == 0x6;
+        case AVX512:
+            return avx512 && (xcr0 & 0xe6) == 0xe6;
+        default:
+            return false;
+    }
+
+    #else
+
+    return isa == SSE2;
+
+    #endif
+}
+
+bool Kernels::available(Isa isa)
+{
+    const Table* table = nullptr;
+
+    switch (isa) {
+        case SSE2:
+            table = sse2Table();
+            break;
+        case AVX2:
+            table = avx2Table();
+            break;
+        case AVX512:
+            table = avx512Table();
+            break;
+        default:
+            break;
+    }
+
+    return table != nullptr && cpuSupports(isa);
+}
+
+Kernels::Isa Kernels::best()
+{
+    for (int i=ISA_COUNT-1; i>0; i--) {
+        if (available(static_cast<Isa>(i))) {
+            return static_cast<Isa>(i);
+        }
+    }
+
+    return SSE2;
+}
+
+void Kernels::select(Isa isa)
+{
+    if (isa != SSE2 && !available(isa)) {
+        throw runtime_error(string("Instruction set ") + name(isa) + " is not supported by this CPU or build");
+    }
+
+    switch (isa) {
+        case AVX2:
+            current = avx2Table();
+            break;
+        case AVX512:
+            current = avx512Table();
+            break;
+        default:
+            current = sse2Table();
+            break;
+    }
+}
+
+/******************************************************************************/
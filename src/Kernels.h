@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *
+ * This file defines the table of hot SIMD kernels. Each kernel is compiled
+ * once per supported instruction set; the best one the CPU supports is
+ * selected once at startup.
+ *
+ * Only loops that run over many independent values belong here. The color
+ * accumulation of supersampling stays in samplePixel() (Raytrace.cpp): it
+ * adds one traced sample at a time, three floats after a whole call to
+ * trace(), so there is no run of data for wider registers to work on. The
+ * same goes for ray/triangle tests and KD-tree traversal, which follow one
+ * ray at a time. The ray/box slab test those traversals make at every node
+ * is here, though: its three axes share one register. So is the bilinear
+ * texel blend behind every texture lookup, for its four channels
+ *
+ * @file Kernels.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+#include <string>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/******************************************************************************/
+
+class PrimitiveBatch;
+struct Ray;
+
+namespace Kernels
+{
+	// Instruction set levels, in increasing order of preference
+	enum Isa {
+		 SSE2
+		,AVX2
+		,AVX512
+		,ISA_COUNT
+	};
+
+	// Kernel implementations for one instruction set
+	struct Table
+	{
+		Isa isa;
+
+		// Number of SIMD lanes processed at once
+		int width;
+
+		// See PrimitiveBatch::intersect()
+		int (*intersectBatch)(const PrimitiveBatch& batch, const glm::vec3& orig, const glm::vec3& dir, float tMax, float* t);
+
+		// See AABB::intersected(); bounds is the box's { min, max } corners
+		bool (*intersectBox)(const glm::vec3* bounds, const Ray& ray);
+
+		// Blends four RGBA8 texels, red in the lowest byte, with the bilinear
+		// weights W[4], in the order (x0,y0), (x1,y0), (x0,y1), (x1,y1).
+		// Writes RGBA in [0,1] to rgba[4]
+		void (*blendTexels)(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, const float* W, float* rgba);
+
+		// Sobel edge filter over a w x h intensity map stored in column-major
+		// order. Writes the clamped gradient magnitude of every interior
+		// pixel to edgeMap; border pixels are left untouched
+		void (*sobel)(const float* intensity, int w, int h, float* edgeMap);
+	};
+
+	// Per instruction set tables; nullptr if the build doesn't include it
+	const Table* sse2Table();
+	const Table* avx2Table();
+	const Table* avx512Table();
+
+	// Currently selected table; see active()
+	extern const Table* current;
+
+	// Returns the table selected at startup or by select()
+	inline const Table& active() { return *current; }
+
+	// Returns the name of an instruction set: "sse2", "avx2" or "avx512"
+	const char* name(Isa isa);
+
+	// Parses an instruction set name, returning false if it is unknown
+	bool fromName(const std::string& name, Isa& isa);
+
+	// Tests if the CPU (and operating system) support the instruction set
+	bool cpuSupports(Isa isa);
+
+	// Tests if the instruction set is both compiled in and supported
+	bool available(Isa isa);
+
+	// Returns the best available instruction set
+	Isa best();
+
+	// Selects the kernels for the given instruction set. Throws if it is
+	// not available. Must not be called while rendering
+	void select(Isa isa);
+}
+
+/******************************************************************************/
+
+#endif
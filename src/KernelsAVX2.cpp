@@ -0,0 +1,64 @@
+/*******************************************************************************
+ *
+ * AVX2 build of the kernels in KernelsImpl.h. Compiled with -mavx2 (or
+ * /arch:AVX2); only ever called once Kernels has checked the CPU supports it
+ *
+ * @file KernelsAVX2.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include "Kernels.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+#include "KernelsImpl.h"
+
+/******************************************************************************/
+
+namespace
+{
+	struct AVX2Vec
+	{
+		static const int N = 8;
+
+		typedef __m256 F;
+		typedef __m256 M;
+
+		static F load(const float* p)      { return _mm256_loadu_ps(p); }
+		static void store(float* p, F x)   { _mm256_storeu_ps(p, x); }
+		static F set1(float x)             { return _mm256_set1_ps(x); }
+		static F zero()                    { return _mm256_setzero_ps(); }
+		static F add(F x, F y)             { return _mm256_add_ps(x, y); }
+		static F sub(F x, F y)             { return _mm256_sub_ps(x, y); }
+		static F mul(F x, F y)             { return _mm256_mul_ps(x, y); }
+		static F div(F x, F y)             { return _mm256_div_ps(x, y); }
+		static F sqrt(F x)                 { return _mm256_sqrt_ps(x); }
+		static F neg(F x)                  { return _mm256_xor_ps(x, _mm256_set1_ps(-0.0f)); }
+		static M lt(F x, F y)              { return _mm256_cmp_ps(x, y, _CMP_LT_OQ); }
+		static M gt(F x, F y)              { return _mm256_cmp_ps(x, y, _CMP_GT_OQ); }
+		static M ge(F x, F y)              { return _mm256_cmp_ps(x, y, _CMP_GE_OQ); }
+		static M eq(F x, F y)              { return _mm256_cmp_ps(x, y, _CMP_EQ_OQ); }
+		static M or_(M m1, M m2)           { return _mm256_or_ps(m1, m2); }
+		static F select(M m, F x, F y)     { return _mm256_blendv_ps(y, x, m); }
+		static int bits(M m)               { return _mm256_movemask_ps(m); }
+	};
+}
+
+const Kernels::Table* Kernels::avx2Table()
+{
+	static const Table table = makeTable<AVX2Vec>(AVX2);
+	return &table;
+}
+
+#else
+
+const Kernels::Table* Kernels::avx2Table()
+{
+	return nullptr;
+}
+
+#endif
+
+/******************************************************************************/
@@ -0,0 +1,64 @@
+/*******************************************************************************
+ *
+ * AVX-512 build of the kernels in KernelsImpl.h. Compiled with -mavx512f (or
+ * /arch:AVX512); only ever called once Kernels has checked the CPU supports it
+ *
+ * @file KernelsAVX512.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include "Kernels.h"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+#include "KernelsImpl.h"
+
+/******************************************************************************/
+
+namespace
+{
+	struct AVX512Vec
+	{
+		static const int N = 16;
+
+		typedef __m512 F;
+		typedef __mmask16 M;
+
+		static F load(const float* p)      { return _mm512_loadu_ps(p); }
+		static void store(float* p, F x)   { _mm512_storeu_ps(p, x); }
+		static F set1(float x)             { return _mm512_set1_ps(x); }
+		static F zero()                    { return _mm512_setzero_ps(); }
+		static F add(F x, F y)             { return _mm512_add_ps(x, y); }
+		static F sub(F x, F y)             { return _mm512_sub_ps(x, y); }
+		static F mul(F x, F y)             { return _mm512_mul_ps(x, y); }
+		static F div(F x, F y)             { return _mm512_div_ps(x, y); }
+		static F sqrt(F x)                 { return _mm512_sqrt_ps(x); }
+		static F neg(F x)                  { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x), _mm512_set1_epi32(static_cast<int>(0x80000000u)))); }
+		static M lt(F x, F y)              { return _mm512_cmp_ps_mask(x, y, _CMP_LT_OQ); }
+		static M gt(F x, F y)              { return _mm512_cmp_ps_mask(x, y, _CMP_GT_OQ); }
+		static M ge(F x, F y)              { return _mm512_cmp_ps_mask(x, y, _CMP_GE_OQ); }
+		static M eq(F x, F y)              { return _mm512_cmp_ps_mask(x, y, _CMP_EQ_OQ); }
+		static M or_(M m1, M m2)           { return static_cast<M>(m1 | m2); }
+		static F select(M m, F x, F y)     { return _mm512_mask_blend_ps(m, y, x); }
+		static int bits(M m)               { return static_cast<int>(m); }
+	};
+}
+
+const Kernels::Table* Kernels::avx512Table()
+{
+	static const Table table = makeTable<AVX512Vec>(AVX512);
+	return &table;
+}
+
+#else
+
+const Kernels::Table* Kernels::avx512Table()
+{
+	return nullptr;
+}
+
+#endif
+
+/******************************************************************************/
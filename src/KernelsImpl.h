@@ -0,0 +1,367 @@
+/*******************************************************************************
+ *
+ * Kernel implementations shared by every instruction set. This header is
+ * only included by the KernelsSSE2/AVX2/AVX512.cpp translation units, each of
+ * which is compiled with its own target flags and supplies a wrapper type V
+ * around its native SIMD registers:
+ *
+ *   V::N                   Number of lanes
+ *   V::F, V::M             Float vector and lane mask types
+ *   load(p), store(p, x)   Unaligned load / store of N floats
+ *   set1(x), zero()        Broadcasts
+ *   add, sub, mul, div     Lane-wise arithmetic
+ *   sqrt(x), neg(x)        Lane-wise square root and negation
+ *   lt, gt, ge, eq         Ordered comparisons, false if either lane is NaN
+ *   or_(m1, m2)            Lane mask union
+ *   select(m, x, y)        Per lane: m ? x : y
+ *   bits(m)                Lane mask as an integer, lane i in bit i
+ *
+ * None of the kernels may be compiled with floating point contraction (FMA)
+ * enabled; every instruction set must produce exactly the same results.
+ *
+ * Everything here has internal linkage and avoids inline library helpers
+ * such as std::min(): the linker must never merge a copy built for one
+ * instruction set into code that runs on a CPU without it
+ *
+ * @file KernelsImpl.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef KERNELS_IMPL_H
+#define KERNELS_IMPL_H
+
+#ifdef ENABLE_OPENMP
+#include <omp.h>
+#endif
+#include <math.h>
+#include "Kernels.h"
+#include "PrimitiveBatch.h"
+#include "Ray.h"
+#if ENABLE_PRIMITIVE_BATCHES
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/******************************************************************************/
+
+namespace
+{
+	/**
+	 * Computes row r of M * (x,y,z,w) for lanes [base, base + N), summing
+	 * the terms in the same order as glm does: (m0 * x + m1 * y) + (m2 * z + m3 * w)
+	 */
+	template <typename V>
+	inline typename V::F transformRow(const float (*M)[PrimitiveBatch::WIDTH], int base, int r
+	                                 ,typename V::F x, typename V::F y, typename V::F z, typename V::F w)
+	{
+		typename V::F add0 = V::add(V::mul(V::load(M[r] + base), x), V::mul(V::load(M[4 + r] + base), y));
+		typename V::F add1 = V::add(V::mul(V::load(M[8 + r] + base), z), V::mul(V::load(M[12 + r] + base), w));
+
+		return V::add(add0, add1);
+	}
+
+	/**
+	 * Slab test against an axis-aligned box, multiplying by the reciprocal
+	 * direction; mirrors Cube::hitImpl() for a ray over [0, infinity)
+	 */
+	template <typename V>
+	inline typename V::F intersectCubes(const PrimitiveBatch& batch, int base
+	                                   ,typename V::F ox, typename V::F oy, typename V::F oz
+	                                   ,typename V::F dx, typename V::F dy, typename V::F dz)
+	{
+		typedef typename V::F F;
+		typedef typename V::M M;
+
+		const F zero = V::zero();
+		const F one  = V::set1(1.0f);
+
+		// As Ray::computeReciprocal():
+		F ix = V::div(one, dx);
+		F iy = V::div(one, dy);
+		F iz = V::div(one, dz);
+
+		M sx = V::lt(ix, zero);
+		M sy = V::lt(iy, zero);
+		M sz = V::lt(iz, zero);
+
+		F minX = V::load(batch.a[0] + base), maxX = V::load(batch.b[0] + base);
+		F minY = V::load(batch.a[1] + base), maxY = V::load(batch.b[1] + base);
+		F minZ = V::load(batch.a[2] + base), maxZ = V::load(batch.b[2] + base);
+
+		// As AABB::slabs():
+		F inX  = V::mul(V::sub(V::select(sx, maxX, minX), ox), ix);
+		F inY  = V::mul(V::sub(V::select(sy, maxY, minY), oy), iy);
+		F inZ  = V::mul(V::sub(V::select(sz, maxZ, minZ), oz), iz);
+		F outX = V::mul(V::sub(V::select(sx, minX, maxX), ox), ix);
+		F outY = V::mul(V::sub(V::select(sy, minY, maxY), oy), iy);
+		F outZ = V::mul(V::sub(V::select(sz, minZ, maxZ), oz), iz);
+
+		// As AABB::maxNear() and AABB::minFar(), which skip NaN distances:
+		F tNear = V::set1(-INFINITY);
+		tNear   = V::select(V::gt(inX, tNear), inX, tNear);
+		tNear   = V::select(V::gt(inY, tNear), inY, tNear);
+		tNear   = V::select(V::gt(inZ, tNear), inZ, tNear);
+
+		F tFar = V::set1(INFINITY);
+		tFar   = V::select(V::lt(outX, tFar), outX, tFar);
+		tFar   = V::select(V::lt(outY, tFar), outY, tFar);
+		tFar   = V::select(V::lt(outZ, tFar), outZ, tFar);
+
+		M miss = V::or_(V::gt(tNear, tFar), V::lt(tFar, zero));
+		F t    = V::select(V::lt(tNear, zero), tFar, tNear);
+
+		return V::select(miss, V::set1(-1.0f), t);
+	}
+
+	/**
+	 * Ray-sphere test; mirrors Sphere::hitImpl()
+	 */
+	template <typename V>
+	inline typename V::F intersectSpheres(const PrimitiveBatch& batch, int base
+	                                     ,typename V::F ox, typename V::F oy, typename V::F oz
+	                                     ,typename V::F dx, typename V::F dy, typename V::F dz)
+	{
+		typedef typename V::F F;
+		typedef typename V::M M;
+
+		const F zero = V::zero();
+		const F two  = V::set1(2.0f);
+
+		F ocx = V::sub(ox, V::load(batch.a[0] + base));
+		F ocy = V::sub(oy, V::load(batch.a[1] + base));
+		F ocz = V::sub(oz, V::load(batch.a[2] + base));
+
+		F a = V::add(V::add(V::mul(dx, dx), V::mul(dy, dy)), V::mul(dz, dz));
+		F b = V::mul(two, V::add(V::add(V::mul(dx, ocx), V::mul(dy, ocy)), V::mul(dz, ocz)));
+		F c = V::sub(V::add(V::add(V::mul(ocx, ocx), V::mul(ocy, ocy)), V::mul(ocz, ocz))
+		            ,V::load(batch.radius2 + base));
+		F D = V::sub(V::mul(b, b), V::mul(V::mul(V::set1(4.0f), a), c));
+
+		M miss   = V::lt(D, zero);
+		F sqrtD  = V::sqrt(D);
+		F minusB = V::neg(b);
+
+		F q = V::div(V::select(V::lt(b, zero), V::add(minusB, sqrtD), V::sub(minusB, sqrtD)), two);
+		F m = V::div(q, a);
+		F n = V::div(c, q);
+
+		// u = std::min(m, n), v = std::max(m, n)
+		F u = V::select(V::lt(n, m), n, m);
+		F v = V::select(V::lt(m, n), n, m);
+		F t = V::select(V::lt(u, zero), v, u);
+
+		return V::select(miss, V::set1(-1.0f), t);
+	}
+
+	/**
+	 * See PrimitiveBatch::intersect(). Lanes are processed N at a time; the
+	 * unused lanes of a partly filled batch are zeroed, so they are safe to
+	 * compute and are masked off at the end
+	 */
+	template <typename V>
+	int intersectBatch(const PrimitiveBatch& batch, const glm::vec3& orig, const glm::vec3& dir, float tMax, float* t)
+	{
+		typedef typename V::F F;
+
+		const F zero  = V::zero();
+		const F one   = V::set1(1.0f);
+		const F limit = V::set1(tMax);
+
+		F wx = V::set1(orig.x);
+		F wy = V::set1(orig.y);
+		F wz = V::set1(orig.z);
+		F vx = V::set1(dir.x);
+		F vy = V::set1(dir.y);
+		F vz = V::set1(dir.z);
+
+		int mask = 0;
+
+		for (int base=0; base<batch.count; base += V::N) {
+
+			// Transform the ray into the OBJECT-LOCAL-space of every lane, as
+			// Utils::transform() does: points are divided by w, directions are not
+			F pw = transformRow<V>(batch.invT, base, 3, wx, wy, wz, one);
+			F w  = V::select(V::eq(pw, zero), one, pw);
+
+			F ox = V::div(transformRow<V>(batch.invT, base, 0, wx, wy, wz, one), w);
+			F oy = V::div(transformRow<V>(batch.invT, base, 1, wx, wy, wz, one), w);
+			F oz = V::div(transformRow<V>(batch.invT, base, 2, wx, wy, wz, one), w);
+			F dx = transformRow<V>(batch.invT, base, 0, vx, vy, vz, zero);
+			F dy = transformRow<V>(batch.invT, base, 1, vx, vy, vz, zero);
+			F dz = transformRow<V>(batch.invT, base, 2, vx, vy, vz, zero);
+
+			F hits = batch.type == Geometry::CUBE
+			       ? intersectCubes<V>(batch, base, ox, oy, oz, dx, dy, dz)
+			       : intersectSpheres<V>(batch, base, ox, oy, oz, dx, dy, dz);
+
+			// As Geometry::hit(), hits beyond tMax are misses:
+			hits = V::select(V::gt(hits, limit), V::set1(-1.0f), hits);
+
+			V::store(t + base, hits);
+
+			mask |= V::bits(V::ge(hits, zero)) << base;
+		}
+
+		// Lanes past the end of the batch never hit:
+		return mask & ((1 << batch.count) - 1);
+	}
+
+	#if ENABLE_PRIMITIVE_BATCHES
+	/**
+	 * See AABB::intersected(). One ray against one box, so unlike the other
+	 * kernels the lanes hold the x, y and z axes (the fourth repeats x) in a
+	 * 128-bit register, whatever the width of V; wider builds only gain the
+	 * shorter encodings. Gives exactly the result of AABB::slabs() reduced by
+	 * AABB::maxNear() and AABB::minFar()
+	 */
+	bool intersectBox(const glm::vec3* bounds, const Ray& ray)
+	{
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 o   = _mm_setr_ps(ray.orig.x, ray.orig.y, ray.orig.z, ray.orig.x);
+		__m128 inv = _mm_setr_ps(ray.invDir.x, ray.invDir.y, ray.invDir.z, ray.invDir.x);
+		__m128 lo  = _mm_setr_ps(bounds[0].x, bounds[0].y, bounds[0].z, bounds[0].x);
+		__m128 hi  = _mm_setr_ps(bounds[1].x, bounds[1].y, bounds[1].z, bounds[1].x);
+
+		// As Ray::sign, the near plane is the maximum for a negative direction:
+		__m128 neg   = _mm_cmplt_ps(inv, zero);
+		__m128 nearP = _mm_or_ps(_mm_and_ps(neg, hi), _mm_andnot_ps(neg, lo));
+		__m128 farP  = _mm_or_ps(_mm_and_ps(neg, lo), _mm_andnot_ps(neg, hi));
+
+		__m128 tNear = _mm_mul_ps(_mm_sub_ps(nearP, o), inv);
+		__m128 tFar  = _mm_mul_ps(_mm_sub_ps(farP, o), inv);
+
+		// maxps and minps return their second operand when either is NaN,
+		// so this skips NaN distances as maxNear() and minFar() do. Once 
+		// none are left, the order of the reduction doesn't matter:
+		tNear = _mm_max_ps(tNear, _mm_set1_ps(ray.tMin));
+		tFar  = _mm_min_ps(tFar, _mm_set1_ps(ray.tMax));
+
+		tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 0, 3, 2)));
+		tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 3, 0, 1)));
+		tFar  = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 0, 3, 2)));
+		tFar  = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		return _mm_cvtss_f32(tNear) <= _mm_cvtss_f32(tFar);
+	}
+
+	/**
+	 * See Kernels::Table::blendTexels. As in intersectBox(), the lanes hold
+	 * the channels of one texel, not N independent values. AVX2 and wider
+	 * builds widen two texels per instruction (vpmovzxbd) and weight them in
+	 * one 256-bit register; either way the sum is formed in the same order,
+	 * (W0 t00 + W1 t10) + (W2 t01 + W3 t11), so the results are identical
+	 */
+	void blendTexels(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, const float* W, float* rgba)
+	{
+		#if defined(__AVX2__)
+
+		__m256 w   = _mm256_castps128_ps256(_mm_loadu_ps(W));
+		__m256 w01 = _mm256_permutevar8x32_ps(w, _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1));
+		__m256 w23 = _mm256_permutevar8x32_ps(w, _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3));
+
+		__m256 top    = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_setr_epi32(static_cast<int>(t00), static_cast<int>(t10), 0, 0))), w01);
+		__m256 bottom = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_setr_epi32(static_cast<int>(t01), static_cast<int>(t11), 0, 0))), w23);
+
+		__m128 c = _mm_add_ps(_mm_add_ps(_mm256_castps256_ps128(top), _mm256_extractf128_ps(top, 1))
+		                     ,_mm_add_ps(_mm256_castps256_ps128(bottom), _mm256_extractf128_ps(bottom, 1)));
+
+		#else
+
+		const __m128i zero = _mm_setzero_si128();
+
+		// Widens the 4 bytes of a texel to 4 floats:
+		#define UNPACK_TEXEL(t) \
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(t)), zero), zero))
+
+		__m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(UNPACK_TEXEL(t00), _mm_set1_ps(W[0]))
+		                                ,_mm_mul_ps(UNPACK_TEXEL(t10), _mm_set1_ps(W[1])))
+		                     ,_mm_add_ps(_mm_mul_ps(UNPACK_TEXEL(t01), _mm_set1_ps(W[2]))
+		                                ,_mm_mul_ps(UNPACK_TEXEL(t11), _mm_set1_ps(W[3]))));
+
+		#undef UNPACK_TEXEL
+
+		#endif
+
+		_mm_storeu_ps(rgba, _mm_mul_ps(c, _mm_set1_ps(1.0f / 255.0f)));
+	}
+	#endif
+
+	/**
+	 * See Kernels::Table::sobel. Plain scalar code: the inner loop runs down
+	 * a column of the map, which the compiler vectorizes for whichever
+	 * instruction set the including translation unit targets. The terms are
+	 * summed in the same order as the original per-pixel filter
+	 */
+	template <typename V>
+	void sobel(const float* intensity, int w, int h, float* edgeMap)
+	{
+		// Sobel filter in X:
+		static const float Gx[3][3] = {{-1.0f, 0.0f, 1.0f}
+		                              ,{-2.0f, 0.0f, 2.0f}
+		                              ,{-1.0f, 0.0f, 1.0f}};
+		// Sobel filter in Y:
+		static const float Gy[3][3] = {{-1.0f, -2.0f, -1.0f}
+		                              ,{ 0.0f,  0.0f,  0.0f}
+		                              ,{ 1.0f,  2.0f,  1.0f}};
+
+		#ifdef ENABLE_OPENMP
+		#pragma omp parallel for
+		#endif
+		for (int i=1; i<(w-1); i++) {
+
+			const float* c0 = intensity + ((i - 1) * h);
+			const float* c1 = intensity + (i * h);
+			const float* c2 = intensity + ((i + 1) * h);
+			float* out      = edgeMap + (i * h);
+
+			for (int j=1; j<(h-1); j++) {
+
+				// Gradient values in the X and Y directions at (i,j)
+				float X = 0.0f;
+				float Y = 0.0f;
+
+				X += c0[j - 1] * Gx[0][0]; Y += c0[j - 1] * Gy[0][0];
+				X += c0[j]     * Gx[0][1]; Y += c0[j]     * Gy[0][1];
+				X += c0[j + 1] * Gx[0][2]; Y += c0[j + 1] * Gy[0][2];
+				X += c1[j - 1] * Gx[1][0]; Y += c1[j - 1] * Gy[1][0];
+				X += c1[j]     * Gx[1][1]; Y += c1[j]     * Gy[1][1];
+				X += c1[j + 1] * Gx[1][2]; Y += c1[j + 1] * Gy[1][2];
+				X += c2[j - 1] * Gx[2][0]; Y += c2[j - 1] * Gy[2][0];
+				X += c2[j]     * Gx[2][1]; Y += c2[j]     * Gy[2][1];
+				X += c2[j + 1] * Gx[2][2]; Y += c2[j + 1] * Gy[2][2];
+
+				// Compute the gradient magnitude and clamp to the range [0,1],
+				// as std::min(std::max(0.0f, magnitude), 1.0f) would:
+				float magnitude = sqrtf((X * X) + (Y * Y));
+				magnitude = 0.0f < magnitude ? magnitude : 0.0f;
+				out[j]    = 1.0f < magnitude ? 1.0f : magnitude;
+			}
+		}
+	}
+
+	/**
+	 * Builds the table for wrapper type V
+	 */
+	template <typename V>
+	Kernels::Table makeTable(Kernels::Isa isa)
+	{
+		Kernels::Table table;
+
+		table.isa            = isa;
+		table.width          = V::N;
+		table.intersectBatch = &intersectBatch<V>;
+		table.intersectBox   = &intersectBox;
+		table.blendTexels    = &blendTexels;
+		table.sobel          = &sobel<V>;
+
+		return table;
+	}
+}
+
+/******************************************************************************/
+
+#endif
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ * SSE2 build of the kernels in KernelsImpl.h. This is the baseline every
+ * x86-64 processor supports
+ *
+ * @file KernelsSSE2.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include "PrimitiveBatch.h"
+#if ENABLE_PRIMITIVE_BATCHES
+#include <emmintrin.h>
+#endif
+#include "KernelsImpl.h"
+#if !ENABLE_PRIMITIVE_BATCHES
+#include "AABB.h"
+#endif
+
+/******************************************************************************/
+
+#if ENABLE_PRIMITIVE_BATCHES
+
+namespace
+{
+	struct SSE2Vec
+	{
+		static const int N = 4;
+
+		typedef __m128 F;
+		typedef __m128 M;
+
+		static F load(const float* p)      { return _mm_loadu_ps(p); }
+		static void store(float* p, F x)   { _mm_storeu_ps(p, x); }
+		static F set1(float x)             { return _mm_set1_ps(x); }
+		static F zero()                    { return _mm_setzero_ps(); }
+		static F add(F x, F y)             { return _mm_add_ps(x, y); }
+		static F sub(F x, F y)             { return _mm_sub_ps(x, y); }
+		static F mul(F x, F y)             { return _mm_mul_ps(x, y); }
+		static F div(F x, F y)             { return _mm_div_ps(x, y); }
+		static F sqrt(F x)                 { return _mm_sqrt_ps(x); }
+		static F neg(F x)                  { return _mm_xor_ps(x, _mm_set1_ps(-0.0f)); }
+		static M lt(F x, F y)              { return _mm_cmplt_ps(x, y); }
+		static M gt(F x, F y)              { return _mm_cmpgt_ps(x, y); }
+		static M ge(F x, F y)              { return _mm_cmpge_ps(x, y); }
+		static M eq(F x, F y)              { return _mm_cmpeq_ps(x, y); }
+		static M or_(M m1, M m2)           { return _mm_or_ps(m1, m2); }
+		static F select(M m, F x, F y)     { return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y)); }
+		static int bits(M m)               { return _mm_movemask_ps(m); }
+	};
+}
+
+const Kernels::Table* Kernels::sse2Table()
+{
+	static const Table table = makeTable<SSE2Vec>(SSE2);
+	return &table;
+}
+
+#else
+
+namespace
+{
+	// No SIMD batches on this platform: only the auto-vectorized kernels
+	struct Scalar
+	{
+		static const int N = 1;
+	};
+
+	// The plain slab test, as AABB::intersected() did before it was a kernel
+	bool intersectBox(const glm::vec3* bounds, const Ray& ray)
+	{
+		glm::vec3 tNear, tFar;
+
+		for (int i=0; i<3; i++) {
+			tNear[i] = (bounds[ray.sign[i]][i] - ray.orig[i]) * ray.invDir[i];
+			tFar[i]  = (bounds[1 - ray.sign[i]][i] - ray.orig[i]) * ray.invDir[i];
+		}
+
+		return AABB::maxNear(ray.tMin, tNear) <= AABB::minFar(ray.tMax, tFar);
+	}
+
+	// The texel blend, one channel at a time
+	void blendTexels(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, const float* W, float* rgba)
+	{
+		for (int c=0; c<4; c++) {
+
+			int shift = 8 * c;
+			float sum = ((W[0] * static_cast<float>((t00 >> shift) & 0xff)) + (W[1] * static_cast<float>((t10 >> shift) & 0xff)))
+			          + ((W[2] * static_cast<float>((t01 >> shift) & 0xff)) + (W[3] * static_cast<float>((t11 >> shift) & 0xff)));
+
+			rgba[c] = sum * (1.0f / 255.0f);
+		}
+	}
+}
+
+const Kernels::Table* Kernels::sse2Table()
+{
+	static Table table = { SSE2, Scalar::N, nullptr, &intersectBox, &blendTexels, &sobel<Scalar> };
+	return &table;
+}
+
+#endif
+
+/******************************************************************************/
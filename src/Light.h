@@ -43,6 +43,7 @@ class Light
 		{
 			  POINT_LIGHT
 			 ,AREA_LIGHT
+			 ,ENVIRONMENT_LIGHT
 		};
 
 	protected:
@@ -72,11 +73,12 @@ class Light
 		virtual glm::vec3 fromSampledPoint(const glm::vec3& from) const = 0;
 
 		/**
-		 * Like, fromSampledPoint(from), but returns the cosine angle from the 
-		 * vector formed from the center of the light to a sampled point on 
-		 * its surface and the computed light vector
+		 * Like fromSampledPoint(from), but also returns the weight of the 
+		 * sample when estimating how much of the light is seen from the 
+		 * given point: the solid angle of the light it stands for. Lights 
+		 * with nothing to sample weigh every sample the same
 		 */
-		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& cosineAngle) const = 0;
+		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& weight) const = 0;
 
 		/**
 		 * Returns the color associated with the light relative to the given position
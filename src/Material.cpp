@@ -29,7 +29,8 @@ Material::Material() :
 	emit(false),
 	ambient(DEFAULT_AMBIENT_COEFF),
 	textureMap(nullptr),
-	bumpMap(nullptr)
+	bumpMap(nullptr),
+	normalMap(nullptr)
 { 
 
 }
@@ -44,7 +45,8 @@ Material::Material(string _name
 				  ,bool _emit
 				  ,float _ambient
 				  ,shared_ptr<TextureMap> _textureMap
-				  ,shared_ptr<BumpMap> _bumpMap) :
+				  ,shared_ptr<BumpMap> _bumpMap
+				  ,shared_ptr<NormalMap> _normalMap) :
 	name(_name),
 	diff(_diff),
 	refl(_refl),
@@ -55,7 +57,8 @@ Material::Material(string _name
 	emit(_emit),
 	ambient(_ambient),
 	textureMap(_textureMap),
-	bumpMap(_bumpMap)
+	bumpMap(_bumpMap),
+	normalMap(_normalMap)
 { }
 
 Material::Material(const Material& other) :
@@ -69,7 +72,8 @@ Material::Material(const Material& other) :
 	emit(other.emit),
 	ambient(other.ambient),
 	textureMap(other.textureMap),
-	bumpMap(other.bumpMap)
+	bumpMap(other.bumpMap),
+	normalMap(other.normalMap)
 { }
 
 ostream& operator<<(ostream& s, const Material& mat)
@@ -89,10 +93,30 @@ ostream& operator<<(ostream& s, const Material& mat)
 	if (mat.hasBumpMap()) {
 		s << ", bump: " << *mat.getBumpMap();
 	}
+	if (mat.hasNormalMap()) {
+		s << ", normal: " << *mat.getNormalMap();
+	}
 	s  << " }";
 	return s;
 }
 
+/**
+ * Spheres, cylinders and meshes are mapped spherically, everything else as
+ * a cube
+ */
+vec2 Material::mapToUV(const vec3& d, shared_ptr<Geometry> geometry)
+{
+	switch (geometry->getGeometryType()) {
+		case Geometry::SPHERE:
+		case Geometry::CYLINDER:
+		case Geometry::MESH:
+			return SurfaceMap::mapToSphere(d);
+		case Geometry::CUBE:
+		default:
+			return SurfaceMap::mapToCube(d);
+	}
+}
+
 /** 
  * "Smart" color function will return the correct color based on assigned 
  * material attributes:
@@ -140,6 +164,83 @@ Color Material::getColor(const vec3& d, shared_ptr<Geometry> geometry) const
 	return this->getColor();
 }
 
+/**
+ * As getColor(d, geometry), filtering the texture map over the area between
+ * d and the positions dX and dY mapped for the neighbouring samples
+ */
+Color Material::getColor(const vec3& d
+	                    ,const vec3& dX
+	                    ,const vec3& dY
+	                    ,shared_ptr<Geometry> geometry
+	                    ,TextureMap::Filter filter) const
+{
+	if (this->hasTextureMap()) {
+
+		vec2 uv, uvX, uvY;
+
+		switch (geometry->getGeometryType()) {
+			case Geometry::SPHERE:
+			case Geometry::CYLINDER:
+			case Geometry::MESH:
+				{
+					uv  = SurfaceMap::mapToSphere(d);
+					uvX = SurfaceMap::mapToSphere(dX);
+					uvY = SurfaceMap::mapToSphere(dY);
+				}
+				break;
+			case Geometry::CUBE:
+			default:
+				{
+					uv  = SurfaceMap::mapToCube(d);
+					uvX = SurfaceMap::mapToCube(dX);
+					uvY = SurfaceMap::mapToCube(dY);
+				}
+				break;
+		}
+
+		// Take the short way around where the mapping wraps, e.g. across 
+		// the seam of a sphere:
+		vec2 dUVdx = uvX - uv;
+		vec2 dUVdy = uvY - uv;
+		dUVdx     -= glm::floor(dUVdx + 0.5f);
+		dUVdy     -= glm::floor(dUVdy + 0.5f);
+
+		return this->textureMap->getColor(uv[0], uv[1], dUVdx, dUVdy, filter);
+	}
+
+	return this->getColor();
+}
+
+/**
+ * Color at a position in a surface's own parameterization
+ */
+Color Material::getColor(const vec2& uv) const
+{
+	if (this->hasTextureMap()) {
+		vec2 st = uv - glm::floor(uv);
+		return this->textureMap->getColor(st[0], st[1]);
+	}
+
+	return this->getColor();
+}
+
+/**
+ * As getColor(uv), filtering the texture map over the area covered by the
+ * changes in (u,v) to the neighbouring samples
+ */
+Color Material::getColor(const vec2& uv
+	                    ,const vec2& dUVdx
+	                    ,const vec2& dUVdy
+	                    ,TextureMap::Filter filter) const
+{
+	if (this->hasTextureMap()) {
+		vec2 st = uv - glm::floor(uv);
+		return this->textureMap->getColor(st[0], st[1], dUVdx, dUVdy, filter);
+	}
+
+	return this->getColor();
+}
+
 /**
  * Given a position in R^3 and a geometric object, this function returns
  * the normal intensity at the given position
@@ -190,4 +291,17 @@ vec3 Material::getNormal(const vec3& d, shared_ptr<Geometry> geometry) const
 	return vec3(); // zero vector
 }
 
+/**
+ * Perturbs the unit normal N by the normal map, in the frame given by T and B
+ */
+vec3 Material::getNormal(const vec2& uv, const vec3& N, const vec3& T, const vec3& B) const
+{
+	if (this->hasNormalMap()) {
+		vec2 st = uv - glm::floor(uv);
+		return this->normalMap->perturb(st[0], st[1], N, T, B);
+	}
+
+	return N;
+}
+
 /******************************************************************************/
@@ -14,6 +14,7 @@
 #include <iostream>
 #include "Color.h"
 #include "SurfaceMap.h"
+#include "NormalMap.h"
 
 /******************************************************************************/
 
@@ -53,6 +54,9 @@ class Material
 		// Bump map
 		std::shared_ptr<BumpMap> bumpMap;
 
+		// Normal map
+		std::shared_ptr<NormalMap> normalMap;
+
 	public:
 
 		static const float DEFAULT_AMBIENT_COEFF;
@@ -68,7 +72,8 @@ class Material
 				,bool emit
 				,float ambient
 				,std::shared_ptr<TextureMap> textureMap = std::shared_ptr<TextureMap>(nullptr)
-				,std::shared_ptr<BumpMap> bumpMap = std::shared_ptr<BumpMap>(nullptr));
+				,std::shared_ptr<BumpMap> bumpMap = std::shared_ptr<BumpMap>(nullptr)
+				,std::shared_ptr<NormalMap> normalMap = std::shared_ptr<NormalMap>(nullptr));
 		Material(const Material& other);
 
         friend std::ostream& operator<<(std::ostream& os, const Material& m);
@@ -86,6 +91,12 @@ class Material
 		bool hasTextureMap() const                        { return !!this->textureMap; }
 		std::shared_ptr<BumpMap> getBumpMap() const       { return this->bumpMap; } 
 		bool hasBumpMap() const                           { return !!this->bumpMap; }
+		std::shared_ptr<NormalMap> getNormalMap() const   { return this->normalMap; } 
+		bool hasNormalMap() const                         { return !!this->normalMap; }
+
+		// Maps a position in R^3 on a geometric object to a UV position, 
+		// projecting it as is best for the type of object
+		static glm::vec2 mapToUV(const glm::vec3& d, std::shared_ptr<Geometry> geometry);
 
 		// "Smart" color function will return the correct color based on
 		// assigned material attributes:
@@ -95,6 +106,23 @@ class Material
 		// and maps a color based on the given information
 		Color getColor(const glm::vec3& d, std::shared_ptr<Geometry> geometry) const;
 
+		// As above, filtering the texture map (if any) over the area between
+		// d and dX, dY: the positions mapped for the neighbouring samples in
+		// screen x and y
+		Color getColor(const glm::vec3& d
+			          ,const glm::vec3& dX
+			          ,const glm::vec3& dY
+			          ,std::shared_ptr<Geometry> geometry
+			          ,TextureMap::Filter filter) const;
+
+		// As above, for a position in a surface's own parameterization, 
+		// e.g. a mesh's texture coordinates. Maps repeat outside [0,1]
+		Color getColor(const glm::vec2& uv) const;
+		Color getColor(const glm::vec2& uv
+			          ,const glm::vec2& dUVdx
+			          ,const glm::vec2& dUVdy
+			          ,TextureMap::Filter filter) const;
+
 		// Given a position in R^3 and a geometric object, this function returns
 		// the normal intensity at the given position
 		float getIntensity(const glm::vec3& d, std::shared_ptr<Geometry> geometry) const;
@@ -102,6 +130,11 @@ class Material
 		// Given a position in R^3 and a geometric object, this function returns
 		// the surface bump normal the given position
 		glm::vec3 getNormal(const glm::vec3& d, std::shared_ptr<Geometry> geometry) const;
+
+		// Perturbs the unit surface normal N by the normal map, if any, at 
+		// the UV position uv. T and B are the directions of increasing u and
+		// of up in the image along the surface
+		glm::vec3 getNormal(const glm::vec2& uv, const glm::vec3& N, const glm::vec3& T, const glm::vec3& B) const;
 };
 
 /******************************************************************************/
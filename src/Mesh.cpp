@@ -15,8 +15,11 @@
 #include <iterator>
 #include <numeric>
 #include <limits>
+#include <glm/gtc/packing.hpp>
 #include <easylogging++.h>
 #include "Mesh.h"
+#include "Stats.h"
+#include "Utils.h"
 
 /******************************************************************************/
 
@@ -24,17 +27,55 @@ using namespace std;
 
 /******************************************************************************/
 
-Mesh::Mesh(shared_ptr<aiMesh> _meshData) :
+bool Mesh::halfNormals = false;
+
+Mesh::Memory::Memory() :
+    vertices(0),
+    normals(0),
+    texcoords(0),
+    indices(0),
+    tree(0),
+    sampling(0)
+{
+
+}
+
+size_t Mesh::Memory::total() const
+{
+    return this->vertices + this->normals + this->texcoords + this->indices + this->tree + this->sampling;
+}
+
+Mesh::Memory& Mesh::Memory::operator+=(const Memory& other)
+{
+    this->vertices  += other.vertices;
+    this->normals   += other.normals;
+    this->texcoords += other.texcoords;
+    this->indices   += other.indices;
+    this->tree      += other.tree;
+    this->sampling  += other.sampling;
+
+    return *this;
+}
+
+/******************************************************************************/
+
+Mesh::Mesh(Model::MeshData&& meshData) :
     Geometry(MESH),
-    meshData(_meshData),
-    tree(unique_ptr<KDTree>(nullptr))
+    tree(unique_ptr<KDTree>(nullptr)),
+    area(0.0f),
+    uvs(move(meshData.uvs)),
+    tangents(move(meshData.tangents)),
+    bitangents(move(meshData.bitangents))
 { 
+    this->vertices_ = move(meshData.vertices);
+    this->normals_  = move(meshData.normals);
+    this->indices_  = move(meshData.indices);
+
     this->buildGeometry();
-    this->buildVolume();
     this->computeCentroid();
     this->computeAABB();
-
-    this->tree = unique_ptr<KDTree>(new KDTree(this->triangles, new CycleAxisStrategy(), new MaxValuesPerLeaf(20)));
+    this->computeArea();
+    this->buildVolume();
 }
 
 Mesh::~Mesh() 
@@ -62,11 +103,32 @@ void Mesh::computeAABB()
 {
     this->aabb = AABB();
 
-    for (auto i = this->triangles.begin(); i != this->triangles.end(); i++) {
+    const vector<Tri>& triangles = this->tree->getTriangles();
+
+    for (auto i = triangles.begin(); i != triangles.end(); i++) {
         this->aabb += i->getAABB();
     }
 }
 
+float Mesh::triangleArea(int i) const
+{
+    glm::uvec3 indices = this->triangle(i);
+    glm::vec3 A        = this->vertices_[indices[0]];
+
+    return 0.5f * glm::length(glm::cross(this->vertices_[indices[1]] - A, this->vertices_[indices[2]] - A));
+}
+
+void Mesh::computeArea()
+{
+    this->area = 0.0f;
+
+    int n = static_cast<int>(this->getTriangleCount());
+
+    for (int i = 0; i < n; i++) {
+        this->area += this->triangleArea(i);
+    }
+}
+
 const glm::vec3& Mesh::getCentroid() const
 {
     return this->centroid;
@@ -79,7 +141,8 @@ const AABB& Mesh::getAABB() const
 
 void Mesh::buildVolume()
 {
-    this->volume = TrivialVolume();
+    // Lets a mesh that lies entirely beyond a closer hit be skipped:
+    this->volume = BoundingBox(this->aabb);
 }
 
 const BoundingVolume& Mesh::getVolume() const
@@ -89,150 +152,224 @@ const BoundingVolume& Mesh::getVolume() const
 
 void Mesh::buildGeometry()
 {
-    // Vertices
+    assert(this->normals_.size() == this->vertices_.size());
+    assert(this->indices_.size() % 3 == 0);
+
+    // Texture coordinates are flipped to match images, whose rows run down:
+
+    for (auto i = this->uvs.begin(); i != this->uvs.end(); i++) {
+        i->y = 1.0f - i->y;
+    }
 
-    assert(this->meshData->HasFaces() && this->meshData->HasNormals());
+    if (halfNormals) {
 
-    for (unsigned int i = 0; i < this->meshData->mNumVertices; i++) {
+        this->halfNormals_.reserve(this->normals_.size() * 3);
 
-        auto vertex = this->meshData->mVertices[i];
+        for (auto i = this->normals_.begin(); i != this->normals_.end(); i++) {
+            this->halfNormals_.push_back(glm::packHalf1x16(i->x));
+            this->halfNormals_.push_back(glm::packHalf1x16(i->y));
+            this->halfNormals_.push_back(glm::packHalf1x16(i->z));
+        }
 
-        this->vertices_.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+        vector<glm::vec3>().swap(this->normals_);
     }
 
-    // Normals
+    // Generate a triangle from each face, referring to the vertices, and
+    // index them. From here on vertices_ must not be resized:
+
+    size_t n = this->indices_.size() / 3;
+    vector<Tri> triangles;
+    triangles.reserve(n);
 
-    for (unsigned int i = 0; i < this->meshData->mNumVertices; i++) {
+    for (size_t i = 0; i < n; i++) {
+        triangles.push_back(Tri(static_cast<unsigned int>(i), this->triangle(static_cast<int>(i)), this->vertices_.data()));
+    }
 
-        auto normal = this->meshData->mNormals[i];
+    this->tree = unique_ptr<KDTree>(new KDTree(move(triangles), new CycleAxisStrategy(), new MaxValuesPerLeaf(20)));
+}
 
-        this->normals_.push_back(glm::vec3(normal.x, normal.y, normal.z));
+glm::vec3 Mesh::normal(unsigned int i) const
+{
+    if (this->halfNormals_.empty()) {
+        return this->normals_[i];
     }
 
-    // Indices
+    const glm::uint16* h = &this->halfNormals_[3 * i];
 
-    for (unsigned int i = 0; i < this->meshData->mNumFaces; i++) {
+    return glm::vec3(glm::unpackHalf1x16(h[0]), glm::unpackHalf1x16(h[1]), glm::unpackHalf1x16(h[2]));
+}
 
-        auto face = this->meshData->mFaces[i];
-        if (face.mNumIndices != 3) {
-            LOG(ERROR) << "face.mNumIndices = " << face.mNumIndices << endl;
-            assert(face.mNumIndices == 3);
-        }
+Mesh::Memory Mesh::getMemoryUsage() const
+{
+    Memory memory;
 
-        unsigned int u = face.mIndices[0];
-        unsigned int v = face.mIndices[1];
-        unsigned int w = face.mIndices[2];
+    memory.vertices  = this->vertices_.capacity() * sizeof(glm::vec3);
+    memory.normals   = (this->normals_.capacity() * sizeof(glm::vec3)) + (this->halfNormals_.capacity() * sizeof(glm::uint16));
+    memory.texcoords = (this->uvs.capacity() * sizeof(glm::vec2))
+                     + ((this->tangents.capacity() + this->bitangents.capacity()) * sizeof(glm::vec3));
+    memory.indices   = this->indices_.capacity() * sizeof(unsigned int);
+    memory.tree      = this->tree != nullptr ? this->tree->getByteSize() : 0;
+    memory.sampling  = this->triangleTable.getByteSize();
 
-        this->indices_.push_back(u);
-        this->indices_.push_back(v);
-        this->indices_.push_back(w);
+    return memory;
+}
 
-        // and generate a triangle from the face: 
+Hit Mesh::hitImpl(const Ray &ray) const
+{
+    float t  = -1.0f; // t distance
+    size_t I = 0;     // Index of closest triangle in the mesh
+    glm::vec3 W;      // barycentric weights
 
-        Tri t(i, glm::uvec3(u, v, w), this->vertices_[u], this->vertices_[v], this->vertices_[w]);
+    // Walk the spatial KD-tree index, nearest subtrees first:
+    Tri const * tri = this->tree->closest(ray, t, W);
 
-        this->triangles.push_back(t);
+    if (tri == nullptr) {
+        return Hit::miss();
     }
+
+    // Get the index of the triangle as it appears in the mesh
+    I = tri->getMeshIndex(); 
+
+    // The first barycentric weight is implied by the other two:
+    return Hit(t, static_cast<int>(I), glm::vec2(W[1], W[2]));
 }
 
-/**
- * Given a vector of triangles, this function returns the closest one with
- * a t value >= 0
- */
-static bool closestTriangle(const Ray& ray
-                           , const vector<Tri>& tris
-                           ,int& k
-                           ,float& t
-                           ,glm::vec3& W)
-{
-    t = numeric_limits<float>::infinity();
-    k = -1;
-    bool found = false;
-    
-    for (auto i=0; i<static_cast<int>(tris.size()); i++) {
-        float t_i = tris[i].intersected(ray, W);
-        if (t_i >= 0.0f && t_i < t) {
-            t = t_i;
-            k = i;
-            found = true;
-        }
-    }
+glm::vec3 Mesh::normalImpl(const Ray &ray, const Hit& hit) const
+{
+    glm::uvec3 indices = this->triangle(hit.primitive);
+    glm::vec3 W        = glm::vec3(1.0f - hit.uv.x - hit.uv.y, hit.uv.x, hit.uv.y);
 
-    if (!found) {
-        t = -1.0f;
-        return false;
-    }
+    // Interpolate the normal at the point-of-intersection:
 
-    // Finally, recompute barycentric weights for the correct triangle at k:
-    t = tris[k].intersected(ray, W);
+    glm::vec3 N  = (W[0] * this->normal(indices[0])) 
+                 + (W[1] * this->normal(indices[1])) 
+                 + (W[2] * this->normal(indices[2]));
 
-    return true;
+    return glm::normalize(N);
 }
 
-Intersection Mesh::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scene) const
+/**
+ * dpdu and dpdv are constant across a triangle, found from its positions and
+ * texture coordinates. The tangents computed at import are interpolated like
+ * the normals, so normal maps shade smoothly across triangles
+ */
+void Mesh::frameImpl(const Hit& hit, Intersection& isect, glm::vec3& dpdu, glm::vec3& dpdv) const
 {
-    vector<Tri> collected;
-    float t  = -1.0f; // t distance
-    size_t I = 0;     // Index of closest triangle found in collected
-    glm::vec3 W;      // barycentric weights
+    if (this->uvs.empty()) {
+        Geometry::frameImpl(hit, isect, dpdu, dpdv);
+        return;
+    }
 
-    if (this->tree != nullptr) { // Yes
+    glm::uvec3 indices = this->triangle(hit.primitive);
+    glm::vec3 W        = glm::vec3(1.0f - hit.uv.x - hit.uv.y, hit.uv.x, hit.uv.y);
 
-        // First, get the set of triangles we'll be working with
-        // from the spatial KD-tree index:
+    const glm::vec2& uv0 = this->uvs[indices[0]];
+    const glm::vec2& uv1 = this->uvs[indices[1]];
+    const glm::vec2& uv2 = this->uvs[indices[2]];
 
-        if (!this->tree->intersects(ray, collected)) {
-            return Intersection::miss(); // No intersections: bail out
-        }
+    isect.hasUV = true;
+    isect.uv    = (W[0] * uv0) + (W[1] * uv1) + (W[2] * uv2);
 
-        int k = -1;
-        if (!closestTriangle(ray, collected, k, t, W)) {
-            return Intersection::miss();
-        }
+    glm::vec3 dp1  = this->vertices_[indices[1]] - this->vertices_[indices[0]];
+    glm::vec3 dp2  = this->vertices_[indices[2]] - this->vertices_[indices[0]];
+    glm::vec2 duv1 = uv1 - uv0;
+    glm::vec2 duv2 = uv2 - uv0;
+    float det      = (duv1.x * duv2.y) - (duv1.y * duv2.x);
 
-        // Get the index of the triangle as it appears in this->triangles
-        I = collected[k].getMeshIndex(); 
+    if (det != 0.0f) {
+        dpdu = ((duv2.y * dp1) - (duv1.y * dp2)) / det;
+        dpdv = ((duv1.x * dp2) - (duv2.x * dp1)) / det;
+    } else {
+        dpdu = glm::vec3();
+        dpdv = glm::vec3();
+    }
 
-    } else { // No
+    if (this->tangents.empty()) {
+        isect.tangent   = dpdu;
+        isect.bitangent = -dpdv;
+        return;
+    }
 
-        int k = -1;
-        if (!closestTriangle(ray, this->triangles, k, t, W)) {
-            return Intersection::miss();
+    isect.tangent   = (W[0] * this->tangents[indices[0]]) 
+                    + (W[1] * this->tangents[indices[1]]) 
+                    + (W[2] * this->tangents[indices[2]]);
+    isect.bitangent = (W[0] * this->bitangents[indices[0]]) 
+                    + (W[1] * this->bitangents[indices[1]]) 
+                    + (W[2] * this->bitangents[indices[2]]);
+}
+
+/**
+ * A mesh may be shared by several lights, set up on different threads, so
+ * the table is built once by whichever gets there first
+ */
+void Mesh::prepareSampling()
+{
+    call_once(this->samplingPrepared, [this]() {
+
+        int n = static_cast<int>(this->getTriangleCount());
+        vector<float> areas(n);
+
+        for (int i = 0; i < n; i++) {
+            areas[i] = this->triangleArea(i);
         }
 
-        I = k;
+        this->triangleTable = Sampling::AliasTable(areas);
+    });
+}
+
+/**
+ * A triangle is picked in proportion to its area in constant time, then a
+ * point uniformly over it. The normal is that of the triangle's plane, as
+ * the density of the points is measured across it
+ */
+glm::vec3 Mesh::sampleImpl(glm::vec3& normal) const
+{
+    if (this->getTriangleCount() == 0) {
+        normal = glm::vec3();
+        return this->centroid;
     }
 
-    glm::uvec3 indices = this->triangles[I].getVertexIndices();
+    if (this->triangleTable.empty()) {
+        throw runtime_error("Mesh::sampleImpl(): prepareSampling() was not called");
+    }
 
-    // Interpolate the normal at the point-of-intersection:
+    float u1 = Utils::unitRand();
+    float u2 = Utils::unitRand();
 
-    glm::vec3 N  = (W[0] * this->normals_[indices[0]]) 
-                 + (W[1] * this->normals_[indices[1]]) 
-                 + (W[2] * this->normals_[indices[2]]);
+    glm::uvec3 indices = this->triangle(static_cast<int>(this->triangleTable.pick(u1, u2)));
+    glm::vec3 A        = this->vertices_[indices[0]];
+    glm::vec3 AB       = this->vertices_[indices[1]] - A;
+    glm::vec3 AC       = this->vertices_[indices[2]] - A;
 
-    Intersection isect(t, glm::normalize(N));
+    float s = sqrt(Utils::unitRand());
+    float t = Utils::unitRand();
 
-    isect.correctNormal = false;
+    glm::vec3 N = glm::cross(AB, AC);
+    float len   = glm::length(N);
 
-    return isect;
-}
+    normal = len > 0.0f ? N / len : glm::vec3();
 
-glm::vec3 Mesh::sampleImpl() const
-{
-    throw runtime_error("Mesh::sampleImpl() not implemented");
+    return A + ((s * (1.0f - t)) * AB) + ((s * t) * AC);
 }
 
 /******************************************************************************/
 
 MultiMesh::MultiMesh(std::vector<std::shared_ptr<Mesh>> _meshes) :
     Geometry(MESH),
-    meshes(_meshes)
+    meshes(_meshes),
+    area(0.0f)
 { 
+    int first = 0;
+    for (auto i = this->meshes.begin(); i != this->meshes.end(); i++) {
+        this->firstTriangle.push_back(first);
+        first      += static_cast<int>((*i)->getTriangleCount());
+        this->area += (*i)->areaImpl();
+    }
+
     this->buildGeometry();
-    this->buildVolume();
     this->computeCentroid();
     this->computeAABB();
+    this->buildVolume();
 }
 
 MultiMesh::~MultiMesh()
@@ -278,7 +415,7 @@ const AABB& MultiMesh::getAABB() const
 
 void MultiMesh::buildVolume()
 {
-    this->volume = TrivialVolume();
+    this->volume = BoundingBox(this->aabb);
 }
 
 const BoundingVolume& MultiMesh::getVolume() const
@@ -291,21 +428,104 @@ void MultiMesh::buildGeometry()
 
 }
 
-Intersection MultiMesh::intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const
+Hit MultiMesh::hitImpl(const Ray &ray) const
 {
-    for (auto i = this->meshes.begin(); i != this->meshes.end(); i++) {
-        auto isect = (*i)->intersectImpl(ray, scene);
-        if (isect.isHit()) {
-            return isect;
+    // Each mesh only needs to find hits closer than those found so far:
+    Ray probe(ray);
+    Hit closest;
+
+    for (size_t i=0; i<this->meshes.size(); i++) {
+
+        // Skip meshes whose bounds start beyond the closest hit:
+        if (!this->meshes[i]->getVolume().intersects(probe)) {
+            continue;
+        }
+
+        Hit hit = this->meshes[i]->hitImpl(probe);
+
+        if (hit.isCloser(closest)) {
+            // Triangles are numbered consecutively across all meshes:
+            hit.primitive += this->firstTriangle[i];
+            closest        = hit;
+            probe.tMax     = hit.t;
         }
     }
 
-    return Intersection::miss();
+    return closest;
+}
+
+size_t MultiMesh::meshOf(Hit& hit) const
+{
+    size_t i = upper_bound(this->firstTriangle.begin(), this->firstTriangle.end(), hit.primitive) 
+             - this->firstTriangle.begin() - 1;
+
+    hit.primitive -= this->firstTriangle[i];
+
+    return i;
 }
 
-glm::vec3 MultiMesh::sampleImpl() const
+glm::vec3 MultiMesh::normalImpl(const Ray &ray, const Hit& hit) const
 {
-    throw runtime_error("MultiMesh::sampleImpl() not implemented");
+    Hit meshHit(hit);
+    size_t i = this->meshOf(meshHit);
+
+    return this->meshes[i]->normalImpl(ray, meshHit);
+}
+
+void MultiMesh::frameImpl(const Hit& hit, Intersection& isect, glm::vec3& dpdu, glm::vec3& dpdv) const
+{
+    Hit meshHit(hit);
+    size_t i = this->meshOf(meshHit);
+
+    this->meshes[i]->frameImpl(meshHit, isect, dpdu, dpdv);
+}
+
+Mesh::Memory MultiMesh::getMemoryUsage() const
+{
+    Mesh::Memory memory;
+
+    for (auto i = this->meshes.begin(); i != this->meshes.end(); i++) {
+        memory += (*i)->getMemoryUsage();
+    }
+
+    memory.sampling += this->meshTable.getByteSize();
+
+    return memory;
+}
+
+void MultiMesh::prepareSampling()
+{
+    call_once(this->samplingPrepared, [this]() {
+
+        vector<float> areas;
+
+        for (auto i = this->meshes.begin(); i != this->meshes.end(); i++) {
+            (*i)->prepareSampling();
+            areas.push_back((*i)->areaImpl());
+        }
+
+        this->meshTable = Sampling::AliasTable(areas);
+    });
+}
+
+/**
+ * A mesh is picked in proportion to its area, then a point uniformly over it
+ */
+glm::vec3 MultiMesh::sampleImpl(glm::vec3& normal) const
+{
+    if (this->meshes.empty()) {
+        normal = glm::vec3();
+        return this->centroid;
+    }
+
+    if (this->meshTable.empty()) {
+        throw runtime_error("MultiMesh::sampleImpl(): prepareSampling() was not called");
+    }
+
+    float u1 = Utils::unitRand();
+    float u2 = Utils::unitRand();
+
+    return this->meshes[this->meshTable.pick(u1, u2)]->sampleImpl(normal);
 }
 
 /******************************************************************************/
\ No newline at end of file
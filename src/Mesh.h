@@ -11,15 +11,15 @@
 #ifndef MESH_H
 #define MESH_H
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <memory>
+#include <mutex>
 #include <tuple>
 #include <vector>
 #include "Geometry.h"
+#include "ModelImport.h"
+#include "Sampling.h"
 #include "Tri.h"
 #include "KDTree.h"
 
@@ -29,26 +29,77 @@ class Mesh : public Geometry
 {
 	friend class MultiMesh;
 
+	public:
+		// Bytes used by each part of a mesh
+		struct Memory
+		{
+			size_t vertices;
+			size_t normals;
+			size_t texcoords; // Texture coordinates and tangent frames
+			size_t indices;
+			size_t tree;      // Triangles, nodes and leaves
+			size_t sampling;  // Triangle areas, for meshes that emit light
+
+			Memory();
+
+			size_t total() const;
+
+			Memory& operator+=(const Memory& other);
+		};
+
 	private:
 		glm::vec3 centroid;
-		TrivialVolume volume;
+		BoundingBox volume;
 		AABB aabb;
-		std::shared_ptr<aiMesh> meshData;
+
+		// The triangles, which refer to vertices_ by index. The tree holds
+		// the only copy of them
 		std::unique_ptr<KDTree> tree;
 
+		// Whether new meshes keep their normals as half floats
+		static bool halfNormals;
+
+		// Surface area, and the table picking triangles in proportion to
+		// theirs, built by prepareSampling()
+		float area;
+		Sampling::AliasTable triangleTable;
+		std::once_flag samplingPrepared;
+
 		void computeCentroid();
 		void computeAABB();
+		void computeArea();
 		void buildVolume();
 
-	protected:
-		// Self-contained triangle data:
-		std::vector<Tri> triangles;
+		// Area of triangle i
+		float triangleArea(int i) const;
 
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const;
-		virtual glm::vec3 sampleImpl() const;
+	protected:
+		// Per-vertex texture coordinates, with v running down the image,
+		// and the tangents and bitangents computed for them. Empty if the
+		// mesh has no texture coordinates
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> tangents;
+		std::vector<glm::vec3> bitangents;
+
+		virtual Hit hitImpl(const Ray &ray) const;
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const;
+		virtual void frameImpl(const Hit& hit, Intersection& isect, glm::vec3& dpdu, glm::vec3& dpdv) const;
+		virtual bool correctsNormal() const { return false; }
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const;
+		virtual float areaImpl() const { return this->area; }
+
+		// Vertex indices of triangle i
+		glm::uvec3 triangle(int i) const
+		{
+			return glm::uvec3(this->indices_[(3 * i)], this->indices_[(3 * i) + 1], this->indices_[(3 * i) + 2]);
+		}
+
+		// Normal of vertex i, whichever way it is stored
+		glm::vec3 normal(unsigned int i) const;
 
 	public:
-		Mesh(std::shared_ptr<aiMesh> meshData);
+		// Takes over the arrays of the given mesh
+		Mesh(Model::MeshData&& meshData);
 
 		virtual ~Mesh();
 		
@@ -57,6 +108,21 @@ class Mesh : public Geometry
 		virtual const BoundingVolume& getVolume() const;
 		virtual const AABB& getAABB() const;
 		virtual void buildGeometry();
+		virtual void prepareSampling();
+
+		// Returns the KD-tree indexing the mesh's triangles, if any
+		KDTree const * getTree() const { return this->tree.get(); }
+
+		// Number of triangles in the mesh
+		size_t getTriangleCount() const { return this->indices_.size() / 3; }
+
+		Memory getMemoryUsage() const;
+
+		// Halves the memory used by the normals of meshes created from now
+		// on, at the cost of about three decimal digits of precision
+		static void setHalfNormals(bool enabled) { halfNormals = enabled; }
+		static bool getHalfNormals()             { return halfNormals; }
+
 		virtual void repr(std::ostream& s) const;
 };
 
@@ -66,17 +132,35 @@ class MultiMesh : public Geometry
 {
 	private:
 		glm::vec3 centroid;
-		TrivialVolume volume;
+		BoundingBox volume;
 		AABB aabb;
 		std::vector<std::shared_ptr<Mesh>> meshes;
 
+		// Surface area of all meshes, and the table picking a mesh in
+		// proportion to its own, built by prepareSampling()
+		float area;
+		Sampling::AliasTable meshTable;
+		std::once_flag samplingPrepared;
+
+		// Index of the first triangle of each mesh, when the triangles of
+		// all meshes are numbered consecutively
+		std::vector<int> firstTriangle;
+
 		void computeCentroid();
 		void computeAABB();
 		void buildVolume();
 
 	protected:
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const;
-		virtual glm::vec3 sampleImpl() const;
+		virtual Hit hitImpl(const Ray &ray) const;
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const;
+		virtual void frameImpl(const Hit& hit, Intersection& isect, glm::vec3& dpdu, glm::vec3& dpdv) const;
+		virtual bool correctsNormal() const { return false; }
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const;
+		virtual float areaImpl() const { return this->area; }
+
+		// Returns the mesh that triangle i of the whole belongs to, making
+		// hit refer to the triangle within it
+		size_t meshOf(Hit& hit) const;
 
 	public:
 		MultiMesh(std::vector<std::shared_ptr<Mesh>> meshes);
@@ -87,6 +171,11 @@ class MultiMesh : public Geometry
 		virtual const BoundingVolume& getVolume() const;
 		virtual const AABB& getAABB() const;
 		virtual void buildGeometry();
+		virtual void prepareSampling();
+
+		// Memory used by all the meshes
+		Mesh::Memory getMemoryUsage() const;
+
 		virtual void repr(std::ostream& s) const;
 };
 
@@ -5,25 +5,719 @@
  *
  ******************************************************************************/
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
 #include <easylogging++.h>
+#ifdef ENABLE_OPENMP
+#include <omp.h>
+#endif
 #include "ModelImport.h"
+#include "TaskPool.h"
+#include "TextScan.h"
 
 /******************************************************************************/
 
 using namespace std;
+using namespace glm;
+using namespace TextScan;
 
 /******************************************************************************/
 
-vector<shared_ptr<aiMesh>> Model::importMeshes(const string& model)
+static bool isOBJ(const string& model)
+{
+	size_t dot = model.rfind('.');
+
+	if (dot == string::npos) {
+		return false;
+	}
+
+	string ext = model.substr(dot + 1);
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	return ext == "obj";
+}
+
+vector<Model::MeshData> Model::loadMeshes(const string& model)
+{
+	if (isOBJ(model)) {
+
+		vector<MeshData> meshes(1);
+
+		try {
+
+			if (readOBJ(model, meshes[0])) {
+				return meshes;
+			}
+
+		} catch (std::exception& e) {
+
+			LOG(ERROR) << "[!] " << model << ": " << e.what() << "; trying assimp";
+		}
+	}
+
+	return importMeshes(model);
+}
+
+/*******************************************************************************
+ * Native Wavefront OBJ reader
+ ******************************************************************************/
+
+/**
+ * A face corner: the position, texture coordinate and normal it refers to.
+ * Negative OBJ indices count back from the last element read, which for a
+ * chunk parsed on its own is only known relative to the start of the chunk,
+ * so they are kept relative until the chunks are merged
+ */
+struct Corner
+{
+	static const int NONE = INT_MIN;
+
+	int v, t, n;
+	unsigned char relative; // Bit 0: v, bit 1: t, bit 2: n
+};
+
+// Everything read from one chunk of the file
+struct Chunk
+{
+	vector<vec3> positions;
+	vector<vec2> texcoords;
+	vector<vec3> normals;
+	vector<Corner> corners; // Three per triangle
+	size_t line;
+	string error;
+};
+
+static inline const char* parseIndex(const char* p, const char* end, int& index)
+{
+	bool negative = false;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	if (p >= end || *p < '0' || *p > '9') {
+		return nullptr;
+	}
+
+	long long k = 0;
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		k = std::min((k * 10) + (*p - '0'), static_cast<long long>(INT_MAX));
+	}
+
+	index = static_cast<int>(negative ? -k : k);
+
+	return p;
+}
+
+/**
+ * Turns an OBJ index into a 0-based one, given how many elements of its kind
+ * the chunk has read so far
+ */
+static inline int toCorner(int k, int count, unsigned char bit, unsigned char& relative)
+{
+	if (k > 0) {
+		return k - 1;
+	}
+
+	relative |= bit;
+
+	return count + k;
+}
+
+/**
+ * Parses the lines in [p,end), which must start at the beginning of a line
+ */
+static void parseChunk(const char* p, const char* end, Chunk& chunk)
+{
+	vector<Corner> polygon;
+
+	for (chunk.line = 1; p < end; chunk.line++) {
+
+		p = skipBlanks(p, end);
+
+		if (p + 1 >= end) {
+			break;
+		}
+
+		if (p[0] == 'v') {
+
+			if (isBlank(p[1])) {
+
+				vec3 v;
+				const char* q = p + 2;
+
+				for (int i=0; i<3 && q != nullptr; i++) {
+					q = parseFloat(q, end, v[i]);
+				}
+
+				if (q == nullptr) {
+					chunk.error = "malformed vertex";
+					return;
+				}
+
+				chunk.positions.push_back(v);
+
+			} else if (p[1] == 't' && p + 2 < end && isBlank(p[2])) {
+
+				// A missing v, or w, is allowed:
+				vec2 t(0.0f);
+				const char* q = parseFloat(p + 3, end, t.x);
+
+				if (q == nullptr) {
+					chunk.error = "malformed texture coordinate";
+					return;
+				}
+
+				parseFloat(q, end, t.y);
+
+				chunk.texcoords.push_back(t);
+
+			} else if (p[1] == 'n' && p + 2 < end && isBlank(p[2])) {
+
+				vec3 n;
+				const char* q = p + 3;
+
+				for (int i=0; i<3 && q != nullptr; i++) {
+					q = parseFloat(q, end, n[i]);
+				}
+
+				if (q == nullptr) {
+					chunk.error = "malformed normal";
+					return;
+				}
+
+				chunk.normals.push_back(n);
+			}
+
+		} else if (p[0] == 'f' && isBlank(p[1])) {
+
+			polygon.clear();
+
+			const char* q = skipBlanks(p + 2, end);
+
+			while (q < end && *q != '\n' && *q != '#') {
+
+				Corner c = { Corner::NONE, Corner::NONE, Corner::NONE, 0 };
+				int k    = 0;
+
+				if ((q = parseIndex(q, end, k)) == nullptr || k == 0) {
+					chunk.error = "malformed face";
+					return;
+				}
+
+				c.v = toCorner(k, static_cast<int>(chunk.positions.size()), 1, c.relative);
+
+				if (q < end && *q == '/') {
+
+					q++;
+
+					if (q < end && *q != '/') {
+						if ((q = parseIndex(q, end, k)) == nullptr || k == 0) {
+							chunk.error = "malformed face";
+							return;
+						}
+						c.t = toCorner(k, static_cast<int>(chunk.texcoords.size()), 2, c.relative);
+					}
+
+					if (q < end && *q == '/') {
+						if ((q = parseIndex(q + 1, end, k)) == nullptr || k == 0) {
+							chunk.error = "malformed face";
+							return;
+						}
+						c.n = toCorner(k, static_cast<int>(chunk.normals.size()), 4, c.relative);
+					}
+				}
+
+				polygon.push_back(c);
+
+				q = skipBlanks(q, end);
+			}
+
+			// Triangulate as a fan around the first corner:
+			for (size_t i=2; i<polygon.size(); i++) {
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[i - 1]);
+				chunk.corners.push_back(polygon[i]);
+			}
+		}
+
+		// Comments, groups, objects, materials, smoothing groups, lines and
+		// points need nothing:
+		p = skipLine(p, end);
+	}
+}
+
+/**
+ * The number of threads to read a model with. Models are loaded on the
+ * TaskPool, several at once, so each takes its share of the cores rather
+ * than starting a team as large as the machine on every worker
+ */
+static int readThreads()
+{
+	#ifdef ENABLE_OPENMP
+	return TaskPool::nestedThreads(omp_get_max_threads());
+	#else
+	return 1;
+	#endif
+}
+
+// Offsets of each chunk's elements once all the chunks are joined
+struct ChunkOffsets
+{
+	int positions, texcoords, normals;
+	size_t corners;
+};
+
+static inline int resolve(int index, int offset, bool relative, int count, const char* what)
+{
+	if (index == Corner::NONE) {
+		return index;
+	}
+
+	int k = relative ? offset + index : index;
+
+	if (k < 0 || k >= count) {
+		throw runtime_error(string("face refers to a missing ") + what);
+	}
+
+	return k;
+}
+
+struct CornerHash
+{
+	size_t operator()(const Corner& c) const
+	{
+		size_t h = hash<int>()(c.v);
+		h ^= hash<int>()(c.t) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		h ^= hash<int>()(c.n) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h;
+	}
+};
+
+struct CornerEqual
+{
+	bool operator()(const Corner& a, const Corner& b) const
+	{
+		return a.v == b.v && a.t == b.t && a.n == b.n;
+	}
+};
+
+/**
+ * Gives every vertex the area-weighted average of the normals of the faces
+ * around its position, so vertices split by texture seams stay smooth
+ */
+static void generateNormals(Model::MeshData& mesh, const vector<int>& positionOf, int positionCount)
+{
+	vector<vec3> sums(positionCount, vec3(0.0f));
+	const vector<vec3>& V = mesh.vertices;
+
+	for (size_t i=0; i<mesh.indices.size(); i+=3) {
+
+		unsigned int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+
+		// Twice the area, in the direction of the face normal:
+		vec3 N = cross(V[b] - V[a], V[c] - V[a]);
+
+		sums[positionOf[a]] += N;
+		sums[positionOf[b]] += N;
+		sums[positionOf[c]] += N;
+	}
+
+	int n       = static_cast<int>(V.size());
+	int threads = readThreads();
+	mesh.normals.resize(n);
+
+	#ifdef ENABLE_OPENMP
+	#pragma omp parallel for num_threads(threads)
+	#endif
+	for (int i=0; i<n; i++) {
+		const vec3& N   = sums[positionOf[i]];
+		float L         = length(N);
+		mesh.normals[i] = L > 0.0f ? N / L : vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+/**
+ * Computes per-vertex directions of increasing u and v from the triangles'
+ * texture coordinates, made perpendicular to the normals
+ */
+static void generateTangents(Model::MeshData& mesh)
+{
+	size_t n = mesh.vertices.size();
+	const vector<vec3>& V  = mesh.vertices;
+	const vector<vec2>& UV = mesh.uvs;
+
+	mesh.tangents.assign(n, vec3(0.0f));
+	mesh.bitangents.assign(n, vec3(0.0f));
+
+	for (size_t i=0; i<mesh.indices.size(); i+=3) {
+
+		unsigned int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+
+		vec3 e1 = V[b] - V[a], e2 = V[c] - V[a];
+		vec2 d1 = UV[b] - UV[a], d2 = UV[c] - UV[a];
+
+		float det = (d1.x * d2.y) - (d2.x * d1.y);
+
+		if (det == 0.0f) {
+			continue;
+		}
+
+		vec3 T = ((e1 * d2.y) - (e2 * d1.y)) / det;
+		vec3 B = ((e2 * d1.x) - (e1 * d2.x)) / det;
+
+		mesh.tangents[a]   += T; mesh.tangents[b]   += T; mesh.tangents[c]   += T;
+		mesh.bitangents[a] += B; mesh.bitangents[b] += B; mesh.bitangents[c] += B;
+	}
+
+	for (size_t i=0; i<n; i++) {
+
+		const vec3& N = mesh.normals[i];
+		vec3 T        = mesh.tangents[i] - (N * dot(N, mesh.tangents[i]));
+		float L       = length(T);
+
+		// No usable mapping around this vertex, so any perpendicular will do:
+		if (L <= 1.0e-12f) {
+			T = fabs(N.x) < 0.9f ? cross(N, vec3(1.0f, 0.0f, 0.0f)) : cross(N, vec3(0.0f, 1.0f, 0.0f));
+			L = length(T);
+		}
+
+		T /= L;
+
+		vec3 B = cross(N, T);
+
+		if (dot(B, mesh.bitangents[i]) < 0.0f) {
+			B = -B;
+		}
+
+		mesh.tangents[i]   = T;
+		mesh.bitangents[i] = B;
+	}
+}
+
+bool Model::readOBJ(const string& model, MeshData& mesh)
+{
+	MappedFile file(model);
+
+	if (file.getSize() == 0) {
+		return false;
+	}
+
+	// Split the file into chunks that end at line breaks, enough of them to
+	// keep every thread busy but not so many that their overhead shows:
+
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+	int threads = readThreads();
+
+	size_t count = std::min(static_cast<size_t>(std::max(1, threads * 4)), (file.getSize() / MIN_CHUNK_SIZE) + 1);
+	vector<const char*> bounds(1, file.begin());
+
+	for (size_t i=1; i<count; i++) {
+
+		const char* p = std::max(bounds.back(), file.begin() + ((file.getSize() * i) / count));
+
+		while (p < file.end() && *(p - 1) != '\n') {
+			p++;
+		}
+
+		if (p < file.end() && p > bounds.back()) {
+			bounds.push_back(p);
+		}
+	}
+
+	bounds.push_back(file.end());
+
+	int chunkCount = static_cast<int>(bounds.size()) - 1;
+	vector<Chunk> chunks(chunkCount);
+
+	#ifdef ENABLE_OPENMP
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+	#endif
+	for (int i=0; i<chunkCount; i++) {
+		parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+	}
+
+	// Where each chunk's elements start once joined:
+
+	vector<ChunkOffsets> offsets(chunkCount + 1);
+	offsets[0] = { 0, 0, 0, 0 };
+
+	for (int i=0; i<chunkCount; i++) {
+
+		if (!chunks[i].error.empty()) {
+
+			size_t line = chunks[i].line;
+
+			for (int j=0; j<i; j++) {
+				line += chunks[j].line - 1;
+			}
+
+			throw runtime_error(chunks[i].error + " on line " + to_string(line));
+		}
+
+		offsets[i + 1].positions = offsets[i].positions + static_cast<int>(chunks[i].positions.size());
+		offsets[i + 1].texcoords = offsets[i].texcoords + static_cast<int>(chunks[i].texcoords.size());
+		offsets[i + 1].normals   = offsets[i].normals   + static_cast<int>(chunks[i].normals.size());
+		offsets[i + 1].corners   = offsets[i].corners   + chunks[i].corners.size();
+	}
+
+	const ChunkOffsets& total = offsets[chunkCount];
+
+	if (total.corners == 0) {
+		return false;
+	}
+
+	// Join the chunks, making every index absolute:
+
+	vector<vec3> positions(total.positions);
+	vector<vec2> texcoords(total.texcoords);
+	vector<vec3> normals(total.normals);
+	vector<Corner> corners(total.corners);
+
+	int missingTexcoords = 0;
+	int missingNormals   = 0;
+	int unaligned        = 0;
+	string error;
+
+	#ifdef ENABLE_OPENMP
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(threads) reduction(+:missingTexcoords, missingNormals, unaligned)
+	#endif
+	for (int i=0; i<chunkCount; i++) {
+
+		Chunk& chunk = chunks[i];
+		const ChunkOffsets& at = offsets[i];
+
+		copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + at.positions);
+		copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + at.texcoords);
+		copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + at.normals);
+
+		try {
+
+			for (size_t j=0; j<chunk.corners.size(); j++) {
+
+				Corner c = chunk.corners[j];
+
+				c.v = resolve(c.v, at.positions, (c.relative & 1) != 0, total.positions, "vertex");
+				c.t = resolve(c.t, at.texcoords, (c.relative & 2) != 0, total.texcoords, "texture coordinate");
+				c.n = resolve(c.n, at.normals, (c.relative & 4) != 0, total.normals, "normal");
+				c.relative = 0;
+
+				missingTexcoords += c.t == Corner::NONE ? 1 : 0;
+				missingNormals   += c.n == Corner::NONE ? 1 : 0;
+				unaligned        += (c.t != Corner::NONE && c.t != c.v) || (c.n != Corner::NONE && c.n != c.v) ? 1 : 0;
+
+				corners[at.corners + j] = c;
+			}
+
+		} catch (std::exception& e) {
+
+			#ifdef ENABLE_OPENMP
+			#pragma omp critical
+			#endif
+			error = e.what();
+		}
+
+		// Done with it:
+		chunk = Chunk();
+	}
+
+	if (!error.empty()) {
+		throw runtime_error(error);
+	}
+
+	// Texture coordinates and normals are only used if every corner has one:
+	bool hasTexcoords = total.texcoords > 0 && missingTexcoords == 0;
+	bool hasNormals   = total.normals > 0 && missingNormals == 0;
+
+	// Exporters often write as many texture coordinates and normals as
+	// positions and refer to all three by the same number, in which case
+	// there is nothing to match up:
+	bool aligned = unaligned == 0
+	            && (!hasTexcoords || total.texcoords == total.positions)
+	            && (!hasNormals || total.normals == total.positions);
+
+	mesh = MeshData();
+	mesh.indices.reserve(corners.size());
+
+	// The position each vertex came from, for smoothing normals across
+	// vertices that only differ by texture coordinate:
+	vector<int> positionOf;
+
+	if (aligned) {
+
+		// Positions are the vertices, as is:
+
+		for (size_t i=0; i<corners.size(); i+=3) {
+
+			int a = corners[i].v, b = corners[i + 1].v, c = corners[i + 2].v;
+
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+
+			mesh.indices.push_back(a);
+			mesh.indices.push_back(b);
+			mesh.indices.push_back(c);
+		}
+
+		mesh.vertices = move(positions);
+
+		if (hasTexcoords) {
+			mesh.uvs = move(texcoords);
+		}
+
+		if (hasNormals) {
+			mesh.normals = move(normals);
+		}
+
+		positionOf.resize(mesh.vertices.size());
+
+		for (size_t i=0; i<positionOf.size(); i++) {
+			positionOf[i] = static_cast<int>(i);
+		}
+
+	} else {
+
+		// A vertex for every distinct combination of position, texture
+		// coordinate and normal:
+
+		unordered_map<Corner, unsigned int, CornerHash, CornerEqual> vertexOf;
+		vertexOf.reserve(std::min(corners.size(), positions.size() * 2));
+
+		for (size_t i=0; i<corners.size(); i+=3) {
+
+			if (corners[i].v == corners[i + 1].v || corners[i + 1].v == corners[i + 2].v || corners[i].v == corners[i + 2].v) {
+				continue;
+			}
+
+			for (size_t j=i; j<i+3; j++) {
+
+				Corner c = corners[j];
+
+				if (!hasTexcoords) { c.t = Corner::NONE; }
+				if (!hasNormals)   { c.n = Corner::NONE; }
+
+				auto found = vertexOf.find(c);
+
+				if (found != vertexOf.end()) {
+					mesh.indices.push_back(found->second);
+					continue;
+				}
+
+				unsigned int k = static_cast<unsigned int>(mesh.vertices.size());
+
+				vertexOf[c] = k;
+				mesh.vertices.push_back(positions[c.v]);
+				positionOf.push_back(c.v);
+
+				if (hasTexcoords) {
+					mesh.uvs.push_back(texcoords[c.t]);
+				}
+
+				if (hasNormals) {
+					mesh.normals.push_back(normals[c.n]);
+				}
+
+				mesh.indices.push_back(k);
+			}
+		}
+	}
+
+	if (mesh.indices.empty()) {
+		return false;
+	}
+
+	if (!hasNormals) {
+		generateNormals(mesh, positionOf, total.positions);
+	} else {
+		for (auto i=mesh.normals.begin(); i != mesh.normals.end(); i++) {
+			float L = length(*i);
+			*i = L > 0.0f ? *i / L : vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	if (hasTexcoords) {
+		generateTangents(mesh);
+	}
+
+	return true;
+}
+
+/*******************************************************************************
+ * assimp import
+ ******************************************************************************/
+
+static Model::MeshData fromAssimp(const aiMesh& data)
+{
+	Model::MeshData mesh;
+
+	mesh.vertices.reserve(data.mNumVertices);
+	mesh.normals.reserve(data.mNumVertices);
+
+	for (unsigned int i = 0; i < data.mNumVertices; i++) {
+		auto v = data.mVertices[i];
+		auto n = data.mNormals[i];
+		mesh.vertices.push_back(vec3(v.x, v.y, v.z));
+		mesh.normals.push_back(vec3(n.x, n.y, n.z));
+	}
+
+	if (data.HasTextureCoords(0)) {
+
+		bool hasTangents = data.HasTangentsAndBitangents();
+
+		for (unsigned int i = 0; i < data.mNumVertices; i++) {
+
+			auto uv = data.mTextureCoords[0][i];
+			mesh.uvs.push_back(vec2(uv.x, uv.y));
+
+			if (hasTangents) {
+				auto t = data.mTangents[i];
+				auto b = data.mBitangents[i];
+				mesh.tangents.push_back(vec3(t.x, t.y, t.z));
+				mesh.bitangents.push_back(vec3(b.x, b.y, b.z));
+			}
+		}
+	}
+
+	mesh.indices.reserve(data.mNumFaces * 3);
+
+	for (unsigned int i = 0; i < data.mNumFaces; i++) {
+
+		const aiFace& face = data.mFaces[i];
+
+		// Lines and points, which aiProcess_SortByPType keeps apart:
+		if (face.mNumIndices != 3) {
+			continue;
+		}
+
+		mesh.indices.push_back(face.mIndices[0]);
+		mesh.indices.push_back(face.mIndices[1]);
+		mesh.indices.push_back(face.mIndices[2]);
+	}
+
+	return mesh;
+}
+
+vector<Model::MeshData> Model::importMeshes(const string& model)
 {
 	Assimp::Importer importer;
-	vector<shared_ptr<aiMesh>> meshes;
+	vector<MeshData> meshes;
 
-	unsigned int flags = aiProcess_Triangulate 
+	unsigned int flags = aiProcess_Triangulate
 	                   | aiProcess_FindDegenerates
 		               | aiProcess_FindInvalidData
 		               | aiProcess_CalcTangentSpace
-		               | aiProcess_Triangulate
 		               | aiProcess_JoinIdenticalVertices
 		               | aiProcess_GenSmoothNormals
 		               | aiProcess_GenUVCoords
@@ -36,21 +730,32 @@ vector<shared_ptr<aiMesh>> Model::importMeshes(const string& model)
 //		               | aiProcess_RemoveRedundantMaterials
 		               | aiProcess_ValidateDataStructure;
 
-	if (!importer.ReadFile(model, flags)) {
+	const aiScene* scene = importer.ReadFile(model, flags);
+
+	if (!scene) {
 		LOG(ERROR) << importer.GetErrorString();
 		return meshes;
 	}
 
-	// Detach the scene from the importer, otherwise when the import goes out
-	// of scope, the scene and all accompanying meshes will be freed:
-
-	auto scene = importer.GetOrphanedScene();
+	// The importer frees the scene when it goes out of scope, so the meshes
+	// are converted while it is still around rather than copied out whole:
 
 	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-		meshes.push_back(make_shared<aiMesh>(*scene->mMeshes[i]));
+
+		const aiMesh& data = *scene->mMeshes[i];
+
+		if (!data.HasFaces() || !data.HasNormals()) {
+			continue;
+		}
+
+		MeshData mesh = fromAssimp(data);
+
+		if (!mesh.indices.empty()) {
+			meshes.push_back(move(mesh));
+		}
 	}
 
 	return meshes;
 }
 
-/******************************************************************************/
\ No newline at end of file
+/******************************************************************************/
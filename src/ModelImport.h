@@ -9,16 +9,52 @@
 #define MODEL_IMPORTER_H
 
 #include <memory>
+#include <string>
 #include <vector>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
 
 /******************************************************************************/
 
 namespace Model
 {
-	std::vector<std::shared_ptr<aiMesh>> importMeshes(const std::string& model);
+	/**
+	 * A triangle mesh, laid out as Mesh keeps it, so its arrays can be
+	 * moved into one without copying
+	 */
+	struct MeshData
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec3> normals;
+
+		// Texture coordinates as stored in the file, with v running up the
+		// image, and the tangent space computed for them. All empty if the
+		// model has no texture coordinates; tangents may be empty if they
+		// could not be computed
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> tangents;
+		std::vector<glm::vec3> bitangents;
+
+		// Three vertex indices per triangle
+		std::vector<unsigned int> indices;
+	};
+
+	// Reads every mesh in a model file. Wavefront OBJ files are read by
+	// readOBJ(); everything else, or an OBJ file it can't make sense of,
+	// is imported with assimp
+	std::vector<MeshData> loadMeshes(const std::string& model);
+
+	/**
+	 * Reads a Wavefront OBJ file as a single mesh. The file is mapped into
+	 * memory and split into chunks that are parsed in parallel. Polygons
+	 * are triangulated as fans, and smooth normals are generated if the
+	 * file has none. Groups, materials and smoothing groups are ignored.
+	 * Returns false if the file can't be read or holds no triangles
+	 */
+	bool readOBJ(const std::string& model, MeshData& mesh);
+
+	// Imports every mesh in a model file with assimp
+	std::vector<MeshData> importMeshes(const std::string& model);
 };
 
 /******************************************************************************/
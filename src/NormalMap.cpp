@@ -7,10 +7,174 @@
  *
  *****************************************************************************/
 
+#include <cassert>
+#include <cfloat>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "NormalMap.h"
+#include "Stats.h"
 
 /*****************************************************************************/
 
+using namespace std;
+using namespace glm;
 
+/*****************************************************************************/
+
+const float NormalMap::DEFAULT_HEIGHT_SCALE = 0.01f;
+
+NormalMap::NormalMap(const string& filename, Source _source, float _heightScale) :
+	SurfaceMap(filename, NORMAL_MAP),
+	source(_source),
+	heightScale(_heightScale)
+{
+
+}
+
+NormalMap::~NormalMap()
+{
+
+}
+
+void NormalMap::build(const Image& image) const
+{
+	shared_ptr<const Normals> p = make_shared<const Normals>(this->fromImage(image));
+	this->normals.set(p, p->getByteSize());
+}
+
+/**
+ * Returns the normals, decoding the bitmap again if they were evicted
+ */
+const NormalMap::Normals* NormalMap::normalMap() const
+{
+	const Normals* p = this->normals.get();
+
+	if (p != nullptr) {
+		return p;
+	}
+
+	lock_guard<mutex> guard(this->loadLock);
+
+	// Another thread may have rebuilt them in the meantime:
+	p = this->normals.peek();
+
+	if (p == nullptr) {
+		Image image;
+		this->decode(image);
+		shared_ptr<const Normals> texels = make_shared<const Normals>(this->fromImage(image));
+		p = this->normals.set(texels, texels->getByteSize());
+	}
+
+	return p;
+}
+
+/**
+ * Decodes every texel to a unit normal once, so a lookup is only a blend
+ */
+NormalMap::Normals NormalMap::fromImage(const Image& image) const
+{
+	int W = image.width();
+	int H = image.height();
+	Normals texels(W, H);
+
+	if (this->source == RGB) {
+
+		for (int i=0; i<W; i++) {
+			for (int j=0; j<H; j++) {
+
+				ImagePixel p = pixel(image, i, j);
+				vec3 n       = (vec3(RED(p), GREEN(p), BLUE(p)) * (2.0f / 255.0f)) - 1.0f;
+				float L      = length(n);
+
+				texels(i, j) = L > 0.0f ? n / L : vec3(0.0f, 0.0f, 1.0f);
+			}
+		}
+
+		return texels;
+	}
+
+	vector<float> heights(W * H);
+
+	for (int i=0; i<W; i++) {
+		for (int j=0; j<H; j++) {
+			ImagePixel p          = pixel(image, i, j);
+			heights[(j * W) + i] = Color(RED(p), GREEN(p), BLUE(p)).luminosity();
+		}
+	}
+
+	// Slopes along u and v from central differences, one-sided at the
+	// edges, in height per texel. Heights are measured in the same unit
+	// along both, a fraction of the map's width, so texels stay square on
+	// maps that aren't. Rows run down the image, so y is up where v is down:
+	for (int i=0; i<W; i++) {
+		for (int j=0; j<H; j++) {
+
+			int i0 = i > 0 ? i - 1 : i, i1 = i + 1 < W ? i + 1 : i;
+			int j0 = j > 0 ? j - 1 : j, j1 = j + 1 < H ? j + 1 : j;
+
+			float dhdu = i1 > i0
+			           ? (heights[(j * W) + i1] - heights[(j * W) + i0]) * (this->heightScale * W) / (i1 - i0)
+			           : 0.0f;
+			float dhdv = j1 > j0
+			           ? (heights[(j1 * W) + i] - heights[(j0 * W) + i]) * (this->heightScale * W) / (j1 - j0)
+			           : 0.0f;
+
+			texels(i, j) = normalize(vec3(-dhdu, dhdv, 1.0f));
+		}
+	}
+
+	return texels;
+}
+
+vec3 NormalMap::getNormal(float u, float v) const
+{
+	Stats::add(Stats::TEXTURE_LOOKUPS);
+
+	this->ensureLoaded();
+
+	TextureCache::Pin pin;
+
+	vec2 P1, P2, P3, P4;
+	vec4 W = this->getBilinearWeights(u, v, P1, P2, P3, P4);
+
+	const Normals& texels = *this->normalMap();
+
+	vec3 n = (W[0] * texels(static_cast<int>(P1.x), static_cast<int>(P1.y)))
+	       + (W[1] * texels(static_cast<int>(P2.x), static_cast<int>(P2.y)))
+	       + (W[2] * texels(static_cast<int>(P3.x), static_cast<int>(P3.y)))
+	       + (W[3] * texels(static_cast<int>(P4.x), static_cast<int>(P4.y)));
+
+	float L = length(n);
+
+	return L > 0.0f ? n / L : vec3(0.0f, 0.0f, 1.0f);
+}
+
+/**
+ * The tangent frame is made orthonormal around N, since T and B are usually
+ * interpolated or transformed, after which the normal is moved into it with
+ * a single matrix multiply
+ */
+vec3 NormalMap::perturb(float u, float v, const vec3& N, const vec3& T, const vec3& B) const
+{
+	vec3 t  = T - (N * dot(N, T));
+	float L = length(t);
+
+	// No frame, e.g. at the poles of a sphere:
+	if (L <= FLT_EPSILON) {
+		return N;
+	}
+
+	t /= L;
+
+	// Keep B's side of the frame, as mirrored UVs flip it:
+	vec3 b = cross(N, t);
+
+	if (dot(b, B) < 0.0f) {
+		b = -b;
+	}
+
+	return normalize(mat3(t, b, N) * this->getNormal(u, v));
+}
 
 /*****************************************************************************/
@@ -10,8 +10,67 @@
 #ifndef NORMAL_MAP_H
 #define NORMAL_MAP_H
 
+#include <string>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "SurfaceMap.h"
+#include "TextureCache.h"
+#include "TiledImage.h"
+
 /******************************************************************************/
 
+class NormalMap : public SurfaceMap
+{
+	public:
+		// What the bitmap holds
+		enum Source
+		{
+			 RGB    // Tangent-space normals, encoded as (N + 1) / 2
+			,HEIGHT // Heights (the luminosity), converted to normals at load
+		};
+
+	private:
+		// Unit tangent-space normals: x along increasing u, y up in the
+		// image and z out of the surface
+		typedef TiledImage<glm::vec3> Normals;
+
+		mutable TextureCache::Resident<Normals> normals;
+
+		Source source;
+
+		// For HEIGHT maps, the height of white above black, as a fraction
+		// of the bitmap's width
+		float heightScale;
+
+	protected:
+		virtual void build(const Image& image) const;
+
+		// Returns the normals, rebuilding them if they were evicted. The
+		// caller must hold a TextureCache::Pin
+		const Normals* normalMap() const;
+
+		Normals fromImage(const Image& image) const;
+
+	public:
+		static const float DEFAULT_HEIGHT_SCALE;
+
+		NormalMap(const std::string& filename, Source source = RGB, float heightScale = DEFAULT_HEIGHT_SCALE);
+		virtual ~NormalMap();
+
+		Source getSource() const    { return this->source; }
+		float getHeightScale() const { return this->heightScale; }
+
+		// Get the unit tangent-space normal at (u,v), filtered bilinearly
+		glm::vec3 getNormal(float u, float v) const;
+
+		/**
+		 * Perturbs the unit surface normal N by the normal at (u,v). T and B
+		 * are the directions of increasing u and of up in the image along
+		 * the surface; neither needs to be unit length or perpendicular to N
+		 */
+		glm::vec3 perturb(float u, float v, const glm::vec3& N, const glm::vec3& T, const glm::vec3& B) const;
+};
+
 /******************************************************************************/
 
 #endif
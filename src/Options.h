@@ -24,6 +24,20 @@ enum OptionIndex {
     ,DISABLE_PREVIEW
     ,SAMPLES_PER_LIGHT
     ,SAMPLES_PER_PIXEL
+    ,SEED
+    ,CHECKPOINT_INTERVAL
+    ,CHECKPOINT_FILE
+    ,RESUME
+    ,SERVE
+    ,JOBS
+    ,SCENE_CACHE
+    ,PRINT_STATS
+    ,STATS_JSON
+    ,HEATMAP
+    ,ISA
+    ,TEXTURE_FILTER
+    ,TEXTURE_CACHE
+    ,HALF_NORMALS
 };
 
 /******************************************************************************/
@@ -102,6 +116,118 @@ const option::Descriptor usage[] =
         ,option::Arg::Optional
         ,"  -A/--aa \t\tSpecifies the number of primary rays used to sample each pixel."
     },
+    {
+         SEED
+        ,0
+        ,""
+        ,"seed"
+        ,option::Arg::Optional
+        ,"  --seed=<n> \t\tSpecifies the random seed. Defaults to the current time."
+    },
+    {
+         CHECKPOINT_INTERVAL
+        ,0
+        ,""
+        ,"checkpoint"
+        ,option::Arg::Optional
+        ,"  --checkpoint=<seconds> \t\tPeriodically save the render state so it can be resumed later."
+    },
+    {
+         CHECKPOINT_FILE
+        ,0
+        ,""
+        ,"checkpoint-file"
+        ,option::Arg::Optional
+        ,"  --checkpoint-file=<path> \t\tSpecifies the checkpoint file. Defaults to output.checkpoint."
+    },
+    {
+         RESUME
+        ,0
+        ,""
+        ,"resume"
+        ,option::Arg::None_
+        ,"  --resume \t\tResume rendering from the checkpoint file, if present."
+    },
+    {
+         SERVE
+        ,0
+        ,""
+        ,"serve"
+        ,option::Arg::Optional
+        ,"  --serve[=<socket>] \t\tRun as a render server, reading JSON jobs from the given Unix socket or stdin."
+    },
+    {
+         JOBS
+        ,0
+        ,""
+        ,"jobs"
+        ,option::Arg::Optional
+        ,"  --jobs=<n> \t\tSpecifies the number of jobs the render server runs concurrently."
+    },
+    {
+         SCENE_CACHE
+        ,0
+        ,""
+        ,"scene-cache"
+        ,option::Arg::Optional
+        ,"  --scene-cache=<n> \t\tSpecifies how many scenes the render server keeps loaded. Defaults to 8."
+    },
+    {
+         PRINT_STATS
+        ,0
+        ,""
+        ,"stats"
+        ,option::Arg::None_
+        ,"  --stats \t\tPrint ray, intersection and timing statistics after rendering."
+    },
+    {
+         STATS_JSON
+        ,0
+        ,""
+        ,"stats-json"
+        ,option::Arg::Optional
+        ,"  --stats-json=<path> \t\tWrite the statistics as JSON to the given file."
+    },
+    {
+         HEATMAP
+        ,0
+        ,""
+        ,"heatmap"
+        ,option::Arg::Optional
+        ,"  --heatmap[=time|rays|tests] \t\tRecord the cost of every pixel, written to output_heatmap.pfm; the given channel (default time) is also written as a false-colour output_heatmap.png."
+    },
+    {
+         ISA
+        ,0
+        ,""
+        ,"isa"
+        ,option::Arg::Optional
+        ,"  --isa=<sse2|avx2|avx512> \t\tUse the SIMD kernels for the given instruction set instead of the best one the CPU supports."
+    },
+    {
+         TEXTURE_FILTER
+        ,0
+        ,""
+        ,"texture-filter"
+        ,option::Arg::Optional
+        ,"  --texture-filter=<bilinear|trilinear|anisotropic> \t\tSpecifies how texture maps are filtered. Defaults to trilinear."
+    },
+    {
+         TEXTURE_CACHE
+        ,0
+        ,""
+        ,"texture-cache"
+        ,option::Arg::Optional
+        ,"  --texture-cache=<MB> \t\tSpecifies how much memory decoded textures may use; the least recently used are evicted and reloaded on demand. Defaults to 512."
+    },
+    {
+         HALF_NORMALS
+        ,0
+        ,""
+        ,"half-normals"
+        ,option::Arg::None_
+        ,"  --half-normals \t\tStore mesh normals as half floats, halving the memory they use."
+    },
     {0,0,0,0,0,0}
 };
 
@@ -8,7 +8,6 @@
  *****************************************************************************/
 
 #include <iostream>
-#include <limits>
 #include "PointLight.h"
 
 /******************************************************************************/
@@ -64,9 +63,9 @@ glm::vec3 PointLight::fromSampledPoint(const glm::vec3& from) const
 	return this->fromCenter(from);
 }
 
-glm::vec3 PointLight::fromSampledPoint(const glm::vec3& from, float& cosineAngle) const
+glm::vec3 PointLight::fromSampledPoint(const glm::vec3& from, float& weight) const
 {
-	cosineAngle = numeric_limits<float>::infinity();
+	weight = 1.0f;
 	return this->fromCenter(from);
 }
 
@@ -48,7 +48,7 @@ class PointLight : public Light
 		virtual glm::vec3 fromCenter(const glm::vec3& from) const;
 
 		virtual glm::vec3 fromSampledPoint(const glm::vec3& from) const;
-		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& cosineAngle) const;
+		virtual glm::vec3 fromSampledPoint(const glm::vec3& from, float& weight) const;
 
 		virtual Color getColor(const glm::vec3& from) const;
 
@@ -0,0 +1,107 @@
+/*******************************************************************************
+ *
+ * This file defines batches of analytic primitives of the same type, stored
+ * in structure-of-arrays form so a ray can be tested against several of them
+ * at once using SIMD instructions
+ *
+ * @file PrimitiveBatch.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <cstring>
+#include <stdexcept>
+#include "Cube.h"
+#include "Kernels.h"
+#include "Sphere.h"
+#include "Utils.h"
+#include "PrimitiveBatch.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+PrimitiveBatch::PrimitiveBatch(Geometry::Type _type) :
+    type(_type),
+    count(0),
+    areaLights(0)
+{
+    memset(this->items, 0, sizeof(this->items));
+    memset(this->invT, 0, sizeof(this->invT));
+    memset(this->a, 0, sizeof(this->a));
+    memset(this->b, 0, sizeof(this->b));
+    memset(this->radius2, 0, sizeof(this->radius2));
+}
+
+bool PrimitiveBatch::accepts(const Geometry& geometry)
+{
+    #if ENABLE_PRIMITIVE_BATCHES
+    switch (geometry.getGeometryType()) {
+        case Geometry::CUBE:
+            return dynamic_cast<const Cube*>(&geometry) != nullptr;
+        case Geometry::SPHERE:
+            return dynamic_cast<const Sphere*>(&geometry) != nullptr;
+        default:
+            return false;
+    }
+    #else
+    return false;
+    #endif
+}
+
+void PrimitiveBatch::add(int item, const Geometry& geometry, const mat4& _invT, bool areaLight)
+{
+    if (this->isFull() || geometry.getGeometryType() != this->type) {
+        throw runtime_error("PrimitiveBatch::add: geometry does not fit in the batch");
+    }
+
+    int k = this->count++;
+
+    this->items[k] = item;
+
+    if (areaLight) {
+        this->areaLights |= 1u << k;
+    }
+
+    for (int c=0; c<4; c++) {
+        for (int r=0; r<4; r++) {
+            this->invT[(c * 4) + r][k] = _invT[c][r];
+        }
+    }
+
+    if (this->type == Geometry::CUBE) {
+
+        const Cube& cube = dynamic_cast<const Cube&>(geometry);
+
+        for (int i=0; i<3; i++) {
+            this->a[i][k] = cube.getAABB().minimum()[i];
+            this->b[i][k] = cube.getAABB().maximum()[i];
+        }
+
+    } else {
+
+        const Sphere& sphere = dynamic_cast<const Sphere&>(geometry);
+
+        for (int i=0; i<3; i++) {
+            this->a[i][k] = sphere.getCenter()[i];
+        }
+
+        this->radius2[k] = sphere.getRadius() * sphere.getRadius();
+    }
+}
+
+int PrimitiveBatch::intersect(const vec3& orig, const vec3& dir, float tMax, float t[WIDTH]) const
+{
+    auto kernel = Kernels::active().intersectBatch;
+
+    if (kernel == nullptr) {
+        throw runtime_error("PrimitiveBatch::intersect: SIMD batches are not supported on this platform");
+    }
+
+    return kernel(*this, orig, dir, tMax, t);
+}
+
+/******************************************************************************/
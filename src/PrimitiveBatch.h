@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * This file defines batches of analytic primitives of the same type, stored
+ * in structure-of-arrays form so a ray can be tested against several of them
+ * at once using SIMD instructions
+ *
+ * @file PrimitiveBatch.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef PRIMITIVE_BATCH_H
+#define PRIMITIVE_BATCH_H
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "Geometry.h"
+
+// Batching requires SSE2, which every x86-64 processor supports
+#if defined(__SSE2__) || defined(_M_X64)
+	#define ENABLE_PRIMITIVE_BATCHES 1
+#else
+	#define ENABLE_PRIMITIVE_BATCHES 0
+#endif
+
+/******************************************************************************/
+
+/**
+ * Up to WIDTH cubes or spheres, each with the inverse of its world transform.
+ * Every lane computes exactly the same arithmetic, in the same order, as the
+ * scalar Geometry::hit() path, so both produce identical hits.
+ *
+ * WIDTH is the widest register the kernels use (AVX-512); narrower
+ * instruction sets walk a batch several lanes at a time. See Kernels.h
+ */
+class PrimitiveBatch
+{
+	public:
+		static const int WIDTH = 16;
+
+		// Geometry::CUBE or Geometry::SPHERE
+		Geometry::Type type;
+
+		// Number of lanes in use
+		int count;
+
+		// Render item index of each lane
+		int items[WIDTH];
+
+		// Bit i is set if lane i is an area light
+		unsigned int areaLights;
+
+		// Inverse world transform of each lane: invT[(column * 4) + row][lane]
+		float invT[16][WIDTH];
+
+		// Cube: minimum (a) and maximum (b) corners. Sphere: center (a) and radius^2
+		float a[3][WIDTH];
+		float b[3][WIDTH];
+		float radius2[WIDTH];
+
+		explicit PrimitiveBatch(Geometry::Type type);
+
+		// Is the batch full?
+		bool isFull() const { return this->count == WIDTH; }
+
+		// Returns true if the geometry can be stored in a batch
+		static bool accepts(const Geometry& geometry);
+
+		// Adds a lane for the given render item
+		void add(int item, const Geometry& geometry, const glm::mat4& invT, bool areaLight);
+
+		// Tests a WORLD-space ray, whose direction must be normalized, against
+		// every lane. t[i] receives the hit distance for lane i, or a negative
+		// value for a miss; hits farther than tMax are misses. Returns a 
+		// bitmask of the lanes that were hit. Runs the kernel for the 
+		// instruction set selected in Kernels
+		int intersect(const glm::vec3& orig, const glm::vec3& dir, float tMax, float t[WIDTH]) const;
+};
+
+/******************************************************************************/
+
+#endif
@@ -10,6 +10,7 @@
 #ifndef RAY_H
 #define RAY_H
 
+#include <cmath>
 #include <iostream>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -35,35 +36,82 @@ struct Ray
 	// Ray type
 	RayType type;
 
-	inline Ray() { }
+	// Reciprocal of the direction, so slab tests multiply instead of divide.
+	// A zero component gives an infinity with the same sign as the zero
+	glm::vec3 invDir;
+
+	// Per axis, 1 if invDir is negative, else 0. Indexes the near plane of
+	// a slab given as { min, max }; 1 - sign indexes the far plane
+	int sign[3];
+
+	// Only hits with tMin <= t <= tMax count
+	float tMin, tMax;
+
+	// Ray differentials: the origins and directions of the rays offset by
+	// one sample in screen x and y. Used to estimate the footprint of the
+	// ray on a surface for texture filtering; only valid if hasDifferentials
+	bool hasDifferentials;
+	glm::vec3 rxOrig, rxDir;
+	glm::vec3 ryOrig, ryDir;
+
+	inline Ray() : hasDifferentials(false) { }
 
 	Ray(const glm::vec3& _orig, const glm::vec3& _dir) :
 		orig(_orig),
 		dir(_dir),
-		type(PRIMARY)
-	{ }
+		type(PRIMARY),
+		tMin(0.0f),
+		tMax(INFINITY),
+		hasDifferentials(false)
+	{ 
+		this->computeReciprocal();
+	}
 
 	Ray(const glm::vec3& _orig, const glm::vec3& _dir, float epsilon) :
 		orig(_orig),
 		dir(_dir),
-		type(PRIMARY)
+		type(PRIMARY),
+		tMin(0.0f),
+		tMax(INFINITY),
+		hasDifferentials(false)
 	{ 
+		this->computeReciprocal();
 		this->nudge(epsilon);	
 	}
 
 	Ray(const glm::vec3& _orig, const glm::vec3& _dir, float epsilon, RayType _type) :
 		orig(_orig),
 		dir(_dir),
-		type(_type)
+		type(_type),
+		tMin(0.0f),
+		tMax(INFINITY),
+		hasDifferentials(false)
 	{ 
+		this->computeReciprocal();
 		this->nudge(epsilon);	
 	}
 
-	Ray(const Ray& other) : 
-		orig(other.orig),
-		dir(other.dir),
-		type(other.type)
-	{ }
+	Ray(const Ray& other) = default;
+
+	// Recomputes invDir and sign from dir. Must be called after dir changes
+	void computeReciprocal()
+	{
+		this->invDir  = 1.0f / this->dir;
+		this->sign[0] = this->invDir.x < 0.0f;
+		this->sign[1] = this->invDir.y < 0.0f;
+		this->sign[2] = this->invDir.z < 0.0f;
+	}
+
+	// Sets the ray differentials
+	void setDifferentials(const glm::vec3& _rxOrig, const glm::vec3& _rxDir
+	                     ,const glm::vec3& _ryOrig, const glm::vec3& _ryDir)
+	{
+		this->hasDifferentials = true;
+		this->rxOrig           = _rxOrig;
+		this->rxDir            = _rxDir;
+		this->ryOrig           = _ryOrig;
+		this->ryDir            = _ryDir;
+	}
 
 	// Normalizes the ray and returns a new instance
 	Ray normalized() const;
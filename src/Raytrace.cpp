@@ -8,7 +8,9 @@
  ******************************************************************************/
 
 #define GLM_FORCE_RADIANS
+#define _USE_MATH_DEFINES
 #include <algorithm>
+#include <cmath>
 #include <ctime>
 #include <chrono>
 #include <cassert>
@@ -17,12 +19,15 @@
 #endif
 #include <cstdlib>
 #include <iostream>
-#include <stack>
+#include <stdexcept>
 #include "Image.h"
 #include "Raytrace.h"
 #include "Intersection.h"
 #include "EnvironmentMap.h"
 #include "AreaLight.h"
+#include "EnvironmentLight.h"
+#include "Checkpoint.h"
+#include "Stats.h"
 
 /******************************************************************************/
 
@@ -79,6 +84,8 @@ ostream& operator<<(ostream& s, const TraceOptions& opts)
 	s << "[samplesPerLight: " << opts.samplesPerLight <<
 		 ", samplesPerPixel: " << opts.samplesPerPixel << 
 		 ", enablePixelDebug: " << (opts.enablePixelDebug ? "yes" : "no") <<
+		 ", seed: " << opts.seed <<
+		 ", textureFilter: " << TextureMap::filterName(opts.textureFilter) <<
 		 "]" << endl;
     return s;
 }
@@ -117,44 +124,77 @@ void initRaytrace(Camera& camera, shared_ptr<SceneContext> scene)
 /******************************************************************************/
 
 /**
- * Fold function used in closestIntersection() below
+ * Is a hit at distance t on the given render item closer than the closest hit
+ * found so far? Ties go to the item that comes first in the scene graph, so 
+ * the result doesn't depend on the order in which items are tested
  */
-static bool isCloser(const TraceContext& test, TraceContext& other)
+static inline bool isCloser(float t, int item, const Hit& closest)
 {
-    return test.closestIsect.isCloser(other.closestIsect);
+    return t >= 0.0f && (closest.isMiss() || t < closest.t || (t == closest.t && item < closest.item));
 }
 
 /**
- * A fold visitor function used in closestIntersection() below
+ * Finds the closest hit of the ray with any render item, other than the
+ * batched items in rejected. fromBatch is set if the hit came from a batch,
+ * which only reports the distance
  */
-static TraceContext intersectNode(shared_ptr<GraphNode> node, TraceContext ctx)
+static Hit closestHit(const Ray& ray
+                     ,const SceneContext& scene
+                     ,const vector<int>& rejected
+                     ,bool& fromBatch)
 {
-    shared_ptr<Geometry> geometry = node->getGeometry();
+    const vector<RenderItem>& items       = scene.getRenderItems();
+    const vector<PrimitiveBatch>& batches = scene.getBatches();
+    const vector<int>& unbatched          = scene.getUnbatchedItems();
 
-    auto nextT = applyTransform(node, ctx.T);
-    auto isect = geometry 
-        ? geometry->intersect(nextT, ctx.ray, ctx.scene) 
-        : Intersection::miss();
+    vec3 dir = normalize(ray.dir);
+    Hit closest;
 
-    if (isect.isHit()) {
-        isect.node = node;
+    fromBatch = false;
+
+    // Anything farther than the closest hit so far can be skipped:
+    Ray probe(ray);
+
+    // Cubes and spheres, several at a time:
+    for (auto b=batches.begin(); b != batches.end(); b++) {
+
+        float t[PrimitiveBatch::WIDTH];
+        int mask = b->intersect(ray.orig, dir, probe.tMax, t);
+
+        Stats::add(static_cast<Stats::Counter>(Stats::TESTS_CUBE + b->type), b->count);
+
+        for (int k=0; mask != 0; k++, mask >>= 1) {
+            if ((mask & 1) && isCloser(t[k], b->items[k], closest)
+                           && (rejected.empty() || find(rejected.begin(), rejected.end(), b->items[k]) == rejected.end())) {
+                closest      = Hit(t[k]);
+                closest.item = b->items[k];
+                fromBatch    = true;
+                probe.tMax   = t[k];
+            }
+        }
     }
 
-    return TraceContext(ctx.scene, ctx.ray, nextT, isect);
-}
+    // Everything else, one at a time:
+    for (auto i=unbatched.begin(); i != unbatched.end(); i++) {
 
-/**
- * Returns the TraceContext instance with the closest (smallest >= 0) t value.
- * Used by closestIntersection
- */
-static TraceContext findClosestContextNode(TraceContext currentCtx, TraceContext lastCtx)
-{
-    return isCloser(currentCtx, lastCtx) ? currentCtx : lastCtx;
+        Hit next = items[*i].hit(probe);
+
+        if (isCloser(next.t, *i, closest)) {
+            closest      = next;
+            closest.item = *i;
+            fromBatch    = false;
+            probe.tMax   = next.t;
+        }
+    }
+
+    return closest;
 }
 
 /*******************************************************************************
  *
- * Given a ray, this function computes the closest intersect in a scene graph
+ * Given a ray, this function computes the closest intersect in the scene. 
+ * Only compact hit records are produced while searching; the full 
+ * intersection is evaluated for the closest hit alone
  *
  ******************************************************************************/
 
@@ -162,17 +202,49 @@ static TraceContext closestIntersection(const Ray& ray
                                        ,shared_ptr<SceneContext> scene
                                        ,bool& hit)
 {
-    // Identity matrix as the initial transformation:
-    auto I        = mat4(); 
-    auto initCtx  = TraceContext(scene, ray, I);
-    auto finalCtx = fold(scene->getSceneGraph()
-                        ,intersectNode
-                        ,findClosestContextNode
-                        ,initCtx);
+    const vector<RenderItem>& items = scene->getRenderItems();
+
+    // Batched items whose hit the exact test didn't confirm:
+    vector<int> rejected;
+    bool fromBatch = false;
+    Hit closest;
+
+    while (true) {
+
+        closest = closestHit(ray, *scene, rejected, fromBatch);
+
+        if (closest.isMiss() || !fromBatch) {
+            break;
+        }
+
+        // Batches only report the distance; repeat the test for the closest
+        // item to find the primitive (e.g. the cube face) needed to evaluate
+        // the surface:
+        Hit exact = items[closest.item].hit(ray);
+
+        if (exact.isHit()) {
+            exact.item = closest.item;
+            closest    = exact;
+            break;
+        }
+
+        // The kernel's rounding put a grazing hit on the item, where the
+        // exact test misses it. Rather than evaluate a surface that wasn't
+        // hit, search again without it:
+        Stats::add(Stats::BATCH_UNCONFIRMED);
+        rejected.push_back(closest.item);
+    }
+
+    hit = closest.isHit();
 
-    hit = finalCtx.closestIsect.isHit();
+    if (!hit) {
+        return TraceContext(scene, ray);
+    }
 
-    return finalCtx;
+    const RenderItem& item = items[closest.item];
+    Intersection isect     = item.surface(ray, closest);
+
+    return TraceContext(scene, ray, item.T, isect);
 }
 
 /*******************************************************************************
@@ -185,44 +257,58 @@ static TraceContext closestIntersection(const Ray& ray
 static bool fastTestInShadow(const Ray& ray
                             ,shared_ptr<SceneContext> scene
                             ,shared_ptr<GraphNode> ignore
+                            ,int ignoreInstance
                             ,float withinDist)
 {
-    auto graph = scene->getSceneGraph();
+    const vector<RenderItem>& items       = scene->getRenderItems();
+    const vector<PrimitiveBatch>& batches = scene->getBatches();
+    const vector<int>& unbatched          = scene->getUnbatchedItems();
 
-    // Initial transformation matrix is the identity matrix:
-    auto I = mat4();
+    vec3 dir = normalize(ray.dir);
 
-    stack<pair<shared_ptr<GraphNode>, mat4>> S;
+    // Occluders beyond the light are of no interest:
+    Ray probe(ray);
+    probe.tMax = withinDist;
 
-    S.push(make_pair(graph.getRoot(), I));
+    for (auto b=batches.begin(); b != batches.end(); b++) {
 
-    while (!S.empty()) {
+        float t[PrimitiveBatch::WIDTH];
 
-        pair<shared_ptr<GraphNode>, mat4> nodeAndT = S.top();
-        S.pop();
+        // Area lights never occlude:
+        int mask = b->intersect(ray.orig, dir, withinDist, t) & ~b->areaLights;
 
-        shared_ptr<GraphNode> node = nodeAndT.first;
-        mat4 T     = nodeAndT.second;
+        Stats::add(static_cast<Stats::Counter>(Stats::TESTS_CUBE + b->type), b->count);
+        Stats::add(Stats::SHADOW_OBJECT_TESTS, b->count);
 
-        shared_ptr<Geometry> geometry = node->getGeometry();
-        mat4 nextT = applyTransform(node, T);
+        for (int k=0; mask != 0; k++, mask >>= 1) {
+            if ((mask & 1) && t[k] < withinDist && items[b->items[k]].node != ignore) {
 
-        if (node != ignore && geometry) {
+                Stats::add(Stats::SHADOW_EARLY_OUTS);
+                return true; // We're done
+            }
+        }
+    }
 
-            Intersection isect = geometry->intersect(nextT, ray, scene);
-            isect.node = node;
+    for (auto i=unbatched.begin(); i != unbatched.end(); i++) {
 
-            if (isect.isHit() && !node->isAreaLight() && isect.t < withinDist) {
+        const RenderItem& item = items[*i];
 
-                return true; // We're done
-            }
+        // Only the copy of a node that was hit is ignored, so copies can 
+        // shadow each other:
+        bool self = item.node == ignore;
+
+        if (self && !item.copies) {
+            continue;
         }
 
-        list<shared_ptr<GraphNode>> children = node->getChildren();
+        Stats::add(Stats::SHADOW_OBJECT_TESTS);
+
+        Hit hit = item.hit(probe, self ? ignoreInstance : -1);
 
-        // Otherwise, go through the children:
-        for (auto i=children.begin(); i != children.end(); i++) {
-            S.push(make_pair(*i, nextT));
+        if (hit.isHit() && !item.areaLight && hit.t < withinDist) {
+
+            Stats::add(Stats::SHADOW_EARLY_OUTS);
+            return true; // We're done
         }
     }
 
@@ -231,30 +317,25 @@ static bool fastTestInShadow(const Ray& ray
 
 /*******************************************************************************
  *
- * Tests if the given point is in the shadow of another object
+ * Tests if the given point is in the shadow of another object, from a point
+ * sampled on the light, returning the weight of the sample in weight
  *
  ******************************************************************************/
 
 static bool isOccludedFromPosition(shared_ptr<SceneContext> scene
                                   ,shared_ptr<GraphNode> selfNode
+                                  ,int selfInstance
                                   ,const glm::vec3& hitAt
-                                  ,shared_ptr<Light> light)
+                                  ,shared_ptr<Light> light
+                                  ,float& weight)
 {
-    float cosine = 0.0f;
-    glm::vec3 L  = light->fromSampledPoint(hitAt, cosine);
-
-    // if the cosine angle is less than zero, then the sample on the surface of
-    // the light geometry is pointing away from the position to test for 
-    // occlusion. As a result, it cannot occlude, so we can exit early:
-    /*
-    if (cosine < 0.0f) {
-        return false;
-    }
-    */
+    glm::vec3 L = light->fromSampledPoint(hitAt, weight);
 
     Ray ray(hitAt, normalize(L), Utils::EPSILON, Ray::SHADOW);
 
-    return fastTestInShadow(ray, scene, selfNode, length(L));
+    Stats::add(Stats::RAYS_SHADOW);
+
+    return fastTestInShadow(ray, scene, selfNode, selfInstance, length(L));
 }
 
 /*******************************************************************************
@@ -270,6 +351,7 @@ static bool isOccludedFromPosition(shared_ptr<SceneContext> scene
 
 static float shadow(shared_ptr<SceneContext> scene
                    ,shared_ptr<GraphNode> selfNode
+                   ,int selfInstance
                    ,const glm::vec3& hitAt
                    ,shared_ptr<Light> light
                    ,int samples)
@@ -279,23 +361,76 @@ static float shadow(shared_ptr<SceneContext> scene
         return 1.0f;
     }
 
+    float weight = 0.0f;
+
     // Point lights only need 1 sample, 
     if (light->getLightType() == Light::POINT_LIGHT) {
-        return isOccludedFromPosition(scene, selfNode, hitAt, light) 
+        return isOccludedFromPosition(scene, selfNode, selfInstance, hitAt, light, weight) 
             ? 0.0f 
             : 1.0f;
     }
 
-    float contribution = 1.0f / static_cast<float>(samples);
-    float shadeFactor  = 1.0f;
+    // Each sample counts for the solid angle of the light it stands for, so
+    // the parts of the light that are nearer, face the point more squarely
+    // or are sampled less densely count for more:
+    float seen    = 0.0f;
+    float total   = 0.0f;
+    int unblocked = 0;
 
     for (int i=0; i<samples; i++) {
-        if (isOccludedFromPosition(scene, selfNode, hitAt, light)) {
-            shadeFactor -= contribution;
+
+        bool occluded = isOccludedFromPosition(scene, selfNode, selfInstance, hitAt, light, weight);
+
+        total += weight;
+
+        if (!occluded) {
+            seen += weight;
+            unblocked++;
         }
     }
 
-    return shadeFactor;
+    // If no sample faces the point at all, fall back to counting them:
+    return total > 0.0f 
+        ? seen / total 
+        : static_cast<float>(unblocked) / static_cast<float>(samples);
+}
+
+/*******************************************************************************
+ *
+ * Gives a reflected or refracted ray the differentials of the incident ray,
+ * which are bent at the hit in the same way as the ray itself. The surface 
+ * is treated as locally flat: the change in the normal across the footprint
+ * is not accounted for
+ *
+ ******************************************************************************/
+
+static void bendDifferentials(Ray& ray
+                             ,const Ray& incident
+                             ,const Intersection& isect
+                             ,const glm::vec3& N
+                             ,float n)
+{
+    if (!incident.hasDifferentials || !isect.hasDifferentials) {
+        return;
+    }
+
+    glm::vec3 Ix = normalize(incident.rxDir);
+    glm::vec3 Iy = normalize(incident.ryDir);
+    glm::vec3 Rx, Ry;
+
+    if (ray.isRefractionRay()) {
+        Rx = refract(Ix, N, n);
+        Ry = refract(Iy, N, n);
+    }
+
+    // Reflected, or a neighbour was totally internally reflected:
+    if (Rx == vec3(0, 0, 0) || Ry == vec3(0, 0, 0)) {
+        Rx = reflect(Ix, N);
+        Ry = reflect(Iy, N);
+    }
+
+    ray.setDifferentials(isect.hitWorld + isect.dpdx, Rx
+                        ,isect.hitWorld + isect.dpdy, Ry);
 }
 
 /*******************************************************************************
@@ -306,13 +441,14 @@ static float shadow(shared_ptr<SceneContext> scene
 
 static Color traceReflect(shared_ptr<SceneContext> scene
                          ,shared_ptr<TraceOptions> opts
+                         ,const Ray& incident
                          ,const Intersection& isect
                          ,const glm::vec3& I
                          ,const glm::vec3& N
                          ,int depth
                          ,bool isDebugPixel = false)
 {
-    shared_ptr<Material> mat = isect.node->getMaterial();
+    shared_ptr<Material> mat = isect.material;
     assert(!!mat);
 
     glm::vec3 R = reflect(I, N);
@@ -324,6 +460,7 @@ static Color traceReflect(shared_ptr<SceneContext> scene
     #endif
 
     Ray ray(isect.hitWorld, R, Utils::EPSILON, Ray::REFLECTION);
+    bendDifferentials(ray, incident, isect, N, 1.0f);
 
     return mat->getReflectColor() * 
            trace(ray, scene, opts, depth + 1, isDebugPixel);
@@ -337,6 +474,7 @@ static Color traceReflect(shared_ptr<SceneContext> scene
 
 static Color traceRefract(shared_ptr<SceneContext> scene
                          ,shared_ptr<TraceOptions> opts
+                         ,const Ray& incident
                          ,const Intersection& isect
                          ,const glm::vec3& I
                          ,const glm::vec3& N
@@ -349,7 +487,7 @@ static Color traceRefract(shared_ptr<SceneContext> scene
     // Is R a zero vector? If so, reflect instead:
     if (R == vec3(0, 0, 0)) {
 
-        return traceReflect(scene, opts, isect, I, N, depth, isDebugPixel);
+        return traceReflect(scene, opts, incident, isect, I, N, depth, isDebugPixel);
     }
 
     #ifdef ENABLE_PIXEL_DEBUG
@@ -362,6 +500,7 @@ static Color traceRefract(shared_ptr<SceneContext> scene
     #endif
 
     Ray ray(isect.hitWorld, R, Utils::EPSILON, Ray::REFRACTION);
+    bendDifferentials(ray, incident, isect, N, n);
 
     return trace(ray, scene, opts, depth + 1, isDebugPixel);
 }
@@ -388,32 +527,24 @@ float reflectCoeff(const glm::vec3& lightDir
 
 /*******************************************************************************
  *
- * Applies diffuse + specular shading
+ * Computes the color of the material at the hit position, and the surface
+ * normal N there, adjusted by the material's bump map if it has one
  *
  ******************************************************************************/
 
-static vec3 blinnPhongShade(shared_ptr<TraceOptions> opts
-                                ,const Intersection& isect
-                                ,const glm::vec3& I
-                                ,shared_ptr<Light> light
-                                ,Color& ambient
-                                ,Color& diffuse
-                                ,Color& specular
-                                ,bool isDebugPixel)
+static Color surfaceColor(shared_ptr<TraceOptions> opts
+                         ,const Intersection& isect
+                         ,glm::vec3& N
+                         ,bool isDebugPixel)
 {
-    // Coefficients
-    float ka = 0.15f; // ambient
-    float kd = 0.95f; // diffuse
-    float ks = 1.0f;  // specular
-
-    shared_ptr<Material> mat      = isect.node->getMaterial();
+    shared_ptr<Material> mat      = isect.material;
     shared_ptr<Geometry> geometry = isect.node->getGeometry();
 
     assert(mat && geometry);
 
     // Adjust the height of the normal vector by multiplying it with the
     // intensity value of the bump map
-    glm::vec3 N = isect.normal;
+    N = isect.normal;
 
     // Choose the UV mapping vector. If one is given in the intersection, use it,
     // otherwise use the local hit
@@ -432,8 +563,64 @@ static vec3 blinnPhongShade(shared_ptr<TraceOptions> opts
         N = normalize(N + B);
     }
 
-    // Get the color at the hit position:
-    Color matColor = mat->getColor(uvFromHit, geometry);
+    // Tilt the normal by the normal map, in the tangent frame of the hit:
+    if (mat->hasNormalMap()) {
+
+        vec2 uv = isect.hasUV ? isect.uv : Material::mapToUV(uvFromHit, geometry);
+        N       = mat->getNormal(uv, N, isect.tangent, isect.bitangent);
+
+        #ifdef ENABLE_PIXEL_DEBUG
+        if (opts->enablePixelDebug && isDebugPixel) {
+            debugPixel(__FUNCTION_NAME__ "/debug:has-normal-map", -99, N);
+        }
+        #endif
+    }
+
+    // Get the color at the hit position, filtered over the area between the
+    // hits of the ray differentials if they're known:
+    Color matColor;
+
+    if (isect.hasUV) {
+        matColor = isect.hasDifferentials
+                 ? mat->getColor(isect.uv, isect.dUVdx, isect.dUVdy, opts->textureFilter)
+                 : mat->getColor(isect.uv);
+    } else if (isect.hasDifferentials) {
+        matColor = mat->getColor(uvFromHit
+                                ,normalize(isect.hitLocal + isect.dLocaldx)
+                                ,normalize(isect.hitLocal + isect.dLocaldy)
+                                ,geometry
+                                ,opts->textureFilter);
+    } else {
+        matColor = mat->getColor(uvFromHit, geometry);
+    }
+
+    return matColor;
+}
+
+/*******************************************************************************
+ *
+ * Applies diffuse + specular shading
+ *
+ ******************************************************************************/
+
+static vec3 blinnPhongShade(shared_ptr<TraceOptions> opts
+                                ,const Intersection& isect
+                                ,const glm::vec3& I
+                                ,shared_ptr<Light> light
+                                ,Color& ambient
+                                ,Color& diffuse
+                                ,Color& specular
+                                ,bool isDebugPixel)
+{
+    // Coefficients
+    float ka = 0.15f; // ambient
+    float kd = 0.95f; // diffuse
+    float ks = 1.0f;  // specular
+
+    shared_ptr<Material> mat = isect.material;
+
+    glm::vec3 N;
+    Color matColor = surfaceColor(opts, isect, N, isDebugPixel);
 
     // Set the base ambient color component:
     ambient = (mat->getAmbientCoeff() < 0.0f ? ka : mat->getAmbientCoeff()) * matColor;
@@ -475,6 +662,77 @@ static vec3 blinnPhongShade(shared_ptr<TraceOptions> opts
     return N; // The surface normal
 }
 
+/*******************************************************************************
+ *
+ * Applies diffuse shading from the light of the environment, estimated with
+ * importance sampling: directions where the environment is brighter are
+ * sampled more often, and each sample is weighted by the inverse of its 
+ * probability. Occluded samples contribute nothing
+ *
+ ******************************************************************************/
+
+static vec3 environmentShade(shared_ptr<SceneContext> scene
+                            ,shared_ptr<TraceOptions> opts
+                            ,const Intersection& isect
+                            ,shared_ptr<EnvironmentLight> light
+                            ,Color& ambient
+                            ,bool isDebugPixel)
+{
+    float kd = 0.95f; // diffuse
+
+    shared_ptr<Material> mat = isect.material;
+
+    glm::vec3 N;
+    Color matColor = surfaceColor(opts, isect, N, isDebugPixel);
+
+    // Emissive surfaces are lit by themselves:
+    if (mat->isEmissive()) {
+        ambient = matColor;
+        return N;
+    }
+
+    int samples = std::max(1, opts->samplesPerLight);
+
+    // Summed as RGB rather than Color, which would clamp each sample:
+    glm::vec3 irradiance;
+
+    for (int i=0; i<samples; i++) {
+
+        // Samples are stratified over the rows of the environment, so even
+        // a few of them are spread across its bright parts:
+        float u2 = (static_cast<float>(i) + Utils::unitRand()) / static_cast<float>(samples);
+
+        glm::vec3 L;
+        float pdf          = 0.0f;
+        glm::vec3 radiance = light->sample(Utils::unitRand(), u2, L, pdf);
+        float cosine       = dot(L, N);
+
+        if (cosine <= 0.0f || pdf <= 0.0f) {
+            continue;
+        }
+
+        Ray ray(isect.hitWorld, L, Utils::EPSILON, Ray::SHADOW);
+
+        Stats::add(Stats::RAYS_SHADOW);
+
+        if (!fastTestInShadow(ray, scene, isect.node, isect.instance, EnvironmentLight::DISTANCE)) {
+            irradiance += radiance * (cosine / pdf);
+        }
+    }
+
+    // A diffuse surface reflects 1/pi of the irradiance towards the viewer:
+    irradiance *= kd / (static_cast<float>(M_PI) * samples);
+    ambient     = Color(irradiance.r, irradiance.g, irradiance.b) * matColor;
+
+    #ifdef ENABLE_PIXEL_DEBUG
+    if (opts->enablePixelDebug && isDebugPixel) {
+        debugPixel(__FUNCTION_NAME__ "/debug:environment", -99, ambient);
+    }
+    #endif
+
+    return N; // The surface normal
+}
+
 /*******************************************************************************
  *
  * Computes surface shading
@@ -491,7 +749,7 @@ static Color computeShading(const Ray& ray
     auto selfNode = isect.node;
     assert(!!selfNode);
 
-    shared_ptr<Material> mat = selfNode->getMaterial();
+    shared_ptr<Material> mat = isect.material;
     assert(!!mat);
 
     /***************************************************************************
@@ -521,14 +779,25 @@ static Color computeShading(const Ray& ray
 
     auto lights = scene->getLights();
 
+    // Light from the environment, if it lights the scene:
+    bool environmentLit = false;
+    Color environment;
+
     // For each light:
     for (auto l=lights->begin(); l != lights->end(); l++) {
 
+        // The environment takes the place of the constant ambient term:
+        if ((*l)->getLightType() == Light::ENVIRONMENT_LIGHT) {
+            N += environmentShade(scene, opts, isect, static_pointer_cast<EnvironmentLight>(*l), environment, isDebugPixel);
+            environmentLit = true;
+            continue;
+        }
+
         N += blinnPhongShade(opts, isect, I, *l, ambient, diffuse, specular, isDebugPixel);
 
         // Compute the Blinn-Phong diffuse and specular components for the current light
         // if not in the shadow:
-        float amount = shadow(scene, isect.node, isect.hitWorld, *l, opts->samplesPerLight);
+        float amount = shadow(scene, isect.node, isect.instance, isect.hitWorld, *l, opts->samplesPerLight);
         //float amount = 1.0f;
 
         // Apply the shading factor to the diffuse + specular components
@@ -542,17 +811,21 @@ static Color computeShading(const Ray& ray
         }
     }
 
+    if (environmentLit) {
+        ambient = environment;
+    }
+
     /***************************************************************************
      * Reflection & refraction
      **************************************************************************/
 
     if (isect.density < 1.0f) {
-        volumetric = traceRefract(scene, opts, isect, I, N, 1.0f, depth, isDebugPixel);
+        volumetric = traceRefract(scene, opts, ray, isect, I, N, 1.0f, depth, isDebugPixel);
     }
 
     if (mat->isTransparent()) {
 
-        refracted = traceRefract(scene, opts, isect, I, N, n, depth, isDebugPixel);
+        refracted = traceRefract(scene, opts, ray, isect, I, N, n, depth, isDebugPixel);
 
         #ifdef ENABLE_PIXEL_DEBUG
         if (opts->enablePixelDebug && isDebugPixel) {
@@ -563,7 +836,7 @@ static Color computeShading(const Ray& ray
 
     if (mat->isMirror()) {
 
-        reflected = traceReflect(scene, opts, isect, I, N, depth, isDebugPixel);
+        reflected = traceReflect(scene, opts, ray, isect, I, N, depth, isDebugPixel);
 
         #ifdef ENABLE_PIXEL_DEBUG
         if (opts->enablePixelDebug && isDebugPixel) {
@@ -639,6 +912,8 @@ static Color trace(const Ray& ray
 {
     auto envMap = scene->getEnvironmentMap();
 
+    Stats::add(static_cast<Stats::Counter>(Stats::RAYS_PRIMARY + ray.type));
+
     if (depth > MAX_DEPTH) {
 
         #ifdef ENABLE_PIXEL_DEBUG
@@ -647,7 +922,7 @@ static Color trace(const Ray& ray
         }
         #endif
 
-        return envMap->getColor(ray, scene);
+        return envMap->getColor(ray);
         //return Color::DEBUG;
     }
 
@@ -672,7 +947,7 @@ static Color trace(const Ray& ray
     
     } else {
 
-        output = envMap->getColor(ray, scene);
+        output = envMap->getColor(ray);
         //output = Color::DEBUG;
     }
 
@@ -726,11 +1001,15 @@ static Color samplePixel(const Camera& camera
         xNDC = X + (u * dx) + (Utils::unitRand() * 0.9f * dx);
         yNDC = Y + (v * dy) + (Utils::unitRand() * 0.9f * dy);
 
-        // Now, shoot a ray per sub-pixel sampling point:
-        C = trace(camera.spawnRay(xNDC, yNDC), scene, opts, 0, false);
+        // Now, shoot a ray per sub-pixel sampling point. Its differentials
+        // span the share of the pixel covered by one of the N * N samples:
+        C = trace(camera.spawnRayDifferential(xNDC, yNDC, pixelW / static_cast<float>(N), pixelH / static_cast<float>(N))
+                 ,scene, opts, 0, false);
 
         // Average the colors component-by-component to get around
-        // the saturation limit imposed by clamping:
+        // the saturation limit imposed by clamping. This is summed as
+        // the samples are traced, so it isn't one of the SIMD kernels
+        // (see Kernels.h):
         avgR += C.fR();
         avgG += C.fG();
         avgB += C.fB();
@@ -739,172 +1018,381 @@ static Color samplePixel(const Camera& camera
     return Color(avgR / K, avgG / K, avgB / K);
 }
 
+/*******************************************************************************
+ *
+ * Tiled rendering & checkpointing
+ *
+ ******************************************************************************/
+
+/**
+ * Writes the pixel at (i,j) of the render state to the output image
+ */
+static void resolvePixel(shared_ptr<Image> output, const RenderState& state, int i, int j)
+{
+    int k   = (i * state.height) + j;
+    Color c = Color(state.color[3 * k], state.color[(3 * k) + 1], state.color[(3 * k) + 2]);
+
+    (*output)(i, j, 0, 0) = c.iR(); // Set red channel
+    (*output)(i, j, 0, 1) = c.iG(); // Set green channel
+    (*output)(i, j, 0, 2) = c.iB(); // Set blue channel
+}
+
+/**
+ * Writes the checkpoint file, reporting (but otherwise ignoring) failures so
+ * that a full disk doesn't abort the render itself
+ */
+static void writeCheckpoint(const RenderState& state, shared_ptr<TraceOptions> opts)
+{
+    try {
+
+        Checkpoint::save(opts->checkpointFile, state);
+
+    } catch (std::runtime_error& e) {
+
+        cerr << "[!] " << e.what() << endl;
+    }
+}
+
+/**
+ * Returns the rays traced and intersection tests performed so far by the
+ * calling thread
+ */
+static void threadCosts(uint64_t& rays, uint64_t& tests)
+{
+    const Stats::Block& counters = Stats::local();
+
+    rays  = 0;
+    tests = 0;
+
+    for (int c=Stats::RAYS_PRIMARY; c<=Stats::RAYS_SHADOW; c++) {
+        rays += counters.counts[c];
+    }
+
+    for (int c=Stats::TESTS_CUBE; c<=Stats::TESTS_VOLUME; c++) {
+        tests += counters.counts[c];
+    }
+
+    tests += counters.counts[Stats::KD_TRIS_TESTED];
+}
+
+/**
+ * Renders every tile of the current pass not yet marked as completed.
+ *
+ * shadePixel(i, j, color) computes the color of pixel (i,j), returning the 
+ * number of samples taken, or 0 if the pixel was left untouched. 
+ *
+ * Returns false if rendering was interrupted by a stop request.
+ */
+template<typename PixelFunc>
+static bool renderTiles(RenderState& state
+                       ,shared_ptr<Image> output
+                       ,shared_ptr<TraceOptions> opts
+                       ,const string& label
+                       ,PixelFunc shadePixel)
+{
+    const int S      = RenderState::TILE_SIZE;
+    int tiles        = state.tileCount();
+    int tilesX       = state.tilesX();
+    int done         = state.tilesCompleted();
+    bool checkpoints = opts->checkpointInterval > 0;
+    auto lastSave    = chrono::system_clock::now();
+    Heatmap* heatmap = opts->heatmap.get();
+    Stats::Scope* statsScope = Stats::current();
+
+    #ifdef ENABLE_OPENMP
+    #pragma omp parallel
+    #endif
+    {
+        // Counters recorded by the team go wherever the calling thread's go:
+        Stats::Enter enterScope(statsScope);
+
+        #ifdef ENABLE_OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif
+        for (int t=0; t<tiles; t++) {
+
+            if (state.tileDone[t] || Checkpoint::stopRequested()) {
+                continue;
+            }
+
+            int i0 = (t % tilesX) * S;
+            int j0 = (t / tilesX) * S;
+            int i1 = std::min(i0 + S, state.width);
+            int j1 = std::min(j0 + S, state.height);
+
+            // Render the tile into a local buffer first, so the shared state only
+            // ever contains fully completed tiles:
+            vector<Color> colors(S * S);
+            vector<unsigned int> samples(S * S, 0);
+
+            for (int i=i0; i<i1; i++) {
+                for (int j=j0; j<j1; j++) {
+                    int k = ((i - i0) * S) + (j - j0);
+
+                    if (heatmap == nullptr) {
+                        samples[k] = shadePixel(i, j, colors[k]);
+                        continue;
+                    }
+
+                    uint64_t rays0, tests0, rays1, tests1;
+
+                    threadCosts(rays0, tests0);
+                    auto pixelStart = chrono::steady_clock::now();
+
+                    samples[k] = shadePixel(i, j, colors[k]);
+
+                    auto pixelTime = chrono::duration<float, micro>(chrono::steady_clock::now() - pixelStart);
+                    threadCosts(rays1, tests1);
+
+                    heatmap->add(i, j, pixelTime.count(), static_cast<float>(rays1 - rays0), static_cast<float>(tests1 - tests0));
+                }
+            }
+
+            #ifdef ENABLE_OPENMP
+            #pragma omp critical(renderState)
+            #endif
+            {
+                for (int i=i0; i<i1; i++) {
+                    for (int j=j0; j<j1; j++) {
+
+                        int k = ((i - i0) * S) + (j - j0);
+
+                        if (samples[k] > 0) {
+
+                            int p = (i * state.height) + j;
+
+                            state.color[3 * p]       = colors[k].fR();
+                            state.color[(3 * p) + 1] = colors[k].fG();
+                            state.color[(3 * p) + 2] = colors[k].fB();
+                            state.samples[p]         = samples[k];
+
+                            resolvePixel(output, state, i, j);
+                        }
+                    }
+                }
+
+                state.tileDone[t] = 1;
+                done++;
+
+                if (opts->verbose) {
+                    clog << "(" << label << ") " << ((static_cast<float>(done) / static_cast<float>(tiles)) * 100.0f) << "%\r";
+                }
+
+                auto now = chrono::system_clock::now();
+
+                if (checkpoints && chrono::duration<double>(now - lastSave).count() >= opts->checkpointInterval) {
+                    writeCheckpoint(state, opts);
+                    lastSave = now;
+                }
+            }
+        }
+    }
+
+    if (Checkpoint::stopRequested()) {
+
+        if (checkpoints) {
+            writeCheckpoint(state, opts);
+            cout << endl << "> Render stopped; checkpoint written to " << opts->checkpointFile << endl;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
 /*******************************************************************************
  *
  * Raytraces the entire scene
  *
  ******************************************************************************/
 
-void rayTrace(shared_ptr<Image> output
+bool rayTrace(shared_ptr<Image> output
              ,const Camera& C
              ,shared_ptr<SceneContext> scene
              ,shared_ptr<TraceOptions> opts)
 {
-    Graph G   = scene->getSceneGraph();
     vec2 reso = scene->getResolution();
     int X     = reso.x;
     int Y     = reso.y;
 
-    unsigned int line = 0;
     chrono::time_point<chrono::system_clock> start, end;
     chrono::duration<double> elapsed_sec_1, elapsed_sec_2;
 
-    // Get all of the point lights, etc. defined in the scene configuration:
-    auto lights = scene->getLights();
-
-    // Collect all objects that constitute emissive objects and merge them
-    // with the existing light list:
-    auto areaLights = G.areaLights();
-    for (auto l=areaLights->begin(); l != areaLights->end(); l++) {
-        lights->push_back(*l);
-    }
-
     // Compute the width and height of a single pixel
     float pixW = 0.0f;
     float pixH = 1.0f;
     Camera::pixelDimensions(X, Y, pixW, pixH);
 
-    // Environment map:
-    auto envMap = scene->getEnvironmentMap();
+    float fX = static_cast<float>(X);
+    float fY = static_cast<float>(Y);
+
+    // Flatten the scene graph, picking up any changes made since the last
+    // render:
+    scene->buildRenderItems();
+
+    // Set up the render state, restoring it from a prior checkpoint if asked:
+    RenderState state;
+    bool resumed = false;
+
+    if (opts->resume) {
 
-    // If the given environment map is null, just use a simple color:
-    if (!envMap) {
-        auto blank = shared_ptr<EnvironmentMap>(make_shared<ColorEnvironmentMap>(Color::BLACK));
-        scene->setEnvironmentMap(blank);
+        resumed = Checkpoint::load(opts->checkpointFile, state);
+
+        if (resumed) {
+
+            if (state.sceneHash != opts->sceneHash || state.width != X || state.height != Y) {
+                throw runtime_error("Checkpoint " + opts->checkpointFile + " does not match the current scene and options");
+            }
+
+            // The seed is part of the render state; always use the stored one:
+            opts->seed = state.seed;
+
+            cout << "> Resuming from checkpoint " << opts->checkpointFile 
+                 << " (pass " << state.pass << ", " << state.tilesCompleted() << "/" << state.tileCount() << " tiles)" 
+                 << endl;
+
+        } else {
+
+            cout << "> No checkpoint found at " << opts->checkpointFile << "; starting a new render" << endl;
+        }
+    }
+
+    if (!resumed) {
+        state.reset(opts->sceneHash, opts->seed, X, Y);
+    }
+
+    // Restore any pixels rendered before the checkpoint was written:
+    for (int i=0; i<X; i++) {
+        for (int j=0; j<Y; j++) {
+            if (state.samples[(i * Y) + j] > 0) {
+                resolvePixel(output, state, i, j);
+            }
+        }
     }
 
-    float fX = static_cast<float>(X);
-    float fY = static_cast<float>(Y);
-    
     // Dump the trace opts:
-    cout << "> Rendering with configuration: " << endl 
-         << endl 
-         << *opts 
-         << endl;
+    if (opts->verbose) {
+        cout << "> Rendering with configuration: " << endl 
+             << endl 
+             << *opts 
+             << endl;
+    }
 
     start = chrono::system_clock::now();
 
-    #ifdef ENABLE_OPENMP
-    #pragma omp parallel
-    #endif
-    {
-        #ifdef ENABLE_OPENMP
-        #pragma omp for schedule(static)
-        #endif
-        for (int i=0; i<X; i++) {
-            for (int j=0; j<Y; j++) {
+    if (state.pass == 1) {
 
-                #ifdef ENABLE_PIXEL_DEBUG
-                bool hitDebugPixel =    opts->enablePixelDebug 
-                                     && opts->xDebugPixel == i 
-                                     && opts->yDebugPixel == j;
-                #else
-                bool hitDebugPixel = false;
-                #endif
+        bool completed = renderTiles(state, output, opts, "PASS-1", [&](int i, int j, Color& c) -> unsigned int {
 
-                // Shoot a single ray through the center of each pixel
-                float xNDC = static_cast<float>(i) / fX;
-                float yNDC = static_cast<float>(j) / fY;
+            #ifdef ENABLE_PIXEL_DEBUG
+            bool hitDebugPixel =    opts->enablePixelDebug 
+                                 && opts->xDebugPixel == i 
+                                 && opts->yDebugPixel == j;
+            #else
+            bool hitDebugPixel = false;
+            #endif
 
-                Color c = trace(C.spawnRay(xNDC, yNDC), scene, opts, 0, hitDebugPixel);
+            Utils::seedRand(Utils::mixSeed(state.seed, 1, i, j));
 
-                #ifdef ENABLE_PIXEL_DEBUG
-                // If we hit the debug pixel: break out, since there's nothing more to do
-                if (opts->enablePixelDebug && hitDebugPixel) {
+            // Shoot a single ray through the center of each pixel
+            float xNDC = static_cast<float>(i) / fX;
+            float yNDC = static_cast<float>(j) / fY;
 
-                    debugPixel(__FUNCTION_NAME__ ":done", 0, c);
-                    exit(EXIT_FAILURE);
-                }
-                #endif
+            c = trace(C.spawnRayDifferential(xNDC, yNDC, pixW, pixH), scene, opts, 0, hitDebugPixel);
+
+            #ifdef ENABLE_PIXEL_DEBUG
+            // If we hit the debug pixel: break out, since there's nothing more to do
+            if (opts->enablePixelDebug && hitDebugPixel) {
 
-                (*output)(i, j, 0, 0) = c.iR(); // Set red channel
-                (*output)(i, j, 0, 1) = c.iG(); // Set green channel
-                (*output)(i, j, 0, 2) = c.iB(); // Set blue channel
+                debugPixel(__FUNCTION_NAME__ ":done", 0, c);
+                exit(EXIT_FAILURE);
             }
+            #endif
 
-            ++line;
+            return 1;
+        });
 
-            clog << "(PASS-1) " << ((static_cast<float>(line) / fY) * 100.0f) << "%\r";
+        if (!completed) {
+            return false;
         }
-    }
 
-    elapsed_sec_1 = chrono::system_clock::now() - start;
+        elapsed_sec_1 = chrono::system_clock::now() - start;
+        Stats::addTime("pass1", elapsed_sec_1.count());
 
-    cout << endl 
-         << endl 
-         << "> Rendering elapsed time: "
-         << elapsed_sec_1.count() << "s" 
-         << endl 
-         << endl;
+        if (opts->verbose) {
+            cout << endl 
+                 << endl 
+                 << "> Rendering elapsed time: "
+                 << elapsed_sec_1.count() << "s" 
+                 << endl 
+                 << endl;
+        }
 
-    // Adaptively antialias:
-    if (opts->samplesPerPixel > 1) {
+        if (opts->samplesPerPixel > 1) {
 
-        line = 0;
+            // Detect the edges of the image. The map is kept as part of the 
+            // render state so a resumed pass selects the same pixels:
+            float avgIntensity = 0.0f;
+            auto edgeMap       = edges(*output, X, Y, avgIntensity);
 
-        // Detect the edges of the image:
-        float avgIntensity = 0.0f;
-        auto edgeMap       = edges(*output, X, Y, avgIntensity);
+            state.edgeMap.assign(edgeMap.get(), edgeMap.get() + (X * Y));
+            state.avgIntensity = avgIntensity;
+            state.beginPass(2);
 
-        cout << "> Adaptively supersampling with " << opts->samplesPerPixel << " x " << opts->samplesPerPixel 
-             << " samples per pixel" 
-             << endl << endl;
+            if (opts->checkpointInterval > 0) {
+                writeCheckpoint(state, opts);
+            }
+        }
+    }
 
-        start = chrono::system_clock::now();
+    // Adaptively antialias:
+    if (opts->samplesPerPixel > 1) {
 
-        #ifdef ENABLE_OPENMP
-        #pragma omp parallel
-        #endif
-        {
-            #ifdef ENABLE_OPENMP
-            #pragma omp for schedule(static)
-            #endif
-            for (int i=0; i<X; i++) {
-                for (int j=0; j<Y; j++) {
+        if (opts->verbose) {
+            cout << "> Adaptively supersampling with " << opts->samplesPerPixel << " x " << opts->samplesPerPixel 
+                 << " samples per pixel" 
+                 << endl << endl;
+        }
+
+        start = chrono::system_clock::now();
 
-                    // Linearize the index:
-                    int k = (i * Y) + j;
+        bool completed = renderTiles(state, output, opts, "PASS-2", [&](int i, int j, Color& c) -> unsigned int {
 
-                    // For any pixel at (i,j) that has an edge intensity greater than
-                    // the average value, run antialiasing:
-                    if (edgeMap[k] > avgIntensity) {
+            // For any pixel at (i,j) that has an edge intensity greater than
+            // the average value, run antialiasing:
+            if (state.edgeMap[(i * Y) + j] <= state.avgIntensity) {
+                return 0;
+            }
 
-                        Color c = samplePixel(C, scene, opts, pixW, pixH, fX, fY, i ,j);
+            Utils::seedRand(Utils::mixSeed(state.seed, 2, i, j));
 
-                        // Overwrite the value previously stored at (i,j) with the 
-                        // supersampled color value:
-                        (*output)(i, j, 0, 0) = c.iR(); // Set red channel
-                        (*output)(i, j, 0, 1) = c.iG(); // Set green channel
-                        (*output)(i, j, 0, 2) = c.iB(); // Set blue channel
-                    }
-                }
+            // Overwrite the value previously stored at (i,j) with the 
+            // supersampled color value:
+            c = samplePixel(C, scene, opts, pixW, pixH, fX, fY, i ,j);
 
-                ++line;
+            return opts->samplesPerPixel * opts->samplesPerPixel;
+        });
 
-                clog << "(PASS-2) " << ((static_cast<float>(line) / fY) * 100.0f) << "%\r";
-            }
+        if (!completed) {
+            return false;
         }
 
         elapsed_sec_2 = chrono::system_clock::now() - start;
-
-        cout << endl 
-             << endl 
-             << "> Supersampling elapsed time: " << elapsed_sec_2.count() << "s"  
-             << endl
-             << "> Total elapsed time: " << (elapsed_sec_1 + elapsed_sec_2).count() << "s"  
-             << endl
-             << endl;
+        Stats::addTime("pass2", elapsed_sec_2.count());
+
+        if (opts->verbose) {
+            cout << endl 
+                 << endl 
+                 << "> Supersampling elapsed time: " << elapsed_sec_2.count() << "s"  
+                 << endl
+                 << "> Total elapsed time: " << (elapsed_sec_1 + elapsed_sec_2).count() << "s"  
+                 << endl
+                 << endl;
+        }
     }
+
+    return true;
 }
 
 /******************************************************************************/
@@ -13,12 +13,15 @@
 #include <iostream>
 #include <memory>
 #include <utility> 
+#include <cstdint>
+#include <string>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #define cimg_display 0
 #include <CImg.h>
 #include "Config.h"
 #include "Camera.h"
+#include "Heatmap.h"
 #include "Ray.h"
 #include "SceneContext.h"
 
@@ -50,12 +53,46 @@ class TraceOptions
 		// Debug pixel-y
 		int yDebugPixel;
 
+		// Base random seed. Every pixel reseeds its generator from this value
+		// so a render is reproducible across runs and thread counts
+		uint64_t seed;
+
+		// Seconds between checkpoints; checkpointing is disabled if <= 0
+		int checkpointInterval;
+
+		// Checkpoint file location
+		std::string checkpointFile;
+
+		// If true, rendering resumes from the checkpoint file if it exists
+		bool resume;
+
+		// Hash identifying the scene and options; stored in checkpoints
+		uint64_t sceneHash;
+
+		// If false, progress and timing output is suppressed
+		bool verbose;
+
+		// If set, the cost of every pixel is recorded here. Ray and 
+		// intersection counts require Stats::enabled
+		std::shared_ptr<Heatmap> heatmap;
+
+		// Filtering applied to texture maps, based on the footprint of the
+		// ray differentials
+		TextureMap::Filter textureFilter;
+
 		TraceOptions() :
 			samplesPerLight(SAMPLES_PER_LIGHT_DEFAULT),
 			samplesPerPixel(SAMPLES_PER_PIXEL_DEFAULT),
 			enablePixelDebug(false),
 			xDebugPixel(-1),
-			yDebugPixel(-1)
+			yDebugPixel(-1),
+			seed(0),
+			checkpointInterval(0),
+			resume(false),
+			sceneHash(0),
+			verbose(true),
+			heatmap(nullptr),
+			textureFilter(TextureMap::TRILINEAR)
 		{ 
 
 		}
@@ -65,7 +102,15 @@ class TraceOptions
 			samplesPerPixel(opts.samplesPerPixel),
 			enablePixelDebug(opts.enablePixelDebug),
 			xDebugPixel(opts.xDebugPixel),
-			yDebugPixel(opts.yDebugPixel)
+			yDebugPixel(opts.yDebugPixel),
+			seed(opts.seed),
+			checkpointInterval(opts.checkpointInterval),
+			checkpointFile(opts.checkpointFile),
+			resume(opts.resume),
+			sceneHash(opts.sceneHash),
+			verbose(opts.verbose),
+			heatmap(opts.heatmap),
+			textureFilter(opts.textureFilter)
 		{ 
 
 		}
@@ -150,7 +195,8 @@ class TraceContext
  */
 void initRaytrace(Camera&, std::shared_ptr<SceneContext> scene);
 
-void rayTrace(std::shared_ptr<cimg_library::CImg<unsigned char>>
+// Returns false if the render was stopped early via Checkpoint::requestStop()
+bool rayTrace(std::shared_ptr<cimg_library::CImg<unsigned char>>
 	         ,const Camera&
 	         ,std::shared_ptr<SceneContext>
 	         ,std::shared_ptr<TraceOptions>);
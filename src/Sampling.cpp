@@ -3,14 +3,19 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include "Utils.h"
+
+/******************************************************************************/
+
+using namespace std;
 
 /******************************************************************************/
 
 glm::vec3 Sampling::getCosineWeightedDirection(const glm::vec3& normal) 
 {
 	// Pick 2 random numbers in the range (0, 1)
-	float xi1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	float xi2 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+	float xi1 = Utils::unitRand();
+	float xi2 = Utils::unitRand();
 
 	float up = sqrt(xi1); 			// cos(theta)
 	float over = sqrt(1 - up * up); // sin(theta)
@@ -40,3 +45,77 @@ glm::vec3 Sampling::getCosineWeightedDirection(const glm::vec3& normal)
 }
 
 /******************************************************************************/
+
+/**
+ * Each entry gets a column of height 1 on average: columns shorter than that
+ * are topped up from taller ones, which then become their aliases, until
+ * every column is full
+ */
+Sampling::AliasTable::AliasTable(const vector<float>& weights) :
+	probability(weights.size(), 1.0f),
+	alias(weights.size())
+{
+	size_t n   = weights.size();
+	double sum = 0.0;
+
+	for (size_t i=0; i<n; i++) {
+		sum += weights[i];
+		this->alias[i] = static_cast<unsigned int>(i);
+	}
+
+	if (sum <= 0.0) {
+		return;
+	}
+
+	vector<double> height(n);
+	vector<unsigned int> small, large;
+
+	for (size_t i=0; i<n; i++) {
+
+		height[i] = (weights[i] * static_cast<double>(n)) / sum;
+
+		if (height[i] < 1.0) {
+			small.push_back(static_cast<unsigned int>(i));
+		} else {
+			large.push_back(static_cast<unsigned int>(i));
+		}
+	}
+
+	while (!small.empty() && !large.empty()) {
+
+		unsigned int s = small.back();
+		unsigned int l = large.back();
+		small.pop_back();
+		large.pop_back();
+
+		this->probability[s] = static_cast<float>(height[s]);
+		this->alias[s]       = l;
+
+		height[l] = (height[l] + height[s]) - 1.0;
+
+		if (height[l] < 1.0) {
+			small.push_back(l);
+		} else {
+			large.push_back(l);
+		}
+	}
+
+	// Whatever is left is full, give or take rounding, and keeps its
+	// probability of 1
+}
+
+unsigned int Sampling::AliasTable::pick(float u1, float u2) const
+{
+	unsigned int n = static_cast<unsigned int>(this->probability.size());
+	unsigned int i = std::min(static_cast<unsigned int>(u1 * static_cast<float>(n)), n - 1);
+
+	return u2 < this->probability[i] ? i : this->alias[i];
+}
+
+size_t Sampling::AliasTable::getByteSize() const
+{
+	return (this->probability.capacity() * sizeof(float))
+	     + (this->alias.capacity() * sizeof(unsigned int));
+}
+
+/******************************************************************************/
@@ -9,6 +9,8 @@
 #ifndef SAMPLING_H
 #define SAMPLING_H
 
+#include <cstddef>
+#include <vector>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 
@@ -17,6 +19,36 @@ namespace Sampling {
 	// Given a normal vector, find a cosine weighted random direction in a
 	// hemisphere. Adapted from CIS 565
 	glm::vec3 getCosineWeightedDirection(const glm::vec3& normal);
+
+	/**
+	 * Picks one of n entries at random in proportion to their weights, in
+	 * constant time whatever n is (Walker's alias method, built as in Vose's
+	 * "A Linear Algorithm For Generating Random Numbers With a Given
+	 * Distribution")
+	 */
+	class AliasTable
+	{
+		protected:
+			// For each entry: the chance of keeping it once it is landed on,
+			// and the entry picked instead otherwise
+			std::vector<float> probability;
+			std::vector<unsigned int> alias;
+
+		public:
+			AliasTable() { }
+
+			// Builds the table for the given weights, none of them negative.
+			// If they are all zero, every entry is equally likely
+			explicit AliasTable(const std::vector<float>& weights);
+
+			bool empty() const  { return this->probability.empty(); }
+			size_t size() const { return this->probability.size(); }
+
+			// Picks an entry given two independent numbers in [0, 1]
+			unsigned int pick(float u1, float u2) const;
+
+			size_t getByteSize() const;
+	};
 }
 
 /******************************************************************************/
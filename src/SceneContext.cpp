@@ -45,4 +45,87 @@ SceneContext::~SceneContext()
 
 }
 
+Hit RenderItem::hit(const Ray& rayWorld, int ignore) const
+{
+    return this->copies 
+         ? this->copies->hit(this->invT, rayWorld, ignore)
+         : this->geometry->hit(this->invT, rayWorld);
+}
+
+Intersection RenderItem::surface(const Ray& rayWorld, const Hit& hit) const
+{
+    Intersection isect = this->copies 
+                       ? this->copies->surface(this->T, this->invT, rayWorld, hit)
+                       : this->geometry->surface(this->T, this->invT, rayWorld, hit);
+
+    isect.node     = this->node;
+    isect.instance = hit.instance;
+    isect.material = (this->copies && hit.instance >= 0) ? this->copies->getMaterial(hit.instance) : nullptr;
+
+    if (!isect.material) {
+        isect.material = this->node->getMaterial();
+    }
+
+    return isect;
+}
+
+/**
+ * Visit function used by buildRenderItems()
+ */
+static pair<vector<RenderItem>*, glm::mat4> addRenderItem(shared_ptr<GraphNode> node
+                                                          ,pair<vector<RenderItem>*, glm::mat4> current
+                                                          ,int depth)
+{
+    glm::mat4 nextT = applyTransform(node, current.second);
+
+    if (node->getGeometry()) {
+
+        RenderItem item;
+
+        item.node      = node;
+        item.geometry  = node->getGeometry();
+        item.copies    = node->getCopies();
+        item.T         = nextT;
+        item.invT      = glm::inverse(nextT);
+        item.areaLight = node->isAreaLight() && !item.copies;
+
+        current.first->push_back(item);
+    }
+
+    return make_pair(current.first, nextT);
+}
+
+void SceneContext::buildRenderItems()
+{
+    this->renderItems.clear();
+
+    walk(this->graph, addRenderItem, make_pair(&this->renderItems, glm::mat4()));
+
+    this->batches.clear();
+    this->unbatchedItems.clear();
+
+    // Index of the batch currently being filled, per geometry type:
+    map<Geometry::Type, size_t> open;
+
+    for (size_t i=0; i<this->renderItems.size(); i++) {
+
+        const RenderItem& item = this->renderItems[i];
+        Geometry::Type type    = item.geometry->getGeometryType();
+
+        if (item.copies || !PrimitiveBatch::accepts(*item.geometry)) {
+            this->unbatchedItems.push_back(static_cast<int>(i));
+            continue;
+        }
+
+        auto current = open.find(type);
+
+        if (current == open.end() || this->batches[current->second].isFull()) {
+            open[type] = this->batches.size();
+            this->batches.push_back(PrimitiveBatch(type));
+        }
+
+        this->batches[open[type]].add(static_cast<int>(i), *item.geometry, item.invT, item.areaLight);
+    }
+}
+
 /******************************************************************************/
@@ -16,10 +16,12 @@
 #include <map>
 #include <list>
 #include <string>
+#include <vector>
 #include "Graph.h"
 #include "Light.h"
 #include "Material.h"
 #include "EnvironmentMap.h"
+#include "PrimitiveBatch.h"
 
 /******************************************************************************/
 
@@ -29,6 +31,37 @@ typedef std::map<std::string, std::shared_ptr<Material>> MATERIALS;
 
 /******************************************************************************/
 
+/**
+ * A scene graph node with geometry, flattened out of the graph together with
+ * its world transformation so rays can be tested against it directly
+ */
+class RenderItem
+{
+    public:
+        std::shared_ptr<GraphNode> node;
+        std::shared_ptr<Geometry> geometry;
+
+        // Set if the node places copies of its geometry; see InstanceSet
+        std::shared_ptr<InstanceSet> copies;
+
+        // Transformation from local to world space, and its inverse
+        glm::mat4 T;
+        glm::mat4 invT;
+
+        // Set if the node is an area light
+        bool areaLight;
+
+        // Computes the closest hit of a WORLD-space ray with the item, 
+        // skipping the copy numbered ignore, if any
+        Hit hit(const Ray& rayWorld, int ignore = -1) const;
+
+        // Evaluates the full WORLD-space intersection for a hit returned by
+        // hit() for the same ray, along with the material there
+        Intersection surface(const Ray& rayWorld, const Hit& hit) const;
+};
+
+/******************************************************************************/
+
 class SceneContext
 {
     protected:
@@ -42,6 +75,9 @@ class SceneContext
         std::shared_ptr<EnvironmentMap> envMap;
         std::shared_ptr<std::map<std::string,std::shared_ptr<Material>>> materials;
         std::shared_ptr<std::list<std::shared_ptr<Light>>> lights;
+        std::vector<RenderItem> renderItems;
+        std::vector<PrimitiveBatch> batches;
+        std::vector<int> unbatchedItems;
     public:
 
         SceneContext(const glm::vec2& resolution
@@ -70,6 +106,18 @@ class SceneContext
         void setEnvironmentMap(std::shared_ptr<EnvironmentMap> envMap) { this->envMap = envMap ; }
         std::shared_ptr<MATERIALS> getMaterials() const { return this->materials; }
         std::shared_ptr<LIGHTS> getLights() const { return this->lights; }
+
+        // Flattens the scene graph into render items, in pre-order, and 
+        // gathers cubes and spheres into SIMD batches. Must be called again 
+        // whenever the graph or its transformations change
+        void buildRenderItems();
+
+        const std::vector<RenderItem>& getRenderItems() const { return this->renderItems; }
+
+        // Batches of cubes and spheres, and the indices of all other items.
+        // Together they cover every render item exactly once
+        const std::vector<PrimitiveBatch>& getBatches() const { return this->batches; }
+        const std::vector<int>& getUnbatchedItems() const     { return this->unbatchedItems; }
 };
 
 /******************************************************************************/
@@ -25,7 +25,6 @@ Sphere::Sphere() :
     center_(glm::vec3(0.f, 0.f, 0.f)),
     radius_(1.0f)
 {
-    this->buildGeometry();
 	this->buildVolume();
     this->computeAABB();
 }
@@ -162,7 +161,7 @@ void Sphere::buildGeometry()
     indices_.push_back(offset);
 }
 
-Intersection Sphere::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scene) const
+Hit Sphere::hitImpl(const Ray &ray) const
 {
 	// Page 266 in the notes
 	glm::vec3 oc = ray.orig - this->center_;
@@ -173,7 +172,7 @@ Intersection Sphere::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scen
 
 	// Miss
 	if (D < 0.0f) {
-		return Intersection::miss();
+		return Hit::miss();
 	}
 
 	float q = (b < 0.0f ? -b + sqrt(D) : -b - sqrt(D)) / 2.0f;
@@ -183,29 +182,36 @@ Intersection Sphere::intersectImpl(const Ray &ray, shared_ptr<SceneContext> scen
 	float v = max(m, n);
 	float t = u < 0.0f ? v : u;
 
-	glm::vec3 p = ray.orig + (ray.dir * t);
-	glm::vec3 N = glm::normalize(p - this->center_);
+	return Hit(t);
+}
+
+glm::vec3 Sphere::normalImpl(const Ray &ray, const Hit& hit) const
+{
+	glm::vec3 p = ray.orig + (ray.dir * hit.t);
 
-	return Intersection(t, N);
+	return glm::normalize(p - this->center_);
 }
 
-glm::vec3 Sphere::sampleImpl() const
+glm::vec3 Sphere::sampleImpl(glm::vec3& normal) const
 {
 	// generate u, v, in the range (0, 1)
-	float u = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	float v = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+	float u = Utils::unitRand();
+	float v = Utils::unitRand();
 
 	float theta = 2.0f * static_cast<float>(M_PI) * u;
 	float phi = acos(2.0f * v - 1.0f);
 
-	// find x, y, z coordinates assuming unit sphere in object space
-	glm::vec3 point;
-	point[0] = sin(phi) * cos(theta);
-	point[1] = sin(phi) * sin(theta);
-	point[2] = cos(phi);
+	// find x, y, z coordinates on the unit sphere, which is the normal:
+	normal[0] = sin(phi) * cos(theta);
+	normal[1] = sin(phi) * sin(theta);
+	normal[2] = cos(phi);
 
-	// TODO: transform point to world space
-	return point;
+	return this->center_ + (this->radius_ * normal);
+}
+
+float Sphere::areaImpl() const
+{
+	return 4.0f * static_cast<float>(M_PI) * this->radius_ * this->radius_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
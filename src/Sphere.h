@@ -26,8 +26,10 @@ class Sphere : public Geometry
 		void computeAABB();
 
 	protected:
-		virtual Intersection intersectImpl(const Ray &ray, std::shared_ptr<SceneContext> scene) const;
-		virtual glm::vec3 sampleImpl() const;
+		virtual Hit hitImpl(const Ray &ray) const;
+		virtual glm::vec3 normalImpl(const Ray &ray, const Hit& hit) const;
+		virtual glm::vec3 sampleImpl(glm::vec3& normal) const;
+		virtual float areaImpl() const;
 
 	public:
 		Sphere();
@@ -39,6 +41,9 @@ class Sphere : public Geometry
 		virtual const AABB& getAABB() const;
 		virtual void buildGeometry();
 		virtual void repr(std::ostream& s) const;
+
+		const glm::vec3& getCenter() const { return this->center_; }
+		float getRadius() const            { return this->radius_; }
 };
 
 /******************************************************************************/
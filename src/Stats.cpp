@@ -0,0 +1,292 @@
+/*******************************************************************************
+ *
+ * Low overhead rendering statistics. Each thread increments its own block of
+ * counters; the blocks are merged only when a report is requested
+ *
+ * @file Stats.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Json.h"
+#include "Stats.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+bool Stats::enabled = false;
+
+static const char* COUNTER_NAMES[Stats::COUNTER_COUNT] = {
+     "rays.primary"
+    ,"rays.reflection"
+    ,"rays.refraction"
+    ,"rays.shadow"
+    ,"tests.cube"
+    ,"tests.sphere"
+    ,"tests.cylinder"
+    ,"tests.mesh"
+    ,"tests.volume"
+    ,"kd.traversals"
+    ,"kd.nodesVisited"
+    ,"kd.trisTested"
+    ,"instances.nodesVisited"
+    ,"instances.tested"
+    ,"shadow.objectTests"
+    ,"shadow.earlyOuts"
+    ,"batch.unconfirmed"
+    ,"texture.lookups"
+    ,"texture.cacheHits"
+    ,"texture.cacheMisses"
+    ,"texture.cacheEvictions"
+    ,"texture.decodes"
+};
+
+// Every thread's block is registered here so it can be merged later. Blocks
+// are never freed, since threads may still hold a pointer to them:
+static mutex registryLock;
+static vector<unique_ptr<Stats::Block>> blocks;
+static map<string, double> timers;
+static map<string, string> info;
+
+static thread_local Stats::Block* localBlock = nullptr;
+
+// The scope the calling thread records into, if any; localBlock then belongs
+// to that scope instead of the registry above:
+static thread_local Stats::Scope* localScope = nullptr;
+
+/******************************************************************************/
+
+Stats::Block& Stats::local()
+{
+    if (localBlock == nullptr) {
+
+        lock_guard<mutex> guard(registryLock);
+
+        blocks.push_back(unique_ptr<Block>(new Block()));
+        localBlock = blocks.back().get();
+        memset(localBlock->counts, 0, sizeof(localBlock->counts));
+    }
+
+    return *localBlock;
+}
+
+Stats::Block Stats::merge()
+{
+    Block sum;
+    memset(sum.counts, 0, sizeof(sum.counts));
+
+    lock_guard<mutex> guard(registryLock);
+
+    for (auto b=blocks.begin(); b != blocks.end(); b++) {
+        for (int i=0; i<COUNTER_COUNT; i++) {
+            sum.counts[i] += (*b)->counts[i];
+        }
+    }
+
+    return sum;
+}
+
+uint64_t Stats::total(Counter counter)
+{
+    return merge().counts[counter];
+}
+
+void Stats::reset()
+{
+    lock_guard<mutex> guard(registryLock);
+
+    for (auto b=blocks.begin(); b != blocks.end(); b++) {
+        memset((*b)->counts, 0, sizeof((*b)->counts));
+    }
+
+    timers.clear();
+    info.clear();
+}
+
+void Stats::addTime(const string& name, double seconds)
+{
+    if (localScope != nullptr) {
+        localScope->addTime(name, seconds);
+        return;
+    }
+
+    lock_guard<mutex> guard(registryLock);
+    timers[name] += seconds;
+}
+
+double Stats::time(const string& name)
+{
+    lock_guard<mutex> guard(registryLock);
+
+    auto t = timers.find(name);
+    return t != timers.end() ? t->second : 0.0;
+}
+
+void Stats::setInfo(const string& name, const string& value)
+{
+    lock_guard<mutex> guard(registryLock);
+    info[name] = value;
+}
+
+const char* Stats::name(Counter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+/**
+ * Computes n / d, or 0 if d is 0
+ */
+static double safeRatio(uint64_t n, uint64_t d)
+{
+    return d > 0 ? static_cast<double>(n) / static_cast<double>(d) : 0.0;
+}
+
+void Stats::print(ostream& os)
+{
+    Block sum = merge();
+    auto& c   = sum.counts;
+
+    lock_guard<mutex> guard(registryLock);
+
+    os << endl
+       << "********************************************************************************" << endl
+       << "STATISTICS" << endl
+       << "********************************************************************************" << endl;
+
+    for (auto i=info.begin(); i != info.end(); i++) {
+        os << "  " << left << setw(32) << i->first << right << setw(16) << i->second << endl;
+    }
+
+    for (int i=0; i<COUNTER_COUNT; i++) {
+        os << "  " << left << setw(32) << COUNTER_NAMES[i] << right << setw(16) << c[i] << endl;
+    }
+
+    os << "  " << left << setw(32) << "kd.nodesPerRay" << right << setw(16) << fixed << setprecision(2) << safeRatio(c[KD_NODES_VISITED], c[KD_TRAVERSALS]) << endl
+       << "  " << left << setw(32) << "kd.trisPerRay" << right << setw(16) << safeRatio(c[KD_TRIS_TESTED], c[KD_TRAVERSALS]) << endl
+       << "  " << left << setw(32) << "shadow.earlyOutRate" << right << setw(16) << safeRatio(c[SHADOW_EARLY_OUTS], c[RAYS_SHADOW]) << endl
+       << "  " << left << setw(32) << "texture.cacheHitRate" << right << setw(16) << safeRatio(c[TEXTURE_CACHE_HITS], c[TEXTURE_CACHE_HITS] + c[TEXTURE_CACHE_MISSES]) << endl;
+
+    for (auto t=timers.begin(); t != timers.end(); t++) {
+        os << "  " << left << setw(32) << ("time." + t->first) << right << setw(15) << setprecision(3) << t->second << "s" << endl;
+    }
+
+    os.unsetf(ios::floatfield);
+    os << setprecision(6) << endl;
+}
+
+void Stats::writeJSON(ostream& os)
+{
+    Block sum = merge();
+    auto& c   = sum.counts;
+
+    lock_guard<mutex> guard(registryLock);
+
+    os << "{" << endl << "  \"counters\": {";
+
+    for (int i=0; i<COUNTER_COUNT; i++) {
+        os << (i > 0 ? "," : "") << endl << "    " << JsonValue::quote(COUNTER_NAMES[i]) << ": " << c[i];
+    }
+
+    os << endl << "  }," << endl
+       << "  \"derived\": {" << endl
+       << "    \"kd.nodesPerRay\": " << safeRatio(c[KD_NODES_VISITED], c[KD_TRAVERSALS]) << "," << endl
+       << "    \"kd.trisPerRay\": " << safeRatio(c[KD_TRIS_TESTED], c[KD_TRAVERSALS]) << "," << endl
+       << "    \"shadow.earlyOutRate\": " << safeRatio(c[SHADOW_EARLY_OUTS], c[RAYS_SHADOW]) << "," << endl
+       << "    \"texture.cacheHitRate\": " << safeRatio(c[TEXTURE_CACHE_HITS], c[TEXTURE_CACHE_HITS] + c[TEXTURE_CACHE_MISSES]) << endl
+       << "  }," << endl
+       << "  \"timers\": {";
+
+    for (auto t=timers.begin(); t != timers.end(); t++) {
+        os << (t != timers.begin() ? "," : "") << endl << "    " << JsonValue::quote(t->first) << ": " << t->second;
+    }
+
+    os << endl << "  }," << endl << "  \"info\": {";
+
+    for (auto i=info.begin(); i != info.end(); i++) {
+        os << (i != info.begin() ? "," : "") << endl << "    " << JsonValue::quote(i->first) << ": " << JsonValue::quote(i->second);
+    }
+
+    os << endl << "  }" << endl << "}" << endl;
+}
+
+/*******************************************************************************
+ * Scopes
+ ******************************************************************************/
+
+Stats::Block* Stats::Scope::newBlock()
+{
+    lock_guard<mutex> guard(this->lock);
+
+    this->blocks.push_back(unique_ptr<Block>(new Block()));
+    Block* block = this->blocks.back().get();
+    memset(block->counts, 0, sizeof(block->counts));
+
+    return block;
+}
+
+Stats::Block Stats::Scope::merge()
+{
+    Block sum;
+    memset(sum.counts, 0, sizeof(sum.counts));
+
+    lock_guard<mutex> guard(this->lock);
+
+    for (auto b=this->blocks.begin(); b != this->blocks.end(); b++) {
+        for (int i=0; i<COUNTER_COUNT; i++) {
+            sum.counts[i] += (*b)->counts[i];
+        }
+    }
+
+    return sum;
+}
+
+uint64_t Stats::Scope::total(Counter counter)
+{
+    return this->merge().counts[counter];
+}
+
+double Stats::Scope::time(const string& name)
+{
+    lock_guard<mutex> guard(this->lock);
+
+    auto t = this->timers.find(name);
+    return t != this->timers.end() ? t->second : 0.0;
+}
+
+void Stats::Scope::addTime(const string& name, double seconds)
+{
+    lock_guard<mutex> guard(this->lock);
+    this->timers[name] += seconds;
+}
+
+Stats::Enter::Enter(Scope* scope) :
+    previousScope(localScope),
+    previousBlock(localBlock)
+{
+    if (scope != nullptr && scope != localScope) {
+        localScope = scope;
+        localBlock = scope->newBlock();
+    }
+}
+
+Stats::Enter::~Enter()
+{
+    localScope = this->previousScope;
+    localBlock = this->previousBlock;
+}
+
+Stats::Scope* Stats::current()
+{
+    return localScope;
+}
+
+/******************************************************************************/
@@ -0,0 +1,192 @@
+/*******************************************************************************
+ *
+ * Low overhead rendering statistics. Each thread increments its own block of
+ * counters; the blocks are merged only when a report is requested
+ *
+ * @file Stats.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Statistics are compiled in by default. Building with -DENABLE_STATS=0
+// removes every counter update entirely
+#ifndef ENABLE_STATS
+	#define ENABLE_STATS 1
+#endif
+
+/******************************************************************************/
+
+namespace Stats
+{
+	enum Counter {
+		// Rays traced, by Ray::RayType
+		 RAYS_PRIMARY
+		,RAYS_REFLECTION
+		,RAYS_REFRACTION
+		,RAYS_SHADOW
+
+		// Geometry::intersect() calls, by Geometry::Type
+		,TESTS_CUBE
+		,TESTS_SPHERE
+		,TESTS_CYLINDER
+		,TESTS_MESH
+		,TESTS_VOLUME
+
+		// KD-tree traversal
+		,KD_TRAVERSALS
+		,KD_NODES_VISITED
+		,KD_TRIS_TESTED
+
+		// Instance hierarchy traversal: nodes visited and copies tested
+		,INSTANCE_NODES_VISITED
+		,INSTANCES_TESTED
+
+		// Objects tested by shadow rays in fastTestInShadow(), and shadow rays
+		// that exited early on finding an occluder
+		,SHADOW_OBJECT_TESTS
+		,SHADOW_EARLY_OUTS
+
+		// Closest hits reported by a PrimitiveBatch that the exact re-test
+		// of the item then missed; see closestIntersection()
+		,BATCH_UNCONFIRMED
+
+		// Texture + bump map lookups
+		,TEXTURE_LOOKUPS
+
+		// TextureCache reads that found their data resident or not, data
+		// evicted to stay within the budget, and bitmaps decoded from disk
+		,TEXTURE_CACHE_HITS
+		,TEXTURE_CACHE_MISSES
+		,TEXTURE_CACHE_EVICTIONS
+		,TEXTURE_DECODES
+
+		,COUNTER_COUNT
+	};
+
+	// Per-thread counter storage
+	struct Block
+	{
+		uint64_t counts[COUNTER_COUNT];
+
+		// Keeps the blocks of different threads on separate cache lines
+		char padding[64];
+	};
+
+	// Runtime switch; counters are only updated if set
+	extern bool enabled;
+
+	// Returns the calling thread's counter block, creating it on first use
+	Block& local();
+
+	// Increments the given counter for the calling thread
+	inline void add(Counter counter, uint64_t n = 1)
+	{
+		#if ENABLE_STATS
+		if (enabled) {
+			local().counts[counter] += n;
+		}
+		#endif
+	}
+
+	// Sums the counter blocks of all threads
+	Block merge();
+
+	// Returns the value of a counter summed across all threads
+	uint64_t total(Counter counter);
+
+	// Zeroes all counters and timers
+	void reset();
+
+	// Records a named timing, in seconds, e.g. the duration of a render pass.
+	// Timings with the same name accumulate. Goes to the calling thread's
+	// scope, if it has one
+	void addTime(const std::string& name, double seconds);
+
+	// Returns the accumulated timing with the given name, or 0
+	double time(const std::string& name);
+
+	// Records a named informational value reported alongside the counters
+	void setInfo(const std::string& name, const std::string& value);
+
+	// Returns the printable name of a counter
+	const char* name(Counter counter);
+
+	// Prints a table of all counters and timings
+	void print(std::ostream& os);
+
+	// Writes all counters and timings as a JSON object
+	void writeJSON(std::ostream& os);
+
+	/**
+	 * Counters and timings of a single unit of work, e.g. one render server
+	 * job, kept apart from those of any work running concurrently. Whatever
+	 * a thread records while it is inside the scope (see Enter) goes to the
+	 * scope only, not to the process wide totals
+	 */
+	class Scope
+	{
+		friend class Enter;
+
+		protected:
+			std::mutex lock;
+			std::vector<std::unique_ptr<Block>> blocks;
+			std::map<std::string, double> timers;
+
+			// Creates a zeroed counter block for a thread entering the scope
+			Block* newBlock();
+
+		public:
+			Scope() { }
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+			// Sums the counter blocks of every thread that entered the scope
+			Block merge();
+
+			// Returns the value of a counter summed across those threads
+			uint64_t total(Counter counter);
+
+			// Returns the accumulated timing with the given name, or 0
+			double time(const std::string& name);
+
+			void addTime(const std::string& name, double seconds);
+	};
+
+	/**
+	 * Directs the calling thread's counters and timings into a scope for as
+	 * long as this object lives. Entering the scope the thread is already in,
+	 * or a null scope, changes nothing. Worker threads, e.g. an OpenMP team,
+	 * enter the scope of the thread that started them with current()
+	 */
+	class Enter
+	{
+		protected:
+			Scope* previousScope;
+			Block* previousBlock;
+
+		public:
+			explicit Enter(Scope* scope);
+			~Enter();
+
+			Enter(const Enter&) = delete;
+			Enter& operator=(const Enter&) = delete;
+	};
+
+	// Returns the scope the calling thread records into, or nullptr
+	Scope* current();
+}
+
+/******************************************************************************/
+
+#endif
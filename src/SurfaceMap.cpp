@@ -11,10 +11,13 @@
 #define _USE_MATH_DEFINES
 #include <algorithm>
 #include <cmath>
-#include <cstring>
+#include <fstream>
+#include <mutex>
 #include <stdexcept>
+#include "Kernels.h"
 #include "SurfaceMap.h"
 #include "Utils.h"
+#include "Stats.h"
 
 /******************************************************************************/
 
@@ -28,6 +31,20 @@ using namespace cimg_library;
 
 /******************************************************************************/
 
+static mutex decodeLock;
+
+/******************************************************************************/
+
+/**
+ * Packs an RGB color into an RGBA8 texel, red in the lowest byte
+ */
+static inline uint32_t packTexel(unsigned int r, unsigned int g, unsigned int b)
+{
+	return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+/******************************************************************************/
+
 /**
  *  Static method that maps the given position P to a spherical UV position
  *
@@ -66,6 +83,38 @@ vec2 SurfaceMap::mapToCube(const vec3& d)
 	}
 }
 
+/**
+ * u runs around the Y axis with atan(z, x), and v down from +Y
+ */
+void SurfaceMap::sphereFrame(const vec3& d, vec3& T, vec3& B)
+{
+	T = vec3(-d.z, 0.0f, d.x);
+	B = vec3(0.0f, 1.0f, 0.0f) - (d.y * d);
+}
+
+/**
+ * Follows the faces picked by mapToCube(). On the X faces v follows d.x, 
+ * which barely changes across the face, so +Y is taken as up there
+ */
+void SurfaceMap::cubeFrame(const vec3& d, vec3& T, vec3& B)
+{
+	float X = abs(d.x);
+	float Y = abs(d.y);
+	float Z = abs(d.z);
+	float M = std::max(X, std::max(Y, Z));
+
+	if (X == M) {
+		T = vec3(0.0f, 0.0f, 1.0f);
+		B = vec3(0.0f, 1.0f, 0.0f);
+	} else if (Y == M) {
+		T = vec3(1.0f, 0.0f, 0.0f);
+		B = vec3(0.0f, 0.0f, -1.0f);
+	} else {
+		T = vec3(-1.0f, 0.0f, 0.0f);
+		B = vec3(0.0f, 1.0f, 0.0f);
+	}
+}
+
 /******************************************************************************/
 
 SurfaceMap::SurfaceMap(const string& _filename, MapType _type) :
@@ -74,9 +123,14 @@ SurfaceMap::SurfaceMap(const string& _filename, MapType _type) :
 	iWidth(0),
 	iHeight(0),
 	fWidth(0.0f),
-	fHeight(0.0f)
+	fHeight(0.0f),
+	loaded(false)
 {
-	this->loadBitmap(_filename);
+	// The bitmap isn't decoded until it is used, but a missing file should
+	// still be reported while the scene is read:
+	if (!ifstream(_filename.c_str()).good()) {
+		throw runtime_error("SurfaceMap: Could not read image from file");
+	}
 }
 
 SurfaceMap::~SurfaceMap()
@@ -84,16 +138,40 @@ SurfaceMap::~SurfaceMap()
 
 }
 
-void SurfaceMap::loadBitmap(const string& filename)
+/**
+ * Decodes the bitmap and hands it to the subclass, once
+ */
+void SurfaceMap::load() const
 {
-	if (!this->image.load(filename.c_str())) {
-		throw runtime_error("SurfaceMap: Could not read image from file");
+	lock_guard<mutex> guard(this->loadLock);
+
+	if (this->loaded.load(memory_order_relaxed)) {
+		return;
 	}
 
-	this->iWidth  = this->image.width();
-	this->iHeight = this->image.height();
+	Image image;
+	this->decode(image);
+
+	this->iWidth  = image.width();
+	this->iHeight = image.height();
 	this->fWidth  = static_cast<float>(this->iWidth);
 	this->fHeight = static_cast<float>(this->iHeight);
+
+	this->build(image);
+
+	this->loaded.store(true, memory_order_release);
+}
+
+void SurfaceMap::decode(Image& image) const
+{
+	Stats::add(Stats::TEXTURE_DECODES);
+
+	// CImg's loaders share global state, so only one runs at a time:
+	lock_guard<mutex> guard(decodeLock);
+
+	if (!image.load(this->filename.c_str())) {
+		throw runtime_error("SurfaceMap: Could not read image from file");
+	}
 }
 
 /**
@@ -107,6 +185,10 @@ void SurfaceMap::uvToXY(float u, float v, int& x, int& y) const
 
 	x = static_cast<int>(floor(u * this->fWidth));
 	y = static_cast<int>(floor(v * this->fHeight));
+
+	// u = 1 or v = 1 would land just past the last texel:
+	x = std::min(x, this->iWidth - 1);
+	y = std::min(y, this->iHeight - 1);
 }
 
 /**
@@ -122,12 +204,14 @@ vec4 SurfaceMap::getBilinearWeights(float u
 {
 	assert(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f);
 
+	this->ensureLoaded();
+
 	float U = u * this->fWidth;
 	float V = v * this->fHeight;
 
 	// Find the fractional parts of u and v:
 	float S = U - floorf(U);
-	float T = U - floorf(U);
+	float T = V - floorf(V);
 
 	// Weights 1-4 corresponding to positions <P1,P2,P3,P4>
 	vec4 W = vec4((1.0f - S) * (1.0f - T), S * (1.0f - T), (1.0f - S) * T, S *  T);
@@ -149,6 +233,25 @@ vec4 SurfaceMap::getBilinearWeights(float u
 
 /******************************************************************************/
 
+static const char* FILTER_NAMES[] = { "bilinear", "trilinear", "anisotropic" };
+
+const char* TextureMap::filterName(Filter filter)
+{
+	return FILTER_NAMES[filter];
+}
+
+bool TextureMap::filterFromName(const string& name, Filter& filter)
+{
+	for (int i=BILINEAR; i<=ANISOTROPIC; i++) {
+		if (name == FILTER_NAMES[i]) {
+			filter = static_cast<Filter>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 TextureMap::TextureMap(const string& filename) :
 	SurfaceMap(filename, TEXTURE_MAP)
 {
@@ -160,13 +263,23 @@ TextureMap::~TextureMap()
 
 }
 
+int TextureMap::getLevelCount() const
+{
+	this->ensureLoaded();
+	return static_cast<int>(this->levels.size());
+}
+
 /**
  * Given a pixel (i,j) coordinate, this returns an RGB color value
  */
 Color TextureMap::getColor(int i, int j) const
 {
-	ImagePixel p = pixel(this->image, i, j);
-	return Color(RED(p), GREEN(p), BLUE(p));
+	this->ensureLoaded();
+
+	TextureCache::Pin pin;
+
+	uint32_t t = (*this->level(0))(i, j);
+	return Color(static_cast<int>(t & 0xff), static_cast<int>((t >> 8) & 0xff), static_cast<int>((t >> 16) & 0xff));
 }
 
 /**
@@ -174,79 +287,409 @@ Color TextureMap::getColor(int i, int j) const
  */
 Color TextureMap::getColor(float u, float v) const
 {
+	Stats::add(Stats::TEXTURE_LOOKUPS);
+
+	this->ensureLoaded();
+
 	#ifdef USE_BILINEAR_FILTERING
 
+	TextureCache::Pin pin;
+
 	vec2 P1, P2, P3, P4;
 	vec4 W = this->getBilinearWeights(u, v, P1, P2, P3, P4);
 
-	ImagePixel pixels[4] = {
-		pixel(this->image, static_cast<int>(P1.x), static_cast<int>(P1.y)),
-		pixel(this->image, static_cast<int>(P2.x), static_cast<int>(P2.y)),
-		pixel(this->image, static_cast<int>(P3.x), static_cast<int>(P3.y)),
-		pixel(this->image, static_cast<int>(P4.x), static_cast<int>(P4.y))
-	};
-
-	return (W[0] * Color(RED(pixels[0]), GREEN(pixels[0]), BLUE(pixels[0]))) + 
-		   (W[1] * Color(RED(pixels[1]), GREEN(pixels[1]), BLUE(pixels[1]))) +
-		   (W[2] * Color(RED(pixels[2]), GREEN(pixels[2]), BLUE(pixels[2]))) +
-		   (W[3] * Color(RED(pixels[3]), GREEN(pixels[3]), BLUE(pixels[3])));
+	const MipLevel& base = *this->level(0);
+	float weights[4]     = { W[0], W[1], W[2], W[3] };
+	float rgba[4];
+
+	Kernels::active().blendTexels(base(static_cast<int>(P1.x), static_cast<int>(P1.y))
+	                             ,base(static_cast<int>(P2.x), static_cast<int>(P2.y))
+	                             ,base(static_cast<int>(P3.x), static_cast<int>(P3.y))
+	                             ,base(static_cast<int>(P4.x), static_cast<int>(P4.y))
+	                             ,weights
+	                             ,rgba);
+
+	return Color(rgba);
 	#else
 
 	int x = 0, y = 0;
 	uvToXY(u, v, x, y);
-	ImagePixel p = pixel(this->image->GetPixel(x, y);
-	return Color(RED(p), GREEN(p), BLUE(p));
+	return this->getColor(x, y);
 	#endif
 }
 
+/**
+ * Builds the mip pyramid and stores every level in the cache
+ */
+void TextureMap::build(const Image& image) const
+{
+	shared_ptr<const MipLevel> next = make_shared<const MipLevel>(fromImage(image));
+
+	this->levels.clear();
+
+	while (true) {
+
+		this->levels.push_back(unique_ptr<MipSlot>(new MipSlot()));
+		this->levels.back()->set(next, next->getByteSize());
+
+		if (next->getWidth() == 1 && next->getHeight() == 1) {
+			break;
+		}
+
+		next = make_shared<const MipLevel>(downsample(*next));
+	}
+}
+
+/**
+ * Returns mip level i. If it was evicted, it is downsampled again from the
+ * nearest finer level still in the cache, decoding the bitmap only if 
+ * there is none
+ */
+const TextureMap::MipLevel* TextureMap::level(int i) const
+{
+	const MipLevel* p = this->levels[i]->get();
+
+	if (p != nullptr) {
+		return p;
+	}
+
+	lock_guard<mutex> guard(this->loadLock);
+
+	// Another thread may have rebuilt it in the meantime:
+	p = this->levels[i]->peek();
+
+	if (p != nullptr) {
+		return p;
+	}
+
+	int k = i;
+
+	while (p == nullptr && k > 0) {
+		p = this->levels[--k]->peek();
+	}
+
+	MipLevel next;
+
+	if (p == nullptr) {
+		Image image;
+		this->decode(image);
+		next = fromImage(image);
+	} else {
+		next = downsample(*p);
+		k++;
+	}
+
+	for (; k<i; k++) {
+		next = downsample(next);
+	}
+
+	size_t bytes = next.getByteSize();
+
+	return this->levels[i]->set(make_shared<const MipLevel>(std::move(next)), bytes);
+}
+
+/**
+ * Converts a decoded bitmap to the full size mip level
+ */
+TextureMap::MipLevel TextureMap::fromImage(const Image& image)
+{
+	MipLevel base(image.width(), image.height());
+
+	for (int i=0; i<base.getWidth(); i++) {
+		for (int j=0; j<base.getHeight(); j++) {
+			ImagePixel p = pixel(image, i, j);
+			base(i, j)   = packTexel(RED(p), GREEN(p), BLUE(p));
+		}
+	}
+
+	return base;
+}
+
+/**
+ * Computes the mip level after prev. Each texel is the average of the 2x2 
+ * texels it covers in prev, rounded to the nearest 8-bit value. When a 
+ * dimension is odd, the last row or column is left out
+ */
+TextureMap::MipLevel TextureMap::downsample(const MipLevel& prev)
+{
+	int W = prev.getWidth();
+	int H = prev.getHeight();
+
+	MipLevel next(std::max(1, W / 2), std::max(1, H / 2));
+
+	for (int i=0; i<next.getWidth(); i++) {
+
+		int i0 = std::min(2 * i, W - 1);
+		int i1 = std::min((2 * i) + 1, W - 1);
+
+		for (int j=0; j<next.getHeight(); j++) {
+
+			int j0 = std::min(2 * j, H - 1);
+			int j1 = std::min((2 * j) + 1, H - 1);
+
+			uint32_t t[4] = { prev(i0, j0), prev(i1, j0), prev(i0, j1), prev(i1, j1) };
+			uint32_t sum[3];
+
+			for (int c=0; c<3; c++) {
+				int shift = 8 * c;
+				sum[c] = (((t[0] >> shift) & 0xff) + ((t[1] >> shift) & 0xff) 
+				        + ((t[2] >> shift) & 0xff) + ((t[3] >> shift) & 0xff) + 2) / 4;
+			}
+
+			next(i, j) = packTexel(sum[0], sum[1], sum[2]);
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Wraps a texel index, given as a whole float so far out of range (u,v) 
+ * can't overflow an int, into [0, n)
+ */
+static inline int wrapTexel(float i, int n)
+{
+	float N = static_cast<float>(n);
+	int k   = static_cast<int>(i - (floorf(i / N) * N));
+
+	// Rounding can land exactly on n:
+	return k < n ? k : 0;
+}
+
+/**
+ * Bilinear lookup in a single mip level, writing RGBA in [0,1]. Texel 
+ * centers lie at ((i + 0.5) / width, (j + 0.5) / height), so every level 
+ * lines up with the others. Textures repeat, as (u,v) are wrapped into 
+ * [0,1) by the callers, so the footprint wraps past the edges as well
+ */
+void TextureMap::bilinear(const MipLevel& level, float u, float v, float rgba[4]) const
+{
+	float U  = (u * static_cast<float>(level.getWidth())) - 0.5f;
+	float V  = (v * static_cast<float>(level.getHeight())) - 0.5f;
+	float UF = floorf(U);
+	float VF = floorf(V);
+	float S  = U - UF;
+	float T  = V - VF;
+
+	int x0 = wrapTexel(UF, level.getWidth());
+	int y0 = wrapTexel(VF, level.getHeight());
+	int x1 = (x0 + 1) % level.getWidth();
+	int y1 = (y0 + 1) % level.getHeight();
+
+	float W[4] = { (1.0f - S) * (1.0f - T), S * (1.0f - T), (1.0f - S) * T, S * T };
+
+	Kernels::active().blendTexels(level(x0, y0), level(x1, y0), level(x0, y1), level(x1, y1), W, rgba);
+}
+
+/**
+ * Splits a level of detail, where level 0 is the full size image, into the
+ * finer of the two nearest mip levels, L, and the weight f of level L + 1
+ */
+void TextureMap::selectLevels(float lod, int& L, float& f) const
+{
+	int maxLevel = static_cast<int>(this->levels.size()) - 1;
+
+	L = 0;
+	f = 0.0f;
+
+	// Also catches NaN:
+	if (!(lod > 0.0f)) {
+		return;
+	}
+
+	if (lod >= static_cast<float>(maxLevel)) {
+		L = maxLevel;
+		return;
+	}
+
+	L = static_cast<int>(floorf(lod));
+	f = lod - static_cast<float>(L);
+}
+
+/**
+ * Blends bilinear lookups in two adjacent mip levels, f being the weight 
+ * of the coarser one
+ */
+void TextureMap::trilinear(const MipLevel& fine, const MipLevel& coarse, float f, float u, float v, float rgba[4]) const
+{
+	if (f == 0.0f) {
+		this->bilinear(fine, u, v, rgba);
+		return;
+	}
+
+	float c0[4], c1[4];
+
+	this->bilinear(fine, u, v, c0);
+	this->bilinear(coarse, u, v, c1);
+
+	for (int c=0; c<4; c++) {
+		rgba[c] = ((1.0f - f) * c0[c]) + (f * c1[c]);
+	}
+}
+
+/**
+ * Given a (u,v) coordinate and its derivatives in screen x and y, this 
+ * returns the RGB color value averaged over the footprint of a sample
+ */
+Color TextureMap::getColor(float u
+	                      ,float v
+	                      ,const vec2& dUVdx
+	                      ,const vec2& dUVdy
+	                      ,Filter filter) const
+{
+	Stats::add(Stats::TEXTURE_LOOKUPS);
+
+	this->ensureLoaded();
+
+	TextureCache::Pin pin;
+
+	float rgba[4];
+
+	if (filter == BILINEAR) {
+		this->bilinear(*this->level(0), u, v, rgba);
+		return Color(rgba);
+	}
+
+	// Length of the footprint's axes, in texels of the base level:
+	vec2 size = vec2(this->fWidth, this->fHeight);
+	float Lx  = length(dUVdx * size);
+	float Ly  = length(dUVdy * size);
+
+	int L   = 0;
+	float f = 0.0f;
+
+	if (filter == TRILINEAR) {
+		this->selectLevels(log2f(std::max(Lx, Ly)), L, f);
+		const MipLevel* fine   = this->level(L);
+		const MipLevel* coarse = f > 0.0f ? this->level(L + 1) : fine;
+
+		this->trilinear(*fine, *coarse, f, u, v, rgba);
+		return Color(rgba);
+	}
+
+	// Anisotropic: choose the level from the footprint's minor axis, then
+	// average several probes spread along its major axis:
+	float major = std::max(Lx, Ly);
+	float minor = std::min(Lx, Ly);
+	vec2 axis   = Lx >= Ly ? dUVdx : dUVdy;
+	int N       = MAX_ANISOTROPY;
+
+	if (minor > 0.0f && major / minor < static_cast<float>(MAX_ANISOTROPY)) {
+		N = std::max(1, static_cast<int>(ceilf(major / minor)));
+	}
+
+	this->selectLevels(log2f(major / static_cast<float>(N)), L, f);
+
+	// Every probe reads the same two levels:
+	const MipLevel* fine   = this->level(L);
+	const MipLevel* coarse = f > 0.0f ? this->level(L + 1) : fine;
+
+	float K      = static_cast<float>(N);
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int k=0; k<N; k++) {
+
+		vec2 offset = (((static_cast<float>(k) + 0.5f) / K) - 0.5f) * axis;
+
+		this->trilinear(*fine, *coarse, f, u + offset.x, v + offset.y, rgba);
+
+		for (int c=0; c<4; c++) {
+			sum[c] += rgba[c];
+		}
+	}
+
+	return Color(sum[0] / K, sum[1] / K, sum[2] / K);
+}
+
 /******************************************************************************/
 
 BumpMap::BumpMap(const string& filename) :
-	SurfaceMap(filename, BUMP_MAP),
-	N(0),
-	bU(nullptr),
-	bV(nullptr)
+	SurfaceMap(filename, BUMP_MAP)
 {
-	this->initHeightMap();
-	this->computeDerivatives();
+
 }
 
 BumpMap::~BumpMap()
 {
-	delete [] this->bU;
-	delete [] this->bV;
+
+}
+
+void BumpMap::build(const Image& image) const
+{
+	shared_ptr<const HeightMap> p = make_shared<const HeightMap>(fromImage(image));
+	this->heights.set(p, p->getByteSize());
 }
 
-void BumpMap::initHeightMap()
+/**
+ * Returns the height map, decoding the bitmap again if it was evicted
+ */
+const BumpMap::HeightMap* BumpMap::heightMap() const
+{
+	const HeightMap* p = this->heights.get();
+
+	if (p != nullptr) {
+		return p;
+	}
+
+	lock_guard<mutex> guard(this->loadLock);
+
+	// Another thread may have rebuilt it in the meantime:
+	p = this->heights.peek();
+
+	if (p == nullptr) {
+		Image image;
+		this->decode(image);
+		shared_ptr<const HeightMap> texels = make_shared<const HeightMap>(fromImage(image));
+		p = this->heights.set(texels, texels->getByteSize());
+	}
+
+	return p;
+}
+
+BumpMap::HeightMap BumpMap::fromImage(const Image& image)
 {
-	this->N = this->iWidth * this->iHeight;
+	HeightMap texels(image.width(), image.height());
 
-	// The derivative in the X & Y directions:
-	this->bU = new float[N];
-	this->bV = new float[N];
+	initHeightMap(image, texels);
+	computeDerivatives(texels);
 
-	// Zero everything out initially:
-	memset(&this->bU[0], 0, sizeof(this->bU[0]) * N);
-	memset(&this->bV[0], 0, sizeof(this->bV[0]) * N);
+	return texels;
+}
+
+/**
+ * Converts the bitmap to heights once, rather than on every lookup
+ */
+void BumpMap::initHeightMap(const Image& image, HeightMap& texels)
+{
+	for (int i=0; i<texels.getWidth(); i++) {
+		for (int j=0; j<texels.getHeight(); j++) {
+
+			ImagePixel p = pixel(image, i, j);
+			Texel& t     = texels(i, j);
+
+			t.height = Color(RED(p), GREEN(p), BLUE(p)).luminosity();
+			t.bU     = 0.0f;
+			t.bV     = 0.0f;
+		}
+	}
 }
 
 /**
  * Computes the derivatives in X and Y based on the technique
  * outlined in the lecture notes pg 911-13
  */
-void BumpMap::computeDerivatives()
+void BumpMap::computeDerivatives(HeightMap& texels)
 {
-	unsigned int k = 0;
+	int W = texels.getWidth();
+	int H = texels.getHeight();
 
-	for (int i=0; i<this->iWidth; i++) {
-		for (int j=0; j<this->iHeight; j++) {
+	for (int i=0; i<W; i++) {
+		for (int j=0; j<H; j++) {
 
-			k = this->convert2DTo1D(i, j);
-			assert(k < this->N);
+			Texel& t = texels(i, j);
 
-			float bIJ   = this->getIntensity(i, j);
-			this->bU[k] = this->getIntensity(i+1 < this->iWidth ? i+1 : i, j) - bIJ;
-			this->bV[k] = this->getIntensity(i, j+1 < this->iHeight ? j+1 : j) - bIJ;
+			t.bU = texels(i+1 < W ? i+1 : i, j).height - t.height;
+			t.bV = texels(i, j+1 < H ? j+1 : j).height - t.height;
 		}
 	}
 }
@@ -256,8 +699,10 @@ void BumpMap::computeDerivatives()
  */
 float BumpMap::getIntensity(int i, int j) const
 {
-	ImagePixel p = pixel(this->image, i, j);
-	return Color(RED(p), GREEN(p), BLUE(p)).luminosity();
+	this->ensureLoaded();
+
+	TextureCache::Pin pin;
+	return (*this->heightMap())(i, j).height;
 }
 
 /**
@@ -265,10 +710,13 @@ float BumpMap::getIntensity(int i, int j) const
  */
 float BumpMap::getIntensity(float u, float v) const
 {
+	this->ensureLoaded();
+
+	TextureCache::Pin pin;
+
 	int i = 0, j = 0;
 	uvToXY(u, v, i, j);
-	ImagePixel p = pixel(this->image, i, j);
-	return Color(RED(p), GREEN(p), BLUE(p)).luminosity();
+	return (*this->heightMap())(i, j).height;
 }
 
 /**
@@ -280,15 +728,20 @@ vec3 BumpMap::getNormal(float u, float v) const
 	// and lecture notes
 	assert(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f);
 
+	Stats::add(Stats::TEXTURE_LOOKUPS);
+
+	this->ensureLoaded();
+
 	int x = 0, y = 0;
 	uvToXY(u, v, x, y);
 
+	TextureCache::Pin pin;
+
 	// Get the partial derivates bU and bV
-	unsigned int k = this->convert2DTo1D(x, y);
-	assert(k < this->N);
+	const Texel& t = (*this->heightMap())(x, y);
 
-	float bu = this->bU[k];
-	float bv = this->bV[k];
+	float bu = t.bU;
+	float bv = t.bV;
 	vec3 pu  = vec3(u, v, bu);
 	vec3 pv  = vec3(u, v, bv);
 	vec3 n   = cross(pu, pv);
@@ -303,6 +756,8 @@ ostream& operator<<(ostream& s, const SurfaceMap& map)
 {
 	if (map.isTextureMap()) {
 		s << "TextureMap { \"" << map.filename << "\" }";
+	} else if (map.isNormalMap()) {
+		s << "NormalMap { \"" << map.filename << "\" }";
 	} else {
 		s << "BumpMap { \"" << map.filename << "\" }";
 	}
@@ -11,13 +11,20 @@
 #ifndef SURFACE_MAP_H
 #define SURFACE_MAP_H
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include "Image.h"
 #include "Color.h"
 #include "Geometry.h"
+#include "TextureCache.h"
+#include "TiledImage.h"
 
 /*******************************************************************************
  * Abstract surface map type
@@ -30,6 +37,7 @@ class SurfaceMap
 		{
 			 TEXTURE_MAP
 			,BUMP_MAP
+			,NORMAL_MAP
 		};
 
 		// Maps the given position P to a spherical UV position
@@ -38,12 +46,23 @@ class SurfaceMap
 		// Maps the given position P to a cubic UV position
 		static glm::vec2 mapToCube(const glm::vec3& d);
 
+		// Directions of increasing u (T) and of up in the image (B) along
+		// the surface at the position mapped by mapToSphere(d) and 
+		// mapToCube(d); d must be unit length. Neither is normalized
+		static void sphereFrame(const glm::vec3& d, glm::vec3& T, glm::vec3& B);
+		static void cubeFrame(const glm::vec3& d, glm::vec3& T, glm::vec3& B);
+
 	protected:
 		MapType type;
-		Image image;
 		std::string filename;
-		int iWidth, iHeight;
-		float fWidth, fHeight;
+
+		// Size of the bitmap; only valid once it has been loaded
+		mutable int iWidth, iHeight;
+		mutable float fWidth, fHeight;
+
+		// Guards loading, and rebuilding data evicted from the TextureCache
+		mutable std::mutex loadLock;
+		mutable std::atomic<bool> loaded;
 
 		inline void convert1DTo2D(int i, int&x, int&y) const
 		{
@@ -56,7 +75,22 @@ class SurfaceMap
 			return (i * this->iHeight) + j;
 		}
 
-		void loadBitmap(const std::string& filename);
+		// Bitmaps are only decoded when a map is first used. Every public
+		// lookup calls this first; it is safe to call from any thread
+		inline void ensureLoaded() const
+		{
+			if (!this->loaded.load(std::memory_order_acquire)) {
+				this->load();
+			}
+		}
+
+		void load() const;
+		void decode(Image& image) const;
+
+		// Converts the decoded bitmap to the subclass's own layout and
+		// stores it in the TextureCache. Called once, with loadLock held
+		virtual void build(const Image& image) const = 0;
+
 		virtual void uvToXY(float u, float v, int& x, int& y) const;
 
 	public:
@@ -72,6 +106,7 @@ class SurfaceMap
 		MapType getType() const   { return this->type; }
 		bool isTextureMap() const { return this->type == TEXTURE_MAP; }
 		bool isBumpMap() const    { return this->type == BUMP_MAP; }
+		bool isNormalMap() const  { return this->type == NORMAL_MAP; }
 
 		friend std::ostream& operator<<(std::ostream& s, const SurfaceMap& m);
 };
@@ -82,6 +117,49 @@ class SurfaceMap
 
 class TextureMap : public SurfaceMap
 {
+	public:
+		// How lookups with a known footprint are filtered
+		enum Filter
+		{
+			 BILINEAR    // Bilinear in the base level; no prefiltering
+			,TRILINEAR   // Bilinear in the two nearest mip levels, blended
+			,ANISOTROPIC // Several trilinear probes along the footprint
+		};
+
+		// Most probes taken by a single ANISOTROPIC lookup
+		static const int MAX_ANISOTROPY = 8;
+
+		// Returns the name of a filter: "bilinear", "trilinear" or "anisotropic"
+		static const char* filterName(Filter filter);
+
+		// Parses a filter name, returning false if it is unknown
+		static bool filterFromName(const std::string& name, Filter& filter);
+
+	protected:
+		// One level of the mip pyramid. Texels are RGBA8, red in the lowest 
+		// byte, so a texel is fetched with a single load
+		typedef TiledImage<uint32_t> MipLevel;
+		typedef TextureCache::Resident<MipLevel> MipSlot;
+
+		// levels[0] is the full size image; every following level halves
+		// the size of the previous one, down to 1x1. Each level is cached
+		// on its own, so the small levels read for distant surfaces can
+		// stay resident while the full size image is evicted
+		mutable std::vector<std::unique_ptr<MipSlot>> levels;
+
+		virtual void build(const Image& image) const;
+
+		// Returns level i, rebuilding it if it was evicted. The caller must
+		// hold a TextureCache::Pin
+		const MipLevel* level(int i) const;
+
+		static MipLevel fromImage(const Image& image);
+		static MipLevel downsample(const MipLevel& prev);
+
+		void bilinear(const MipLevel& level, float u, float v, float rgba[4]) const;
+		void trilinear(const MipLevel& fine, const MipLevel& coarse, float f, float u, float v, float rgba[4]) const;
+		void selectLevels(float lod, int& L, float& f) const;
+
 	public:
 		TextureMap(const std::string& filename);
 		virtual ~TextureMap();
@@ -89,6 +167,17 @@ class TextureMap : public SurfaceMap
 		// Get the color at the given cartesian (i,j) or (u,v) position
 		virtual Color getColor(int i, int j) const;
 		virtual Color getColor(float u, float v) const;
+
+		// Get the color at (u,v), filtered over the area covered by a single 
+		// sample. dUVdx and dUVdy are the changes in (u,v) from one sample
+		// to the next in screen x and y
+		Color getColor(float u
+			          ,float v
+			          ,const glm::vec2& dUVdx
+			          ,const glm::vec2& dUVdy
+			          ,Filter filter) const;
+
+		int getLevelCount() const;
 };
 
 /*******************************************************************************
@@ -98,13 +187,29 @@ class TextureMap : public SurfaceMap
 class BumpMap : public SurfaceMap
 {
 	private:
-		unsigned int N;
-		float* bU; // Bump map derivative in the X direction
-		float* bV; // Bump map derivative in the Y direction
+		// Height of the bump map (the luminosity of the bitmap) at a texel
+		// and its derivatives, kept together as they are read together
+		struct Texel
+		{
+			float height;
+			float bU; // Bump map derivative in the X direction
+			float bV; // Bump map derivative in the Y direction
+		};
+
+		typedef TiledImage<Texel> HeightMap;
+
+		mutable TextureCache::Resident<HeightMap> heights;
 
 	protected:
-		void initHeightMap();
-		void computeDerivatives();
+		virtual void build(const Image& image) const;
+
+		// Returns the height map, rebuilding it if it was evicted. The 
+		// caller must hold a TextureCache::Pin
+		const HeightMap* heightMap() const;
+
+		static HeightMap fromImage(const Image& image);
+		static void initHeightMap(const Image& image, HeightMap& texels);
+		static void computeDerivatives(HeightMap& texels);
 
 	public:
 		BumpMap(const std::string& filename);
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *
+ * A fixed set of worker threads running queued tasks, each of which hands
+ * its result back through a future
+ *
+ * @file TaskPool.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <algorithm>
+#include "TaskPool.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+// The pool the current thread works for, if any:
+static thread_local TaskPool* currentPool = nullptr;
+
+/******************************************************************************/
+
+TaskPool::TaskPool(int threads) :
+    closed(false),
+    busy(0)
+{
+    for (int i=0; i<std::max(1, threads); i++) {
+        this->workers.push_back(thread(&TaskPool::work, this));
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->closed = true;
+    }
+
+    this->notEmpty.notify_all();
+
+    for (auto i=this->workers.begin(); i != this->workers.end(); i++) {
+        i->join();
+    }
+}
+
+TaskPool& TaskPool::shared()
+{
+    static TaskPool pool(static_cast<int>(thread::hardware_concurrency()));
+    return pool;
+}
+
+int TaskPool::nestedThreads(int available)
+{
+    if (currentPool == nullptr) {
+        return std::max(1, available);
+    }
+
+    return std::max(1, available / std::max(1, currentPool->busy.load()));
+}
+
+void TaskPool::work()
+{
+    currentPool = this;
+
+    while (true) {
+
+        function<void()> task;
+
+        {
+            unique_lock<mutex> guard(this->lock);
+
+            this->notEmpty.wait(guard, [this]() {
+                return this->closed || !this->tasks.empty();
+            });
+
+            if (this->tasks.empty()) {
+                return;
+            }
+
+            task = move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+
+        // Tasks are packaged, so anything they throw ends up in their future:
+        this->busy++;
+        task();
+        this->busy--;
+    }
+}
+
+/******************************************************************************/
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ *
+ * A fixed set of worker threads running queued tasks, each of which hands
+ * its result back through a future
+ *
+ * @file TaskPool.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/******************************************************************************/
+
+class TaskPool
+{
+	protected:
+		std::mutex lock;
+		std::condition_variable notEmpty;
+		std::deque<std::function<void()>> tasks;
+		std::vector<std::thread> workers;
+		bool closed;
+
+		// Number of workers running a task
+		std::atomic<int> busy;
+
+		void work();
+
+	public:
+		// Starts the given number of worker threads
+		TaskPool(int threads);
+
+		// Runs every task already queued, then stops the workers
+		~TaskPool();
+
+		// The pool shared by the whole program, with a thread per core
+		static TaskPool& shared();
+
+		int getThreadCount() const { return static_cast<int>(this->workers.size()); }
+
+		/**
+		 * The number of threads a task may start for parallel work of its
+		 * own (e.g. an OpenMP team), out of the given number available. On
+		 * a worker, the cores are shared with the other tasks running at the
+		 * same time, so the pool's threads don't each start a full team.
+		 * Elsewhere all of them are available
+		 */
+		static int nestedThreads(int available);
+
+		/**
+		 * Queues f to run on one of the workers. Whatever it returns or
+		 * throws is passed on by the returned future. Tasks that wait on
+		 * other tasks must only wait on ones already running, otherwise the
+		 * pool may run out of workers to run them
+		 */
+		template <typename F>
+		std::future<typename std::result_of<F()>::type> submit(F f)
+		{
+			typedef typename std::result_of<F()>::type R;
+
+			auto task             = std::make_shared<std::packaged_task<R()>>(f);
+			std::future<R> result = task->get_future();
+
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				this->tasks.push_back([task]() { (*task)(); });
+			}
+
+			this->notEmpty.notify_one();
+
+			return result;
+		}
+};
+
+/******************************************************************************/
+
+#endif
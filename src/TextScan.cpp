@@ -0,0 +1,371 @@
+/*******************************************************************************
+ *
+ * Reading large text files quickly: the file is mapped into memory and
+ * scanned in place, line by line and word by word, without copying it into
+ * streams and strings first
+ *
+ * @file TextScan.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "TextScan.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+TextScan::MappedFile::MappedFile(const string& filename) :
+	bytes(nullptr),
+	size(0),
+	good(false)
+{
+	#if !defined(_WIN32) && !defined(_WIN64)
+	this->mapped = false;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+
+	if (fd >= 0) {
+
+		struct stat info;
+
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+
+			void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (p != MAP_FAILED) {
+				madvise(p, info.st_size, MADV_SEQUENTIAL);
+				this->bytes  = static_cast<const char*>(p);
+				this->size   = static_cast<size_t>(info.st_size);
+				this->mapped = true;
+				this->good   = true;
+			}
+		}
+
+		close(fd);
+
+		if (this->mapped) {
+			return;
+		}
+	}
+	#endif
+
+	ifstream in(filename, ios::in | ios::binary);
+
+	if (in.good()) {
+		this->buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		this->bytes = this->buffer.data();
+		this->size  = this->buffer.size();
+		this->good  = true;
+	}
+}
+
+TextScan::MappedFile::~MappedFile()
+{
+	#if !defined(_WIN32) && !defined(_WIN64)
+	if (this->mapped) {
+		munmap(const_cast<char*>(this->bytes), this->size);
+	}
+	#endif
+}
+
+/******************************************************************************/
+
+/**
+ * The digits are gathered as an integer and scaled once, which is exact for
+ * anything a model exporter or scene generator writes; the rare number that
+ * isn't, like one with a huge exponent, is handed to strtod
+ */
+const char* TextScan::parseFloat(const char* p, const char* end, float& value)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	p = skipBlanks(p, end);
+
+	const char* start = p;
+	bool negative     = false;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int digits        = 0;
+	int exponent      = 0;
+	bool any          = false;
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+		if (digits < 19) {
+			mantissa = (mantissa * 10) + (*p - '0');
+			digits  += mantissa > 0 ? 1 : 0;
+		} else {
+			exponent++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+			if (digits < 19) {
+				mantissa = (mantissa * 10) + (*p - '0');
+				digits  += mantissa > 0 ? 1 : 0;
+				exponent--;
+			}
+		}
+	}
+
+	if (!any) {
+		return nullptr;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+
+		const char* q = p + 1;
+		bool negativeExp = false;
+		int e = 0;
+
+		if (q < end && (*q == '-' || *q == '+')) {
+			negativeExp = *q == '-';
+			q++;
+		}
+
+		if (q < end && *q >= '0' && *q <= '9') {
+			for (; q < end && *q >= '0' && *q <= '9'; q++) {
+				e = std::min((e * 10) + (*q - '0'), 100000);
+			}
+			exponent += negativeExp ? -e : e;
+			p = q;
+		}
+	}
+
+	if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+
+		double d = static_cast<double>(mantissa);
+		d = exponent < 0 ? d / powers[-exponent] : d * powers[exponent];
+		value = static_cast<float>(negative ? -d : d);
+
+		return p;
+	}
+
+	// The token can't run past the end of the buffer, so strtod is given a
+	// terminated copy of it:
+	string token(start, p);
+	value = static_cast<float>(strtod(token.c_str(), nullptr));
+
+	return p;
+}
+
+/**
+ * Parses a whole word as a decimal integer of at most maxValue, returning
+ * false if it is anything else
+ */
+static bool parseInteger(const char* p, const char* end, bool allowNegative, unsigned long maxValue, unsigned long& magnitude, bool& negative)
+{
+	negative = false;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	if (p == end || (negative && !allowNegative)) {
+		return false;
+	}
+
+	magnitude = 0;
+
+	for (; p < end; p++) {
+
+		if (*p < '0' || *p > '9') {
+			return false;
+		}
+
+		unsigned long digit = static_cast<unsigned long>(*p - '0');
+
+		if (magnitude > (maxValue - digit) / 10) {
+			return false;
+		}
+
+		magnitude = (magnitude * 10) + digit;
+	}
+
+	return true;
+}
+
+/******************************************************************************/
+
+TextScan::Line::Line(const char* _begin, const char* _end) :
+	p(_begin),
+	end(_end),
+	failed(false)
+{
+
+}
+
+bool TextScan::Line::nextWord(const char*& word, const char*& wordEnd)
+{
+	if (this->failed) {
+		return false;
+	}
+
+	word = skipBlanks(this->p, this->end);
+
+	if (word == this->end) {
+		this->p      = this->end;
+		this->failed = true;
+		return false;
+	}
+
+	for (wordEnd = word; wordEnd < this->end && !isBlank(*wordEnd); wordEnd++) { }
+
+	return true;
+}
+
+char TextScan::Line::peek() const
+{
+	const char* q = skipBlanks(this->p, this->end);
+	return q < this->end ? *q : '\0';
+}
+
+TextScan::Line& TextScan::Line::operator>>(string& value)
+{
+	const char *word, *wordEnd;
+
+	if (this->nextWord(word, wordEnd)) {
+		value.assign(word, wordEnd);
+		this->p = wordEnd;
+	}
+
+	return *this;
+}
+
+TextScan::Line& TextScan::Line::operator>>(float& value)
+{
+	const char *word, *wordEnd;
+
+	if (this->nextWord(word, wordEnd)) {
+
+		if (parseFloat(word, wordEnd, value) == wordEnd) {
+			this->p = wordEnd;
+		} else {
+			// The word is left to be read as something else:
+			value        = 0.0f;
+			this->failed = true;
+		}
+	}
+
+	return *this;
+}
+
+TextScan::Line& TextScan::Line::operator>>(int& value)
+{
+	const char *word, *wordEnd;
+
+	if (this->nextWord(word, wordEnd)) {
+
+		unsigned long magnitude = 0;
+		bool negative           = false;
+
+		if (parseInteger(word, wordEnd, true, static_cast<unsigned long>(INT_MAX), magnitude, negative)) {
+			value   = negative ? -static_cast<int>(magnitude) : static_cast<int>(magnitude);
+			this->p = wordEnd;
+		} else {
+			value        = 0;
+			this->failed = true;
+		}
+	}
+
+	return *this;
+}
+
+TextScan::Line& TextScan::Line::operator>>(unsigned long& value)
+{
+	const char *word, *wordEnd;
+
+	if (this->nextWord(word, wordEnd)) {
+
+		unsigned long magnitude = 0;
+		bool negative           = false;
+
+		if (parseInteger(word, wordEnd, false, ULONG_MAX, magnitude, negative)) {
+			value   = magnitude;
+			this->p = wordEnd;
+		} else {
+			value        = 0;
+			this->failed = true;
+		}
+	}
+
+	return *this;
+}
+
+/******************************************************************************/
+
+TextScan::Scanner::Scanner(const char* _begin, const char* _end) :
+	p(_begin),
+	end(_end)
+{
+
+}
+
+TextScan::Scanner::Scanner(const MappedFile& file) :
+	p(file.begin()),
+	end(file.end())
+{
+
+}
+
+bool TextScan::Scanner::nextWord(string& word)
+{
+	while (this->p < this->end && (isBlank(*this->p) || *this->p == '\n')) {
+		this->p++;
+	}
+
+	if (this->p == this->end) {
+		return false;
+	}
+
+	const char* start = this->p;
+
+	while (this->p < this->end && !isBlank(*this->p) && *this->p != '\n') {
+		this->p++;
+	}
+
+	word.assign(start, this->p);
+
+	return true;
+}
+
+bool TextScan::Scanner::nextLine(Line& line)
+{
+	if (this->p == this->end) {
+		return false;
+	}
+
+	const char* next = skipLine(this->p, this->end);
+	const char* stop = (next > this->p && next[-1] == '\n') ? next - 1 : next;
+
+	line    = Line(this->p, stop);
+	this->p = next;
+
+	return true;
+}
+
+/******************************************************************************/
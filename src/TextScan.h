@@ -0,0 +1,154 @@
+/*******************************************************************************
+ *
+ * Reading large text files quickly: the file is mapped into memory and
+ * scanned in place, line by line and word by word, without copying it into
+ * streams and strings first
+ *
+ * @file TextScan.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/******************************************************************************/
+
+namespace TextScan
+{
+	/**
+	 * The file's bytes, mapped into memory where possible so nothing is
+	 * copied before it is parsed
+	 */
+	class MappedFile
+	{
+		private:
+			const char* bytes;
+			size_t size;
+			bool good;
+			std::vector<char> buffer;
+			#if !defined(_WIN32) && !defined(_WIN64)
+			bool mapped;
+			#endif
+
+			MappedFile(const MappedFile&);
+			MappedFile& operator=(const MappedFile&);
+
+		public:
+			MappedFile(const std::string& filename);
+			~MappedFile();
+
+			// False if the file couldn't be opened; an empty file is fine
+			bool isGood() const { return this->good; }
+
+			const char* begin() const { return this->bytes; }
+			const char* end() const   { return this->bytes + this->size; }
+			size_t getSize() const    { return this->size; }
+	};
+
+	// Blanks separate the words of a line; unlike isspace(), '\n' isn't one
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	inline const char* skipBlanks(const char* p, const char* end)
+	{
+		while (p < end && isBlank(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	// Returns the start of the next line
+	inline const char* skipLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n') {
+			p++;
+		}
+		return p < end ? p + 1 : end;
+	}
+
+	// Lower-cases an ASCII word in place
+	inline void toLower(std::string& word)
+	{
+		for (size_t i=0; i<word.size(); i++) {
+			if (word[i] >= 'A' && word[i] <= 'Z') {
+				word[i] = static_cast<char>(word[i] + ('a' - 'A'));
+			}
+		}
+	}
+
+	/**
+	 * Parses a decimal number after any blanks at p, returning the end of
+	 * it, or nullptr if there isn't one
+	 */
+	const char* parseFloat(const char* p, const char* end, float& value);
+
+	/**
+	 * The words of one line, read in turn like an std::istringstream: a
+	 * number that can't be read sets the value to 0 and fails the line,
+	 * after which nothing more is read from it; a read past the last word
+	 * fails it and leaves the value alone
+	 */
+	class Line
+	{
+		protected:
+			const char* p;
+			const char* end;
+			bool failed;
+
+			// Finds the next word, or returns false if there are none left
+			bool nextWord(const char*& word, const char*& wordEnd);
+
+		public:
+			Line() : p(nullptr), end(nullptr), failed(false) { }
+			Line(const char* begin, const char* end);
+
+			// True if nothing but blanks is left
+			bool empty() const { return skipBlanks(this->p, this->end) == this->end; }
+
+			// The first character of the next word, or '\0' if there is none
+			char peek() const;
+
+			bool fail() const { return this->failed; }
+			void clear()      { this->failed = false; }
+
+			explicit operator bool() const { return !this->failed; }
+
+			Line& operator>>(std::string& value);
+			Line& operator>>(float& value);
+			Line& operator>>(int& value);
+			Line& operator>>(unsigned long& value);
+	};
+
+	/**
+	 * Reads a whole file mapped into memory as words, and as lines of words
+	 */
+	class Scanner
+	{
+		protected:
+			const char* p;
+			const char* end;
+
+		public:
+			Scanner(const char* begin, const char* end);
+			Scanner(const MappedFile& file);
+
+			// Reads the next word, on whichever line it is, like
+			// std::istream's operator>>. Returns false at the end
+			bool nextWord(std::string& word);
+
+			// Reads the rest of the current line, like std::getline().
+			// Returns false at the end
+			bool nextLine(Line& line);
+	};
+};
+
+/******************************************************************************/
+
+#endif
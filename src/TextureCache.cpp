@@ -0,0 +1,223 @@
+/*******************************************************************************
+ *
+ * A cache shared by every texture and bump map that keeps the decoded
+ * texel data of all of them within a single byte budget
+ *
+ * @file TextureCache.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "TextureCache.h"
+
+/******************************************************************************/
+
+using namespace std;
+
+/******************************************************************************/
+
+atomic<uint64_t> TextureCache::clock(1);
+atomic<uint64_t> TextureCache::epoch(1);
+
+// Every live slot and every reader, guarded by cacheLock along with the byte
+// counts. Readers are never freed, since a Pin may still hold a reference to
+// one; a reader released by an exiting thread is reused by the next new one,
+// so there are never more readers than threads alive at once:
+static mutex cacheLock;
+static vector<TextureCache::Slot*> slots;
+static vector<unique_ptr<TextureCache::Reader>> readers;
+static size_t budget        = TextureCache::DEFAULT_BUDGET;
+static size_t residentBytes = 0;
+static size_t peakBytes     = 0;
+
+// Evicted data, with the epoch it was evicted in, waiting to be freed:
+static vector<pair<uint64_t, shared_ptr<const void>>> retired;
+
+/**
+ * Holds the calling thread's reader, and releases it when the thread exits
+ */
+struct ReaderOwner
+{
+    TextureCache::Reader* reader;
+
+    ReaderOwner() : reader(nullptr) { }
+
+    ~ReaderOwner()
+    {
+        if (this->reader != nullptr) {
+
+            lock_guard<mutex> guard(cacheLock);
+
+            this->reader->pinned.store(0, memory_order_seq_cst);
+            this->reader->depth = 0;
+            this->reader->owned = false;
+        }
+    }
+};
+
+static thread_local ReaderOwner localReader;
+
+/******************************************************************************/
+
+TextureCache::Reader& TextureCache::reader()
+{
+    if (localReader.reader == nullptr) {
+
+        lock_guard<mutex> guard(cacheLock);
+
+        for (auto r=readers.begin(); r != readers.end(); r++) {
+            if (!(*r)->owned) {
+                localReader.reader = r->get();
+                break;
+            }
+        }
+
+        if (localReader.reader == nullptr) {
+            readers.push_back(unique_ptr<Reader>(new Reader()));
+            localReader.reader = readers.back().get();
+        }
+
+        localReader.reader->pinned.store(0);
+        localReader.reader->depth = 0;
+        localReader.reader->owned = true;
+    }
+
+    return *localReader.reader;
+}
+
+TextureCache::Slot::Slot() :
+    lastUse(0),
+    ptr(nullptr),
+    bytes(0)
+{
+    lock_guard<mutex> guard(cacheLock);
+    slots.push_back(this);
+}
+
+/**
+ * Nothing may read a slot while it is destroyed, so its data is freed at once
+ */
+TextureCache::Slot::~Slot()
+{
+    lock_guard<mutex> guard(cacheLock);
+
+    residentBytes -= this->bytes;
+    slots.erase(std::remove(slots.begin(), slots.end(), this), slots.end());
+}
+
+/**
+ * Frees the retired data no pinned reader can still be using: a reader that
+ * pinned in epoch e can only have seen data evicted in epoch e or later.
+ * cacheLock must be held
+ */
+static void reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+
+    for (auto r=readers.begin(); r != readers.end(); r++) {
+
+        uint64_t pinned = (*r)->pinned.load(memory_order_seq_cst);
+
+        if (pinned != 0) {
+            oldest = std::min(oldest, pinned);
+        }
+    }
+
+    auto keep = std::remove_if(retired.begin(), retired.end(), [oldest](const pair<uint64_t, shared_ptr<const void>>& r) {
+        return r.first < oldest;
+    });
+
+    retired.erase(keep, retired.end());
+}
+
+/**
+ * Empties the least recently used slots, other than keep, until the budget
+ * is met or nothing else can be evicted. cacheLock must be held
+ */
+static void evict(TextureCache::Slot* keep)
+{
+    while (residentBytes > budget) {
+
+        TextureCache::Slot* victim = nullptr;
+        uint64_t oldest            = UINT64_MAX;
+
+        for (auto s=slots.begin(); s != slots.end(); s++) {
+
+            uint64_t used = (*s)->lastUse.load(memory_order_relaxed);
+
+            if (*s != keep && (*s)->bytes > 0 && used < oldest) {
+                victim = *s;
+                oldest = used;
+            }
+        }
+
+        if (victim == nullptr) {
+            break;
+        }
+
+        // Readers that load the pointer from here on see nullptr; those that
+        // already have it pinned an earlier epoch:
+        victim->ptr.store(nullptr, memory_order_seq_cst);
+        retired.push_back(make_pair(TextureCache::epoch.fetch_add(1, memory_order_seq_cst), victim->data));
+
+        victim->data.reset();
+        residentBytes -= victim->bytes;
+        victim->bytes  = 0;
+
+        Stats::add(Stats::TEXTURE_CACHE_EVICTIONS);
+    }
+
+    reclaim();
+}
+
+void TextureCache::setBudget(size_t bytes)
+{
+    lock_guard<mutex> guard(cacheLock);
+
+    budget = bytes;
+    evict(nullptr);
+}
+
+size_t TextureCache::getBudget()
+{
+    lock_guard<mutex> guard(cacheLock);
+    return budget;
+}
+
+size_t TextureCache::getResidentBytes()
+{
+    lock_guard<mutex> guard(cacheLock);
+    return residentBytes;
+}
+
+size_t TextureCache::getPeakBytes()
+{
+    lock_guard<mutex> guard(cacheLock);
+    return peakBytes;
+}
+
+void TextureCache::admit(Slot* slot, const shared_ptr<const void>& data, size_t bytes)
+{
+    lock_guard<mutex> guard(cacheLock);
+
+    // Owners only rebuild slots that were evicted, so there is nothing to
+    // retire here:
+    residentBytes -= slot->bytes;
+    residentBytes += bytes;
+    slot->bytes    = bytes;
+    slot->data     = data;
+    slot->ptr.store(data.get(), memory_order_seq_cst);
+
+    // Newly loaded data is the most recently used:
+    slot->lastUse.store(clock.fetch_add(1, memory_order_relaxed) + 1, memory_order_relaxed);
+
+    evict(slot);
+
+    peakBytes = std::max(peakBytes, residentBytes);
+}
+
+/******************************************************************************/
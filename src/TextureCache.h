@@ -0,0 +1,180 @@
+/*******************************************************************************
+ *
+ * A cache shared by every texture and bump map that keeps the decoded
+ * texel data of all of them within a single byte budget. Data is
+ * held in slots, e.g. one per mip level; when the budget is exceeded, the
+ * least recently used slots are emptied, and their owners rebuild them if
+ * they are needed again.
+ *
+ * Reading a slot takes no locks. Instead, a reader holds a Pin while it
+ * uses the data: evicted data is only freed once every thread that could
+ * still be reading it has let go of its pin (epoch based reclamation)
+ *
+ * @file TextureCache.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "Stats.h"
+
+/******************************************************************************/
+
+namespace TextureCache
+{
+	// Budget used unless setBudget() is called, in bytes
+	const size_t DEFAULT_BUDGET = static_cast<size_t>(512) << 20;
+
+	// Sets the budget, in bytes, evicting data at once if it is exceeded
+	void setBudget(size_t bytes);
+
+	size_t getBudget();
+
+	// Bytes currently held, and the most ever held at once
+	size_t getResidentBytes();
+	size_t getPeakBytes();
+
+	// Recency clock: advances every time data enters the cache
+	extern std::atomic<uint64_t> clock;
+
+	// Reclamation epoch: advances every time data is evicted
+	extern std::atomic<uint64_t> epoch;
+
+	// Per-thread reader state
+	struct Reader
+	{
+		// Value of the epoch when the thread took its outermost pin, or 0
+		// if it holds none
+		std::atomic<uint64_t> pinned;
+
+		// Number of pins held
+		int depth;
+
+		// Whether a live thread owns the reader. Guarded by the cache's
+		// lock; readers whose threads have exited are handed out again
+		bool owned;
+
+		// Keeps the readers of different threads on separate cache lines
+		char padding[64];
+	};
+
+	// Returns the calling thread's reader, creating it on first use
+	Reader& reader();
+
+	/**
+	 * While a thread holds a pin, no data it reads from a slot is freed,
+	 * even if it is evicted in the meantime. Pins nest
+	 */
+	class Pin
+	{
+		private:
+			Reader& r;
+
+			Pin(const Pin&);
+			Pin& operator=(const Pin&);
+
+		public:
+			Pin() : r(reader())
+			{
+				if (this->r.depth++ == 0) {
+					this->r.pinned.store(epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+				}
+			}
+
+			~Pin()
+			{
+				if (--this->r.depth == 0) {
+					this->r.pinned.store(0, std::memory_order_release);
+				}
+			}
+	};
+
+	/**
+	 * A unit of cached data. Slots are registered with the cache for their
+	 * whole lifetime; the cache only decides when their data is dropped.
+	 * Use Resident<T>, below
+	 */
+	class Slot
+	{
+		public:
+			// Value of the clock when the data was last used
+			std::atomic<uint64_t> lastUse;
+
+			// What readers load: data.get(), or nullptr once evicted
+			std::atomic<const void*> ptr;
+
+			// Owns the data, and the bytes charged to the budget for it.
+			// Guarded by the cache's lock
+			std::shared_ptr<const void> data;
+			size_t bytes;
+
+			Slot();
+			~Slot();
+
+			// Only stores to lastUse when the clock has moved on, so slots
+			// read by many threads at once aren't written on every lookup
+			inline void touch()
+			{
+				uint64_t now = clock.load(std::memory_order_relaxed);
+				if (this->lastUse.load(std::memory_order_relaxed) != now) {
+					this->lastUse.store(now, std::memory_order_relaxed);
+				}
+			}
+
+		private:
+			Slot(const Slot&);
+			Slot& operator=(const Slot&);
+	};
+
+	// Stores newly built data in slot and charges it to the budget, then
+	// evicts the least recently used other slots until the budget is met
+	void admit(Slot* slot, const std::shared_ptr<const void>& data, size_t bytes);
+
+	/**
+	 * A slot holding an immutable T. Pointers returned by get(), peek() and
+	 * set() are only valid while the calling thread holds a Pin
+	 */
+	template <typename T>
+	class Resident : public Slot
+	{
+		public:
+			// Returns the data, or nullptr if it is not resident, counting a
+			// cache hit or miss
+			inline const T* get()
+			{
+				const T* p = static_cast<const T*>(this->ptr.load(std::memory_order_seq_cst));
+
+				if (p != nullptr) {
+					this->touch();
+					Stats::add(Stats::TEXTURE_CACHE_HITS);
+				} else {
+					Stats::add(Stats::TEXTURE_CACHE_MISSES);
+				}
+
+				return p;
+			}
+
+			// As get(), without counting the lookup or marking the data used
+			inline const T* peek() const
+			{
+				return static_cast<const T*>(this->ptr.load(std::memory_order_seq_cst));
+			}
+
+			// Stores newly built data; see TextureCache::admit()
+			const T* set(const std::shared_ptr<const T>& p, size_t bytes)
+			{
+				admit(this, p, bytes);
+				return p.get();
+			}
+	};
+}
+
+/******************************************************************************/
+
+#endif
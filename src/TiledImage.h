@@ -0,0 +1,81 @@
+/*******************************************************************************
+ *
+ * A 2D array of texels stored in square tiles. Within a tile, texels are
+ * laid out in Morton (Z) order, so the 2x2 neighbourhood read by a bilinear
+ * lookup usually shares a cache line, whichever direction it is accessed in
+ *
+ * @file TiledImage.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+/******************************************************************************/
+
+template <typename T>
+class TiledImage
+{
+	public:
+		// Tiles are TILE_SIZE x TILE_SIZE texels
+		static const int TILE_BITS = 3;
+		static const int TILE_SIZE = 1 << TILE_BITS;
+
+	protected:
+		int width, height;
+
+		// Number of tiles in a row
+		int tilesX;
+
+		// Texels, tile by tile. Partly covered tiles at the right and bottom
+		// edges are padded out to full tiles
+		std::vector<T> texels;
+
+		// Spreads the low TILE_BITS bits of v out to the even bits
+		static inline int spread(int v)
+		{
+			return (v & 1) | ((v & 2) << 1) | ((v & 4) << 2);
+		}
+
+	public:
+		TiledImage() :
+			width(0),
+			height(0),
+			tilesX(0)
+		{
+
+		}
+
+		TiledImage(int _width, int _height) :
+			width(_width),
+			height(_height),
+			tilesX((_width + TILE_SIZE - 1) >> TILE_BITS)
+		{
+			int tilesY = (_height + TILE_SIZE - 1) >> TILE_BITS;
+			this->texels.resize(static_cast<size_t>(this->tilesX * tilesY) << (2 * TILE_BITS));
+		}
+
+		int getWidth() const  { return this->width; }
+		int getHeight() const { return this->height; }
+
+		// Memory used by the texels, in bytes
+		size_t getByteSize() const { return this->texels.size() * sizeof(T); }
+
+		// Offset of texel (x,y) in the texel array
+		inline int index(int x, int y) const
+		{
+			int tile = ((y >> TILE_BITS) * this->tilesX) + (x >> TILE_BITS);
+			return (tile << (2 * TILE_BITS)) | spread(x & (TILE_SIZE - 1)) | (spread(y & (TILE_SIZE - 1)) << 1);
+		}
+
+		inline T& operator()(int x, int y)             { return this->texels[this->index(x, y)]; }
+		inline const T& operator()(int x, int y) const { return this->texels[this->index(x, y)]; }
+};
+
+/******************************************************************************/
+
+#endif
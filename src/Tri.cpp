@@ -19,71 +19,67 @@ using namespace std;
 /******************************************************************************/
 
 Tri::Tri() :
-	meshIndex(-1)
+	meshIndex(-1),
+	vertices(nullptr)
 { 
 	
 }
 
 Tri::Tri(unsigned int _meshIndex
 	    ,glm::uvec3 _indices
-	    ,glm::vec3 _v1
-	    ,glm::vec3 _v2
-	    ,glm::vec3 _v3) :
+	    ,glm::vec3 const * _vertices) :
     meshIndex(_meshIndex),
-    indices(_indices)
+    indices(_indices),
+    vertices(_vertices)
 {
-	this->vertices[0] = _v1;
-	this->vertices[1] = _v2;
-	this->vertices[2] = _v3;
 
-	this->buildAABB();
 }
 
 float Tri::getXMinima() const
 {
-	return std::min(std::min(this->vertices[0].x, this->vertices[1].x), this->vertices[2].x);
+	return std::min(std::min(this->getVertex(0).x, this->getVertex(1).x), this->getVertex(2).x);
 }
 
 float Tri::getYMinima() const
 {
-	return std::min(std::min(this->vertices[0].y, this->vertices[1].y), this->vertices[2].y);
+	return std::min(std::min(this->getVertex(0).y, this->getVertex(1).y), this->getVertex(2).y);
 }
 
 float Tri::getZMinima() const
 {
-	return std::min(std::min(this->vertices[0].z, this->vertices[1].z), this->vertices[2].z);
+	return std::min(std::min(this->getVertex(0).z, this->getVertex(1).z), this->getVertex(2).z);
 }
 
 float Tri::getXMaxima() const
 {
-	return std::max(std::max(this->vertices[0].x, this->vertices[1].x), this->vertices[2].x);
+	return std::max(std::max(this->getVertex(0).x, this->getVertex(1).x), this->getVertex(2).x);
 }
 
 float Tri::getYMaxima() const
 {
-	return std::max(std::max(this->vertices[0].y, this->vertices[1].y), this->vertices[2].y);
+	return std::max(std::max(this->getVertex(0).y, this->getVertex(1).y), this->getVertex(2).y);
 }
 
 float Tri::getZMaxima() const
 {
-	return std::max(std::max(this->vertices[0].z, this->vertices[1].z), this->vertices[2].z);
+	return std::max(std::max(this->getVertex(0).z, this->getVertex(1).z), this->getVertex(2).z);
 }
 
 /**
- * Builds the AABB of this object
+ * Computes the AABB of this object
  */
-void Tri::buildAABB()
+AABB Tri::getAABB() const
 {
 	// Find the min and max in X, Y, and Z to use as the two
 	// extrema of the AABB:
-	float xMin = std::min(std::min(this->vertices[0].x, this->vertices[1].x), this->vertices[2].x);
-	float xMax = std::max(std::max(this->vertices[0].x, this->vertices[1].x), this->vertices[2].x);
-	float yMin = std::min(std::min(this->vertices[0].y, this->vertices[1].y), this->vertices[2].y);
-	float yMax = std::max(std::max(this->vertices[0].y, this->vertices[1].y), this->vertices[2].y);
-	float zMin = std::min(std::min(this->vertices[0].z, this->vertices[1].z), this->vertices[2].z);
-	float zMax = std::max(std::max(this->vertices[0].z, this->vertices[1].z), this->vertices[2].z);
-
-	this->aabb = AABB(glm::vec3(xMin, yMin, zMin), glm::vec3(xMax, yMax, zMax));
+	float xMin = std::min(std::min(this->getVertex(0).x, this->getVertex(1).x), this->getVertex(2).x);
+	float xMax = std::max(std::max(this->getVertex(0).x, this->getVertex(1).x), this->getVertex(2).x);
+	float yMin = std::min(std::min(this->getVertex(0).y, this->getVertex(1).y), this->getVertex(2).y);
+	float yMax = std::max(std::max(this->getVertex(0).y, this->getVertex(1).y), this->getVertex(2).y);
+	float zMin = std::min(std::min(this->getVertex(0).z, this->getVertex(1).z), this->getVertex(2).z);
+	float zMax = std::max(std::max(this->getVertex(0).z, this->getVertex(1).z), this->getVertex(2).z);
+
+	return AABB(glm::vec3(xMin, yMin, zMin), glm::vec3(xMax, yMax, zMax));
 }
 
 /**
@@ -91,15 +87,15 @@ void Tri::buildAABB()
  */
 float Tri::naiveIntersect(const Ray& ray, glm::vec3& W) const
 {
-	glm::vec3 e21 = this->vertices[1] - this->vertices[0];
-	glm::vec3 e32 = this->vertices[2] - this->vertices[1];
-	glm::vec3 e13 = this->vertices[0] - this->vertices[2];
-	glm::vec3 e31 = this->vertices[2] - this->vertices[0];
+	glm::vec3 e21 = this->getVertex(1) - this->getVertex(0);
+	glm::vec3 e32 = this->getVertex(2) - this->getVertex(1);
+	glm::vec3 e13 = this->getVertex(0) - this->getVertex(2);
+	glm::vec3 e31 = this->getVertex(2) - this->getVertex(0);
 
 	// First, test if the ray intersects the plane formed by the triangle:
 	glm::vec3 k = glm::cross(e21, e31);
 	glm::vec3 n = glm::normalize(k);
-	float d     = glm::dot(n, this->vertices[0]);
+	float d     = glm::dot(n, this->getVertex(0));
 	
 	// Find the normal of the plane, i.e. the cross product of the two
 	// vectors that are sides of the triangle A-B and B-C:
@@ -120,9 +116,9 @@ float Tri::naiveIntersect(const Ray& ray, glm::vec3& W) const
 	float t     = (d - (glm::dot(n, ray.orig))) / nd;
 	glm::vec3 Q = ray.project(tInTri);
 
-	glm::vec3 eQ1 = Q - this->vertices[0];
-	glm::vec3 eQ2 = Q - this->vertices[1];
-	glm::vec3 eQ3 = Q - this->vertices[2];
+	glm::vec3 eQ1 = Q - this->getVertex(0);
+	glm::vec3 eQ2 = Q - this->getVertex(1);
+	glm::vec3 eQ3 = Q - this->getVertex(2);
 
 	// Perform the "in-triangle" test against each vertex:
 	float c1 = glm::dot(glm::cross(e21, eQ1), n);
@@ -153,8 +149,10 @@ float Tri::naiveIntersect(const Ray& ray, glm::vec3& W) const
  */
 float Tri::mollerTrumboreIntersect(const Ray& ray, glm::vec3& W) const
 {
-	glm::vec3 e1 = this->vertices[1] - this->vertices[0];
-	glm::vec3 e2 = this->vertices[2] - this->vertices[0];
+	const glm::vec3& v0 = this->getVertex(0);
+
+	glm::vec3 e1 = this->getVertex(1) - v0;
+	glm::vec3 e2 = this->getVertex(2) - v0;
 	glm::vec3 D  = ray.dir;
 	glm::vec3 P  = glm::cross(D, e2);
 	float det    = glm::dot(e1, P);
@@ -165,7 +163,7 @@ float Tri::mollerTrumboreIntersect(const Ray& ray, glm::vec3& W) const
 	}
 
 	float invDet = 1.0f / det;
-	glm::vec3 T  = ray.orig - this->vertices[0];
+	glm::vec3 T  = ray.orig - v0;
 
 	float u = glm::dot(T, P) * invDet;
 	if (u < 0.0f || u > 1.0f) {
@@ -195,9 +193,9 @@ float Tri::mollerTrumboreIntersect(const Ray& ray, glm::vec3& W) const
 
 glm::vec3 Tri::barycenter(const glm::vec3& p) const
 {
-    glm::vec3 v0 = this->vertices[1] - this->vertices[0]; 
-    glm::vec3 v1 = this->vertices[2] - this->vertices[0];
-    glm::vec3 v2 = p - this->vertices[0];
+    glm::vec3 v0 = this->getVertex(1) - this->getVertex(0); 
+    glm::vec3 v1 = this->getVertex(2) - this->getVertex(0);
+    glm::vec3 v2 = p - this->getVertex(0);
     float d00 = glm::dot(v0, v0);
     float d01 = glm::dot(v0, v1);
     float d11 = glm::dot(v1, v1);
@@ -17,16 +17,17 @@
 
 /******************************************************************************/
 
+/**
+ * A triangle of a mesh, referring to its corners by index into the mesh's
+ * vertex array rather than holding copies of them. The array must outlive
+ * the triangle and must not be resized while it is in use
+ */
 class Tri
 {
 	private:
 		unsigned int meshIndex;
-		glm::uvec3 indices;     // Vertex indices
-		glm::vec3 vertices[3];  // Corner vertices
-		AABB aabb;
-
-		void buildAABB();
-		void computeCentroid();
+		glm::uvec3 indices;          // Vertex indices
+		glm::vec3 const * vertices;  // The mesh's vertices
 
 	protected:
 		float naiveIntersect(const Ray& ray, glm::vec3& W) const;
@@ -36,14 +37,14 @@ class Tri
 		Tri();
 		Tri(unsigned int meshIndex
 		   ,glm::uvec3 _indices
-		   ,glm::vec3 v1
-		   ,glm::vec3 v2
-		   ,glm::vec3 v3);
-		virtual ~Tri() { }
+		   ,glm::vec3 const * vertices);
 
 		unsigned int getMeshIndex() const   { return this->meshIndex; }
 		glm::uvec3 getVertexIndices() const { return this->indices; }
 
+		// Returns corner k, 0-2
+		const glm::vec3& getVertex(int k) const { return this->vertices[this->indices[k]]; }
+
 		float getXMinima() const;
 		float getYMinima() const;
 		float getZMinima() const;
@@ -53,9 +54,8 @@ class Tri
 
 		glm::vec3 barycenter(const glm::vec3& p) const;
 
-		glm::vec3 const * getVertices() const { return this->vertices; }
-
-		const AABB& getAABB() { return this->aabb; }
+		// Computed on demand, as it is only needed while a KD-tree is built
+		AABB getAABB() const;
 
 		float intersected(const Ray& ray, glm::vec3& W) const;
 };
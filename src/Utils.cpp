@@ -114,12 +114,50 @@ float Utils::trilerp(float xd, float yd, float zd
     return lerp(c0, c1, zd);
 }
 
+// Per-thread generator state (PCG32, see http://www.pcg-random.org):
+static thread_local uint64_t rngState = 0x853c49e6748fea9bULL;
+
+/**
+ * SplitMix64 finalizer used to scramble seeds
+ */
+static uint64_t splitMix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x  = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x  = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * Seeds the calling thread's random number generator
+ */
+void Utils::seedRand(uint64_t seed)
+{
+	rngState = splitMix(seed);
+}
+
+/**
+ * Mixes a base seed with additional values to produce a new seed
+ */
+uint64_t Utils::mixSeed(uint64_t seed, uint64_t a, uint64_t b, uint64_t c)
+{
+	return splitMix(splitMix(splitMix(splitMix(seed) ^ a) ^ b) ^ c);
+}
+
 /**
  * Generate a random float in the range [0,1]
  */
 float Utils::unitRand()
 {
-	return static_cast<float>(rand()) / (static_cast<float>(RAND_MAX));
+	uint64_t old = rngState;
+	rngState     = old * 6364136223846793005ULL + 1442695040888963407ULL;
+
+	uint32_t xorShifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+	uint32_t rot        = static_cast<uint32_t>(old >> 59u);
+	uint32_t bits       = (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+
+	// Use the top 24 bits so the result is exactly representable:
+	return static_cast<float>(bits >> 8) / static_cast<float>((1 << 24) - 1);
 }
 
 /**
@@ -127,7 +165,7 @@ float Utils::unitRand()
  */
 float Utils::randInRange(float lo, float hi)
 {
-	return lo + static_cast<float>(rand()) /(static_cast<float>(RAND_MAX / (hi - lo)));
+	return lo + (unitRand() * (hi - lo));
 }
 
 /**
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -69,6 +70,15 @@ namespace Utils
                  ,float v100, float v101
                  ,float v110, float v111);
 
+	// Seeds the calling thread's random number generator. Each thread owns
+	// its own generator state, so a render is reproducible regardless of how
+	// work is distributed across threads
+	void seedRand(uint64_t seed);
+
+	// Mixes a base seed with up to three additional values, e.g. the render
+	// pass and pixel coordinates, to produce a well distributed seed
+	uint64_t mixSeed(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0);
+
 	// Generate a random float in the range [0,1]
 	float unitRand();
 
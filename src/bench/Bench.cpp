@@ -0,0 +1,1496 @@
+/*******************************************************************************
+ *
+ * Microbenchmarks for the intersection, traversal and shading kernels. Every
+ * benchmark runs over a fixed, seeded set of random inputs, so numbers taken
+ * before and after a change are directly comparable. With --check, the fast
+ * paths are instead compared against straightforward reference versions
+ *
+ * @file Bench.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define GLM_FORCE_RADIANS
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <easylogging++.h>
+#include <optionparser.h>
+
+INITIALIZE_EASYLOGGINGPP
+
+#include "AABB.h"
+#include "Color.h"
+#include "Config.h"
+#include "Cube.h"
+#include "Cylinder.h"
+#include "Daemon.h"
+#include "Image.h"
+#include "Json.h"
+#include "InstanceSet.h"
+#include "Kernels.h"
+#include "KDTree.h"
+#include "Mesh.h"
+#include "ModelImport.h"
+#include "PrimitiveBatch.h"
+#include "Ray.h"
+#include "Sphere.h"
+#include "SurfaceMap.h"
+#include "Tri.h"
+#include "Utils.h"
+#include "SceneBench.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+enum OptionIndex { UNKNOWN, HELP, FILTER, MIN_TIME, ASSETS, CHECK
+                 , SCENES, BASELINE, OUTPUT, THRESHOLD, SCALE, SPP, SPL, THREADS, RAND_SEED, ISA };
+
+const option::Descriptor usage[] =
+{
+    { UNKNOWN  ,0 ,""  ,""         ,option::Arg::None_    ,"USAGE: raycpp_bench [options]\n\n Options:" },
+    { HELP     ,0 ,""  ,"help"     ,option::Arg::None_    ,"  --help  \t\tPrint usage and exit." },
+    { FILTER   ,0 ,"f" ,"filter"   ,option::Arg::Optional ,"  -f/--filter=<text> \t\tOnly run benchmarks whose name contains <text>." },
+    { MIN_TIME ,0 ,"t" ,"time"     ,option::Arg::Optional ,"  -t/--time=<seconds> \t\tMinimum time spent per benchmark (default 0.5)." },
+    { ASSETS   ,0 ,"a" ,"assets"   ,option::Arg::Optional ,"  -a/--assets=<dir> \t\tLocation of the bundled assets (default ./assets)." },
+    { ISA      ,0 ,""  ,"isa"      ,option::Arg::Optional ,"  --isa=<sse2|avx2|avx512> \t\tRun the SIMD kernels for the given instruction set (default: best supported)." },
+    { CHECK    ,0 ,""  ,"check"    ,option::Arg::None_    ,"  --check  \t\tRun the self-checks instead of the benchmarks; exits with failure if any fails." },
+    { UNKNOWN  ,0 ,""  ,""         ,option::Arg::None_    ,"\n Scene benchmarks:" },
+    { SCENES   ,0 ,""  ,"scenes"   ,option::Arg::None_    ,"  --scenes  \t\tRender every scene in the asset directory instead of running the microbenchmarks." },
+    { BASELINE ,0 ,""  ,"baseline" ,option::Arg::Optional ,"  --baseline=<file> \t\tCompare against the results in <file>; exits with failure on regressions." },
+    { OUTPUT   ,0 ,"o" ,"output"   ,option::Arg::Optional ,"  -o/--output=<file> \t\tWrite results as JSON to <file> (default scene_bench.json)." },
+    { THRESHOLD,0 ,""  ,"threshold",option::Arg::Optional ,"  --threshold=<fraction> \t\tSlowdown tolerated before flagging a regression (default 0.1)." },
+    { SCALE    ,0 ,""  ,"scale"    ,option::Arg::Optional ,"  --scale=<factor> \t\tScale applied to each scene's resolution (default 1)." },
+    { SPP      ,0 ,""  ,"spp"      ,option::Arg::Optional ,"  --spp=<N> \t\tSamples per pixel (default 1)." },
+    { SPL      ,0 ,""  ,"spl"      ,option::Arg::Optional ,"  --spl=<N> \t\tSamples per area light (default 4)." },
+    { THREADS  ,0 ,""  ,"threads"  ,option::Arg::Optional ,"  --threads=<N> \t\tRender threads per scene (default 1)." },
+    { RAND_SEED,0 ,""  ,"seed"     ,option::Arg::Optional ,"  --seed=<N> \t\tRandom seed used for every scene (default 1)." },
+    {0,0,0,0,0,0}
+};
+
+/******************************************************************************/
+
+// Number of rays in each fixed ray set:
+static const size_t RAY_COUNT = 1 << 16;
+
+// Seed shared by all input generators:
+static const uint64_t SEED = 0x5eed;
+
+static string filter;
+static double minTime = 0.5;
+
+// Results are accumulated here so the compiler cannot discard the work:
+static volatile float sink = 0.0f;
+
+// Number of self-checks that failed:
+static int failures = 0;
+
+/*******************************************************************************
+ * Harness
+ ******************************************************************************/
+
+/**
+ * Runs body() repeatedly until at least minTime seconds have elapsed, then
+ * reports the time per operation. body() performs opsPerCall operations per
+ * invocation; if isRayTest is set, throughput is also reported in Mrays/s
+ */
+template<typename F>
+static void run(const string& name, size_t opsPerCall, bool isRayTest, F body)
+{
+    if (!filter.empty() && name.find(filter) == string::npos) {
+        return;
+    }
+
+    // Warm up caches and branch predictors:
+    sink = sink + body();
+
+    size_t calls = 0;
+    double elapsed = 0.0;
+    auto start = chrono::steady_clock::now();
+
+    do {
+        sink = sink + body();
+        calls++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < minTime);
+
+    double ops = static_cast<double>(calls) * static_cast<double>(opsPerCall);
+
+    cout << "  " << left << setw(40) << name
+         << right << setw(12) << fixed << setprecision(2) << ((elapsed * 1.0e9) / ops) << " ns/op";
+
+    if (isRayTest) {
+        cout << setw(12) << setprecision(2) << ((ops / elapsed) / 1.0e6) << " Mrays/s";
+    }
+
+    cout << endl;
+}
+
+/**
+ * Tests if the check of the given name passes --filter
+ */
+static bool checked(const string& name)
+{
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+/**
+ * Reports the outcome of a self-check, with details of what was compared
+ */
+static void report(const string& name, bool passed, const string& details)
+{
+    cout << "  " << left << setw(50) << name << right << setw(6) << (passed ? "ok" : "FAILED")
+         << "  " << details << endl;
+
+    failures += passed ? 0 : 1;
+}
+
+/**
+ * Generates rays with origins on a sphere of the given radius around center,
+ * aimed at random points inside the box [center - extent, center + extent]
+ */
+static vector<Ray> makeRays(const vec3& center, const vec3& extent, float radius)
+{
+    vector<Ray> rays;
+    rays.reserve(RAY_COUNT);
+
+    for (size_t i=0; i<RAY_COUNT; i++) {
+
+        vec3 d = normalize(vec3(Utils::randInRange(-1.0f, 1.0f)
+                               ,Utils::randInRange(-1.0f, 1.0f)
+                               ,Utils::randInRange(-1.0f, 1.0f)));
+
+        vec3 target = center + (extent * vec3(Utils::randInRange(-1.0f, 1.0f)
+                                              ,Utils::randInRange(-1.0f, 1.0f)
+                                              ,Utils::randInRange(-1.0f, 1.0f)));
+
+        vec3 origin = center + (radius * d);
+
+        rays.push_back(Ray(origin, normalize(target - origin)));
+    }
+
+    return rays;
+}
+
+/*******************************************************************************
+ * Benchmarks
+ ******************************************************************************/
+
+static void benchPrimitives()
+{
+    Utils::seedRand(SEED);
+
+    auto rays = makeRays(vec3(0.0f), vec3(0.5f), 3.0f);
+
+    // Triangles scattered throughout the unit cube:
+    vector<vec3> vertices;
+    for (unsigned int i=0; i<1024; i++) {
+        vec3 p = vec3(Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f));
+        vertices.push_back(p);
+        vertices.push_back(p + vec3(Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f), 0.0f));
+        vertices.push_back(p + vec3(0.0f, Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f)));
+    }
+
+    vector<Tri> tris;
+    for (unsigned int i=0; i<1024; i++) {
+        tris.push_back(Tri(i, uvec3(3 * i, (3 * i) + 1, (3 * i) + 2), vertices.data()));
+    }
+
+    run("Tri::intersected", RAY_COUNT, true, [&]() {
+        float acc = 0.0f;
+        vec3 W;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            acc += tris[i & 1023].intersected(rays[i], W);
+        }
+        return acc;
+    });
+
+    AABB box(vec3(-0.5f), vec3(0.5f));
+
+    run("AABB::intersected", RAY_COUNT, true, [&]() {
+        float acc = 0.0f;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            acc += box.intersected(rays[i]) ? 1.0f : 0.0f;
+        }
+        return acc;
+    });
+
+    // Analytic primitives, called through the base class as the renderer does:
+    vector<pair<string, shared_ptr<Geometry>>> shapes = {
+         make_pair("Sphere::hitImpl",   shared_ptr<Geometry>(make_shared<Sphere>()))
+        ,make_pair("Cube::hitImpl",     shared_ptr<Geometry>(make_shared<Cube>()))
+        ,make_pair("Cylinder::hitImpl", shared_ptr<Geometry>(make_shared<Cylinder>()))
+    };
+
+    for (auto s=shapes.begin(); s != shapes.end(); s++) {
+
+        shared_ptr<Geometry> geometry = s->second;
+
+        run(s->first, RAY_COUNT, true, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                acc += geometry->hitImpl(rays[i]).t;
+            }
+            return acc;
+        });
+    }
+
+    #if ENABLE_PRIMITIVE_BATCHES
+    // A full batch of each batched type, including the world to local 
+    // transformation done per lane. Reported per primitive tested:
+    for (auto s=shapes.begin(); s != shapes.begin() + 2; s++) {
+
+        PrimitiveBatch batch(s->second->getGeometryType());
+
+        while (!batch.isFull()) {
+            batch.add(batch.count, *s->second, mat4(), false);
+        }
+
+        vector<vec3> dirs;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            dirs.push_back(normalize(rays[i].dir));
+        }
+
+        string name = s->first.substr(0, s->first.find("::")) + " PrimitiveBatch::intersect";
+
+        run(name, RAY_COUNT * PrimitiveBatch::WIDTH, true, [&]() {
+            float acc = 0.0f;
+            float t[PrimitiveBatch::WIDTH];
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                acc += static_cast<float>(batch.intersect(rays[i].orig, dirs[i], INFINITY, t)) + t[0];
+            }
+            return acc;
+        });
+    }
+    #endif
+}
+
+static void benchModels(const string& assets)
+{
+    vector<string> models = {
+         "cube.obj", "sphere.obj", "cylinder.obj", "prism.obj", "teapot.obj", "cow.obj"
+        ,"bunny_low.obj", "skull.obj", "athena.obj", "venus.obj"
+    };
+
+    for (auto m=models.begin(); m != models.end(); m++) {
+
+        string file = assets + DirSep + "models" + DirSep + *m;
+
+        if (!filter.empty() && ("KDTree::intersects/" + *m).find(filter) == string::npos
+                             && ("KDTree::closest/" + *m).find(filter) == string::npos
+                             && ("Mesh::sample/" + *m).find(filter) == string::npos
+                             && ("Model::readOBJ/" + *m).find(filter) == string::npos
+                             && ("Model::importMeshes/" + *m).find(filter) == string::npos) {
+            continue;
+        }
+
+        vector<Model::MeshData> meshData;
+
+        try {
+            meshData = Model::loadMeshes(file);
+        } catch (std::exception& e) {
+            cout << "  (skipping " << *m << ": " << e.what() << ")" << endl;
+            continue;
+        }
+
+        if (meshData.empty()) {
+            cout << "  (skipping " << *m << ": no meshes)" << endl;
+            continue;
+        }
+
+        // Loading the model natively and through assimp:
+
+        run("Model::readOBJ/" + *m, 1, false, [&]() {
+            Model::MeshData data;
+            return Model::readOBJ(file, data) ? static_cast<float>(data.indices.size()) : 0.0f;
+        });
+
+        run("Model::importMeshes/" + *m, 1, false, [&]() {
+            auto data = Model::importMeshes(file);
+            return data.empty() ? 0.0f : static_cast<float>(data[0].indices.size());
+        });
+
+        Mesh mesh(move(meshData[0]));
+
+        if (mesh.getTree() == nullptr) {
+            continue;
+        }
+
+        const AABB& bounds = mesh.getAABB();
+        vec3 center        = bounds.centroid();
+        vec3 extent        = 0.5f * vec3(bounds.width(), bounds.height(), bounds.depth());
+
+        Utils::seedRand(SEED);
+        auto rays = makeRays(center, extent, 2.0f * length(extent));
+
+        KDTree const * tree = mesh.getTree();
+        vector<Tri> collected;
+
+        ostringstream name;
+        name << "KDTree::intersects/" << *m << " (" << mesh.getTriangleCount() << " tris)";
+
+        run(name.str(), RAY_COUNT, true, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                collected.clear();
+                acc += tree->intersects(rays[i], collected) ? static_cast<float>(collected.size()) : 0.0f;
+            }
+            return acc;
+        });
+
+        name.str("");
+        name << "KDTree::closest/" << *m << " (" << mesh.getTriangleCount() << " tris)";
+
+        run(name.str(), RAY_COUNT, true, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                float t = -1.0f;
+                vec3 W;
+                acc += tree->closest(rays[i], t, W) != nullptr ? t : 0.0f;
+            }
+            return acc;
+        });
+
+        // Sampling the mesh as a light, which shouldn't depend on its size:
+        mesh.prepareSampling();
+
+        name.str("");
+        name << "Mesh::sample/" << *m << " (" << mesh.getTriangleCount() << " tris)";
+
+        run(name.str(), RAY_COUNT, false, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                vec3 N;
+                float pdf = 0.0f;
+                acc += mesh.sample(mat4(), N, pdf).x + pdf;
+            }
+            return acc;
+        });
+    }
+}
+
+static void benchInstances(const string& assets)
+{
+    string file = assets + DirSep + "models" + DirSep + "cow.obj";
+
+    vector<Model::MeshData> meshData;
+
+    try {
+        meshData = Model::loadMeshes(file);
+    } catch (std::exception& e) {
+        cout << "  (skipping instances: " << e.what() << ")" << endl;
+        return;
+    }
+
+    if (meshData.empty()) {
+        return;
+    }
+
+    shared_ptr<Geometry> mesh = make_shared<Mesh>(move(meshData[0]));
+
+    // Copies scattered over a field, viewed from all around it:
+    for (int count = 100; count <= 10000; count *= 10) {
+
+        InstanceSet copies;
+        copies.addScatter(count, SEED, vec3(-30.0f, 0.0f, -30.0f), vec3(30.0f, 0.0f, 30.0f), 0.6f, 1.2f);
+        copies.build(mesh);
+
+        Utils::seedRand(SEED);
+        auto rays = makeRays(vec3(0.0f), vec3(30.0f, 1.0f, 30.0f), 45.0f);
+
+        ostringstream name;
+        name << "InstanceSet::hit/" << count << " cow.obj";
+
+        run(name.str(), RAY_COUNT, true, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                acc += copies.hit(mat4(), rays[i]).t;
+            }
+            return acc;
+        });
+    }
+}
+
+/**
+ * Writes a scene of the given number of nodes, as a scene generator would:
+ * the leaves, alternately spheres and cubes, are split into groups of 1000
+ * under the root, and use one of four materials
+ */
+static void writeScene(const string& file, int nodes)
+{
+    ofstream out(file.c_str(), ios::out | ios::trunc);
+
+    out << "CAMERA\nRESO 64 64\nEYEP 0 0 60\nVDIR 0 0 -1\nUVEC 0 1 0\nFOVY 50\n\n"
+        << "LIGHT\nLPOS 0 50 50\nLCOL 1 1 1\n\n";
+
+    for (int m=0; m<4; m++) {
+        out << "MAT m" << m << "\nDIFF " << (0.1f + (0.2f * m)) << " 0.5 0.5\nREFL 0 0 0\nEXPO 0\nIOR 0\nMIRR 0\nTRAN 0\n\n";
+    }
+
+    out << "NODE root\nTRANSLATION 0 0 0\nROTATION 0 0 0\nSCALE 1 1 1\nCENTER 0 0 0\nPARENT null\nSHAPE null\nMAT null\n\n";
+
+    const int GROUP_SIZE = 1000;
+
+    for (int i=0; i<nodes; i++) {
+
+        if (i % GROUP_SIZE == 0) {
+            out << "NODE g" << (i / GROUP_SIZE) << "\nTRANSLATION " << (i / GROUP_SIZE) % 40 << " 0 0\n"
+                << "ROTATION 0 0 0\nSCALE 1 1 1\nCENTER 0 0 0\nPARENT root\nSHAPE null\nMAT null\n\n";
+        }
+
+        out << "NODE n" << i << "\nTRANSLATION " << (i % 40) - 20 << " " << ((i / 40) % 25) - 12 << " " << -(i % 7) << "\n"
+            << "ROTATION 0 " << (i % 360) << " 0\nSCALE 0.4 0.4 0.4\nCENTER 0 0 0\nPARENT g" << (i / GROUP_SIZE) << "\n"
+            << "SHAPE " << ((i % 2) == 0 ? "sphere" : "cube") << "\nMAT m" << (i % 4) << "\n\n";
+    }
+}
+
+static void benchSceneRead()
+{
+    // Reported per node, so the sizes are directly comparable:
+    for (int nodes = 100000; nodes <= 1000000; nodes *= 10) {
+
+        ostringstream name;
+        name << "Configuration::read/" << nodes << " nodes";
+
+        if (!filter.empty() && name.str().find(filter) == string::npos) {
+            continue;
+        }
+
+        string file = "bench_scene.txt";
+        writeScene(file, nodes);
+
+        run(name.str(), static_cast<size_t>(nodes), false, [&]() {
+            Configuration config(file);
+            auto scene = config.read();
+            return static_cast<float>(scene->getSceneGraph().getRoot()->getChildren().size());
+        });
+
+        remove(file.c_str());
+    }
+}
+
+static void benchSurfaceMaps(const string& assets)
+{
+    string file = assets + DirSep + "textures" + DirSep + "checkerboard.bmp";
+
+    unique_ptr<TextureMap> texture;
+    unique_ptr<BumpMap> bump;
+
+    try {
+        texture = unique_ptr<TextureMap>(new TextureMap(file));
+        bump    = unique_ptr<BumpMap>(new BumpMap(file));
+    } catch (std::exception& e) {
+        cout << "  (skipping surface maps: " << e.what() << ")" << endl;
+        return;
+    }
+
+    Utils::seedRand(SEED);
+
+    vector<vec2> uvs;
+    for (size_t i=0; i<RAY_COUNT; i++) {
+        uvs.push_back(vec2(Utils::unitRand(), Utils::unitRand()));
+    }
+
+    run("TextureMap::getColor", RAY_COUNT, false, [&]() {
+        float acc = 0.0f;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            acc += texture->getColor(uvs[i].x, uvs[i].y).fR();
+        }
+        return acc;
+    });
+
+    // Footprints spanning 1/2 to 32 texels, at random orientations:
+    vector<vec2> dUVdx, dUVdy;
+    for (size_t i=0; i<RAY_COUNT; i++) {
+        float scale = powf(2.0f, (Utils::unitRand() * 6.0f) - 1.0f) / 400.0f;
+        float angle = Utils::unitRand() * 6.2831853f;
+        dUVdx.push_back(scale * vec2(cosf(angle), sinf(angle)));
+        dUVdy.push_back(scale * (0.25f + Utils::unitRand()) * vec2(-sinf(angle), cosf(angle)));
+    }
+
+    const TextureMap::Filter filters[] = { TextureMap::BILINEAR, TextureMap::TRILINEAR, TextureMap::ANISOTROPIC };
+
+    for (auto f=begin(filters); f != end(filters); f++) {
+
+        run(string("TextureMap::getColor/") + TextureMap::filterName(*f), RAY_COUNT, false, [&]() {
+            float acc = 0.0f;
+            for (size_t i=0; i<RAY_COUNT; i++) {
+                acc += texture->getColor(uvs[i].x, uvs[i].y, dUVdx[i], dUVdy[i], *f).fR();
+            }
+            return acc;
+        });
+    }
+
+    run("BumpMap::getNormal", RAY_COUNT, false, [&]() {
+        float acc = 0.0f;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            acc += bump->getNormal(uvs[i].x, uvs[i].y).x;
+        }
+        return acc;
+    });
+}
+
+static void benchImage()
+{
+    const int W = 512;
+    const int H = 512;
+
+    Utils::seedRand(SEED);
+
+    Image image(W, H, 1, 3);
+    cimg_forXYC(image, x, y, c) {
+        image(x, y, 0, c) = static_cast<unsigned char>(Utils::unitRand() * 255.0f);
+    }
+
+    run("Image edges (Sobel)", W * H, false, [&]() {
+        float avgIntensity = 0.0f;
+        auto edgeMap = edges(image, W, H, avgIntensity);
+        return avgIntensity + edgeMap[W + 1];
+    });
+}
+
+static void benchColor()
+{
+    Utils::seedRand(SEED);
+
+    vector<Color> colors;
+    for (size_t i=0; i<RAY_COUNT; i++) {
+        colors.push_back(Color(Utils::unitRand(), Utils::unitRand(), Utils::unitRand()));
+    }
+
+    // A typical shading expression: ambient + diffuse * light + specular
+    run("Color arithmetic", RAY_COUNT, false, [&]() {
+        Color acc;
+        for (size_t i=0; i<RAY_COUNT; i++) {
+            const Color& c = colors[i];
+            const Color& d = colors[(i + 1) & (RAY_COUNT - 1)];
+            acc += (0.15f * c) + ((0.95f * c) * d) + (d / 4.0f);
+        }
+        return acc.fR();
+    });
+}
+
+/*******************************************************************************
+ * Self-checks
+ ******************************************************************************/
+
+/**
+ * KDTree::closest() must find exactly the hit a brute-force search over every
+ * triangle finds, including when the ray's range is clipped at both ends
+ */
+static void checkClosestHit()
+{
+    const string name = "KDTree::closest vs brute force";
+
+    if (!checked(name)) {
+        return;
+    }
+
+    Utils::seedRand(SEED);
+
+    size_t mismatches = 0;
+    size_t hits       = 0;
+    size_t total      = 0;
+
+    for (int soup=0; soup<4; soup++) {
+
+        // Triangles of all sizes scattered throughout the unit cube:
+        vector<vec3> vertices;
+        for (unsigned int i=0; i<2048; i++) {
+            float size = Utils::randInRange(0.01f, 0.5f);
+            vec3 p     = vec3(Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f), Utils::randInRange(-0.5f, 0.5f));
+            vertices.push_back(p);
+            vertices.push_back(p + (size * vec3(Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f))));
+            vertices.push_back(p + (size * vec3(Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f))));
+        }
+
+        vector<Tri> tris;
+        for (unsigned int i=0; i<2048; i++) {
+            tris.push_back(Tri(i, uvec3(3 * i, (3 * i) + 1, (3 * i) + 2), vertices.data()));
+        }
+
+        KDTree tree(tris, new CycleAxisStrategy(), new MaxValuesPerLeaf(20));
+
+        auto rays = makeRays(vec3(0.0f), vec3(0.5f), 3.0f);
+
+        for (size_t i=0; i<RAY_COUNT; i += 4) {
+
+            Ray ray = rays[i];
+
+            // Three rays in four have their range clipped at one or both ends:
+            if ((i & 4) != 0) {
+                ray.tMin = Utils::randInRange(0.0f, 3.0f);
+            }
+            if ((i & 8) != 0) {
+                ray.tMax = ray.tMin + Utils::randInRange(0.0f, 3.0f);
+            }
+
+            float best = -1.0f;
+
+            for (auto t=tris.begin(); t != tris.end(); t++) {
+                vec3 W;
+                float s = t->intersected(ray, W);
+                if (s >= ray.tMin && s <= ray.tMax && (best < 0.0f || s < best)) {
+                    best = s;
+                }
+            }
+
+            float t = -1.0f;
+            vec3 W;
+            Tri const * found = tree.closest(ray, t, W);
+
+            if ((found != nullptr) != (best >= 0.0f) || (found != nullptr && t != best)) {
+                mismatches++;
+            }
+
+            hits  += best >= 0.0f ? 1 : 0;
+            total += 1;
+        }
+    }
+
+    ostringstream details;
+    details << mismatches << " of " << total << " rays differ (" << hits << " hits)";
+
+    report(name, mismatches == 0, details.str());
+}
+
+/**
+ * Every lane of a PrimitiveBatch must agree with Geometry::hit() for the same
+ * ray and range. The kernels transform the ray with their own arithmetic, so
+ * distances may differ by rounding, but they must be identical on every
+ * instruction set
+ */
+static void checkBatches()
+{
+    #if ENABLE_PRIMITIVE_BATCHES
+    // Relative difference in distance allowed between a lane and hit():
+    const float TOLERANCE = 1.0e-3f;
+
+    Kernels::Isa selected = Kernels::active().isa;
+
+    vector<shared_ptr<Geometry>> shapes = { make_shared<Sphere>(), make_shared<Cube>() };
+
+    for (auto s=shapes.begin(); s != shapes.end(); s++) {
+
+        const Geometry& geometry = **s;
+        string shape             = geometry.getGeometryType() == Geometry::SPHERE ? "Sphere" : "Cube";
+
+        // Distances found on the first instruction set checked, or -1:
+        vector<float> reference;
+        string referenceIsa;
+
+        for (int i=0; i<Kernels::ISA_COUNT; i++) {
+
+            Kernels::Isa isa = static_cast<Kernels::Isa>(i);
+            string name      = shape + " PrimitiveBatch vs hit/" + Kernels::name(isa);
+
+            if (!checked(name)) {
+                continue;
+            }
+
+            if (!Kernels::available(isa)) {
+                cout << "  (skipping " << name << ": not supported)" << endl;
+                continue;
+            }
+
+            Kernels::select(isa);
+            Utils::seedRand(SEED);
+
+            // Lanes scattered, rotated and stretched around the origin:
+            PrimitiveBatch batch(geometry.getGeometryType());
+            vector<mat4> invT;
+
+            while (!batch.isFull()) {
+
+                mat4 T = translate(mat4(), vec3(Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f), Utils::randInRange(-1.0f, 1.0f)));
+                T      = rotate(T, Utils::randInRange(0.0f, 6.2831853f), normalize(vec3(Utils::randInRange(-1.0f, 1.0f), 1.0f, Utils::randInRange(-1.0f, 1.0f))));
+                T      = scale(T, vec3(Utils::randInRange(0.2f, 0.6f), Utils::randInRange(0.2f, 0.6f), Utils::randInRange(0.2f, 0.6f)));
+
+                invT.push_back(inverse(T));
+                batch.add(batch.count, geometry, invT.back(), false);
+            }
+
+            auto rays = makeRays(vec3(0.0f), vec3(1.0f), 4.0f);
+
+            vector<float> found;
+            size_t mismatches = 0;
+            size_t hits       = 0;
+
+            for (size_t r=0; r<RAY_COUNT; r++) {
+
+                // Half of the rays stop short of the far side of the lanes:
+                Ray ray(rays[r].orig, normalize(rays[r].dir));
+                ray.tMax = (r & 1) != 0 ? Utils::randInRange(2.0f, 6.0f) : INFINITY;
+
+                float t[PrimitiveBatch::WIDTH];
+                int mask = batch.intersect(ray.orig, ray.dir, ray.tMax, t);
+
+                for (int k=0; k<batch.count; k++) {
+
+                    Hit hit     = geometry.hit(invT[k], ray);
+                    bool inMask = (mask & (1 << k)) != 0;
+                    float slack = TOLERANCE * hit.t;
+
+                    // Hits within rounding of tMax may fall on either side:
+                    if (inMask != hit.isHit()) {
+                        mismatches += (hit.isHit() && ray.tMax - hit.t <= slack) ? 0 : 1;
+                    } else if (inMask && fabsf(t[k] - hit.t) > slack) {
+                        mismatches++;
+                    }
+
+                    found.push_back(inMask ? t[k] : -1.0f);
+                    hits += inMask ? 1 : 0;
+                }
+            }
+
+            // Compared bit for bit; NaNs are never stored:
+            size_t differing = 0;
+
+            if (reference.empty()) {
+                reference    = found;
+                referenceIsa = Kernels::name(isa);
+            } else {
+                for (size_t j=0; j<found.size(); j++) {
+                    differing += found[j] != reference[j] ? 1 : 0;
+                }
+            }
+
+            ostringstream details;
+            details << mismatches << " of " << found.size() << " lane tests disagree (" << hits << " hits)";
+
+            if (referenceIsa != Kernels::name(isa)) {
+                details << ", " << differing << " differ from " << referenceIsa;
+            }
+
+            report(name, mismatches == 0 && differing == 0, details.str());
+        }
+    }
+
+    Kernels::select(selected);
+    #endif
+}
+
+/**
+ * The slab test kernel must give exactly the result of AABB::slabs() reduced
+ * by AABB::maxNear() and AABB::minFar(), on every instruction set, including
+ * for rays parallel to a slab and rays starting on one of its planes
+ */
+static void checkBoxes()
+{
+    Kernels::Isa selected = Kernels::active().isa;
+
+    for (int i=0; i<Kernels::ISA_COUNT; i++) {
+
+        Kernels::Isa isa = static_cast<Kernels::Isa>(i);
+        string name      = string("AABB::intersected vs slabs/") + Kernels::name(isa);
+
+        if (!checked(name)) {
+            continue;
+        }
+
+        if (!Kernels::available(isa) && isa != Kernels::SSE2) {
+            cout << "  (skipping " << name << ": not supported)" << endl;
+            continue;
+        }
+
+        Kernels::select(isa);
+        Utils::seedRand(SEED);
+
+        auto rays = makeRays(vec3(0.0f), vec3(0.5f), 2.0f);
+
+        size_t mismatches = 0;
+        size_t hits       = 0;
+
+        for (size_t r=0; r<RAY_COUNT; r++) {
+
+            vec3 lo = vec3(Utils::randInRange(-1.0f, 0.0f), Utils::randInRange(-1.0f, 0.0f), Utils::randInRange(-1.0f, 0.0f));
+            vec3 hi = lo + vec3(Utils::randInRange(0.0f, 1.0f), Utils::randInRange(0.0f, 1.0f), Utils::randInRange(0.0f, 1.0f));
+            AABB box(lo, hi);
+
+            Ray ray    = rays[r];
+            int axis   = static_cast<int>(r % 3);
+            int corner = static_cast<int>((r / 3) % 2);
+
+            // One ray in four runs parallel to an axis's slab, and half of
+            // those start on one of its planes, giving NaN distances:
+            if ((r & 3) == 0) {
+                ray.dir[axis] = 0.0f;
+                if ((r & 4) != 0) {
+                    ray.orig[axis] = corner == 0 ? lo[axis] : hi[axis];
+                }
+                ray.computeReciprocal();
+            }
+
+            // One in two has its range clipped:
+            if ((r & 8) != 0) {
+                ray.tMin = Utils::randInRange(0.0f, 2.0f);
+                ray.tMax = ray.tMin + Utils::randInRange(0.0f, 2.0f);
+            }
+
+            vec3 tNear, tFar;
+            box.slabs(ray, tNear, tFar);
+
+            bool expected = AABB::maxNear(ray.tMin, tNear) <= AABB::minFar(ray.tMax, tFar);
+            bool found    = box.intersected(ray);
+
+            mismatches += found != expected ? 1 : 0;
+            hits       += found ? 1 : 0;
+        }
+
+        ostringstream details;
+        details << mismatches << " of " << RAY_COUNT << " rays differ (" << hits << " hits)";
+
+        report(name, mismatches == 0, details.str());
+    }
+
+    Kernels::select(selected);
+}
+
+/**
+ * Returns a random RGBA8 texel
+ */
+static uint32_t randomTexel()
+{
+    uint32_t texel = 0;
+
+    for (int c=0; c<4; c++) {
+        texel |= (static_cast<uint32_t>(Utils::randInRange(0.0f, 255.99f)) & 0xff) << (8 * c);
+    }
+
+    return texel;
+}
+
+/**
+ * The texel blend kernel must give exactly the result of blending each
+ * channel on its own, in the same order, on every instruction set
+ */
+static void checkTexelBlend()
+{
+    const size_t BLENDS   = 1 << 18;
+    Kernels::Isa selected = Kernels::active().isa;
+
+    for (int i=0; i<Kernels::ISA_COUNT; i++) {
+
+        Kernels::Isa isa = static_cast<Kernels::Isa>(i);
+        string name      = string("Kernels::blendTexels vs per channel/") + Kernels::name(isa);
+
+        if (!checked(name)) {
+            continue;
+        }
+
+        if (!Kernels::available(isa) && isa != Kernels::SSE2) {
+            cout << "  (skipping " << name << ": not supported)" << endl;
+            continue;
+        }
+
+        Kernels::select(isa);
+        Utils::seedRand(SEED);
+
+        size_t mismatches = 0;
+
+        for (size_t b=0; b<BLENDS; b++) {
+
+            uint32_t t[4] = { randomTexel(), randomTexel(), randomTexel(), randomTexel() };
+
+            float S    = Utils::randInRange(0.0f, 1.0f);
+            float T    = Utils::randInRange(0.0f, 1.0f);
+            float W[4] = { (1.0f - S) * (1.0f - T), S * (1.0f - T), (1.0f - S) * T, S * T };
+
+            float found[4];
+            Kernels::active().blendTexels(t[0], t[1], t[2], t[3], W, found);
+
+            for (int c=0; c<4; c++) {
+
+                int shift      = 8 * c;
+                float expected = ((W[0] * static_cast<float>((t[0] >> shift) & 0xff)) + (W[1] * static_cast<float>((t[1] >> shift) & 0xff)))
+                               + ((W[2] * static_cast<float>((t[2] >> shift) & 0xff)) + (W[3] * static_cast<float>((t[3] >> shift) & 0xff)));
+
+                if (found[c] != expected * (1.0f / 255.0f)) {
+                    mismatches++;
+                    break;
+                }
+            }
+        }
+
+        ostringstream details;
+        details << mismatches << " of " << BLENDS << " blends differ";
+
+        report(name, mismatches == 0, details.str());
+    }
+
+    Kernels::select(selected);
+}
+
+/**
+ * Filtered texture lookups must be closer than plain bilinear ones to the
+ * average color over the footprint of a sample, found by supersampling the
+ * base level
+ */
+static void checkTextureFilters(const string& assets)
+{
+    const TextureMap::Filter filters[] = { TextureMap::TRILINEAR, TextureMap::ANISOTROPIC };
+
+    bool any = false;
+    for (auto f=begin(filters); f != end(filters); f++) {
+        any = any || checked(string("TextureMap::getColor/") + TextureMap::filterName(*f) + " vs supersampled");
+    }
+
+    if (!any) {
+        return;
+    }
+
+    string file = assets + DirSep + "textures" + DirSep + "checkerboard.bmp";
+    unique_ptr<TextureMap> texture;
+
+    try {
+        texture = unique_ptr<TextureMap>(new TextureMap(file));
+    } catch (std::exception& e) {
+        cout << "  (skipping texture filters: " << e.what() << ")" << endl;
+        return;
+    }
+
+    // Jittered samples per axis of the footprint, for the reference:
+    const int GRID    = 32;
+    const size_t SIZE = 4096;
+
+    Utils::seedRand(SEED);
+
+    // Footprints spanning 1/2 to 32 texels, at random orientations, as in
+    // the benchmarks. A sample covers [-1/2, 1/2] along both axes:
+    vector<vec2> uvs, dUVdx, dUVdy;
+    vector<vec3> reference;
+
+    for (size_t i=0; i<SIZE; i++) {
+
+        float scale = powf(2.0f, (Utils::unitRand() * 6.0f) - 1.0f) / 400.0f;
+        float angle = Utils::unitRand() * 6.2831853f;
+
+        uvs.push_back(vec2(Utils::unitRand(), Utils::unitRand()));
+        dUVdx.push_back(scale * vec2(cosf(angle), sinf(angle)));
+        dUVdy.push_back(scale * (0.25f + Utils::unitRand()) * vec2(-sinf(angle), cosf(angle)));
+
+        // Summed outside of Color, which clamps:
+        vec3 sum;
+
+        for (int a=0; a<GRID; a++) {
+            for (int b=0; b<GRID; b++) {
+
+                float sx = ((static_cast<float>(a) + Utils::unitRand()) / GRID) - 0.5f;
+                float sy = ((static_cast<float>(b) + Utils::unitRand()) / GRID) - 0.5f;
+                vec2 uv  = uvs[i] + (sx * dUVdx[i]) + (sy * dUVdy[i]);
+
+                Color c  = texture->getColor(uv.x, uv.y, dUVdx[i], dUVdy[i], TextureMap::BILINEAR);
+
+                sum += vec3(c.fR(), c.fG(), c.fB());
+            }
+        }
+
+        reference.push_back(sum / static_cast<float>(GRID * GRID));
+    }
+
+    // Root mean square error over all channels, against the reference:
+    auto rmse = [&](TextureMap::Filter filter) {
+        double sum = 0.0;
+        for (size_t i=0; i<SIZE; i++) {
+            Color c = texture->getColor(uvs[i].x, uvs[i].y, dUVdx[i], dUVdy[i], filter);
+            vec3 d  = vec3(c.fR(), c.fG(), c.fB()) - reference[i];
+            sum += dot(d, d);
+        }
+        return std::sqrt(sum / static_cast<double>(3 * SIZE));
+    };
+
+    double unfiltered = rmse(TextureMap::BILINEAR);
+
+    for (auto f=begin(filters); f != end(filters); f++) {
+
+        string name = string("TextureMap::getColor/") + TextureMap::filterName(*f) + " vs supersampled";
+
+        if (!checked(name)) {
+            continue;
+        }
+
+        double error = rmse(*f);
+
+        ostringstream details;
+        details << fixed << setprecision(4) << "RMSE " << error << ", bilinear " << unfiltered
+                << " (" << SIZE << " footprints, " << GRID << "x" << GRID << " reference samples)";
+
+        report(name, error < unfiltered, details.str());
+    }
+}
+
+/**
+ * Writes a scene with one node placing cubes from the given list of copies,
+ * and that list, next to each other
+ */
+static void writeInstanceScene(const string& file, const string& listFile, const vector<string>& lines)
+{
+    ofstream out(file.c_str(), ios::out | ios::trunc);
+
+    out << "CAMERA\nRESO 16 16\nEYEP 0 0 20\nVDIR 0 0 -1\nUVEC 0 1 0\nFOVY 50\n\n"
+        << "LIGHT\nLPOS 0 10 10\nLCOL 1 1 1\n\n"
+        << "MAT red\nDIFF 0.8 0.1 0.1\nREFL 0 0 0\nEXPO 0\nIOR 0\nMIRR 0\nTRAN 0\n\n"
+        << "NODE root\nTRANSLATION 0 0 0\nROTATION 0 0 0\nSCALE 1 1 1\nCENTER 0 0 0\nPARENT null\nSHAPE null\nMAT null\n\n"
+        << "NODE copies\nPARENT root\nSHAPE cube\nMAT null\nINSTANCES " << listFile << "\n";
+
+    ofstream list(listFile.c_str(), ios::out | ios::trunc);
+
+    for (auto l=lines.begin(); l != lines.end(); l++) {
+        list << *l << "\n";
+    }
+}
+
+/**
+ * Every form of an instance list line must place its copy as written, with
+ * the unlisted rotation and scale left at their defaults, and a placement
+ * that cannot be inverted must be rejected
+ */
+static void checkInstanceList()
+{
+    const string name = "Configuration::readInstanceList forms";
+
+    if (!checked(name)) {
+        return;
+    }
+
+    const string file     = "bench_instances.txt";
+    const string listFile = "bench_instances.lst";
+
+    // The 3, 6 and 9 number forms, each with and without a material. The
+    // copies are told apart by their x translation:
+    vector<string> lines = {
+         "1 0 0", "2 0 0 red"
+        ,"3 0 0 0 45 0", "4 0 0 0 45 0 red"
+        ,"5 0 0 0 45 0 2 3 4", "6 0 0 0 45 0 2 3 4 red"
+    };
+
+    size_t mismatches = 0;
+    size_t placed     = 0;
+    string error;
+
+    try {
+
+        writeInstanceScene(file, listFile, lines);
+
+        Configuration config(file);
+        auto scene = config.read();
+
+        const auto& children = scene->getSceneGraph().getRoot()->getChildren();
+        shared_ptr<InstanceSet> copies;
+
+        for (auto c=children.begin(); c != children.end(); c++) {
+            if ((*c)->getName() == "copies") {
+                copies = (*c)->getCopies();
+            }
+        }
+
+        if (!copies) {
+            throw runtime_error("no copies were placed");
+        }
+
+        placed = copies->size();
+
+        for (int i=0; i<static_cast<int>(copies->size()); i++) {
+
+            mat4 T = copies->getTransform(i);
+            int k  = static_cast<int>(roundf(T[3][0]));
+
+            if (k < 1 || k > static_cast<int>(lines.size())) {
+                mismatches++;
+                continue;
+            }
+
+            vec3 angles  = k > 2 ? vec3(0.0f, radians(45.0f), 0.0f) : vec3(0.0f);
+            vec3 scaling = k > 4 ? vec3(2.0f, 3.0f, 4.0f) : vec3(1.0f);
+            mat4 E       = InstanceSet::placement(vec3(static_cast<float>(k), 0.0f, 0.0f), angles, scaling);
+
+            bool same = true;
+            for (int c=0; c<4; c++) {
+                for (int r=0; r<4; r++) {
+                    same = same && fabsf(T[c][r] - E[c][r]) <= 1.0e-4f;
+                }
+            }
+
+            shared_ptr<Material> material = copies->getMaterial(i);
+            bool red                      = (k % 2) == 0;
+
+            if (!same || (material != nullptr) != red || (red && material->getName() != "red")) {
+                mismatches++;
+            }
+        }
+
+    } catch (std::exception& e) {
+        error = e.what();
+    }
+
+    // A zero scale makes the placement singular:
+    bool rejected = false;
+
+    try {
+        writeInstanceScene(file, listFile, { "1 2 3 0 0 0 0 1 1 red" });
+        Configuration config(file);
+        config.read();
+    } catch (std::exception& e) {
+        rejected = string(e.what()).find("cannot be inverted") != string::npos;
+    }
+
+    remove(file.c_str());
+    remove(listFile.c_str());
+
+    ostringstream details;
+
+    if (!error.empty()) {
+        details << "read failed: " << error;
+    } else {
+        details << mismatches << " of " << placed << " copies misplaced"
+                << (placed != lines.size() ? " (wrong count)" : "")
+                << ", zero scale " << (rejected ? "rejected" : "accepted");
+    }
+
+    report(name, error.empty() && mismatches == 0 && placed == lines.size() && rejected, details.str());
+}
+
+/**
+ * Writes a scene whose nodes, besides the root, have the given parents
+ */
+static void writeParentScene(const string& file, const vector<pair<string, string>>& nodes)
+{
+    ofstream out(file.c_str(), ios::out | ios::trunc);
+
+    out << "CAMERA\nRESO 16 16\nEYEP 0 0 20\nVDIR 0 0 -1\nUVEC 0 1 0\nFOVY 50\n\n"
+        << "LIGHT\nLPOS 0 10 10\nLCOL 1 1 1\n\n"
+        << "NODE root\nTRANSLATION 0 0 0\nROTATION 0 0 0\nSCALE 1 1 1\nCENTER 0 0 0\nPARENT null\nSHAPE null\nMAT null\n\n";
+
+    for (auto n=nodes.begin(); n != nodes.end(); n++) {
+        out << "NODE " << n->first << "\nTRANSLATION 0 0 0\nROTATION 0 0 0\nSCALE 1 1 1\nCENTER 0 0 0\n"
+            << "PARENT " << n->second << "\nSHAPE sphere\nMAT null\n\n";
+    }
+}
+
+/**
+ * A node named as its own parent, or parents that form a cycle, must be
+ * rejected when the graph is built, while parents defined after their
+ * children are still accepted
+ */
+static void checkParentCycles()
+{
+    const string name = "GraphBuilder::build parent cycles";
+
+    if (!checked(name)) {
+        return;
+    }
+
+    const string file = "bench_parents.txt";
+
+    struct Case
+    {
+        const char* label;
+        vector<pair<string, string>> nodes;
+        const char* error;
+    };
+
+    const Case cases[] = {
+         { "forward", { { "a", "b" }, { "b", "root" } }, nullptr }
+        ,{ "self", { { "a", "a" } }, "itself" }
+        ,{ "2-cycle", { { "a", "b" }, { "b", "a" } }, "cycle" }
+        ,{ "3-cycle", { { "c", "root" }, { "a", "b" }, { "b", "d" }, { "d", "a" } }, "cycle" }
+    };
+
+    int wrong = 0;
+    ostringstream details;
+
+    for (auto c=begin(cases); c != end(cases); c++) {
+
+        string error;
+
+        try {
+            writeParentScene(file, c->nodes);
+            Configuration config(file);
+            config.read();
+        } catch (std::exception& e) {
+            error = e.what();
+        }
+
+        bool passed = c->error == nullptr ? error.empty() : error.find(c->error) != string::npos;
+
+        if (!passed) {
+            wrong++;
+            details << c->label << ": " << (error.empty() ? "accepted" : error) << "; ";
+        }
+    }
+
+    remove(file.c_str());
+
+    details << wrong << " of " << (end(cases) - begin(cases)) << " scenes handled wrongly";
+
+    report(name, wrong == 0, details.str());
+}
+
+/**
+ * Runs the given job lines through a render server, returning the responses
+ * keyed by job id. The server's own output is discarded
+ */
+static map<string, JsonValue> serveJobs(int jobs, size_t cachedScenes, const vector<string>& requests)
+{
+    ostringstream in, responses, quiet;
+
+    for (auto r=requests.begin(); r != requests.end(); r++) {
+        in << *r << "\n";
+    }
+
+    istringstream input(in.str());
+    streambuf* saved = cout.rdbuf(quiet.rdbuf());
+
+    {
+        RenderDaemon daemon(jobs, requests.size(), cachedScenes);
+        daemon.serveStream(input, responses);
+    }
+
+    cout.rdbuf(saved);
+
+    map<string, JsonValue> byId;
+    istringstream lines(responses.str());
+    string line;
+
+    while (getline(lines, line)) {
+        JsonValue response = JsonValue::parse(line);
+        byId[response["id"].asString()] = response;
+    }
+
+    return byId;
+}
+
+/**
+ * Returns a render server job line for the given scene
+ */
+static string jobLine(const string& id, const string& scene, int width, int height)
+{
+    ostringstream ss;
+    ss << "{\"id\": \"" << id << "\", \"scene\": \"" << scene << "\", \"output\": \"bench_" << id << ".png\""
+       << ", \"width\": " << width << ", \"height\": " << height
+       << ", \"samplesPerPixel\": 1, \"samplesPerLight\": 1, \"seed\": 7}";
+    return ss.str();
+}
+
+/**
+ * Two jobs rendering at the same time must each report the rays of their own
+ * render, the same as when run alone, and the scene cache must stay within
+ * its bound
+ */
+static void checkDaemon()
+{
+    const string name = "RenderDaemon per-job stats + scene cache";
+
+    if (!checked(name)) {
+        return;
+    }
+
+    const string sceneA = "bench_daemon_a.txt";
+    const string sceneB = "bench_daemon_b.txt";
+
+    writeScene(sceneA, 200);
+    writeScene(sceneB, 100);
+
+    map<string, JsonValue> alone, together;
+    string error;
+
+    try {
+
+        // One at a time, keeping a single scene: "a" is loaded again after
+        // "b" has replaced it in the cache
+        alone = serveJobs(1, 1, {
+             jobLine("a", sceneA, 48, 40)
+            ,jobLine("b", sceneB, 24, 32)
+            ,jobLine("a2", sceneA, 48, 40)
+        });
+
+        together = serveJobs(2, 2, {
+             jobLine("a", sceneA, 48, 40)
+            ,jobLine("b", sceneB, 24, 32)
+        });
+
+    } catch (std::exception& e) {
+        error = e.what();
+    }
+
+    remove(sceneA.c_str());
+    remove(sceneB.c_str());
+
+    const char* ids[] = { "a", "b", "a2" };
+
+    for (int i=0; i<3; i++) {
+        remove(("bench_" + string(ids[i]) + ".png").c_str());
+    }
+
+    bool ok = error.empty();
+    ostringstream details;
+
+    for (int i=0; i<3 && ok; i++) {
+        if (alone[ids[i]]["status"].asString() != "ok") {
+            error = string(ids[i]) + ": " + alone[ids[i]]["message"].asString();
+            ok    = false;
+        }
+    }
+
+    for (int i=0; i<2 && ok; i++) {
+        if (together[ids[i]]["status"].asString() != "ok") {
+            error = string(ids[i]) + " (concurrent): " + together[ids[i]]["message"].asString();
+            ok    = false;
+        }
+    }
+
+    if (!ok) {
+        details << "render failed: " << error;
+        report(name, false, details.str());
+        return;
+    }
+
+    double raysA   = alone["a"]["rays"].asNumber();
+    double raysB   = alone["b"]["rays"].asNumber();
+    bool sameRays  = raysA > 0.0 && raysB > 0.0 && raysA != raysB
+                  && together["a"]["rays"].asNumber() == raysA
+                  && together["b"]["rays"].asNumber() == raysB
+                  && alone["a2"]["rays"].asNumber() == raysA;
+    bool evicted   = !alone["a2"]["cached"].asBool(true);
+
+    details << "rays a " << together["a"]["rays"].asNumber() << "/" << raysA
+            << ", b " << together["b"]["rays"].asNumber() << "/" << raysB
+            << ", evicted scene " << (evicted ? "reloaded" : "still cached");
+
+    report(name, sameRays && evicted, details.str());
+}
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    // Skip program name argv[0] if present:
+    argc -= argc > 0;
+    argv += argc > 0;
+
+    option::Stats  stats(usage, argc, argv);
+    vector<option::Option> options(stats.options_max);
+    vector<option::Option> buffer(stats.buffer_max);
+    option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+
+    if (parse.error() || options[HELP]) {
+        option::printUsage(std::cout, usage);
+        return parse.error() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    string assets = "assets";
+
+    if (options[FILTER] && options[FILTER].arg) {
+        filter = options[FILTER].arg;
+    }
+    if (options[MIN_TIME] && options[MIN_TIME].arg) {
+        minTime = Utils::parseNumber(string(options[MIN_TIME].arg), minTime);
+    }
+    if (options[ASSETS] && options[ASSETS].arg) {
+        assets = options[ASSETS].arg;
+    }
+    if (options[ISA] && options[ISA].arg) {
+
+        Kernels::Isa isa;
+
+        if (!Kernels::fromName(options[ISA].arg, isa)) {
+            cerr << "Unknown instruction set: " << options[ISA].arg << endl;
+            return EXIT_FAILURE;
+        }
+
+        try {
+            Kernels::select(isa);
+        } catch (std::exception& e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options[CHECK]) {
+
+        cout << "raycpp self-checks (seed " << SEED << ")" << endl << endl;
+
+        checkClosestHit();
+        checkBatches();
+        checkBoxes();
+        checkTexelBlend();
+        checkTextureFilters(assets);
+        checkInstanceList();
+        checkParentCycles();
+        checkDaemon();
+
+        cout << endl << failures << " check(s) failed" << endl;
+
+        return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (options[SCENES]) {
+
+        SceneBenchSettings settings;
+
+        settings.assets     = assets;
+        settings.outputFile = "scene_bench.json";
+
+        if (options[BASELINE] && options[BASELINE].arg) {
+            settings.baselineFile = options[BASELINE].arg;
+        }
+        if (options[OUTPUT] && options[OUTPUT].arg) {
+            settings.outputFile = options[OUTPUT].arg;
+        }
+        if (options[THRESHOLD] && options[THRESHOLD].arg) {
+            settings.threshold = Utils::parseNumber(string(options[THRESHOLD].arg), settings.threshold);
+        }
+        if (options[SCALE] && options[SCALE].arg) {
+            settings.scale = Utils::parseNumber(string(options[SCALE].arg), settings.scale);
+        }
+        if (options[SPP] && options[SPP].arg) {
+            settings.samplesPerPixel = std::max(1, Utils::parseNumber(string(options[SPP].arg), settings.samplesPerPixel));
+        }
+        if (options[SPL] && options[SPL].arg) {
+            settings.samplesPerLight = std::max(1, Utils::parseNumber(string(options[SPL].arg), settings.samplesPerLight));
+        }
+        if (options[THREADS] && options[THREADS].arg) {
+            settings.threads = std::max(1, Utils::parseNumber(string(options[THREADS].arg), settings.threads));
+        }
+        if (options[RAND_SEED] && options[RAND_SEED].arg) {
+            settings.seed = Utils::parseNumber(string(options[RAND_SEED].arg), settings.seed);
+        }
+
+        try {
+            return runSceneBenchmarks(settings) > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        } catch (std::exception& e) {
+            cerr << "Scene benchmarks failed: " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    cout << "raycpp microbenchmarks (" << RAY_COUNT << " inputs per set, seed " << SEED
+         << ", " << Kernels::name(Kernels::active().isa) << " kernels)" << endl << endl;
+
+    benchPrimitives();
+    benchModels(assets);
+    benchInstances(assets);
+    benchSceneRead();
+    benchSurfaceMaps(assets);
+    benchImage();
+    benchColor();
+
+    return EXIT_SUCCESS;
+}
+
+/******************************************************************************/
@@ -0,0 +1,377 @@
+/*******************************************************************************
+ *
+ * End-to-end scene benchmarks: renders every scene in the asset directory
+ * headless with fixed settings, records timings and memory use, and compares
+ * the results against a stored baseline
+ *
+ * @file SceneBench.cpp
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#define GLM_FORCE_RADIANS
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef ENABLE_OPENMP
+#include <omp.h>
+#endif
+#include "Camera.h"
+#include "Config.h"
+#include "Image.h"
+#include "Json.h"
+#include "Kernels.h"
+#include "Raytrace.h"
+#include "Stats.h"
+#include "Utils.h"
+#include "SceneBench.h"
+
+/******************************************************************************/
+
+using namespace std;
+using namespace glm;
+
+/******************************************************************************/
+
+// Timings below this many seconds are too noisy to flag as regressions:
+static const double MIN_COMPARABLE_TIME = 0.05;
+
+/**
+ * Lists the scene files (*.txt) in the given directory, sorted by name
+ */
+static vector<string> listScenes(const string& dir)
+{
+    vector<string> scenes;
+    DIR* d = opendir(dir.c_str());
+
+    if (d == nullptr) {
+        throw runtime_error("cannot open asset directory " + dir);
+    }
+
+    while (dirent* entry = readdir(d)) {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) {
+            scenes.push_back(name);
+        }
+    }
+
+    closedir(d);
+    sort(scenes.begin(), scenes.end());
+
+    return scenes;
+}
+
+/**
+ * Loads and renders a single scene, returning the measurements as a JSON
+ * object. Runs in the child process
+ */
+static string benchmarkScene(const string& file, const SceneBenchSettings& settings)
+{
+    ostringstream ss;
+
+    try {
+
+        #ifdef ENABLE_OPENMP
+        omp_set_num_threads(settings.threads);
+        #endif
+
+        Stats::enabled = true;
+        Stats::reset();
+        Utils::seedRand(settings.seed);
+
+        auto start = chrono::steady_clock::now();
+
+        Configuration config(file);
+        shared_ptr<SceneContext> base(config.read());
+
+        double loadTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        vec2 reso = glm::max(vec2(1.0f), glm::floor(base->getResolution() * settings.scale));
+
+        auto scene = make_shared<SceneContext>(reso
+                                              ,base->getEyePosition()
+                                              ,base->getViewDir()
+                                              ,base->getUpDir()
+                                              ,base->getFOVAngle()
+                                              ,base->getSceneGraph()
+                                              ,base->getEnvironmentMap()
+                                              ,base->getMaterials()
+                                              ,base->getLights());
+
+        auto opts = make_shared<TraceOptions>();
+
+        opts->samplesPerPixel = settings.samplesPerPixel;
+        opts->samplesPerLight = settings.samplesPerLight;
+        opts->seed            = settings.seed;
+        opts->verbose         = false;
+
+        Camera camera;
+        initRaytrace(camera, scene);
+
+        auto output = make_shared<Image>(static_cast<int>(reso.x), static_cast<int>(reso.y), 1, 3, 0);
+        rayTrace(output, camera, scene, opts);
+
+        double pass1Time  = Stats::time("pass1");
+        double pass2Time  = Stats::time("pass2");
+        double renderTime = pass1Time + pass2Time;
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        ss << "{\"status\": \"ok\""
+           << ", \"width\": " << reso.x
+           << ", \"height\": " << reso.y
+           << ", \"loadTime\": " << loadTime
+           << ", \"pass1Time\": " << pass1Time
+           << ", \"pass2Time\": " << pass2Time
+           << ", \"renderTime\": " << renderTime
+           << ", \"peakRSSKB\": " << usage.ru_maxrss;
+
+        // Rays are only counted when statistics are compiled in; otherwise
+        // the counts are left null rather than reported as zero:
+        #if ENABLE_STATS
+        uint64_t rays = Stats::total(Stats::RAYS_PRIMARY)
+                      + Stats::total(Stats::RAYS_REFLECTION)
+                      + Stats::total(Stats::RAYS_REFRACTION)
+                      + Stats::total(Stats::RAYS_SHADOW);
+
+        ss << ", \"rays\": " << rays
+           << ", \"raysPerSec\": " << (renderTime > 0.0 ? static_cast<double>(rays) / renderTime : 0.0);
+        #else
+        ss << ", \"rays\": null, \"raysPerSec\": null";
+        #endif
+
+        ss << "}";
+
+    } catch (std::exception& e) {
+
+        ss.str("");
+        ss << "{\"status\": \"error\", \"message\": " << JsonValue::quote(e.what()) << "}";
+    }
+
+    return ss.str();
+}
+
+/**
+ * Runs benchmarkScene() in a child process, returning its result
+ */
+static JsonValue benchmarkSceneInChild(const string& file, const SceneBenchSettings& settings)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        throw runtime_error("pipe() failed");
+    }
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        throw runtime_error("fork() failed");
+    }
+
+    if (pid == 0) {
+
+        // Child: silence the renderer's progress output and report back
+        // through the pipe only:
+        close(fds[0]);
+
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+
+        string result = benchmarkScene(file, settings);
+
+        if (write(fds[1], result.data(), result.size()) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+
+        close(fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    string result;
+    char buffer[4096];
+    ssize_t n;
+
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, static_cast<size_t>(n));
+    }
+
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    if (result.empty()) {
+        ostringstream ss;
+        ss << "{\"status\": \"crashed\", \"message\": \"";
+        if (WIFSIGNALED(status)) {
+            ss << "killed by signal " << WTERMSIG(status);
+        } else {
+            ss << "exited with status " << WEXITSTATUS(status);
+        }
+        ss << "\"}";
+        result = ss.str();
+    }
+
+    return JsonValue::parse(result);
+}
+
+/**
+ * Compares a metric against its baseline value, printing and counting a
+ * regression if it grew by more than the threshold
+ */
+static int compareMetric(const string& scene
+                        ,const string& metric
+                        ,const JsonValue& current
+                        ,const JsonValue& baseline
+                        ,double threshold
+                        ,double minValue)
+{
+    double now  = current[metric].asNumber(0.0);
+    double then = baseline[metric].asNumber(0.0);
+
+    if (then < minValue || now <= then * (1.0 + threshold)) {
+        return 0;
+    }
+
+    cout << "    REGRESSION " << scene << ": " << metric << " "
+         << then << " -> " << now
+         << " (+" << fixed << setprecision(1) << (((now / then) - 1.0) * 100.0) << "%)"
+         << endl;
+
+    cout.unsetf(ios::floatfield);
+
+    return 1;
+}
+
+int runSceneBenchmarks(const SceneBenchSettings& settings)
+{
+    JsonValue baseline;
+
+    if (!settings.baselineFile.empty()) {
+        baseline = JsonValue::parse(Utils::textFileRead(settings.baselineFile));
+    }
+
+    vector<string> scenes = listScenes(settings.assets);
+    ostringstream results;
+
+    results << "{" << endl
+            << "  \"settings\": {"
+            << "\"seed\": " << settings.seed
+            << ", \"threads\": " << settings.threads
+            << ", \"samplesPerPixel\": " << settings.samplesPerPixel
+            << ", \"samplesPerLight\": " << settings.samplesPerLight
+            << ", \"scale\": " << settings.scale
+            << ", \"isa\": " << JsonValue::quote(Kernels::name(Kernels::active().isa))
+            << "}," << endl
+            << "  \"scenes\": {";
+
+    cout << "Scene benchmarks (seed " << settings.seed
+         << ", " << settings.threads << " thread(s)"
+         << ", " << settings.samplesPerPixel << " spp"
+         << ", " << settings.samplesPerLight << " light samples"
+         << ", scale " << settings.scale
+         << ", " << Kernels::name(Kernels::active().isa) << " kernels)" << endl << endl
+         << "  " << left << setw(36) << "scene"
+         << right << setw(10) << "load(s)" << setw(10) << "pass1(s)" << setw(10) << "pass2(s)"
+         << setw(10) << "Mrays/s" << setw(10) << "RSS(MB)" << endl;
+
+    #if !ENABLE_STATS
+    cout << "  (built with ENABLE_STATS=0: rays are not counted)" << endl;
+    #endif
+
+    int regressions = 0;
+
+    for (size_t i=0; i<scenes.size(); i++) {
+
+        string file   = settings.assets + DirSep + scenes[i];
+        JsonValue res = benchmarkSceneInChild(file, settings);
+
+        results << (i > 0 ? "," : "") << endl << "    " << JsonValue::quote(scenes[i]) << ": {"
+                << "\"status\": " << JsonValue::quote(res["status"].asString());
+
+        if (res["status"].asString() != "ok") {
+
+            cout << "  " << left << setw(36) << scenes[i] << right << "  " << res["status"].asString()
+                 << ": " << res["message"].asString() << endl;
+
+            results << ", \"message\": " << JsonValue::quote(res["message"].asString()) << "}";
+            continue;
+        }
+
+        const char* metrics[] = { "width", "height", "loadTime", "pass1Time", "pass2Time", "renderTime", "rays", "raysPerSec", "peakRSSKB" };
+
+        for (auto m : metrics) {
+            results << ", " << JsonValue::quote(m) << ": ";
+
+            if (res[m].isNull()) {
+                results << "null";
+            } else {
+                results << setprecision(9) << res[m].asNumber();
+            }
+        }
+
+        results << "}";
+
+        cout << "  " << left << setw(36) << scenes[i] << right << fixed << setprecision(3)
+             << setw(10) << res["loadTime"].asNumber()
+             << setw(10) << res["pass1Time"].asNumber()
+             << setw(10) << res["pass2Time"].asNumber()
+             << setw(10) << setprecision(2);
+
+        if (res["raysPerSec"].isNull()) {
+            cout << "-";
+        } else {
+            cout << (res["raysPerSec"].asNumber() / 1.0e6);
+        }
+
+        cout << setw(10) << setprecision(1) << (res["peakRSSKB"].asNumber() / 1024.0)
+             << endl;
+
+        cout.unsetf(ios::floatfield);
+        cout << setprecision(6);
+
+        const JsonValue& base = baseline["scenes"][scenes[i]];
+
+        if (base["status"].asString() == "ok") {
+            regressions += compareMetric(scenes[i], "loadTime", res, base, settings.threshold, MIN_COMPARABLE_TIME);
+            regressions += compareMetric(scenes[i], "renderTime", res, base, settings.threshold, MIN_COMPARABLE_TIME);
+            regressions += compareMetric(scenes[i], "peakRSSKB", res, base, settings.threshold, 0.0);
+        }
+    }
+
+    results << endl << "  }" << endl << "}" << endl;
+
+    if (!settings.outputFile.empty()) {
+        ofstream os(settings.outputFile);
+        os << results.str();
+        cout << endl << "Results written to " << settings.outputFile << endl;
+    }
+
+    if (!settings.baselineFile.empty()) {
+        cout << endl << regressions << " regression(s) against " << settings.baselineFile
+             << " (threshold " << (settings.threshold * 100.0) << "%)" << endl;
+    }
+
+    return regressions;
+}
+
+/******************************************************************************/
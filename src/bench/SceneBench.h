@@ -0,0 +1,66 @@
+/*******************************************************************************
+ *
+ * End-to-end scene benchmarks: renders every scene in the asset directory
+ * headless with fixed settings, records timings and memory use, and compares
+ * the results against a stored baseline
+ *
+ * @file SceneBench.h
+ * @author Michael Woods
+ *
+ ******************************************************************************/
+
+#ifndef SCENE_BENCH_H
+#define SCENE_BENCH_H
+
+#include <cstdint>
+#include <string>
+
+/******************************************************************************/
+
+class SceneBenchSettings
+{
+	public:
+		// Directory containing the *.txt scene files
+		std::string assets;
+
+		// Results are written here as JSON, if not empty
+		std::string outputFile;
+
+		// Results are compared against this file, if not empty
+		std::string baselineFile;
+
+		// Relative slowdown (0.1 = 10%) tolerated before flagging a regression
+		double threshold;
+
+		// Fixed render settings shared by every scene
+		uint64_t seed;
+		int threads;
+		int samplesPerPixel;
+		int samplesPerLight;
+
+		// Scale applied to each scene's resolution
+		float scale;
+
+		SceneBenchSettings() :
+			assets("assets"),
+			threshold(0.10),
+			seed(1),
+			threads(1),
+			samplesPerPixel(1),
+			samplesPerLight(4),
+			scale(1.0f)
+		{
+
+		}
+};
+
+/**
+ * Runs the scene benchmarks. Each scene is rendered in a child process so
+ * peak memory use is measured per scene and a crash doesn't end the run.
+ * Returns the number of regressions found against the baseline
+ */
+int runSceneBenchmarks(const SceneBenchSettings& settings);
+
+/******************************************************************************/
+
+#endif
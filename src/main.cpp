@@ -8,20 +8,46 @@
 #include <iostream>
 #include <string>
 #include <stdexcept>
+#include <csignal>
+#include <chrono>
+#include <fstream>
+#ifdef ENABLE_OPENMP
+#include <omp.h>
+#endif
+
+// The OpenGL preview is built in by default. Building with -DENABLE_PREVIEW=0
+// leaves it out, along with every OpenGL, GLEW and GLFW dependency, for 
+// machines without a display; such a build always renders immediately:
+#ifndef ENABLE_PREVIEW
+#define ENABLE_PREVIEW 1
+#endif
+
+#if ENABLE_PREVIEW
 #include <glew/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 #include <easylogging++.h>
 
 INITIALIZE_EASYLOGGINGPP
 
+#if ENABLE_PREVIEW
 #include "GLSL.h"
 #include "GLUtils.h"
+#include "GLGeometry.h"
 #include "GLWorldState.h"
+#endif
 #include "SceneContext.h"
 #include "Config.h"
 #include "Camera.h"
 #include "Options.h"
 #include "Raytrace.h"
+#include "Checkpoint.h"
+#include "Daemon.h"
+#include "Stats.h"
+#include "Heatmap.h"
+#include "Kernels.h"
+#include "Mesh.h"
+#include "TextureCache.h"
 
 /******************************************************************************/
 
@@ -34,6 +60,8 @@ using namespace cimg_library;
 static Camera rayTraceCamera;
 static shared_ptr<Image> output;
 
+#if ENABLE_PREVIEW
+
 // Attributes
 static GLint locationPos;
 static GLint locationCol;
@@ -129,12 +157,28 @@ void main()
 }
 );
 
+#endif
+
 // Scene state & render options ////////////////////////////////////////////////
 
+#if ENABLE_PREVIEW
 static shared_ptr<GLWorldState> state(nullptr);
+#endif
 static shared_ptr<SceneContext> sceneContext(nullptr);
 static shared_ptr<TraceOptions> traceOptions(nullptr);
 
+// Statistics output; see Stats.h
+static bool printStats = false;
+static string statsFile;
+
+// Channel written to the false-colour heatmap; see Heatmap.h
+static Heatmap::Channel heatmapChannel = Heatmap::TIME;
+
+static void cleanup();
+static void finish();
+
+#if ENABLE_PREVIEW
+
 // Animation/transformation stuff //////////////////////////////////////////////
 
 clock_t old_time;
@@ -145,8 +189,6 @@ float rotation = 0.0f;
 static void initShader();
 static void cleanupShader();
 static void uploadGeometry();
-static void cleanup();
-static void finish();
 
 static void initGLPreviewWindow(int argc, char** argv, const std::string& title);
 static void display();
@@ -154,6 +196,8 @@ static void handleWindowResize(GLFWwindow* window, int width, int height);
 static void handleError(int error, const char* description);
 static void handleKeyPress(GLFWwindow* window, int key, int scancode, int action, int mods);
 
+#endif
+
 /**
  * Initiates actual raytracing
  */
@@ -161,13 +205,55 @@ static void runRaytracer(bool disablePreview = false)
 {
     assert((!!sceneContext) && (!!traceOptions));
 
-    rayTrace(output, rayTraceCamera, sceneContext, traceOptions);
+    try {
+
+        if (!rayTrace(output, rayTraceCamera, sceneContext, traceOptions)) {
+            exit(EXIT_FAILURE);
+        }
+
+    } catch (std::runtime_error& e) {
+
+        LOG(ERROR) << "[!] Raytrace error: " << e.what() << endl;
+        exit(EXIT_FAILURE);
+    }
 
     if (!traceOptions->enablePixelDebug) {
 
         string outputFile = Utils::cwd("output.png");
         output->save(outputFile.c_str());
         cout << "Output written to " << outputFile << endl;
+
+        // The finished image supersedes any checkpoint:
+        if (traceOptions->checkpointInterval > 0 || traceOptions->resume) {
+            Checkpoint::remove(traceOptions->checkpointFile);
+        }
+
+        if (traceOptions->heatmap) {
+
+            string pfmFile = Utils::cwd("output_heatmap.pfm");
+            string pngFile = Utils::cwd("output_heatmap.png");
+
+            try {
+                traceOptions->heatmap->writePFM(pfmFile);
+                traceOptions->heatmap->writePNG(pngFile, heatmapChannel);
+                cout << "Heatmap written to " << pfmFile << " and " << pngFile << endl;
+            } catch (std::exception& e) {
+                LOG(ERROR) << "[!] Heatmap error: " << e.what() << endl;
+            }
+        }
+
+        Stats::setInfo("textureCache.budgetMB", Utils::S(static_cast<int>(TextureCache::getBudget() >> 20)));
+        Stats::setInfo("textureCache.peakMB", Utils::S(static_cast<float>(TextureCache::getPeakBytes()) / (1 << 20)));
+
+        if (printStats) {
+            Stats::print(cout);
+        }
+
+        if (!statsFile.empty()) {
+            ofstream os(statsFile);
+            Stats::writeJSON(os);
+            cout << "Statistics written to " << statsFile << endl;
+        }
     
     } else {
 
@@ -177,6 +263,14 @@ static void runRaytracer(bool disablePreview = false)
     }
 }
 
+/**
+ * Stops the render at the next tile boundary, leaving a checkpoint behind
+ */
+static void handleStopSignal(int signal)
+{
+    Checkpoint::requestStop();
+}
+
 /**
  * Dump the configuration settings to stdout and quit
  */
@@ -186,6 +280,113 @@ static void printConfigAndQuit(shared_ptr<Configuration>& config)
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * Records the memory used by each part of every mesh in the scene, in MB
+ */
+static void recordMeshMemory(const AssetRegistry& assets)
+{
+    auto meshes = assets.getMeshes();
+    Mesh::Memory total;
+    float MB = static_cast<float>(1 << 20);
+
+    for (auto i=meshes.begin(); i != meshes.end(); i++) {
+
+        shared_ptr<MultiMesh> mesh = dynamic_pointer_cast<MultiMesh>(i->second);
+
+        if (!mesh) {
+            continue;
+        }
+
+        Mesh::Memory memory = mesh->getMemoryUsage();
+        string name         = "mesh." + i->first.substr(i->first.find_last_of("/\\") + 1) + ".";
+
+        Stats::setInfo(name + "vertexMB", Utils::S(memory.vertices / MB));
+        Stats::setInfo(name + "normalMB", Utils::S(memory.normals / MB));
+        Stats::setInfo(name + "texcoordMB", Utils::S(memory.texcoords / MB));
+        Stats::setInfo(name + "indexMB", Utils::S(memory.indices / MB));
+        Stats::setInfo(name + "kdTreeMB", Utils::S(memory.tree / MB));
+        Stats::setInfo(name + "samplingMB", Utils::S(memory.sampling / MB));
+        Stats::setInfo(name + "totalMB", Utils::S(memory.total() / MB));
+
+        total += memory;
+    }
+
+    if (!meshes.empty()) {
+        Stats::setInfo("mesh.totalMB", Utils::S(total.total() / MB));
+    }
+}
+
+/**
+ * Visit function used by recordInstanceMemory(): sums the number of copies
+ * placed by instanced nodes, and the bytes they use
+ */
+static pair<size_t, size_t>* countCopies(shared_ptr<GraphNode> node, pair<size_t, size_t>* totals, int depth)
+{
+    if (node->getCopies()) {
+        totals->first  += node->getCopies()->size();
+        totals->second += node->getCopies()->getByteSize();
+    }
+
+    return totals;
+}
+
+/**
+ * Records the number of copies placed by instanced nodes, and their memory
+ * in MB, not counting the geometry they share
+ */
+static void recordInstanceMemory(const Graph& graph)
+{
+    pair<size_t, size_t> totals(0, 0);
+
+    if (graph.getRoot()) {
+        walk(graph, countCopies, &totals);
+    }
+
+    if (totals.first > 0) {
+        Stats::setInfo("instances.count", Utils::S(static_cast<int>(totals.first)));
+        Stats::setInfo("instances.MB", Utils::S(static_cast<float>(totals.second) / (1 << 20)));
+    }
+}
+
+/**
+ * Runs the render server until its input is exhausted
+ */
+static int runDaemon(option::Option* options)
+{
+    int jobs = 1;
+    if (options[JOBS].count() > 0 && options[JOBS].first()->arg) {
+        jobs = Utils::parseNumber(string(options[JOBS].first()->arg), 1);
+    }
+
+    int cachedScenes = 8;
+    if (options[SCENE_CACHE].count() > 0 && options[SCENE_CACHE].first()->arg) {
+        cachedScenes = std::max(1, Utils::parseNumber(string(options[SCENE_CACHE].first()->arg), 8));
+    }
+
+    // Responses are the only thing written to stdout; everything else that
+    // would normally go there is sent to stderr instead:
+    ostream responses(cout.rdbuf());
+    cout.rdbuf(cerr.rdbuf());
+
+    try {
+
+        RenderDaemon daemon(jobs, 4 * static_cast<size_t>(std::max(1, jobs)), static_cast<size_t>(cachedScenes));
+
+        if (options[SERVE].arg) {
+            daemon.serveSocket(options[SERVE].arg);
+        } else {
+            daemon.serveStream(cin, responses);
+        }
+
+    } catch (std::runtime_error& e) {
+
+        LOG(ERROR) << "[!] Render server error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /**
  * Main
  */
@@ -207,6 +408,43 @@ int main(int argc, char** argv)
 
     option::Parser parse(usage, argc, argv, options, buffer);
 
+    // The kernels are picked before anything renders, including the server:
+    if (options[ISA].count() > 0 && options[ISA].first()->arg) {
+
+        Kernels::Isa isa;
+
+        if (!Kernels::fromName(options[ISA].first()->arg, isa)) {
+            LOG(ERROR) << "[!] Unknown instruction set: " << options[ISA].first()->arg << endl;
+            goto failure;
+        }
+
+        try {
+            Kernels::select(isa);
+        } catch (std::runtime_error& e) {
+            LOG(ERROR) << "[!] " << e.what() << endl;
+            goto failure;
+        }
+    }
+
+    // Texture memory budget, shared by every scene the server renders too:
+    if (options[TEXTURE_CACHE].count() > 0 && options[TEXTURE_CACHE].first()->arg) {
+
+        size_t megabytes = Utils::parseNumber(string(options[TEXTURE_CACHE].first()->arg), static_cast<size_t>(0));
+
+        if (megabytes == 0) {
+            LOG(ERROR) << "[!] Invalid texture cache size: " << options[TEXTURE_CACHE].first()->arg << endl;
+            goto failure;
+        }
+
+        TextureCache::setBudget(megabytes << 20);
+    }
+
+    Mesh::setHalfNormals(!!options[HALF_NORMALS]);
+
+    if (options[SERVE] && !parse.error()) {
+        exit(runDaemon(options));
+    }
+
     if (parse.error() || options[HELP] || argc == 0) {
         if (parse.error()) {
             LOG(ERROR) << "[!] option parse error" << endl;
@@ -215,14 +453,45 @@ int main(int argc, char** argv)
         goto failure;
     }
 
-    // Seed PRNG
-    srand(static_cast<unsigned int>(time(nullptr)));
+    // Statistics are collected if either form of output is requested:
+    printStats = !!options[PRINT_STATS];
+    if (options[STATS_JSON].count() > 0 && options[STATS_JSON].first()->arg) {
+        statsFile = options[STATS_JSON].first()->arg;
+    }
+
+    // The heatmap's ray and intersection counts are taken from the counters
+    // as well:
+    if (options[HEATMAP].count() > 0 && options[HEATMAP].first()->arg) {
+        try {
+            heatmapChannel = Heatmap::channelFromName(options[HEATMAP].first()->arg);
+        } catch (std::runtime_error& e) {
+            LOG(ERROR) << "[!] " << e.what() << endl;
+            goto failure;
+        }
+    }
+
+    Stats::enabled = printStats || !statsFile.empty() || !!options[HEATMAP];
 
     // Parse configuration
     config = make_shared<Configuration>(argv[argc-1]);
     try {
 
-        sceneContext = move(config->read());
+        auto loadStart = chrono::system_clock::now();
+        sceneContext   = move(config->read());
+
+        Stats::addTime("load", chrono::duration<double>(chrono::system_clock::now() - loadStart).count());
+        Stats::setInfo("scene", argv[argc-1]);
+        Stats::setInfo("isa", Kernels::name(Kernels::active().isa));
+        Stats::setInfo("assets.loaded", Utils::S(static_cast<int>(config->getAssets().getLoadCount())));
+        Stats::setInfo("assets.shared", Utils::S(static_cast<int>(config->getAssets().getReuseCount())));
+        recordMeshMemory(config->getAssets());
+        recordInstanceMemory(sceneContext->getSceneGraph());
+
+        #ifdef ENABLE_OPENMP
+        Stats::setInfo("threads", Utils::S(omp_get_max_threads()));
+        #else
+        Stats::setInfo("threads", "1");
+        #endif
 
     } catch (std::runtime_error& e) {
 
@@ -235,8 +504,10 @@ int main(int argc, char** argv)
         printConfigAndQuit(config);
     }
 
+    #if ENABLE_PREVIEW
     // Create the world state object from the current configuration:
     state = unique_ptr<GLWorldState>(new GLWorldState(sceneContext->getSceneGraph()));
+    #endif
 
     // Configure options used during ray tracing
     traceOptions = shared_ptr<TraceOptions>(new TraceOptions());
@@ -261,6 +532,41 @@ int main(int argc, char** argv)
         }
     }
 
+    // Random seed:
+    traceOptions->seed = static_cast<uint64_t>(time(nullptr));
+    if (options[SEED].count() > 0 && options[SEED].first()->arg) {
+        traceOptions->seed = Utils::parseNumber(string(options[SEED].first()->arg), traceOptions->seed);
+    }
+
+    // Texture filtering:
+    if (options[TEXTURE_FILTER].count() > 0 && options[TEXTURE_FILTER].first()->arg) {
+        if (!TextureMap::filterFromName(options[TEXTURE_FILTER].first()->arg, traceOptions->textureFilter)) {
+            LOG(ERROR) << "[!] Unknown texture filter: " << options[TEXTURE_FILTER].first()->arg << endl;
+            goto failure;
+        }
+    }
+
+    // Seed the PRNG of the main thread, which is used while building the scene:
+    Utils::seedRand(traceOptions->seed);
+
+    // Checkpointing:
+    traceOptions->checkpointFile = Utils::cwd("output.checkpoint");
+    if (options[CHECKPOINT_FILE].count() > 0 && options[CHECKPOINT_FILE].first()->arg) {
+        traceOptions->checkpointFile = string(options[CHECKPOINT_FILE].first()->arg);
+    }
+
+    if (options[CHECKPOINT_INTERVAL].count() > 0) {
+        auto str = options[CHECKPOINT_INTERVAL].first()->arg;
+        traceOptions->checkpointInterval = str ? Utils::parseNumber(string(str), 60) : 60;
+    }
+
+    traceOptions->resume = !!options[RESUME];
+
+    if (traceOptions->checkpointInterval > 0) {
+        signal(SIGINT, handleStopSignal);
+        signal(SIGTERM, handleStopSignal);
+    }
+
     // Was a debug pixel specified?
     if (options[DEBUG_PIXEL].count() >= 2) {
 
@@ -283,8 +589,23 @@ int main(int argc, char** argv)
 
     // Initialize raytracer code:
     resolution = sceneContext->getResolution();
+
+    // Identify the scene + the options that affect the output, so a 
+    // checkpoint is only ever resumed into the same render:
+    traceOptions->sceneHash = Checkpoint::hashScene(argv[argc-1], { 
+         traceOptions->samplesPerLight
+        ,traceOptions->samplesPerPixel
+        ,static_cast<int64_t>(resolution.x)
+        ,static_cast<int64_t>(resolution.y) 
+        ,static_cast<int64_t>(traceOptions->textureFilter)
+    });
+
     initRaytrace(rayTraceCamera, sceneContext);
 
+    if (options[HEATMAP]) {
+        traceOptions->heatmap = make_shared<Heatmap>(resolution.x, resolution.y);
+    }
+
     // Dimension the output image:
     output = shared_ptr<CImg<unsigned char>>(make_shared<CImg<unsigned char>>(resolution.x, resolution.y, 1, 3, 0));
 
@@ -293,11 +614,15 @@ int main(int argc, char** argv)
     }
 
     // If no preview, rendering starts immediately:
+    #if ENABLE_PREVIEW
     if (options[DISABLE_PREVIEW]) {
         runRaytracer(true);
     } else {
         initGLPreviewWindow(argc, argv, "raycpp :: OpenGL Preview");
     }
+    #else
+    runRaytracer(true);
+    #endif
 
     exit(EXIT_SUCCESS);
 
@@ -309,6 +634,8 @@ failure:
     exit(EXIT_FAILURE);
 }
 
+#if ENABLE_PREVIEW
+
 /**
  * Initializes the OpenGL preview window
  */
@@ -389,6 +716,8 @@ void initGLPreviewWindow(int argc, char** argv, const string& title)
     exit(EXIT_SUCCESS);
 }
 
+#endif
+
 /**
  *
  */
@@ -398,7 +727,12 @@ void cleanup()
     LOG(DEBUG) << "- cleanup()" << endl;
     #endif
 
-    glDeleteProgram(shaderProgram);
+    #if ENABLE_PREVIEW
+    // Nothing was created if the preview never opened:
+    if (shaderProgram != 0) {
+        glDeleteProgram(shaderProgram);
+    }
+    #endif
 }
 
 /**
@@ -410,6 +744,8 @@ void finish()
     exit(EXIT_SUCCESS);
 }
 
+#if ENABLE_PREVIEW
+
 /**
  * Initializes the shader
  */
@@ -464,7 +800,8 @@ void initShader()
 }
 
 /**
- * Uploads the geometry contained in the given scene graph node
+ * Uploads the geometry contained in the given scene graph node, first 
+ * creating its OpenGL instance, which is only ever needed here
  */
 static void* uploadNode(shared_ptr<GraphNode> node, void* ignore, int depth)
 {
@@ -472,6 +809,19 @@ static void* uploadNode(shared_ptr<GraphNode> node, void* ignore, int depth)
 
     shared_ptr<GLGeometry> instance = node->getInstance();
 
+    if (!instance && node->getGeometry()) {
+
+        instance = make_shared<GLGeometry>(node->getGeometry());
+
+        // Set the color of the geometry contained in the node based
+        // on the diffuse color of the node's material:
+        if (node->getMaterial()) {
+            instance->setColor(node->getMaterial()->getDiffuseColor());
+        }
+
+        node->setInstance(instance);
+    }
+
     if (instance) {
         instance->upload(shaderProgram, locationPos, locationNor, locationCol);
     }
@@ -507,8 +857,13 @@ static mat4 drawGLGeometry(shared_ptr<GraphNode> node, mat4 current, int depth)
     }
 
     shared_ptr<GLGeometry> instance = node->getInstance();
+    shared_ptr<InstanceSet> copies  = node->getCopies();
 
-    if (instance) {
+    if (instance && copies) {
+        for (size_t i=0; i<copies->size(); i++) {
+            instance->draw(*state, shaderProgram, unifModel, unifModelInvTr, next * copies->getTransform(static_cast<int>(i)));
+        }
+    } else if (instance) {
         instance->draw(*state, shaderProgram, unifModel, unifModelInvTr, next);
     }
 
@@ -801,3 +1156,5 @@ void handleKeyPress(GLFWwindow* window, int key, int scancode, int action, int m
             break;
     }
 }
+
+#endif